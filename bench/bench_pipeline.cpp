@@ -0,0 +1,391 @@
+// Benchmarks for every pipeline stage plus end-to-end detect().
+//
+// Resolutions sweep 640x480 .. 7680x4320 over four synthetic scene kinds
+// (clean, rotated, blurred, cluttered). Results can be stored and diffed
+// between releases with Google Benchmark's JSON output:
+//
+//   mce_bench --benchmark_out=bench.json --benchmark_out_format=json
+//   compare.py benchmarks old.json new.json   (tools/ of google/benchmark)
+
+#include <benchmark/benchmark.h>
+#include <opencv2/opencv.hpp>
+
+#include <map>
+#include <tuple>
+
+#include "binary_morph.hpp"
+#include "color_segmenter.hpp"
+#include "geometry.hpp"
+#include "grid_detector.hpp"
+#include "marker_detector.hpp"
+#include "synthetic_board.hpp"
+
+namespace {
+    enum SceneKind { kClean = 0, kRotated, kBlurred, kCluttered };
+
+    /// @brief Cached scenes keyed by (width, height, kind); generation is not timed.
+    static const cv::Mat& scene(int w, int h, int kind) {
+        static std::map<std::tuple<int, int, int>, cv::Mat> cache;
+        auto key = std::make_tuple(w, h, kind);
+        auto it = cache.find(key);
+        if (it != cache.end()) return it->second;
+
+        synth::SceneOptions so;
+        const double scale = std::min(w, h) / 480.0;
+        if (kind == kRotated)   so.angle_deg = 30.0;
+        if (kind == kBlurred)   so.blur_sigma = 2.0 * scale;
+        if (kind == kCluttered) so.clutter = 200;
+        return cache.emplace(key, synth::makeScene(cv::Size(w, h), so)).first->second;
+    }
+
+    static const char* kindName(int kind) {
+        switch (kind) {
+        case kRotated: return "rotated";
+        case kBlurred: return "blurred";
+        case kCluttered: return "cluttered";
+        default: return "clean";
+        }
+    }
+
+    /// @brief Resolution × scene sweep shared by the full-frame benchmarks.
+    static void Sweep(benchmark::internal::Benchmark* b) {
+        b->ArgNames({ "w", "h", "scene" });
+        const int res[][2] = { {640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160}, {7680, 4320} };
+        for (auto& r : res) {
+            for (int k = kClean; k <= kCluttered; ++k) b->Args({ r[0], r[1], k });
+        }
+        b->Unit(benchmark::kMillisecond);
+    }
+
+    static void setCounters(benchmark::State& st, const cv::Mat& img) {
+        st.SetLabel(kindName((int)st.range(2)));
+        st.SetItemsProcessed(st.iterations());
+        st.SetBytesProcessed(st.iterations() * (int64_t)img.total() * (int64_t)img.elemSize());
+    }
+
+    /// @brief NV12 planes of a scene (Y + interleaved UV), as a camera would deliver them.
+    struct Nv12Frame {
+        cv::Mat y, uv;
+    };
+    static const Nv12Frame& nv12Scene(int w, int h, int kind) {
+        static std::map<std::tuple<int, int, int>, Nv12Frame> cache;
+        auto key = std::make_tuple(w, h, kind);
+        auto it = cache.find(key);
+        if (it != cache.end()) return it->second;
+
+        cv::Mat i420;
+        cv::cvtColor(scene(w, h, kind), i420, cv::COLOR_BGR2YUV_I420);
+        Nv12Frame f;
+        f.y = i420.rowRange(0, h).clone();
+        const cv::Mat u(h / 2, w / 2, CV_8UC1, i420.ptr(h));
+        const cv::Mat v(h / 2, w / 2, CV_8UC1, i420.ptr(h) + (size_t)(w / 2) * (h / 2));
+        cv::merge(std::vector<cv::Mat>{ u, v }, f.uv);
+        return cache.emplace(key, f).first->second;
+    }
+
+    /// @brief HSV (+CLAHE) of a scene as produced inside allowedMaskHSV.
+    static cv::Mat claheHsv(const cv::Mat& bgr) {
+        cv::Mat hsv; cv::cvtColor(bgr, hsv, cv::COLOR_BGR2HSV);
+        cv::Mat v; cv::extractChannel(hsv, v, 2);
+        cv::createCLAHE(2.0, cv::Size(8, 8))->apply(v, v);
+        cv::insertChannel(v, hsv, 2);
+        return hsv;
+    }
+
+    /// @brief Warped 320×320 square and its mask for the grid benchmarks.
+    struct WarpedBoard {
+        cv::Mat warped, mask;
+    };
+    static const WarpedBoard& warpedBoard() {
+        static const WarpedBoard wb = [] {
+            WarpedBoard r;
+            const cv::Mat& img = scene(1280, 720, kRotated);
+            auto quad = geom::findStrongQuad(ColorSegmenter::allowedMaskHSV(img));
+            r.warped = geom::warpToSquare(img, quad.value(), 320);
+            r.mask = ColorSegmenter::allowedMaskHSV(r.warped);
+            return r;
+        }();
+        return wb;
+    }
+}
+
+// --- Stage benchmarks ------------------------------------------------------
+
+static void BM_AllowedMaskHSV(benchmark::State& st) {
+    const cv::Mat& img = scene((int)st.range(0), (int)st.range(1), (int)st.range(2));
+    SegOptions sopt;
+    SegWorkspace ws;
+    cv::Mat mask;
+    for (auto _ : st) {
+        ColorSegmenter::allowedMaskHSV(img, sopt, ws, mask);
+        benchmark::DoNotOptimize(mask.data);
+    }
+    setCounters(st, img);
+}
+BENCHMARK(BM_AllowedMaskHSV)->Apply(Sweep);
+
+// Same mask in one stripe per OpenCV thread (SegOptions::stripes = 0).
+static void BM_AllowedMaskHSVStriped(benchmark::State& st) {
+    const cv::Mat& img = scene((int)st.range(0), (int)st.range(1), (int)st.range(2));
+    SegOptions sopt;
+    sopt.stripes = 0;
+    SegWorkspace ws;
+    cv::Mat mask;
+    for (auto _ : st) {
+        ColorSegmenter::allowedMaskHSV(img, sopt, ws, mask);
+        benchmark::DoNotOptimize(mask.data);
+    }
+    setCounters(st, img);
+    st.counters["stripes"] = ws.stats.stripes;
+}
+BENCHMARK(BM_AllowedMaskHSVStriped)->Apply(Sweep)->UseRealTime();
+
+// NV12 conversion + BGR segmentation, the path NV12 input took before detectNV12().
+static void BM_AllowedMaskNV12ViaBGR(benchmark::State& st) {
+    const Nv12Frame& f = nv12Scene((int)st.range(0), (int)st.range(1), (int)st.range(2));
+    SegOptions sopt;
+    SegWorkspace ws;
+    cv::Mat bgr, mask;
+    for (auto _ : st) {
+        cv::cvtColorTwoPlane(f.y, f.uv, bgr, cv::COLOR_YUV2BGR_NV12);
+        ColorSegmenter::allowedMaskHSV(bgr, sopt, ws, mask);
+        benchmark::DoNotOptimize(mask.data);
+    }
+    setCounters(st, f.y);
+}
+BENCHMARK(BM_AllowedMaskNV12ViaBGR)->Apply(Sweep);
+
+// HSV planes straight from Y/UV (ColorSegmenter::prepareNV12).
+static void BM_AllowedMaskNV12(benchmark::State& st) {
+    const Nv12Frame& f = nv12Scene((int)st.range(0), (int)st.range(1), (int)st.range(2));
+    SegOptions sopt;
+    ColorSegmenter seg;
+    cv::Mat mask;
+    for (auto _ : st) {
+        seg.prepareNV12(f.y, f.uv, sopt.blur_ksize);
+        seg.mask(sopt, mask);
+        benchmark::DoNotOptimize(mask.data);
+    }
+    setCounters(st, f.y);
+}
+BENCHMARK(BM_AllowedMaskNV12)->Apply(Sweep);
+
+// Upload + device segmentation + mask download, as the OpenCL backend runs stage (1).
+static void BM_AllowedMaskOCL(benchmark::State& st) {
+    if (!ColorSegmenter::openclAvailable()) {
+        st.SkipWithError("no OpenCL device");
+        return;
+    }
+    const cv::Mat& img = scene((int)st.range(0), (int)st.range(1), (int)st.range(2));
+    SegOptions sopt;
+    OclSegWorkspace ws;
+    cv::UMat dev;
+    cv::Mat mask;
+    for (auto _ : st) {
+        img.copyTo(dev);
+        ColorSegmenter::allowedMaskOCL(dev, sopt, ws, mask);
+        benchmark::DoNotOptimize(mask.data);
+    }
+    setCounters(st, img);
+}
+BENCHMARK(BM_AllowedMaskOCL)->Apply(Sweep);
+
+static void BM_WhiteRim(benchmark::State& st) {
+    const cv::Mat& img = scene((int)st.range(0), (int)st.range(1), (int)st.range(2));
+    const cv::Mat hsv = claheHsv(img);
+    SegWorkspace ws;
+    cv::Mat rim;
+    for (auto _ : st) {
+        ColorSegmenter::whiteRimMask(hsv, ws, rim);
+        benchmark::DoNotOptimize(rim.data);
+    }
+    setCounters(st, img);
+}
+BENCHMARK(BM_WhiteRim)->Apply(Sweep);
+
+// Segmenter cleanup (open 1 + close 2): eight 8-bit passes vs one packed chain.
+static void BM_MorphCleanOpenCV(benchmark::State& st) {
+    const cv::Mat& img = scene((int)st.range(0), (int)st.range(1), (int)st.range(2));
+    const cv::Mat mask = ColorSegmenter::allowedMaskHSV(img);
+    const cv::Mat k3 = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+    cv::Mat out;
+    for (auto _ : st) {
+        cv::morphologyEx(mask, out, cv::MORPH_OPEN, k3, cv::Point(-1, -1), 1);
+        cv::morphologyEx(out, out, cv::MORPH_CLOSE, k3, cv::Point(-1, -1), 2);
+        benchmark::DoNotOptimize(out.data);
+    }
+    setCounters(st, img);
+}
+BENCHMARK(BM_MorphCleanOpenCV)->Apply(Sweep);
+
+static void BM_MorphCleanPacked(benchmark::State& st) {
+    const cv::Mat& img = scene((int)st.range(0), (int)st.range(1), (int)st.range(2));
+    const cv::Mat mask = ColorSegmenter::allowedMaskHSV(img);
+    binmorph::Workspace ws;
+    cv::Mat out;
+    for (auto _ : st) {
+        binmorph::openClose(mask, out, 1, 2, ws);
+        benchmark::DoNotOptimize(out.data);
+    }
+    setCounters(st, img);
+}
+BENCHMARK(BM_MorphCleanPacked)->Apply(Sweep);
+
+static void BM_FindStrongQuad(benchmark::State& st) {
+    const cv::Mat& img = scene((int)st.range(0), (int)st.range(1), (int)st.range(2));
+    const cv::Mat mask = ColorSegmenter::allowedMaskHSV(img);
+    geom::QuadWorkspace ws;
+    for (auto _ : st) {
+        auto q = geom::findStrongQuad(mask, ws);
+        benchmark::DoNotOptimize(q);
+    }
+    setCounters(st, img);
+}
+BENCHMARK(BM_FindStrongQuad)->Apply(Sweep);
+
+static void BM_FindStrongQuadComponents(benchmark::State& st) {
+    const cv::Mat& img = scene((int)st.range(0), (int)st.range(1), (int)st.range(2));
+    const cv::Mat mask = ColorSegmenter::allowedMaskHSV(img);
+    geom::QuadWorkspace ws;
+    for (auto _ : st) {
+        auto q = geom::findStrongQuad(mask, ws, geom::QuadEngine::Components);
+        benchmark::DoNotOptimize(q);
+    }
+    setCounters(st, img);
+}
+BENCHMARK(BM_FindStrongQuadComponents)->Apply(Sweep);
+
+// Square sizes of the warp benchmarks (all with a fixed warpSquare() path).
+static void WarpSweep(benchmark::internal::Benchmark* b) {
+    b->ArgNames({ "N" });
+    for (int n : { 128, 256, 320 }) b->Arg(n);
+    b->Unit(benchmark::kMicrosecond);
+}
+
+static void BM_WarpToSquareWithH(benchmark::State& st) {
+    const int N = (int)st.range(0);
+    const cv::Mat& img = scene(1920, 1080, kRotated);
+    const auto quad = geom::findStrongQuad(ColorSegmenter::allowedMaskHSV(img));
+    if (!quad) { st.SkipWithError("no quad in scene"); return; }
+    geom::WarpResult wr;
+    for (auto _ : st) {
+        geom::warpToSquareWithH(img, *quad, N, wr);
+        benchmark::DoNotOptimize(wr.image.data);
+    }
+    st.SetItemsProcessed(st.iterations() * (int64_t)N * N);
+}
+BENCHMARK(BM_WarpToSquareWithH)->Apply(WarpSweep);
+
+// The baseline: warpPerspective with the forward H (inverted inside the warp),
+// on the same quad and sizes as BM_WarpToSquareWithH.
+static void BM_WarpPerspective(benchmark::State& st) {
+    const int N = (int)st.range(0);
+    const cv::Mat& img = scene(1920, 1080, kRotated);
+    const auto quad = geom::findStrongQuad(ColorSegmenter::allowedMaskHSV(img));
+    if (!quad) { st.SkipWithError("no quad in scene"); return; }
+    const cv::Mat H = geom::squareHomography(*quad, N);
+    cv::Mat out;
+    for (auto _ : st) {
+        cv::warpPerspective(img, out, H, cv::Size(N, N), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+        benchmark::DoNotOptimize(out.data);
+    }
+    st.SetItemsProcessed(st.iterations() * (int64_t)N * N);
+}
+BENCHMARK(BM_WarpPerspective)->Apply(WarpSweep);
+
+static void BM_CheckGridSeams(benchmark::State& st) {
+    const cv::Mat& mask = warpedBoard().mask;
+    grid::GridWorkspace ws;
+    for (auto _ : st) {
+        auto s = grid::checkGridSeams(mask, ws);
+        benchmark::DoNotOptimize(s);
+    }
+    st.SetItemsProcessed(st.iterations());
+}
+BENCHMARK(BM_CheckGridSeams)->Unit(benchmark::kMicrosecond);
+
+static void BM_CheckGridCells(benchmark::State& st) {
+    const cv::Mat& mask = warpedBoard().mask;
+    for (auto _ : st) {
+        auto c = grid::checkGridCells(mask, 0.15);
+        benchmark::DoNotOptimize(c);
+    }
+    st.SetItemsProcessed(st.iterations());
+}
+BENCHMARK(BM_CheckGridCells)->Unit(benchmark::kMicrosecond);
+
+// One integral per warped square, then seams + cells for 3x3 / 4x4 / 5x5 layouts.
+static void BM_GridIntegrals(benchmark::State& st) {
+    const cv::Mat& mask = warpedBoard().mask;
+    const int n = (int)st.range(0);
+    grid::GridWorkspace ws;
+    for (auto _ : st) {
+        grid::integrateMask(mask, ws);
+        auto s = grid::checkGridSeams(ws, n, n);
+        auto c = grid::checkGridCells(ws, n, n, 0.15);
+        benchmark::DoNotOptimize(s);
+        benchmark::DoNotOptimize(c);
+    }
+    st.SetItemsProcessed(st.iterations());
+}
+BENCHMARK(BM_GridIntegrals)->Arg(3)->Arg(4)->Arg(5)->Unit(benchmark::kMicrosecond);
+
+// --- End-to-end ------------------------------------------------------------
+
+static void BM_Detect(benchmark::State& st) {
+    const cv::Mat& img = scene((int)st.range(0), (int)st.range(1), (int)st.range(2));
+    MarkerDetector det;
+    DetectOptions opt;
+    DetectorWorkspace ws;
+    for (auto _ : st) {
+        auto r = det.detect(img, opt, ws);
+        benchmark::DoNotOptimize(r);
+    }
+    setCounters(st, img);
+}
+BENCHMARK(BM_Detect)->Apply(Sweep);
+
+// Grid validation from lattice samples of the frame mask (no warp, no second segmentation).
+static void BM_DetectLattice(benchmark::State& st) {
+    const cv::Mat& img = scene((int)st.range(0), (int)st.range(1), (int)st.range(2));
+    MarkerDetector det;
+    DetectOptions opt;
+    opt.warped_mask = WarpedMaskSource::Lattice;
+    DetectorWorkspace ws;
+    for (auto _ : st) {
+        auto r = det.detect(img, opt, ws);
+        benchmark::DoNotOptimize(r);
+    }
+    setCounters(st, img);
+}
+BENCHMARK(BM_DetectLattice)->Apply(Sweep);
+
+static void BM_DetectNV12(benchmark::State& st) {
+    const Nv12Frame& f = nv12Scene((int)st.range(0), (int)st.range(1), (int)st.range(2));
+    MarkerDetector det;
+    DetectOptions opt;
+    DetectorWorkspace ws;
+    for (auto _ : st) {
+        auto r = det.detectNV12(f.y, f.uv, opt, ws);
+        benchmark::DoNotOptimize(r);
+    }
+    setCounters(st, f.y);
+}
+BENCHMARK(BM_DetectNV12)->Apply(Sweep);
+
+// Full-resolution path (pyramid disabled) for comparison with BM_Detect.
+static void BM_DetectFullRes(benchmark::State& st) {
+    const cv::Mat& img = scene((int)st.range(0), (int)st.range(1), (int)st.range(2));
+    MarkerDetector det;
+    DetectOptions opt;
+    opt.max_side = 0;
+    DetectorWorkspace ws;
+    for (auto _ : st) {
+        auto r = det.detect(img, opt, ws);
+        benchmark::DoNotOptimize(r);
+    }
+    setCounters(st, img);
+}
+BENCHMARK(BM_DetectFullRes)->Apply(Sweep);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,284 @@
+// Golden-dataset regression and throughput harness (mce_golden).
+//
+// Runs detect() over a manifest of images with expected coverage, once per
+// configuration, and reports accuracy (absolute coverage error, false
+// positives / negatives) next to throughput and per-stage latency. Gates make
+// the exit code fail when a configuration loses accuracy, so an optimization
+// can be accepted only if it holds accuracy while improving speed:
+//
+//   mce_golden --manifest golden/manifest.csv --config default --config loose+warp-mask
+//              --repeat 3 --max-fn 0 --max-fp 0 --max-mae 1.0 --out report.json
+//
+// Without a dataset, --synthetic N scores N generated scenes (rotation, blur,
+// clutter, size sweep) with analytically known coverage plus N/4 marker-free
+// frames. Images are decoded once up front; decode time is not part of the
+// throughput. OpenCV runs single-threaded (--threads) so latencies reproduce.
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/utils/logger.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "golden_eval.hpp"
+#include "marker_detector.hpp"
+#include "stats_aggregator.hpp"
+#include "synthetic_board.hpp"
+#include "timer.hpp"
+
+namespace {
+    struct GoldenImage {
+        std::string path;
+        std::optional<double> expected;
+        cv::Mat bgr;
+    };
+
+    struct Config {
+        std::string name;
+        DetectOptions opt;
+    };
+
+    /// @brief Apply one '+'-separated modifier of a --config spec; false if unknown.
+    static bool applyModifier(const std::string& m, DetectOptions& opt) {
+        if (m == "default")                 return true;
+        if (m == "loose")                   opt.strict_grid = false;
+        else if (m == "full-res")           opt.max_side = 0;
+        else if (m == "no-refine")          opt.refine_corners = false;
+        else if (m == "warp-mask")          opt.warped_mask = WarpedMaskSource::FrameMask;
+        else if (m == "warp-mask-fallback") {
+            if (opt.warped_mask != WarpedMaskSource::Lattice) opt.warped_mask = WarpedMaskSource::FrameMask;
+            opt.warped_mask_fallback = true;
+        }
+        else if (m == "lattice")            opt.warped_mask = WarpedMaskSource::Lattice;
+        else if (m == "components")         opt.quad_engine = geom::QuadEngine::Components;
+        else if (m == "precheck")           opt.precheck = true;
+        else if (m == "opencl")             opt.backend = ComputeBackend::OpenCL;
+        else return false;
+        return true;
+    }
+
+    static std::optional<Config> parseConfig(const std::string& spec) {
+        Config c;
+        c.name = spec;
+        std::stringstream ss(spec);
+        std::string m;
+        while (std::getline(ss, m, '+')) {
+            if (!applyModifier(m, c.opt)) return std::nullopt;
+        }
+        return c;
+    }
+
+    /// @brief Deterministic synthetic set: n scenes with one board, n/4 without.
+    static std::vector<GoldenImage> syntheticSet(int n) {
+        const cv::Size sizes[] = { {640, 480}, {1280, 720}, {1920, 1080} };
+        std::vector<GoldenImage> out;
+        for (int i = 0; i < n; ++i) {
+            const cv::Size sz = sizes[i % 3];
+            synth::SceneOptions so;
+            so.seed = 1000u + (unsigned)i;
+            so.angle_deg = (double)((i * 17) % 60) - 30.0;
+            so.blur_sigma = (i % 4 == 3) ? 1.5 : 0.0;
+            so.clutter = (i % 5 == 4) ? 120 : 0;
+            so.board_frac = 0.25 + 0.05 * (double)(i % 6);
+
+            // Same cell rounding as makeScene(); rotation preserves area.
+            const int minSide = std::min(sz.width, sz.height);
+            const double side = 3.0 * std::max(4, (int)(so.board_frac * minSide / 3.0));
+            GoldenImage g;
+            g.path = "synthetic/pos_" + std::to_string(i);
+            g.expected = 100.0 * side * side / ((double)sz.width * (double)sz.height);
+            g.bgr = synth::makeScene(sz, so);
+            out.push_back(std::move(g));
+        }
+        for (int i = 0; i < n / 4; ++i) {
+            // Marker-free frames: gray background with saturated distractors.
+            cv::Mat img(sizes[i % 3], CV_8UC3, cv::Scalar(70, 70, 70));
+            cv::RNG rng(5000u + (unsigned)i);
+            for (int k = 0; k < 60; ++k) {
+                const cv::Point c(rng.uniform(0, img.cols), rng.uniform(0, img.rows));
+                const int r = rng.uniform(4, std::max(5, img.rows / 20));
+                cv::circle(img, c, r, cv::Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256)), cv::FILLED);
+            }
+            GoldenImage g;
+            g.path = "synthetic/neg_" + std::to_string(i);
+            g.bgr = img;
+            out.push_back(std::move(g));
+        }
+        return out;
+    }
+
+    static void print_usage(const char* argv0) {
+        std::cerr << "Usage: " << argv0
+            << " (--manifest <file.csv> | --synthetic <N>)"
+            << " [--config <preset>[+<preset>...]]..."
+            << " [--repeat <N>] [--tol <pct>] [--threads <N>] [--out <report.json>]"
+            << " [--max-mae <pct>] [--max-fp <N>] [--max-fn <N>] [--max-over-tol <N>]\n"
+            << "  presets: default loose full-res no-refine warp-mask warp-mask-fallback"
+            << " lattice components precheck opencl\n"
+            << "  manifest lines: <path>,<expected coverage %|none>\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_ERROR);
+
+    std::string manifest;
+    int synthetic = 0;
+    std::vector<Config> configs;
+    int repeat = 1;
+    int threads = 1;
+    double tol = 2.0;
+    std::string out_path;
+    double max_mae = -1.0;        // negative = gate disabled
+    long long max_fp = -1, max_fn = -1, max_over_tol = -1;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string s = argv[i];
+        auto value = [&](const char* what) -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value after " << s << " (" << what << ")\n";
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+
+        if (s == "--manifest")          manifest = value("file");
+        else if (s == "--synthetic")    synthetic = std::stoi(value("count"));
+        else if (s == "--repeat")       repeat = std::max(1, std::stoi(value("count")));
+        else if (s == "--threads")      threads = std::stoi(value("count"));
+        else if (s == "--tol")          tol = std::stod(value("pct"));
+        else if (s == "--out")          out_path = value("file");
+        else if (s == "--max-mae")      max_mae = std::stod(value("pct"));
+        else if (s == "--max-fp")       max_fp = std::stoll(value("count"));
+        else if (s == "--max-fn")       max_fn = std::stoll(value("count"));
+        else if (s == "--max-over-tol") max_over_tol = std::stoll(value("count"));
+        else if (s == "--config") {
+            const std::string spec = value("preset");
+            auto c = parseConfig(spec);
+            if (!c) {
+                std::cerr << "Unknown --config preset in '" << spec << "'\n";
+                print_usage(argv[0]);
+                return 2;
+            }
+            configs.push_back(std::move(*c));
+        }
+        else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+    if (manifest.empty() == (synthetic <= 0)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if (configs.empty()) configs.push_back(*parseConfig("default"));
+    cv::setNumThreads(threads);
+
+    // --- Load the dataset (decoded once, outside the timed loop) ---
+    std::vector<GoldenImage> images;
+    if (!manifest.empty()) {
+        std::ifstream in(manifest);
+        if (!in) {
+            std::cerr << "Cannot open manifest: " << manifest << "\n";
+            return 2;
+        }
+        std::string err;
+        const auto entries = loadGoldenManifest(in, std::filesystem::path(manifest).parent_path().string(), &err);
+        if (!entries) {
+            std::cerr << manifest << ": " << err << "\n";
+            return 2;
+        }
+        for (const GoldenEntry& e : *entries) {
+            GoldenImage g{ e.path, e.expected_coverage, cv::imread(e.path, cv::IMREAD_COLOR) };
+            if (g.bgr.empty()) {
+                std::cerr << "Cannot read image: " << e.path << "\n";
+                return 2;
+            }
+            images.push_back(std::move(g));
+        }
+    }
+    else {
+        images = syntheticSet(synthetic);
+    }
+    if (images.empty()) {
+        std::cerr << "Empty dataset\n";
+        return 2;
+    }
+
+    // --- Run every configuration ---
+    std::ofstream file;
+    if (!out_path.empty()) {
+        file.open(out_path);
+        if (!file) {
+            std::cerr << "Cannot open --out file: " << out_path << "\n";
+            return 2;
+        }
+    }
+    std::ostream& os = out_path.empty() ? std::cout : file;
+    os << "{\"opencv\":\"" << CV_VERSION << "\",\"images\":" << images.size()
+        << ",\"repeat\":" << repeat << ",\"threads\":" << threads << ",\"configs\":[";
+
+    int exit_code = 0;
+    std::cerr << std::left << std::setw(28) << "config" << std::right
+        << std::setw(6) << "tp" << std::setw(5) << "fp" << std::setw(5) << "fn"
+        << std::setw(10) << "mae%" << std::setw(10) << "max%" << std::setw(10) << "img/s"
+        << std::setw(10) << "p50 ms" << std::setw(10) << "p95 ms" << "\n";
+
+    for (size_t c = 0; c < configs.size(); ++c) {
+        const Config& cfg = configs[c];
+        MarkerDetector det;
+        DetectorWorkspace ws;
+        StatsAggregator agg;
+        AccuracyScorer acc(tol);
+
+        (void)det.detect(images[0].bgr, cfg.opt, ws); // warm-up: buffers and CLAHE
+
+        Timer wall;
+        for (int r = 0; r < repeat; ++r) {
+            for (const GoldenImage& g : images) {
+                const auto res = det.detect(g.bgr, cfg.opt, ws);
+                agg.add(g.path, ws.stats);
+                if (r == 0) acc.add(g.path, g.expected, res);
+            }
+        }
+        const double wall_ms = wall.ms();
+        const double per_sec = 1000.0 * (double)(images.size() * (size_t)repeat) / std::max(1e-9, wall_ms);
+        const AccuracyReport rep = acc.report();
+        const StageSummary total = agg.summary().back();
+
+        if (c) os << ',';
+        os << "{\"config\":\"" << cfg.name << "\",\"wall_ms\":" << wall_ms
+            << ",\"images_per_sec\":" << per_sec << ",\"accuracy\":";
+        acc.writeJson(os);
+        os << ",\"latency\":";
+        agg.writeJson(os);
+        os << '}';
+
+        std::cerr << std::left << std::setw(28) << cfg.name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(6) << rep.true_pos << std::setw(5) << rep.false_pos << std::setw(5) << rep.false_neg
+            << std::setw(10) << rep.mean_abs_err << std::setw(10) << rep.max_abs_err << std::setw(10) << per_sec
+            << std::setw(10) << total.p50_ms << std::setw(10) << total.p95_ms << "\n";
+        std::cerr.unsetf(std::ios::floatfield);
+
+        // --- Accuracy gates ---
+        auto gate = [&](bool bad, const std::string& what) {
+            if (!bad) return;
+            std::cerr << "[gate] " << cfg.name << ": " << what << "\n";
+            exit_code = 1;
+        };
+        gate(max_mae >= 0.0 && rep.mean_abs_err > max_mae, "mae " + std::to_string(rep.mean_abs_err) + " > " + std::to_string(max_mae));
+        gate(max_fp >= 0 && (long long)rep.false_pos > max_fp, "false positives " + std::to_string(rep.false_pos) + " > " + std::to_string(max_fp));
+        gate(max_fn >= 0 && (long long)rep.false_neg > max_fn, "false negatives " + std::to_string(rep.false_neg) + " > " + std::to_string(max_fn));
+        gate(max_over_tol >= 0 && (long long)rep.over_tol > max_over_tol, "over tolerance " + std::to_string(rep.over_tol) + " > " + std::to_string(max_over_tol));
+    }
+    os << "]}\n";
+    return exit_code;
+}
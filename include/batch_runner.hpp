@@ -0,0 +1,123 @@
+/**
+ * @file batch_runner.hpp
+ * @brief Multi-threaded batch engine for running the detector over many images
+ * 
+ * Three stages connected by bounded queues:
+ * decode (mmap + imdecode, runs ahead) → detect (worker pool) → output (caller thread).
+ * With a ResultCache, the decode stage hashes the mapped bytes first and
+ * passes cache hits straight through, undecoded.
+ */
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "marker_types.hpp"
+
+class ResultCache;
+
+/**
+ * @brief Configuration of the batch worker pool
+ */
+struct BatchOptions {
+    /// @brief Number of detection workers (0 = one per hardware thread)
+    int jobs = 1;
+
+    /// @brief Number of decode threads feeding the workers (0 = auto, about jobs/2)
+    int decode_threads = 0;
+
+    /// @brief Maximum decoded images waiting for a worker (0 = 2 × jobs)
+    /// @note Bounds peak memory: at most queue_depth + jobs frames are resident
+    int queue_depth = 0;
+
+    /// @brief Deliver results in input order (false = as soon as they finish)
+    bool ordered = true;
+
+    /// @brief Decode JPEGs at 1/2, 1/4 or 1/8 scale when DetectOptions::max_side allows it
+    /// @note Polygons are mapped back to full-resolution coordinates
+    bool reduced_decode = true;
+
+    /// @brief Read binary PGM/PPM images of at least this many pixels in strips
+    ///        (MarkerDetector::detectStreaming()) instead of decoding them (0 = never)
+    std::int64_t stream_min_pixels = 0;
+
+    /// @brief Persistent results to reuse and extend (nullptr = no caching)
+    std::shared_ptr<ResultCache> cache;
+};
+
+/**
+ * @brief One image travelling through the batch pipeline
+ */
+struct BatchItem {
+    /// @brief Position of the image in the input list
+    size_t index = 0;
+
+    /// @brief Input path as given by the caller
+    std::string path;
+
+    /// @brief False if the image could not be decoded
+    bool loaded = false;
+
+    /// @brief True if the result came from BatchOptions::cache (nothing was decoded or detected)
+    bool cached = false;
+
+    /// @brief Detection result (nullopt = no marker, or not loaded)
+    std::optional<DetectionResult> result;
+
+    /// @brief Time spent reading and decoding the image (milliseconds)
+    double decode_ms = 0.0;
+
+    /// @brief Decode reduction used (1 = full resolution, else 2, 4 or 8)
+    int decode_reduction = 1;
+
+    /// @brief Per-stage timings and counters of the detect call (zero if not loaded or cached)
+    DetectionStats stats;
+};
+
+/**
+ * @brief Bounded worker pool running MarkerDetector over a list of files
+ * 
+ * Each worker owns its own MarkerDetector and DetectorWorkspace, so frames are processed fully in
+ * parallel. The sink is always invoked from the thread calling run(), one item
+ * at a time, so it may write to stdout without locking.
+ * 
+ * @note OpenCV's internal threading should be pinned (cv::setNumThreads(1))
+ *       when jobs > 1 to avoid oversubscription.
+ */
+class BatchRunner {
+public:
+    /// @brief Callback receiving finished items
+    using Sink = std::function<void(const BatchItem&)>;
+
+    /**
+     * @brief Create a runner with fixed detection and pool options
+     */
+    BatchRunner(const DetectOptions& opt, const BatchOptions& bopt);
+
+    /**
+     * @brief Process all paths and deliver one BatchItem per path to @p sink
+     * 
+     * @param paths Image files to process
+     * @param sink Called once per path (in input order if BatchOptions::ordered)
+     * 
+     * @note If @p sink throws, the remaining items are not delivered: the
+     *       pipeline is closed, images already queued finish, every thread is
+     *       joined, and the exception is rethrown from run()
+     */
+    void run(const std::vector<std::string>& paths, const Sink& sink) const;
+
+    /// @brief Effective number of detection workers
+    int jobs() const { return jobs_; }
+
+private:
+    DetectOptions opt_;
+    BatchOptions bopt_;
+    int jobs_ = 1;
+    int decoders_ = 1;
+    size_t depth_ = 2;
+    std::uint64_t options_hash_ = 0; ///< Cache key part of opt_ (with reduced_decode)
+};
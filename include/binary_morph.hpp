@@ -0,0 +1,64 @@
+/**
+ * @file binary_morph.hpp
+ * @brief Fused 3×3 morphology on bit-packed binary masks
+ *
+ * The pipeline applies the same 3×3 rectangular element many times to
+ * full-frame masks: the segmenter's open + close cleanup, the quad finder's
+ * close, the rim booster's dilations. cv::morphologyEx() runs each erosion or
+ * dilation as a separate pass over an 8-bit image. Here a mask is packed to
+ * one bit per pixel (64 pixels per word) once, a whole chain of erosions and
+ * dilations runs row-pipelined in a single traversal — every step of the
+ * chain keeps only three packed rows — and the result is unpacked once.
+ * Each step is the separable 3×3 min (erode: AND) or max (dilate: OR) of a
+ * row shifted by one pixel, then of three neighbouring rows.
+ *
+ * Results equal cv::erode() / cv::dilate() / cv::morphologyEx() with a 3×3
+ * MORPH_RECT kernel and default borders on 0/255 masks, including
+ * open/close with iterations.
+ *
+ * @note Nonzero input pixels are set; output pixels are 0 or 255. Pixels
+ *       outside an ROI input are never read (OpenCV reads the parent
+ *       matrix there): the border is always the default one (set for
+ *       erosion, clear for dilation).
+ */
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace binmorph {
+
+    /// @brief One 3×3 step of a chain
+    enum class Op : std::uint8_t {
+        Erode,   ///< 3×3 min (pixel stays set only if its whole neighbourhood is set)
+        Dilate   ///< 3×3 max
+    };
+
+    /**
+     * @brief Reusable buffers (packed rows of every chain step)
+     */
+    struct Workspace {
+        std::vector<std::uint64_t> bits;   ///< Row rings and output rows of the steps
+        std::vector<Op> ops;               ///< Chain built by the convenience calls
+    };
+
+    /**
+     * @brief Apply @p n steps to @p src in one traversal
+     *
+     * @param src Binary mask (CV_8UC1)
+     * @param dst Result (CV_8UC1, 0/255); may be @p src (in place)
+     * @param ops Steps, applied first to last
+     * @param n Number of steps (0 = binarized copy)
+     * @param ws Scratch buffers (reused across calls)
+     */
+    void apply(const cv::Mat& src, cv::Mat& dst, const Op* ops, int n, Workspace& ws);
+
+    /// @brief Opening (@p open_iter erosions, as many dilations), then closing (@p close_iter dilations, as many erosions)
+    void openClose(const cv::Mat& src, cv::Mat& dst, int open_iter, int close_iter, Workspace& ws);
+
+    /// @brief Closing with @p iter iterations (same as MORPH_CLOSE)
+    void close(const cv::Mat& src, cv::Mat& dst, int iter, Workspace& ws);
+
+    /// @brief @p iter dilations
+    void dilate(const cv::Mat& src, cv::Mat& dst, int iter, Workspace& ws);
+}
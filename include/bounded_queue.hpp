@@ -0,0 +1,84 @@
+/**
+ * @file bounded_queue.hpp
+ * @brief Blocking bounded FIFO used between pipeline stages
+ * 
+ * Producers block while the queue is full, consumers block while it is empty.
+ * close() wakes everybody: pending items can still be popped, new pushes fail.
+ */
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+/**
+ * @brief Thread-safe FIFO with a fixed capacity
+ * 
+ * @tparam T Item type (moved in and out)
+ * 
+ * @example
+ * ```cpp
+ * BoundedQueue<int> q(8);
+ * std::thread prod([&] { for (int i = 0; i < 100; ++i) q.push(i); q.close(); });
+ * while (auto v = q.pop()) { use(*v); }
+ * prod.join();
+ * ```
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    /**
+     * @brief Create a queue holding at most @p capacity items (minimum 1)
+     */
+    explicit BoundedQueue(size_t capacity) : cap_(capacity > 0 ? capacity : 1) {}
+
+    /**
+     * @brief Append an item, blocking while the queue is full
+     * @return false if the queue was closed (item is dropped)
+     */
+    bool push(T item) {
+        std::unique_lock<std::mutex> lk(m_);
+        not_full_.wait(lk, [&] { return closed_ || q_.size() < cap_; });
+        if (closed_) return false;
+        q_.push_back(std::move(item));
+        lk.unlock();
+        not_empty_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Remove the oldest item, blocking while the queue is empty
+     * @return The item, or std::nullopt once the queue is closed and drained
+     */
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lk(m_);
+        not_empty_.wait(lk, [&] { return closed_ || !q_.empty(); });
+        if (q_.empty()) return std::nullopt;
+        T item = std::move(q_.front());
+        q_.pop_front();
+        lk.unlock();
+        not_full_.notify_one();
+        return item;
+    }
+
+    /**
+     * @brief Stop accepting items and wake all waiting threads
+     */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            closed_ = true;
+        }
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+private:
+    size_t cap_;
+    std::deque<T> q_;
+    bool closed_ = false;
+    std::mutex m_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+};
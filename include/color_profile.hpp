@@ -0,0 +1,162 @@
+/**
+ * @file color_profile.hpp
+ * @brief Marker color palettes compiled into classification tables
+ *
+ * A ColorProfile holds the HSV ranges of the marker colors and the white
+ * highlight cut, and compiles them once into the (H,S) lookup tables of the
+ * fused classifier, including the relaxed S/V variants the segmenter falls
+ * back to on sparse masks. Profiles are immutable and shared, so switching
+ * palettes at runtime is a pointer swap in SegOptions / DetectOptions.
+ */
+#pragma once
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Marker color classes written by the optional label output
+ */
+enum class MarkerColor : std::uint8_t {
+    None = 0,   ///< Background / not a marker color
+    Red,        ///< H: 0-10 ∪ 170-180
+    Green,      ///< H: 40-85
+    Yellow,     ///< H: 20-35
+    Blue,       ///< H: 90-130
+    Magenta,    ///< H: 135-165
+    Cyan        ///< H: 85-100
+};
+
+/**
+ * @brief Inclusive HSV range in OpenCV 8-bit units (H 0-180, S/V 0-255)
+ *
+ * V has a floor only (no upper bound): bright pixels are cut by the profile's
+ * white highlight test instead.
+ */
+struct HsvRange {
+    int hmin, hmax;
+    int smin, smax;
+    int vmin;
+};
+
+/**
+ * @brief One palette entry: pixels inside @p range are labelled @p color
+ */
+struct ColorRange {
+    HsvRange range;
+    MarkerColor color;
+};
+
+/**
+ * @brief (H,S) lookup table of the fused classifier for one pair of global floors
+ *
+ * `entry[h * 256 + s] = (label << 8) | V floor`, label 0 = no color passes. For
+ * overlapping hues the color with the lowest V floor wins, which makes
+ * "V >= floor" exactly equivalent to OR-ing the per-color inRange() masks.
+ */
+struct ClassTable {
+    std::vector<std::uint16_t> entry;  ///< ColorProfile::kHueBins * 256 entries
+    int smin = 0;                      ///< Global S floor the table was built for (clamped)
+    int vmin = 0;                      ///< Global V floor the table was built for (clamped)
+};
+
+/**
+ * @brief Immutable marker palette with its compiled classification tables
+ *
+ * Tables for the default floors (SegOptions and DetectOptions) and their
+ * relaxation steps are built by compile(); any other floors are built on
+ * first use and kept, so steady-state frames only look tables up.
+ *
+ * @note Thread-safe: share one profile between all workers
+ *
+ * @example
+ * ```cpp
+ * std::string err;
+ * auto line3 = ColorProfile::load("profiles/line3.yaml", &err);
+ * if (!line3) { std::cerr << err << "\n"; return 2; }
+ * opt.color_profile = line3;            // next detect() uses the new palette
+ * ```
+ */
+class ColorProfile {
+public:
+    /// @brief OpenCV 8-bit hue bins
+    static constexpr int kHueBins = 180;
+
+    /// @brief Sparse-mask relaxation: steps, and S/V floor decrease per step
+    static constexpr int kRelaxSteps = 2;
+    static constexpr int kRelaxDelta = 10;
+
+    /// @brief Tables for the floors (smin, vmin) and each relaxation step
+    using Chain = std::array<const ClassTable*, kRelaxSteps + 1>;
+
+    /// @brief The built-in six-color palette (compiled on first use)
+    static const std::shared_ptr<const ColorProfile>& builtin();
+
+    /**
+     * @brief Compile a palette
+     *
+     * @param colors Palette entries (at least one; H within 0-180, S/V within 0-255)
+     * @param white_smax White highlights (S ≤ white_smax and V ≥ white_vmin) are never a color
+     * @param white_vmin See @p white_smax
+     * @param name Name reported by name()
+     * @return The compiled profile
+     * @throws cv::Exception if an entry is out of range
+     */
+    static std::shared_ptr<const ColorProfile> compile(std::vector<ColorRange> colors,
+        int white_smax = 60, int white_vmin = 210, std::string name = "custom");
+
+    /**
+     * @brief Load a palette through cv::FileStorage (YAML, JSON or XML, by extension)
+     *
+     * ```yaml
+     * name: line3
+     * white_smax: 60          # optional
+     * white_vmin: 210         # optional
+     * colors:
+     *   - { color: red, h: [0, 10], s: [80, 255], v_min: 50 }
+     *   - { color: blue, h: [90, 130], s: [60, 255], v_min: 50 }
+     * ```
+     * Colors are red, green, yellow, blue, magenta or cyan; a color may appear
+     * in several entries (e.g. red on both ends of the hue circle).
+     *
+     * @param path Profile file
+     * @param error Receives the reason on failure (may be nullptr)
+     * @return The compiled profile, or nullptr if the file is missing or malformed
+     */
+    static std::shared_ptr<const ColorProfile> load(const std::string& path, std::string* error = nullptr);
+
+    /// @brief Write the palette in load()'s format; false if the file cannot be written
+    bool save(const std::string& path) const;
+
+    /// @brief Table for the global floors (smin, vmin), clamped to 0-255
+    const ClassTable& table(int smin, int vmin) const;
+
+    /// @brief table() for (smin, vmin), clamped, and each relaxation step (floors
+    ///        lowered by kRelaxDelta, not below 0)
+    Chain chain(int smin, int vmin) const;
+
+    /// @brief Palette entries as compiled
+    const std::vector<ColorRange>& colors() const { return colors_; }
+
+    /// @brief White highlight cut (see compile())
+    int whiteSmax() const { return white_smax_; }
+    int whiteVmin() const { return white_vmin_; }
+
+    /// @brief Profile name
+    const std::string& name() const { return name_; }
+
+private:
+    ColorProfile() = default;
+    ClassTable build(int smin, int vmin) const;
+
+    std::vector<ColorRange> colors_;
+    int white_smax_ = 60;
+    int white_vmin_ = 210;
+    std::string name_;
+
+    mutable std::mutex m_;
+    mutable std::map<int, std::unique_ptr<const ClassTable>> tables_; ///< Key (smin << 8) | vmin; never erased
+};
@@ -7,6 +7,12 @@
  */
 #pragma once
 #include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "binary_morph.hpp"
+#include "color_profile.hpp"
+#include "scratch_mat.hpp"
 
 /**
  * @brief Configuration options for HSV color segmentation
@@ -29,6 +35,120 @@ struct SegOptions {
     
     /// @brief Global minimum value/brightness threshold (0-255, higher = reject darker colors)
     int vmin = 80;
+
+    /// @brief Horizontal stripes processed in parallel within one frame
+    ///        (1 = serial, 0 = one per OpenCV thread); the mask is bit-identical
+    ///        to the serial one for every value
+    /// @note Stripes are at least 64 rows; speed-up needs cv::getNumThreads() > 1
+    int stripes = 1;
+
+    /// @brief Marker palette (nullptr = ColorProfile::builtin())
+    /// @note smin/vmin still raise every color's floors; the profile holds the
+    ///       compiled tables, so swapping it costs nothing per frame
+    std::shared_ptr<const ColorProfile> profile;
+};
+
+/**
+ * @brief Counters describing what one allowedMaskHSV() call did
+ */
+struct SegStats {
+    /// @brief Threshold relaxation steps taken because the mask was too sparse (0-2)
+    int relax_attempts = 0;
+
+    /// @brief True if the white rim was subtracted from the mask
+    bool rim_applied = false;
+
+    /// @brief True if the rim-removal safety brake fired (rim would remove >35% of the mask)
+    bool rim_braked = false;
+
+    /// @brief True if the booster was skipped because no white candidate touches the
+    ///        mask, or because the mask is sparse enough to be relaxed
+    bool rim_skipped = false;
+
+    /// @brief Stripes the mask stages ran in (1 = serial)
+    int stripes = 1;
+
+    /// @brief True if ColorSegmenter::mask() derived the classification from the
+    ///        slack map of an earlier mask() call instead of classifying again
+    bool slack_reused = false;
+};
+
+/**
+ * @brief Reusable intermediate buffers for one segmentation call
+ * 
+ * Hold one per thread and pass it to the workspace overload of
+ * ColorSegmenter::allowedMaskHSV(); buffers keep their allocation (grow-only)
+ * between frames, so steady-state segmentation does not allocate.
+ * 
+ * @warning Not thread-safe: never share a workspace between concurrent calls
+ */
+struct SegWorkspace {
+    ScratchMat blurred;     ///< Pre-blurred BGR (CV_8UC3)
+    ScratchMat hsv;         ///< HSV with CLAHE applied to V (CV_8UC3)
+    ScratchMat v;           ///< CLAHE'd V plane (CV_8UC1)
+    ScratchMat v_raw;       ///< V plane before CLAHE (CV_8UC1)
+    ScratchMat luma;        ///< Full-range luma of NV12 input (CV_8UC1)
+    ScratchMat white_cand;  ///< White-rim candidates (CV_8UC1)
+    ScratchMat white_hi;    ///< Strong highlights (CV_8UC1)
+    ScratchMat v_blur;      ///< Unsharp-mask blur of V (CV_8UC1)
+    ScratchMat v_diff;      ///< Unsharp-mask detail (CV_16SC1)
+    ScratchMat v_sharp;     ///< Sharpened V (CV_8UC1)
+    ScratchMat gx, gy;      ///< Sobel gradients of sharpened V (CV_16SC1)
+    ScratchMat edges;       ///< Thresholded bright edges (CV_8UC1)
+    ScratchMat rim;         ///< White rim mask (CV_8UC1)
+    ScratchMat tmp;         ///< General-purpose 8-bit scratch (CV_8UC1)
+    ScratchMat v_win;       ///< Copy of V inside the booster window (CV_8UC1)
+    ScratchMat stripe_in;   ///< Haloed input rows of one stripe (CV_8UC3)
+    ScratchMat morph;       ///< Striped morphology output (CV_8UC1)
+    binmorph::Workspace bitmorph; ///< Packed rows of the 3×3 morphology chains
+    ScratchMat slack;       ///< Per-pixel S/V floor drop needed to pass, 255 = never (CV_8UC1)
+    std::vector<std::uint8_t> row; ///< Row buffer of the fused classifier
+    std::vector<SegWorkspace> stripes; ///< Per-stripe buffers (SegOptions::stripes > 1)
+    cv::Ptr<cv::CLAHE> clahe;      ///< CLAHE instance (clip 2.0, 8×8 tiles), created on first use
+    SegStats stats;         ///< Counters of the last call using this workspace
+};
+
+/**
+ * @brief Floors and palette the slack map in a SegWorkspace was built for
+ *
+ * The slack map stores, per pixel, the uniform drop of the global S/V floors
+ * the pixel needs to pass classification, so a mask for any lower floors is a
+ * threshold of it. ColorSegmenter uses this to serve a relaxed mask() of the
+ * same prepared image without classifying again.
+ */
+struct SlackCache {
+    std::shared_ptr<const ColorProfile> profile; ///< Palette (nullptr = no valid map)
+    int smin = 0;   ///< Global S floor (clamped) the slack is relative to
+    int vmin = 0;   ///< Global V floor (clamped) the slack is relative to
+};
+
+/**
+ * @brief Device-side buffers for ColorSegmenter::allowedMaskOCL()
+ * 
+ * Same role as SegWorkspace for the OpenCL (T-API) path: every intermediate
+ * image stays on the device and only the final mask is downloaded.
+ * 
+ * @warning Not thread-safe: hold one per thread
+ */
+struct OclSegWorkspace {
+    cv::UMat blurred;       ///< Pre-blurred BGR (CV_8UC3)
+    cv::UMat hsv;           ///< HSV with CLAHE applied to V (CV_8UC3)
+    cv::UMat v;             ///< CLAHE'd V plane (CV_8UC1)
+    cv::UMat v_raw;         ///< V plane before CLAHE (CV_8UC1)
+    cv::UMat color;         ///< One color's inRange() mask (CV_8UC1)
+    cv::UMat mask;          ///< Allowed-color mask before download (CV_8UC1)
+    cv::UMat white_cand;    ///< White-rim candidates (CV_8UC1)
+    cv::UMat white_hi;      ///< Strong highlights (CV_8UC1)
+    cv::UMat v_blur;        ///< Unsharp-mask blur of V (CV_8UC1)
+    cv::UMat v_diff;        ///< Unsharp-mask detail (CV_16SC1)
+    cv::UMat v_sharp;       ///< Sharpened V (CV_8UC1)
+    cv::UMat gx, gy;        ///< Sobel gradients of sharpened V (CV_16SC1)
+    cv::UMat edges;         ///< Thresholded bright edges (CV_8UC1)
+    cv::UMat rim;           ///< White rim mask (CV_8UC1)
+    cv::UMat removed;       ///< Mask pixels the rim would remove (CV_8UC1)
+    cv::UMat v_win;         ///< Copy of V inside the booster window (CV_8UC1)
+    cv::Ptr<cv::CLAHE> clahe; ///< CLAHE instance (clip 2.0, 8×8 tiles), created on first use
+    SegStats stats;         ///< Counters of the last call using this workspace
 };
 
 /**
@@ -43,11 +163,93 @@ struct SegOptions {
  * - Cyan (H: 85-100°)
  * 
  * @note Uses CLAHE (Contrast Limited Adaptive Histogram Equalization) on V channel
- * @note Includes "White Rim Booster" to remove blurry white borders
- * @note Automatically relaxes thresholds if mask is extremely sparse (<0.1%)
+ * @note Includes "White Rim Booster" to remove blurry white borders; it runs only
+ *       in the mask's bounding box and only when white touches the mask
+ * @note Automatically relaxes thresholds if mask is extremely sparse (<0.1%); one
+ *       classification pass yields every relaxation level (slack map), so the
+ *       relaxed mask costs a histogram and one threshold
+ * 
+ * The static functions are self-contained. An instance additionally keeps its
+ * buffers and CLAHE object, and splits segmentation into prepare() (blur,
+ * HSV, CLAHE) and mask() (classification and cleanup), so several masks of
+ * one image (e.g. a relaxed retry) and other consumers of its HSV planes
+ * share a single preparation.
+ * 
+ * @example
+ * ```cpp
+ * ColorSegmenter seg;                 // one per thread
+ * seg.prepare(warped, opt.blur_ksize);
+ * seg.mask(opt, mask);
+ * if (tooSparse(mask)) seg.mask(relaxed, mask);   // no second blur/HSV/CLAHE
+ * cv::Scalar meanS = cv::mean(seg.hsv());
+ * ```
  */
 class ColorSegmenter {
 public:
+    // === Instance API (stateful, one per thread) ===
+
+    /**
+     * @brief Blur, convert to HSV and apply CLAHE to V, keeping the planes
+     * 
+     * @param bgr Input BGR image (CV_8UC3)
+     * @param blur_ksize Gaussian pre-blur kernel (odd ≥3, else no blur), as SegOptions::blur_ksize
+     * @param stripes Intra-frame stripes, as SegOptions::stripes (ROIs of a larger
+     *                image are always prepared serially)
+     */
+    void prepare(const cv::Mat& bgr, int blur_ksize, int stripes = 1);
+
+    /**
+     * @brief prepare() for NV12 input, without a BGR round trip
+     * 
+     * Hue and saturation are derived from U/V through a precomputed (U,V)
+     * table, brightness from Y; blur and CLAHE act on the luma plane. The
+     * planes match what prepare() would produce for the converted BGR image
+     * up to rounding and the BGR pre-blur of chroma.
+     * 
+     * @param y Luma plane (CV_8UC1, even width and height)
+     * @param uv Interleaved chroma plane (CV_8UC2, half width and height)
+     * @param blur_ksize Gaussian pre-blur kernel applied to luma (odd ≥3, else no blur)
+     */
+    void prepareNV12(const cv::Mat& y, const cv::Mat& uv, int blur_ksize);
+
+    /**
+     * @brief Accept an already prepared HSV image instead of calling prepare()
+     * 
+     * @param hsv HSV image with CLAHE already applied to V (CV_8UC3); copied
+     * @note rawV() is empty afterwards
+     */
+    void setPrepared(const cv::Mat& hsv);
+
+    /**
+     * @brief Allowed-color mask of the prepared image
+     * 
+     * Same result as allowedMaskHSV(bgr, opt) for the image passed to
+     * prepare(bgr, opt.blur_ksize); opt.blur_ksize itself is ignored here.
+     * A later call with the same profile and both floors lowered by the same
+     * amount (e.g. a relaxed retry) reuses this call's classification.
+     * 
+     * @param opt Thresholds and morphology
+     * @param mask Output binary mask (CV_8UC1)
+     */
+    void mask(const SegOptions& opt, cv::Mat& mask);
+
+    /// @brief prepare() followed by mask()
+    void segment(const cv::Mat& bgr, const SegOptions& opt, cv::Mat& mask);
+
+    /// @brief Prepared HSV image, V replaced by its CLAHE'd version (CV_8UC3)
+    const cv::Mat& hsv() const { return hsv_; }
+
+    /// @brief Prepared CLAHE'd V plane (CV_8UC1)
+    const cv::Mat& claheV() const { return v_; }
+
+    /// @brief V plane of the (blurred) image before CLAHE (CV_8UC1)
+    const cv::Mat& rawV() const { return v_raw_; }
+
+    /// @brief Counters of the last mask() call
+    const SegStats& stats() const { return ws_.stats; }
+
+    // === Static API ===
+
     /**
      * @brief Create binary mask of allowed marker colors using default settings
      * 
@@ -70,4 +272,81 @@ public:
      * @note May relax thresholds if resulting mask is too sparse
      */
     static cv::Mat allowedMaskHSV(const cv::Mat& bgr, const SegOptions& opt);
+
+    /**
+     * @brief Allocation-free variant writing into caller-owned buffers
+     * 
+     * @param bgr Input BGR image (CV_8UC3)
+     * @param opt Segmentation parameters and thresholds
+     * @param ws Per-thread scratch buffers (reused across calls)
+     * @param mask Output binary mask (CV_8UC1); reused if it already has the right size
+     * 
+     * @note Produces exactly the same mask as allowedMaskHSV(bgr, opt)
+     * @note ws.stats is overwritten with the counters of this call
+     */
+    static void allowedMaskHSV(const cv::Mat& bgr, const SegOptions& opt,
+        SegWorkspace& ws, cv::Mat& mask);
+
+    /**
+     * @brief allowedMaskHSV() on the OpenCL device through cv::UMat
+     * 
+     * Blur, HSV, CLAHE, classification (per-color inRange), white-rim booster,
+     * relaxation and morphology all run on the device; only the final 8-bit
+     * mask is downloaded into @p mask.
+     * 
+     * @param bgr Input BGR image already on the device (CV_8UC3)
+     * @param opt Segmentation parameters and thresholds
+     * @param ws Per-thread device buffers (reused across calls)
+     * @param mask Output binary mask (CV_8UC1); reused if it already has the right size
+     * 
+     * @note The classification equals the CPU one for the same HSV input; device
+     *       blur/CLAHE rounding may move a few border pixels
+     * @note Runs on the CPU (slowly, through OpenCV's fallbacks) when OpenCL is off;
+     *       check openclAvailable() first
+     */
+    static void allowedMaskOCL(const cv::UMat& bgr, const SegOptions& opt,
+        OclSegWorkspace& ws, cv::Mat& mask);
+
+    /// @brief True if an OpenCL device is present and OpenCV's T-API is enabled
+    static bool openclAvailable();
+
+    /**
+     * @brief Build the "White Rim Booster" mask for an HSV image
+     * 
+     * Marks white/highlight pixels (low S, high V) that lie on or next to a
+     * bright edge of the sharpened V channel. allowedMaskHSV() subtracts this
+     * mask to detach blurry white borders from the colored board.
+     * 
+     * @param hsv HSV image with CLAHE applied to V (CV_8UC3)
+     * @param ws Scratch buffers (reused across calls)
+     * @param rim Output binary mask (CV_8UC1): 255 = white rim
+     */
+    static void whiteRimMask(const cv::Mat& hsv, SegWorkspace& ws, cv::Mat& rim);
+
+    /**
+     * @brief Classify HSV pixels into marker colors in a single pass
+     * 
+     * Fused replacement for the per-color inRange() calls: every pixel is looked
+     * up in a precomputed (H,S) table that yields the best-matching color and
+     * its V floor, and white highlights (low S, high V) are suppressed in the
+     * same pass. Vectorized with OpenCV universal intrinsics.
+     * 
+     * @param hsv Input HSV image (CV_8UC3, OpenCV 8-bit hue range 0-179)
+     * @param smin Global minimum saturation (raises every color's S floor)
+     * @param vmin Global minimum value (raises every color's V floor)
+     * @param mask Output binary mask (CV_8UC1): 255 = allowed color
+     * @param labels Optional output (CV_8UC1) of MarkerColor values, None outside the mask
+     * @param profile Marker palette (nullptr = ColorProfile::builtin())
+     * 
+     * @note Lookup tables are compiled once per profile and (smin, vmin) pair, see ColorProfile
+     */
+    static void classifyHSV(const cv::Mat& hsv, int smin, int vmin,
+        cv::Mat& mask, cv::Mat* labels = nullptr, const ColorProfile* profile = nullptr);
+
+private:
+    SegWorkspace ws_;
+    SlackCache slack_;  ///< Floors ws_.slack holds for the prepared image
+    cv::Mat hsv_;    ///< View into ws_.hsv
+    cv::Mat v_;      ///< View into ws_.v
+    cv::Mat v_raw_;  ///< View into ws_.v_raw (empty after setPrepared())
 };
@@ -0,0 +1,162 @@
+/**
+ * @file debug_writer.hpp
+ * @brief Background writer for --save-debug artifacts
+ *
+ * Encoding debug images (PNG) can cost more than detection itself. A
+ * DebugWriter takes a copy of each artifact and encodes it on its own
+ * thread(s), with a byte budget for queued pixels, optional sampling of the
+ * images to capture, fast encodings (uncompressed PNG, QOI) and
+ * de-duplication of identical artifacts (written once, hard-linked after).
+ */
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief On-disk encoding of debug artifacts
+ */
+enum class DebugFormat {
+    Png,      ///< PNG at OpenCV's default compression (smallest, slowest)
+    PngFast,  ///< PNG without deflate compression (fast, larger files)
+    Qoi       ///< QOI ("Quite OK Image"): fast lossless, compact on masks
+};
+
+/**
+ * @brief Configuration of a DebugWriter
+ */
+struct DebugWriterOptions {
+    /// @brief Encoding of written artifacts (decides the file extension)
+    DebugFormat format = DebugFormat::PngFast;
+
+    /// @brief Fraction of images whose artifacts are captured (0-1), spread evenly
+    double sample_rate = 1.0;
+
+    /// @brief Pixel bytes allowed to wait for encoding; artifacts beyond it are dropped
+    size_t max_queued_bytes = (size_t)64 << 20;
+
+    /// @brief Encoder threads (minimum 1)
+    int threads = 1;
+
+    /// @brief Hard-link an artifact identical to a recently written one instead of encoding it
+    bool dedup = true;
+
+    /// @brief Log every written or dropped artifact to stderr
+    bool verbose = false;
+};
+
+/**
+ * @brief Counters of a DebugWriter
+ */
+struct DebugWriterStats {
+    std::uint64_t images_sampled = 0;   ///< sample() calls that returned true
+    std::uint64_t images_skipped = 0;   ///< sample() calls that returned false
+    std::uint64_t written = 0;          ///< Artifacts encoded and written
+    std::uint64_t deduplicated = 0;     ///< Artifacts linked to an identical earlier one
+    std::uint64_t dropped = 0;          ///< Artifacts rejected because the queue was full
+    std::uint64_t failed = 0;           ///< Artifacts that could not be written
+};
+
+/**
+ * @brief Asynchronous, bounded debug artifact writer
+ *
+ * @note Thread-safe: one writer is shared by all detection workers
+ *       (DetectOptions::debug_writer). The destructor writes everything queued.
+ *
+ * @example
+ * ```cpp
+ * auto writer = std::make_shared<DebugWriter>(DebugWriterOptions{});
+ * opt.save_debug = true;
+ * opt.debug_writer = writer;      // detect() now only copies and enqueues
+ * ...
+ * writer->flush();
+ * ```
+ */
+class DebugWriter {
+public:
+    explicit DebugWriter(const DebugWriterOptions& opt = DebugWriterOptions{});
+    ~DebugWriter();
+
+    DebugWriter(const DebugWriter&) = delete;
+    DebugWriter& operator=(const DebugWriter&) = delete;
+
+    /**
+     * @brief Decide whether the next image's artifacts are captured
+     *
+     * Call once per image and skip rendering its artifacts when false.
+     * Of n consecutive calls, round(n * sample_rate) return true (up to
+     * floating-point rounding of the rate), evenly spread.
+     */
+    bool sample();
+
+    /**
+     * @brief Queue a copy of @p img for writing
+     *
+     * @param img Artifact (CV_8UC1, CV_8UC3 or CV_8UC4); copied, so it may change afterwards
+     * @param stem Output path without extension (extension() of the format is appended)
+     * @return false if it was dropped because the queued bytes would exceed the budget
+     */
+    bool submit(const cv::Mat& img, const std::string& stem);
+
+    /// @brief Block until every queued artifact is written
+    void flush();
+
+    /// @brief Counters so far
+    DebugWriterStats stats() const;
+
+    /// @brief Options in effect
+    const DebugWriterOptions& options() const { return opt_; }
+
+    /// @brief File extension of a format, with the dot (".png", ".qoi")
+    static const char* extension(DebugFormat format);
+
+private:
+    struct Job {
+        cv::Mat img;
+        std::string path;
+    };
+
+    void run();
+    void write(const Job& job);
+
+    DebugWriterOptions opt_;
+
+    mutable std::mutex m_;
+    std::condition_variable has_work_;
+    std::condition_variable idle_;
+    std::deque<Job> q_;
+    size_t queued_bytes_ = 0;
+    int busy_ = 0;
+    bool stop_ = false;
+    double sample_acc_ = 0.5;          ///< Error-diffusion accumulator (0.5 = round to nearest)
+    DebugWriterStats stats_;
+
+    std::mutex dirs_m_;
+    std::set<std::string> dirs_;        ///< Directories already created
+
+    std::mutex dedup_m_;
+    std::deque<std::pair<std::uint64_t, std::string>> recent_; ///< (content hash, path), newest last
+
+    std::vector<std::thread> workers_;
+};
+
+/**
+ * @brief Encode an 8-bit image as QOI
+ *
+ * @param img CV_8UC1 (stored as gray RGB), CV_8UC3 (BGR) or CV_8UC4 (BGRA)
+ * @return The complete .qoi file
+ */
+std::vector<std::uint8_t> encodeQoi(const cv::Mat& img);
+
+/**
+ * @brief Decode a QOI file into BGR (3 channels) or BGRA (4 channels)
+ * @return The image, or an empty Mat if @p data is not a valid QOI file
+ */
+cv::Mat decodeQoi(const std::vector<std::uint8_t>& data);
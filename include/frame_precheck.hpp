@@ -0,0 +1,90 @@
+﻿/**
+ * @file frame_precheck.hpp
+ * @brief Early-exit cascade that rejects frames with no marker before full segmentation
+ * 
+ * Two cheap stages run on downscaled copies of the frame: a thumbnail test
+ * (enough marker-colored pixels, enough distinct marker hues) and a coarse
+ * mask test (one blob large enough to be a marker). Only frames passing both
+ * pay for the full-resolution CLAHE, white-rim booster, relaxation and
+ * morphology of ColorSegmenter.
+ */
+#pragma once
+#include <opencv2/opencv.hpp>
+#include "binary_morph.hpp"
+#include "marker_types.hpp"
+#include "scratch_mat.hpp"
+
+namespace precheck {
+
+    /**
+     * @brief Thresholds of the cascade
+     * 
+     * Defaults are derived from the 0.5% minimum coverage of a reported marker:
+     * the color test asks for a quarter of that area, the blob test for half.
+     */
+    struct PrecheckOptions {
+        /// @brief Long side of the thumbnail (stage A)
+        int thumb_side = 96;
+
+        /// @brief Minimum fraction of marker-colored thumbnail pixels
+        double min_color_frac = 0.00125;
+
+        /// @brief Minimum number of distinct marker colors in the thumbnail
+        int min_hues = 2;
+
+        /// @brief Long side of the coarse mask (stage B)
+        int coarse_side = 256;
+
+        /// @brief Minimum area of the largest coarse blob, as fraction of the coarse image
+        double min_blob_frac = 0.0025;
+
+        /// @brief Global S floor of the classifier (the segmenter's most relaxed floor)
+        int smin = 60;
+
+        /// @brief Global V floor of the classifier (the segmenter's most relaxed floor)
+        int vmin = 45;
+
+        /// @brief Marker palette (nullptr = built-in), as DetectOptions::color_profile
+        std::shared_ptr<const ColorProfile> profile;
+    };
+
+    /**
+     * @brief Reusable buffers of the cascade
+     * 
+     * @warning Not thread-safe: hold one per thread
+     */
+    struct PrecheckWorkspace {
+        ScratchMat coarse;      ///< Coarse BGR (CV_8UC3)
+        ScratchMat thumb;       ///< Thumbnail BGR (CV_8UC3)
+        cv::Mat hsv;            ///< HSV of the current stage (CV_8UC3)
+        cv::Mat v;              ///< V plane (CV_8UC1)
+        cv::Mat v_eq;           ///< CLAHE'd V plane (CV_8UC1)
+        cv::Mat mask;           ///< Classifier mask (CV_8UC1)
+        cv::Mat labels;         ///< MarkerColor labels (CV_8UC1)
+        cv::Mat cc_labels;      ///< Component labels (CV_32S)
+        cv::Mat cc_stats;       ///< Component statistics (CV_32S)
+        cv::Mat cc_centroids;   ///< Component centroids (CV_64F)
+        binmorph::Workspace morph; ///< Packed rows of the mask close
+        cv::Ptr<cv::CLAHE> clahe; ///< CLAHE (clip 2.0, 8×8 tiles), created on first use
+    };
+
+    /**
+     * @brief Cascade thresholds matching a DetectOptions configuration
+     * @note S/V floors are the segmenter's floors after its two relaxation steps
+     */
+    PrecheckOptions optionsFor(const DetectOptions& opt);
+
+    /**
+     * @brief Run the cascade on a frame
+     * 
+     * @param bgr Input frame (CV_8UC3)
+     * @param opt Thresholds
+     * @param ws Per-thread buffers
+     * @return PrecheckReject::None if the frame may contain a marker, else the
+     *         stage that rejected it
+     */
+    PrecheckReject run(const cv::Mat& bgr, const PrecheckOptions& opt, PrecheckWorkspace& ws);
+
+    /// @brief Stable snake_case name of a reject reason (for logs and reports)
+    const char* rejectName(PrecheckReject r);
+}
@@ -0,0 +1,129 @@
+/**
+ * @file frame_server.hpp
+ * @brief Long-running detection server for framed image streams (--serve)
+ * 
+ * Clients write frames to stdin or a Unix domain socket; each frame is a
+ * fixed 24-byte little-endian header followed by its payload:
+ * 
+ * | offset | size | field                                             |
+ * |--------|------|---------------------------------------------------|
+ * | 0      | 4    | magic "MCE1"                                      |
+ * | 4      | 4    | id (echoed in the result)                         |
+ * | 8      | 4    | kind: 0 = encoded image (JPEG/PNG/...), 1 = raw BGR |
+ * | 12     | 4    | width  (raw BGR only, else 0)                     |
+ * | 16     | 4    | height (raw BGR only, else 0)                     |
+ * | 20     | 4    | payload length in bytes (raw: width × height × 3) |
+ * 
+ * One JSON line is written back per frame, in submission order:
+ * `{"id":7,"status":"ok","coverage":41.93,"grid_ok":true,"polygon":[[x,y],...],"ms":3.1}`
+ * with status one of ok, not_found, decode_error, error (detector exception) or
+ * bad_frame (malformed header/short payload; the stream is closed after it).
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "batch_runner.hpp"
+#include "marker_types.hpp"
+
+/**
+ * @brief Fixed header preceding every frame of the serve protocol
+ */
+struct FrameHeader {
+    /// @brief Payload kinds
+    enum Kind : std::uint32_t { Encoded = 0, RawBgr = 1 };
+
+    std::uint32_t id = 0;       ///< Caller-chosen frame id
+    std::uint32_t kind = Encoded; ///< Payload kind
+    std::uint32_t width = 0;    ///< Raw frames only
+    std::uint32_t height = 0;   ///< Raw frames only
+    std::uint32_t length = 0;   ///< Payload bytes following the header
+};
+
+/// @brief Size of the serialized FrameHeader in bytes
+constexpr size_t kFrameHeaderSize = 24;
+
+/// @brief Largest accepted payload (guards against corrupt length fields)
+constexpr std::uint32_t kMaxFramePayload = 512u << 20;
+
+/// @brief Payload bytes all connections of one FrameServer may hold at once
+///        (read, queued or being decoded); readers wait for their share
+constexpr std::uint64_t kServePayloadBudget = 2ull * kMaxFramePayload;
+
+/**
+ * @brief Parse a serialized frame header
+ * 
+ * @param bytes kFrameHeaderSize bytes as read from the stream
+ * @param out Parsed header
+ * @return False on bad magic, unknown kind, or inconsistent raw dimensions
+ */
+bool parseFrameHeader(const std::uint8_t* bytes, FrameHeader& out);
+
+/**
+ * @brief Serialize a frame header (for clients and tests)
+ */
+void writeFrameHeader(const FrameHeader& hdr, std::uint8_t* bytes);
+
+/**
+ * @brief Warm worker pool answering framed detection requests
+ * 
+ * Worker threads, their MarkerDetector and DetectorWorkspace are created once
+ * and live as long as the server, so per-frame cost is decode + detect only.
+ * Several streams (e.g. socket connections) can be served concurrently; they
+ * share the pool and each gets its results back in its own submission order.
+ * Frame payloads of all streams are charged against kServePayloadBudget, so
+ * memory stays bounded however many clients connect.
+ * 
+ * @note Uses BatchOptions::jobs, queue_depth and reduced_decode
+ */
+class FrameServer {
+public:
+    /**
+     * @brief Start the worker pool
+     */
+    FrameServer(const DetectOptions& opt, const BatchOptions& bopt);
+
+    /// @brief Stop the pool (pending frames are still answered)
+    ~FrameServer();
+
+    FrameServer(const FrameServer&) = delete;
+    FrameServer& operator=(const FrameServer&) = delete;
+
+    /**
+     * @brief Serve one byte stream until EOF or a protocol error
+     * 
+     * @param in_fd File descriptor frames are read from (e.g. 0 for stdin)
+     * @param out_fd File descriptor results are written to (e.g. 1 for stdout)
+     * @return Number of frames answered
+     * 
+     * @note Blocks the calling thread; safe to call from several threads at once
+     */
+    size_t serveStream(int in_fd, int out_fd);
+
+    /**
+     * @brief Listen on a Unix domain socket and serve every connection
+     * 
+     * Each accepted connection is served by serveStream() on its own thread.
+     * Runs until the listening socket fails, then waits for open connections.
+     * 
+     * @param path Socket path (an existing socket file is replaced)
+     * @return False if the socket could not be created (or on Windows)
+     */
+    bool serveUnixSocket(const std::string& path);
+
+    /// @brief Effective number of detection workers
+    int jobs() const { return jobs_; }
+
+private:
+    struct Job;
+    struct Shared;
+
+    DetectOptions opt_;
+    BatchOptions bopt_;
+    int jobs_ = 1;
+    std::shared_ptr<Shared> shared_;
+    std::vector<std::thread> workers_;
+};
@@ -9,6 +9,8 @@
 #include <opencv2/opencv.hpp>
 #include <vector>
 #include <optional>
+#include "binary_morph.hpp"
+#include "scratch_mat.hpp"
 
 namespace geom {
 
@@ -24,8 +26,60 @@ namespace geom {
         /// @brief Forward homography matrix (3×3, source → destination)
         cv::Mat H;
         
-        /// @brief Inverse homography matrix (3×3, destination → source)  
+        /// @brief Inverse homography matrix (3×3, destination → source)
+        /// @note The map the warp sampled through; no extra inversion is made for it
         cv::Mat Hinv;
+
+        /// @brief Device copy of the warped square (OpenCL overload only)
+        cv::UMat device;
+
+        /// @brief Warped interleaved chroma, (N/2)×(N/2) CV_8UC2 (NV12 overload only;
+        ///        image then holds the warped luma)
+        cv::Mat uv;
+    };
+
+    /**
+     * @brief Strategy used by findStrongQuad() to pick the marker blob
+     */
+    enum class QuadEngine {
+        /// @brief Trace every external contour, keep the largest by contourArea()
+        Contours,
+
+        /// @brief Label the mask once (connectedComponentsWithStats), keep the largest
+        ///        component by pixel count and trace only that blob's bounding box
+        /// @note Much cheaper on cluttered backgrounds with thousands of blobs
+        Components
+    };
+
+    /**
+     * @brief Reusable buffers for findStrongQuad()
+     * 
+     * @warning Not thread-safe: hold one per thread
+     */
+    struct QuadWorkspace {
+        /// @brief Closed copy of the input mask
+        cv::Mat closed;
+
+        /// @brief External contours of the closed mask (or of the selected blob)
+        std::vector<std::vector<cv::Point>> contours;
+
+        /// @brief Polygon approximation of the best contour
+        std::vector<cv::Point> approx;
+
+        /// @brief Component labels (CV_32S, QuadEngine::Components only)
+        cv::Mat labels;
+
+        /// @brief Per-component statistics (CV_32S, QuadEngine::Components only)
+        cv::Mat stats;
+
+        /// @brief Component centroids (CV_64F, QuadEngine::Components only)
+        cv::Mat centroids;
+
+        /// @brief Selected blob with a 1-pixel zero border (CV_8UC1, QuadEngine::Components only)
+        cv::Mat blob;
+
+        /// @brief Packed rows of the 3×3 close
+        binmorph::Workspace morph;
     };
 
     /**
@@ -45,6 +99,34 @@ namespace geom {
     std::optional<std::vector<cv::Point2f>>
         findStrongQuad(const cv::Mat& allowedMask);
 
+    /**
+     * @brief Same as findStrongQuad(allowedMask), reusing caller-owned buffers
+     * 
+     * @param allowedMask Binary mask (CV_8UC1) where 255 = marker pixels
+     * @param ws Scratch buffers (reused across calls)
+     * @param engine Blob selection strategy (see QuadEngine)
+     */
+    std::optional<std::vector<cv::Point2f>>
+        findStrongQuad(const cv::Mat& allowedMask, QuadWorkspace& ws,
+            QuadEngine engine = QuadEngine::Contours);
+
+    /**
+     * @brief Extract up to @p max_quads quadrilaterals, largest blobs first
+     * 
+     * Multi-marker variant of findStrongQuad(): the mask is closed and traced
+     * once, the external contours are ranked by area, and each of the top
+     * @p max_quads gets the same 4-corner fit.
+     * 
+     * @param allowedMask Binary mask (CV_8UC1) where 255 = marker pixels
+     * @param ws Scratch buffers (reused across calls)
+     * @param max_quads Maximum number of candidates (K)
+     * @param min_area_frac Ignore contours smaller than this fraction of the mask area
+     * @return Corner sets ordered clockwise from top-left, by decreasing contour area
+     */
+    std::vector<std::vector<cv::Point2f>>
+        findQuadCandidates(const cv::Mat& allowedMask, QuadWorkspace& ws,
+            int max_quads, double min_area_frac = 0.0);
+
     /**
      * @brief Apply perspective correction to transform quadrilateral to square
      * 
@@ -79,6 +161,114 @@ namespace geom {
         const std::vector<cv::Point2f>& quad,
         int N);
 
+    /**
+     * @brief Homography mapping a quad onto the N×N square
+     * 
+     * @param quad Corner points (any order; sorted clockwise from top-left)
+     * @param N Square size in pixels
+     * @return 3×3 CV_64F matrix, source → square, as used by warpToSquareWithH()
+     */
+    cv::Mat squareHomography(const std::vector<cv::Point2f>& quad, int N);
+
+    /**
+     * @brief Bilinear warp onto the N×N square through the inverse map
+     * 
+     * Same as warpPerspective(src, dst, Hinv, Size(N, N), INTER_LINEAR |
+     * WARP_INVERSE_MAP, BORDER_REPLICATE): the map is used as given, so the
+     * warp makes no inversion of its own. Sizes with a compile-time path
+     * (hasFixedWarp()) build the sample maps band by band on the stack and
+     * gather them with remap(); results agree up to the rounding of the
+     * 1/32 px sample coordinates.
+     * 
+     * @param src Source image (CV_8U, 1-4 channels)
+     * @param Hinv 3×3 CV_64F map from square to source coordinates
+     * @param N Output square size
+     * @param dst Output N×N image (reused when size and type match; not @p src)
+     */
+    void warpSquare(const cv::Mat& src, const cv::Mat& Hinv, int N, cv::Mat& dst);
+
+    /// @brief True if warpSquare() has a specialized path for N×N
+    ///        (64, 128, 160, 256, 320: common warp_size values and NV12 chroma halves)
+    bool hasFixedWarp(int N);
+
+    /**
+     * @brief Same as warpToSquareWithH(), writing into an existing WarpResult
+     * 
+     * @param out Result whose buffers are reused when N and the image type match
+     */
+    void warpToSquareWithH(const cv::Mat& bgr,
+        const std::vector<cv::Point2f>& quad,
+        int N,
+        WarpResult& out);
+
+    /**
+     * @brief warpToSquareWithH() with the source image on the OpenCL device
+     * 
+     * Warps on the device and downloads only the N×N square into out.image.
+     * 
+     * @param bgr Device image (CV_8UC3) covering the frame region that starts at @p origin
+     * @param origin Frame coordinates of bgr's top-left pixel
+     * @param quad Corner points in frame coordinates (inside the region)
+     * @param N Output square size (N×N pixels)
+     * @param out Result; H and Hinv map frame coordinates, as in the Mat overload
+     * 
+     * @note Pixels sampled outside the region replicate its border, not the frame
+     */
+    void warpToSquareWithH(const cv::UMat& bgr,
+        const cv::Point& origin,
+        const std::vector<cv::Point2f>& quad,
+        int N,
+        WarpResult& out);
+
+    /**
+     * @brief warpToSquareWithH() for an NV12 frame
+     * 
+     * Warps luma into out.image (N×N, CV_8UC1) and chroma into out.uv
+     * ((N/2)×(N/2), CV_8UC2) with the same geometry, keeping the 4:2:0 sample
+     * siting, so the square can be segmented with ColorSegmenter::prepareNV12().
+     * 
+     * @param y Luma plane (CV_8UC1, even width and height)
+     * @param uv Interleaved chroma plane (CV_8UC2, half width and height)
+     * @param quad Corner points in luma coordinates
+     * @param N Output square size (even)
+     * @param out Result; H and Hinv map luma coordinates
+     */
+    void warpToSquareWithH(const cv::Mat& y,
+        const cv::Mat& uv,
+        const std::vector<cv::Point2f>& quad,
+        int N,
+        WarpResult& out);
+
+    /**
+     * @brief Map quadrilateral corners from a resized image back to the source image
+     * 
+     * @param quad Corner points in resized-image coordinates
+     * @param from Size of the resized image the quad was found in
+     * @param to Size of the source image
+     * @return Corner points in source-image coordinates (same order)
+     * 
+     * @note Uses the pixel-center convention of cv::resize: x' = (x + 0.5) * sx - 0.5
+     */
+    std::vector<cv::Point2f> mapQuadToSize(const std::vector<cv::Point2f>& quad,
+        const cv::Size& from,
+        const cv::Size& to);
+
+    /**
+     * @brief Refine quadrilateral corners to sub-pixel accuracy
+     * 
+     * Runs cv::cornerSubPix on a small grayscale ROI around each corner, so the
+     * cost is independent of the image size.
+     * 
+     * @param bgr Full-resolution BGR image (CV_8UC3) or luma plane (CV_8UC1)
+     * @param quad Approximate corner points in image coordinates
+     * @param radius Half-size of the search window in pixels
+     * @return Refined corner points (same order); a corner is kept unchanged if its
+     *         ROI does not fit in the image or refinement drifts outside the window
+     */
+    std::vector<cv::Point2f> refineQuadCorners(const cv::Mat& bgr,
+        const std::vector<cv::Point2f>& quad,
+        int radius);
+
     /**
      * @brief Calculate polygon coverage as percentage of total image area
      * 
@@ -92,4 +282,19 @@ namespace geom {
      */
     double polygonCoveragePercent(const std::vector<cv::Point2f>& poly,
         const cv::Size& sz);
+
+    /**
+     * @brief Coverage of the union of several polygons (overlaps counted once)
+     * 
+     * Each polygon is filled separately into a raster whose longer side is at
+     * most @p max_side, so overlapping polygons do not cancel out.
+     * 
+     * @param polys Polygons in image coordinates
+     * @param sz Image size (width × height)
+     * @param max_side Longest raster side (the image is scaled down to fit)
+     * @param raster Scratch buffer for the raster (CV_8UC1)
+     * @return Coverage percentage [0.0, 100.0]
+     */
+    double unionCoveragePercent(const std::vector<std::vector<cv::Point2f>>& polys,
+        const cv::Size& sz, int max_side, ScratchMat& raster);
 }
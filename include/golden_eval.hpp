@@ -0,0 +1,114 @@
+/**
+ * @file golden_eval.hpp
+ * @brief Golden-dataset manifest and accuracy scoring for regression runs
+ *
+ * A manifest lists images with their expected coverage (or none for frames
+ * without a marker). AccuracyScorer compares detect() results against it and
+ * reports the absolute coverage error and false positive / false negative
+ * counts, so speed work can be gated on unchanged accuracy (mce_golden).
+ */
+#pragma once
+#include <cstddef>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "marker_types.hpp"
+
+/**
+ * @brief One image of a golden dataset
+ */
+struct GoldenEntry {
+    /// @brief Image path (resolved against the manifest directory)
+    std::string path;
+
+    /// @brief Expected coverage in percent; nullopt = no marker in the image
+    std::optional<double> expected_coverage;
+};
+
+/**
+ * @brief Parse a golden manifest
+ *
+ * One image per line: `path,expected_coverage`. Empty lines and lines starting
+ * with '#' are skipped, as is a first line whose second field is not a number
+ * (header). An expected value of `none`, `-` or an empty field marks an image
+ * without a marker. Relative paths are resolved against @p base_dir.
+ *
+ * @param is Manifest text
+ * @param base_dir Directory relative paths are resolved against ("" = as given)
+ * @param error Receives "line N: reason" on failure (may be nullptr)
+ * @return Entries in file order, or nullopt on a malformed line
+ */
+std::optional<std::vector<GoldenEntry>>
+    loadGoldenManifest(std::istream& is, const std::string& base_dir, std::string* error = nullptr);
+
+/**
+ * @brief Accuracy summary of one configuration over a golden dataset
+ */
+struct AccuracyReport {
+    size_t images = 0;          ///< Images scored
+    size_t true_pos = 0;        ///< Marker expected and found
+    size_t false_pos = 0;       ///< Found although no marker is expected
+    size_t false_neg = 0;       ///< Marker expected but not found
+    size_t true_neg = 0;        ///< No marker expected, none found
+    size_t over_tol = 0;        ///< True positives with |error| above the tolerance
+    double mean_abs_err = 0.0;  ///< Mean |coverage error| over true positives (percentage points)
+    double p95_abs_err = 0.0;   ///< 95th percentile of |coverage error| (nearest rank)
+    double max_abs_err = 0.0;   ///< Largest |coverage error|
+    std::string worst_path;     ///< Image with the largest error
+};
+
+/**
+ * @brief Accumulates detection outcomes against expected coverages
+ *
+ * @note Not thread-safe: feed it from one thread
+ *
+ * @example
+ * ```cpp
+ * AccuracyScorer acc(2.0);
+ * for (const GoldenEntry& e : entries) {
+ *     acc.add(e.path, e.expected_coverage, detector.detect(cv::imread(e.path), opt, ws));
+ * }
+ * acc.writeJson(std::cout);
+ * ```
+ */
+class AccuracyScorer {
+public:
+    /**
+     * @brief Create a scorer
+     * @param tol_pct Coverage error (percentage points) above which a true positive counts as over_tol
+     */
+    explicit AccuracyScorer(double tol_pct = 2.0) : tol_pct_(tol_pct) {}
+
+    /**
+     * @brief Score one image
+     *
+     * @param path Image path (reported for the worst error and misclassifications)
+     * @param expected Expected coverage (nullopt = no marker)
+     * @param got Detection result of the image
+     */
+    void add(const std::string& path, std::optional<double> expected, const std::optional<DetectionResult>& got);
+
+    /// @brief Summary over all images added so far
+    AccuracyReport report() const;
+
+    /// @brief Images counted as false positives or false negatives, in input order
+    const std::vector<std::string>& misses() const { return misses_; }
+
+    /**
+     * @brief Write the report as one JSON object
+     *
+     * Layout: `{"images":N,"tp":..,"fp":..,"fn":..,"tn":..,"over_tol":..,"tol_pct":..,
+     * "mae_pct":..,"p95_abs_err_pct":..,"max_abs_err_pct":..,"worst_path":"..","misses":[..]}`
+     */
+    void writeJson(std::ostream& os) const;
+
+private:
+    double tol_pct_;
+    size_t images_ = 0;
+    size_t tp_ = 0, fp_ = 0, fn_ = 0, tn_ = 0, over_tol_ = 0;
+    std::vector<double> abs_err_;
+    std::vector<std::string> err_path_;
+    std::vector<std::string> misses_;
+};
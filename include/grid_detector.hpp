@@ -1,12 +1,17 @@
 ﻿/**
  * @file grid_detector.hpp
- * @brief Grid structure validation for 3x3 marker patterns
+ * @brief Grid structure validation for NxM marker patterns (3x3 by default)
  * 
- * Validates that detected quadrilaterals contain proper 3x3 grid structure
+ * Validates that detected quadrilaterals contain proper grid structure
  * by analyzing seam positions and cell content in warped marker images.
+ * All per-cell and per-column/row statistics are O(1) lookups into integral
+ * images built once per warped square. The lattice checks produce the same
+ * reports from point samples mapped through the homography instead, without
+ * materializing the warped square.
  */
 #pragma once
 #include <opencv2/opencv.hpp>
+#include <vector>
 
 namespace grid {
 
@@ -14,40 +19,156 @@ namespace grid {
      * @brief Grid seam detection results
      * 
      * Stores the positions of vertical and horizontal grid lines that should
-     * separate the 3x3 cells at approximately 1/3 and 2/3 positions.
+     * separate the cells at approximately k/cols and k/rows positions.
      */
     struct Seams {
-        /// @brief First vertical seam position (expected ~1/3 from left)
-        int cx1 = -1;
-        
-        /// @brief Second vertical seam position (expected ~2/3 from left)  
-        int cx2 = -1;
-        
-        /// @brief First horizontal seam position (expected ~1/3 from top)
-        int cy1 = -1;
-        
-        /// @brief Second horizontal seam position (expected ~2/3 from top)
-        int cy2 = -1;
+        /// @brief Vertical seam positions, left to right (cols-1 entries; ~1/3, ~2/3 for 3x3)
+        std::vector<int> cx;
+
+        /// @brief Horizontal seam positions, top to bottom (rows-1 entries)
+        std::vector<int> cy;
         
-        /// @brief True if both vertical and horizontal seams found within tolerance
+        /// @brief True if all vertical and horizontal seams found within tolerance
         bool ok = false;
     };
 
     /**
      * @brief Grid cell validation results  
      * 
-     * Contains coverage fractions for each of the 9 cells in the 3x3 grid
+     * Contains coverage fractions for each cell of a rows x cols grid
      * and overall validation status.
      */
     struct CellsReport {
-        /// @brief Fraction of allowed-color pixels in each cell [0.0-1.0]
-        /// @note Indexed as frac[row][col] where (0,0) is top-left
-        double frac[3][3];
+        /// @brief Grid rows
+        int rows = 3;
+
+        /// @brief Grid columns
+        int cols = 3;
+
+        /// @brief Fraction of allowed-color pixels in each cell [0.0-1.0], row-major
+        std::vector<double> frac;
         
-        /// @brief True if all 9 cells meet minimum coverage threshold
+        /// @brief True if all cells meet minimum coverage threshold
         bool ok = false;
+
+        /// @brief Fraction of cell (r, c) where (0,0) is top-left
+        double at(int r, int c) const { return frac[(size_t)r * cols + c]; }
+    };
+
+    /**
+     * @brief Reusable buffers for grid validation
+     *
+     * Holds the integral images of the last warped square; fill them with
+     * integrateMask() / integrateColor() before the lookup-based checks.
+     * 
+     * @warning Not thread-safe: hold one per thread
+     */
+    struct GridWorkspace {
+        /// @brief Integral of the mask ((H+1) × (W+1), CV_32S or CV_64F for huge masks)
+        cv::Mat mask_sum;
+
+        /// @brief Integral of the HSV saturation plane (empty until integrateColor)
+        cv::Mat s_sum;
+
+        /// @brief Integral of the value plane (empty until integrateColor)
+        cv::Mat v_sum;
+
+        /// @brief Scratch plane for the extracted S channel (CV_8UC1)
+        cv::Mat plane;
+    };
+
+    /**
+     * @brief Sample density of the lattice checks
+     */
+    struct LatticeOptions {
+        /// @brief Samples per cell side (cell_samples² per cell)
+        int cell_samples = 6;
+
+        /// @brief Candidate lines per seam search window
+        int seam_steps = 9;
+
+        /// @brief Samples along each candidate seam line
+        int line_samples = 16;
+    };
+
+    /**
+     * @brief Mask verdicts of latticeMaskChecks()
+     */
+    struct LatticeMask {
+        /// @brief Seams in pixels of the virtual N×N warped square (as checkGridSeams())
+        Seams seams;
+
+        /// @brief Sampled allowed-color fraction of each cell
+        CellsReport cells;
+    };
+
+    /**
+     * @brief Reusable buffers for latticeColorfulCells()
+     * 
+     * @warning Not thread-safe: hold one per thread
+     */
+    struct LatticeWorkspace {
+        cv::Mat y, uv;      ///< Gathered NV12 samples (latticeColorfulCells)
+        cv::Mat bgr, hsv;   ///< Gathered color samples and their HSV
     };
 
+    /**
+     * @brief Seams and cell coverage of the N×N warped mask, sampled on a lattice
+     * 
+     * Instead of warping the mask, maps cell interior points and candidate seam
+     * lines of the square through @p square_to_mask and reads the mask at the
+     * nearest pixel (0 outside, as the INTER_NEAREST warp of the frame mask).
+     * Seam windows, tolerances and spacing are those of checkGridSeams(ws, rows,
+     * cols), searched on seam_steps candidate lines per window.
+     * 
+     * @param mask Frame mask (CV_8UC1, 0/255)
+     * @param square_to_mask 3×3 CV_64F map from square to mask pixel coordinates
+     * @param N Side of the virtual warped square
+     * @param rows Grid rows
+     * @param cols Grid columns
+     * @param minFraction Minimum sampled fraction per cell
+     * @param lopt Sample density
+     */
+    LatticeMask latticeMaskChecks(const cv::Mat& mask, const cv::Mat& square_to_mask, int N,
+        int rows, int cols, double minFraction, const LatticeOptions& lopt = LatticeOptions{});
+
+    /**
+     * @brief countColorfulCells() from color samples at the cell lattice points
+     * 
+     * @param image BGR frame (CV_8UC3), or the luma plane (CV_8UC1) with @p uv
+     * @param uv NV12 chroma plane (CV_8UC2, half size) or empty for BGR
+     * @param square_to_image 3×3 CV_64F map from square to image pixel coordinates
+     * @param N Side of the virtual warped square
+     * @param rows Grid rows
+     * @param cols Grid columns
+     * @param minS Minimum mean saturation of a colorful cell
+     * @param minV Minimum mean value of a colorful cell
+     * @param lopt Sample density
+     * @param ws Reusable buffers
+     * @return Cells whose sampled mean S ≥ minS and mean V ≥ minV
+     */
+    int latticeColorfulCells(const cv::Mat& image, const cv::Mat& uv, const cv::Mat& square_to_image,
+        int N, int rows, int cols, double minS, double minV, const LatticeOptions& lopt, LatticeWorkspace& ws);
+
+    /**
+     * @brief Rectangle of cell (r, c) when a size is split into rows x cols cells
+     * @note The last row/column absorbs the integer-division remainder
+     */
+    cv::Rect cellRect(const cv::Size& size, int rows, int cols, int r, int c);
+
+    /**
+     * @brief Build the mask integral in ws (one pass over the mask)
+     * @param mask Binary mask (CV_8UC1, values 0/255) of warped marker region
+     */
+    void integrateMask(const cv::Mat& mask, GridWorkspace& ws);
+
+    /**
+     * @brief Build the S and V integrals in ws (for countColorfulCells)
+     * @param hsv HSV image (CV_8UC3) of the warped square
+     * @param v Value plane (CV_8UC1, same size) — typically the pre-CLAHE V
+     */
+    void integrateColor(const cv::Mat& hsv, const cv::Mat& v, GridWorkspace& ws);
+
     /**
      * @brief Detect grid seam positions in a binary mask
      * 
@@ -63,6 +184,23 @@ namespace grid {
      */
     Seams checkGridSeams(const cv::Mat& mask);
 
+    /**
+     * @brief Same as checkGridSeams(mask), reusing caller-owned buffers
+     */
+    Seams checkGridSeams(const cv::Mat& mask, GridWorkspace& ws);
+
+    /**
+     * @brief Seam search for a rows x cols grid on the mask integral in ws
+     *
+     * Column/row sums are read from the integral in O(1) each. Seam k of n is
+     * searched in a window of 0.6 cell around k/n (leaning towards the nearer
+     * border), must lie within half a cell of k/n and be at least half a cell
+     * from its neighbour. For 3x3 this is exactly checkGridSeams(mask).
+     *
+     * @pre integrateMask() was called on the mask
+     */
+    Seams checkGridSeams(const GridWorkspace& ws, int rows, int cols);
+
     /**
      * @brief Validate coverage of each cell in the 3x3 grid
      * 
@@ -76,7 +214,18 @@ namespace grid {
      * 
      * @note Expects square mask (rows == cols) from perspective correction
      * @note Edge cells may be slightly larger due to integer division remainder
-     * @warning Returns all zeros if mask is empty or non-square
      */
     CellsReport checkGridCells(const cv::Mat& mask, double minFraction);
+
+    /**
+     * @brief Cell coverage for a rows x cols grid on the mask integral in ws
+     * @pre integrateMask() was called on the mask
+     */
+    CellsReport checkGridCells(const GridWorkspace& ws, int rows, int cols, double minFraction);
+
+    /**
+     * @brief Number of cells whose mean S ≥ minS and mean V ≥ minV
+     * @pre integrateColor() was called on the warped square
+     */
+    int countColorfulCells(const GridWorkspace& ws, int rows, int cols, double minS, double minV);
 }
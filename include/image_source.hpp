@@ -0,0 +1,130 @@
+/**
+ * @file image_source.hpp
+ * @brief Zero-copy file input and reduced-size decoding for batch processing
+ * 
+ * Files are memory-mapped and handed to cv::imdecode without an intermediate
+ * heap copy. For JPEG, the frame dimensions are read from the SOF header and
+ * the image is decoded directly at 1/2, 1/4 or 1/8 scale (DCT scaling) when
+ * that still leaves at least DetectOptions::max_side pixels on the long side.
+ */
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+/**
+ * @brief Read-only memory mapping of a whole file
+ * 
+ * Uses mmap() on POSIX and CreateFileMapping() on Windows. Move-only; the
+ * mapping is released by the destructor.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Map @p path read-only, replacing any previous mapping
+     * @return False if the file cannot be opened or is empty
+     */
+    bool open(const std::string& path);
+
+    /// @brief Release the mapping
+    void close();
+
+    /// @brief Mapped bytes (nullptr if not open)
+    const std::uint8_t* data() const { return data_; }
+
+    /// @brief Size of the mapping in bytes
+    size_t size() const { return size_; }
+
+    /// @brief True if a file is mapped
+    bool isOpen() const { return data_ != nullptr; }
+
+private:
+    const std::uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;     ///< HANDLE of the file
+    void* mapping_ = nullptr;  ///< HANDLE of the file mapping
+#endif
+};
+
+/**
+ * @brief Container format and stored dimensions of an encoded image
+ */
+struct ImageHeader {
+    /// @brief Recognized container formats
+    enum class Format { Unknown, Jpeg, Png };
+
+    Format format = Format::Unknown;  ///< Container format
+    int width = 0;                    ///< Stored width (before EXIF orientation)
+    int height = 0;                   ///< Stored height (before EXIF orientation)
+    int orientation = 1;              ///< EXIF orientation tag (1-8; 5-8 swap width and height)
+};
+
+/**
+ * @brief Read the dimensions of a JPEG (SOFn marker) or PNG (IHDR chunk)
+ * 
+ * JPEG headers also report the EXIF orientation found before the frame header.
+ * 
+ * @param data Encoded file bytes
+ * @param size Number of bytes
+ * @return Header if the format is recognized and the dimensions are valid
+ */
+std::optional<ImageHeader> probeImageHeader(const std::uint8_t* data, size_t size);
+
+/**
+ * @brief Largest decode reduction (1, 2, 4 or 8) that keeps enough resolution
+ * 
+ * @param hdr Probed header
+ * @param max_side Long-side target of the detector (0 = full resolution)
+ * @return Reduction factor; always 1 for non-JPEG input
+ * 
+ * @note The reduced long side ceil(L / f) never drops below @p max_side
+ */
+int chooseDecodeReduction(const ImageHeader& hdr, int max_side);
+
+/**
+ * @brief Decoded frame plus the geometry needed to map results back
+ */
+struct DecodedImage {
+    /// @brief Decoded pixels (CV_8UC3, empty on failure)
+    cv::Mat bgr;
+
+    /// @brief Size of the image when decoded at full resolution
+    cv::Size full_size;
+
+    /// @brief Decode reduction used (1 = full resolution)
+    int reduction = 1;
+};
+
+/**
+ * @brief Decode an image file, at reduced size when @p max_side allows it
+ * 
+ * @param path Image file
+ * @param max_side Long-side target (0 = always decode at full resolution)
+ * @param out Decoded image; out.bgr is empty if the file could not be decoded
+ * @return True on success
+ * 
+ * @note Falls back to cv::imread() when the file cannot be memory-mapped
+ */
+bool decodeImage(const std::string& path, int max_side, DecodedImage& out);
+
+/**
+ * @brief Decode an encoded image held in memory (same rules as decodeImage())
+ * 
+ * @param data Encoded bytes (not copied)
+ * @param size Number of bytes
+ * @param max_side Long-side target (0 = always decode at full resolution)
+ * @param out Decoded image; out.bgr is empty if the bytes could not be decoded
+ * @return True on success
+ */
+bool decodeImageBuffer(const std::uint8_t* data, size_t size, int max_side, DecodedImage& out);
@@ -8,9 +8,117 @@
  */
 #pragma once
 #include <opencv2/opencv.hpp>
+#include <cstdint>
 #include <optional>
 #include <string>
+#include <vector>
 #include "marker_types.hpp"
+#include "color_segmenter.hpp"
+#include "frame_precheck.hpp"
+#include "geometry.hpp"
+#include "grid_detector.hpp"
+#include "row_source.hpp"
+#include "scratch_mat.hpp"
+
+/**
+ * @brief Per-thread scratch state for MarkerDetector::detect()
+ * 
+ * Keeps every intermediate image of the pipeline (segmentation planes, masks,
+ * contours, warped square) between calls. Buffers only grow, so processing a
+ * stream of frames, even of varying size, reaches a steady state with no
+ * per-frame allocations.
+ * 
+ * @warning Not thread-safe: hold one workspace per thread
+ * 
+ * @example
+ * ```cpp
+ * MarkerDetector detector;
+ * DetectorWorkspace ws;               // one per thread, reused for every frame
+ * while (grab(frame)) {
+ *     auto res = detector.detect(frame, opts, ws);
+ * }
+ * ```
+ */
+struct DetectorWorkspace {
+    /// @brief Segmenter (buffers + CLAHE) for the full (or pyramid) frame
+    ColorSegmenter seg;
+
+    /// @brief Segmenter for the warped square; its HSV planes also feed the
+    ///        relaxed retry and the colorful-cells check
+    ColorSegmenter seg_warp;
+
+    /// @brief Early-exit cascade buffers (DetectOptions::precheck)
+    precheck::PrecheckWorkspace precheck;
+
+    /// @brief Quad extraction buffers
+    geom::QuadWorkspace quad;
+
+    /// @brief Grid validation buffers
+    grid::GridWorkspace grid;
+
+    /// @brief Color sample buffers of the lattice check (WarpedMaskSource::Lattice)
+    grid::LatticeWorkspace lattice;
+
+    /// @brief Warped square and its homography
+    geom::WarpResult warp;
+
+    /// @brief Pyramid-downscaled frame (CV_8UC3)
+    ScratchMat small;
+
+    /// @brief Pyramid-downscaled NV12 luma (CV_8UC1, detectNV12())
+    ScratchMat small_y;
+
+    /// @brief Pyramid-downscaled NV12 chroma (CV_8UC2, detectNV12())
+    ScratchMat small_uv;
+
+    /// @brief Full-frame allowed-color mask (CV_8UC1)
+    ScratchMat mask;
+
+    /// @brief Warped-square mask (CV_8UC1)
+    ScratchMat warped_mask;
+
+    /// @brief Device segmentation buffers (ComputeBackend::OpenCL)
+    OclSegWorkspace ocl_seg;
+
+    /// @brief Uploaded frame region (CV_8UC3, ComputeBackend::OpenCL)
+    cv::UMat frame_dev;
+
+    /// @brief Pyramid-downscaled device frame (CV_8UC3, ComputeBackend::OpenCL)
+    cv::UMat small_dev;
+
+    /// @brief Timings and counters of the last call (overwritten by every call)
+    DetectionStats stats;
+
+    /// @brief Per-candidate workspaces of detectAll() (one per validated quad)
+    std::vector<DetectorWorkspace> candidates;
+
+    /// @brief Rasterized marker polygons for the union coverage of detectAll() (CV_8UC1)
+    ScratchMat union_mask;
+
+    /// @brief Strip being reduced by detectStreaming() (CV_8UC3)
+    ScratchMat stream_strip;
+
+    /// @brief Coarse view built by detectStreaming() (CV_8UC3)
+    ScratchMat stream_coarse;
+
+    /// @brief Full-resolution quad region pulled by detectStreaming() (CV_8UC3)
+    ScratchMat stream_roi;
+
+    /// @brief Per-column block sums of the strip reduction
+    std::vector<std::uint32_t> stream_sums;
+};
+
+/**
+ * @brief All markers found in one frame by MarkerDetector::detectAll()
+ */
+struct MultiDetectionResult {
+    /// @brief Validated markers, largest first
+    std::vector<DetectionResult> markers;
+
+    /// @brief Area covered by the union of all marker polygons, as percentage of the image (0.0-100.0)
+    /// @note Overlapping polygons are counted once
+    double union_coverage_percent = 0.0;
+};
 
 /**
  * @brief Complete pipeline for detecting 3×3 color grid markers
@@ -24,7 +132,8 @@
  * 6. Result validation and output
  * 
  * @note This class is thread-safe and stateless - the same instance
- *       can be used to process multiple images concurrently.
+ *       can be used to process multiple images concurrently (give each
+ *       thread its own DetectorWorkspace when using the workspace overload).
  * 
  * @example
  * ```cpp
@@ -66,4 +175,141 @@ public:
         detect(const cv::Mat& bgr,
             const DetectOptions& opt,
             const std::string& image_path_hint = "") const;
+
+    /**
+     * @brief Detect a marker using caller-owned scratch buffers
+     * 
+     * Same result as detect(bgr, opt, image_path_hint), but all intermediate
+     * images live in @p ws and are reused on the next call. Per-stage timings
+     * and counters of the call are left in ws.stats.
+     * 
+     * @param bgr Input image in BGR color format (CV_8UC3)
+     * @param opt Detection and validation options
+     * @param ws Per-thread workspace (must not be shared between threads)
+     * @param image_path_hint Optional filename for debug logging and output naming
+     */
+    std::optional<DetectionResult>
+        detect(const cv::Mat& bgr,
+            const DetectOptions& opt,
+            DetectorWorkspace& ws,
+            const std::string& image_path_hint = "") const;
+
+    /**
+     * @brief Detect a marker in an NV12 frame without converting it to BGR
+     * 
+     * Camera and decoder frames usually arrive as NV12; the segmenter derives
+     * hue and saturation from the chroma plane and brightness from luma
+     * (ColorSegmenter::prepareNV12()), corners are refined on Y and the grid
+     * check warps both planes. Results match detect() on the converted frame
+     * up to small rounding differences in the color planes.
+     * 
+     * @param y Luma plane (CV_8UC1, even width and height)
+     * @param uv Interleaved UV plane (CV_8UC2, half width and height)
+     * @param opt Detection and validation options (opt.precheck and the
+     *            OpenCL backend are not used for NV12)
+     * @param ws Per-thread workspace (must not be shared between threads)
+     * @param image_path_hint Optional filename for debug logging and output naming
+     * 
+     * @return DetectionResult if marker found and validated, std::nullopt otherwise
+     *         (also for mismatched plane sizes or types)
+     */
+    std::optional<DetectionResult>
+        detectNV12(const cv::Mat& y,
+            const cv::Mat& uv,
+            const DetectOptions& opt,
+            DetectorWorkspace& ws,
+            const std::string& image_path_hint = "") const;
+
+    /**
+     * @brief detectNV12() with a temporary workspace
+     */
+    std::optional<DetectionResult>
+        detectNV12(const cv::Mat& y,
+            const cv::Mat& uv,
+            const DetectOptions& opt,
+            const std::string& image_path_hint = "") const;
+
+    /**
+     * @brief Detect a marker whose quad lies inside a region of interest
+     * 
+     * Segmentation and quad extraction only look at @p roi; warping, grid
+     * validation and coverage use the full frame, so the result is expressed
+     * in full-frame coordinates and coverage is relative to the whole image.
+     * 
+     * @param bgr Input image in BGR color format (CV_8UC3)
+     * @param roi Search region (clipped to the image)
+     * @param opt Detection and validation options
+     * @param ws Per-thread workspace (must not be shared between threads)
+     * @param image_path_hint Optional filename for debug logging and output naming
+     * 
+     * @note Used by MarkerTracker to follow a marker between video frames
+     */
+    std::optional<DetectionResult>
+        detectInRoi(const cv::Mat& bgr,
+            const cv::Rect& roi,
+            const DetectOptions& opt,
+            DetectorWorkspace& ws,
+            const std::string& image_path_hint = "") const;
+
+    /**
+     * @brief Detect a marker in an image read strip by strip
+     * 
+     * For images too large to decode whole (e.g. orthophoto tiles). The source
+     * is read once in strips of a few hundred rows, each box-filtered into a
+     * coarse view whose long side is at most opt.max_side; segmentation, the
+     * precheck and quad extraction run on that view. Only the quad's bounding
+     * box is then read at full resolution, for corner refinement, the warp and
+     * grid validation. Peak memory is one strip, the coarse view and the quad
+     * region, independent of the image size.
+     * 
+     * Results follow detect() up to the downscaling filter (an exact f×f box
+     * mean here, cv::INTER_AREA there). The polygon is in full-image coordinates
+     * and coverage is relative to the whole image.
+     * 
+     * @param src Image rows (e.g. NetpbmRowSource over a mapped file)
+     * @param opt Detection and validation options (opt.max_side = 0 keeps the
+     *            coarse view at full resolution; the OpenCL backend is only used for segmentation)
+     * @param ws Per-thread workspace (must not be shared between threads)
+     * @param image_path_hint Optional filename for debug logging and output naming
+     */
+    std::optional<DetectionResult>
+        detectStreaming(const RowSource& src,
+            const DetectOptions& opt,
+            DetectorWorkspace& ws,
+            const std::string& image_path_hint = "") const;
+
+    /**
+     * @brief Detect every 3x3 marker in a frame
+     * 
+     * Segments the frame once, takes the @p max_markers largest quad candidates
+     * from the shared mask (geom::findQuadCandidates) and validates them
+     * concurrently (cv::parallel_for_), each with its own warp, grid check and
+     * coverage guard exactly as in detect().
+     * 
+     * @param bgr Input image in BGR color format (CV_8UC3)
+     * @param opt Detection and validation options (opt.quad_engine is not used)
+     * @param ws Per-thread workspace (must not be shared between threads)
+     * @param max_markers Maximum number of candidates evaluated (K)
+     * @param image_path_hint Optional filename for debug logging and output naming
+     * 
+     * @return Validated markers and their union coverage (empty if none)
+     * 
+     * @note Candidates run sequentially when opt.debug is set, to keep logs readable
+     * @note ws.stats holds the shared segmentation plus summed per-candidate stage times
+     */
+    MultiDetectionResult
+        detectAll(const cv::Mat& bgr,
+            const DetectOptions& opt,
+            DetectorWorkspace& ws,
+            int max_markers = 8,
+            const std::string& image_path_hint = "") const;
+
+    /**
+     * @brief detectAll() with a temporary workspace
+     */
+    MultiDetectionResult
+        detectAll(const cv::Mat& bgr,
+            const DetectOptions& opt,
+            int max_markers = 8,
+            const std::string& image_path_hint = "") const;
 };
@@ -0,0 +1,98 @@
+/**
+ * @file marker_tracker.hpp
+ * @brief Temporal tracking of a marker across video frames
+ * 
+ * MarkerTracker follows a marker between consecutive frames by searching only
+ * an expanded ROI around the previous polygon, and falls back to full-frame
+ * detection when the ROI result cannot be trusted.
+ */
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <optional>
+#include "marker_detector.hpp"
+#include "marker_types.hpp"
+
+/**
+ * @brief Tuning of the ROI tracking heuristics
+ */
+struct TrackOptions {
+    /// @brief ROI = previous polygon bounding box expanded by this fraction of its size on each side
+    double roi_margin = 0.25;
+
+    /// @brief Minimum ROI expansion in pixels (handles small markers and fast motion)
+    int min_margin_px = 16;
+
+    /// @brief Relative coverage change vs. the previous frame that forces a full re-detect
+    /// @note 0.25 = a jump of more than ±25% of the previous coverage
+    double max_coverage_jump = 0.25;
+
+    /// @brief Force a full-frame detection every N frames (0 = only on failure)
+    int redetect_interval = 0;
+};
+
+/**
+ * @brief Stateful per-stream marker tracker
+ * 
+ * Each update() segments only the ROI around the last polygon. A full-frame
+ * detect() is used when there is no previous result, the frame size changed,
+ * the ROI result fails grid validation, the quad touches the ROI border
+ * (marker may extend beyond it), or coverage jumps by more than
+ * TrackOptions::max_coverage_jump.
+ * 
+ * @warning Not thread-safe: use one tracker per stream / thread
+ * 
+ * @example
+ * ```cpp
+ * MarkerTracker tracker(opts);
+ * while (cap.read(frame)) {
+ *     if (auto r = tracker.update(frame)) draw(r->polygon);
+ * }
+ * ```
+ */
+class MarkerTracker {
+public:
+    /**
+     * @brief Create a tracker with fixed detection and tracking options
+     */
+    explicit MarkerTracker(const DetectOptions& opt, const TrackOptions& topt = TrackOptions());
+
+    /**
+     * @brief Process the next frame of the stream
+     * 
+     * @param bgr Frame in BGR color format (CV_8UC3)
+     * @return Detection for this frame, or nullopt if the marker was not found
+     */
+    std::optional<DetectionResult> update(const cv::Mat& bgr);
+
+    /**
+     * @brief Seed the tracker with a known result (e.g. from a previous run)
+     * 
+     * @param prev Result whose polygon defines the ROI for the next frame
+     * @param frame_size Size of the frame @p prev was measured on
+     */
+    void seed(const DetectionResult& prev, const cv::Size& frame_size);
+
+    /// @brief Drop the previous result; the next update() runs full-frame detection
+    void reset();
+
+    /// @brief True if the next update() will try the ROI path
+    bool tracking() const { return prev_.has_value(); }
+
+    /// @brief True if the last update() was answered from the ROI without fallback
+    bool lastWasTracked() const { return last_tracked_; }
+
+    /// @brief Timings and counters of the last detector call (the fallback, if one ran)
+    const DetectionStats& lastStats() const { return ws_.stats; }
+
+private:
+    std::optional<DetectionResult> tryRoi(const cv::Mat& bgr);
+
+    MarkerDetector detector_;
+    DetectOptions opt_;
+    TrackOptions topt_;
+    DetectorWorkspace ws_;
+    std::optional<DetectionResult> prev_;
+    cv::Size prev_size_;
+    int since_full_ = 0;
+    bool last_tracked_ = false;
+};
@@ -4,15 +4,22 @@
  * 
  * This file defines the main types used throughout the marker detection pipeline:
  * - DetectionResult: Output of successful marker detection
+ * - DetectionStats: Per-stage timings and counters of one detect() call
  * - DetectOptions: Configuration parameters for detection behavior
  * 
  * Supported marker colors: red, green, yellow, blue, magenta, cyan
  */
 #pragma once
 #include <opencv2/opencv.hpp>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <optional>
+#include <memory>
+#include "geometry.hpp"
+
+class ColorProfile;
+class DebugWriter;
 
 /**
  * @brief Result of marker detection for a single image
@@ -31,6 +38,122 @@ struct DetectionResult {
     bool grid_ok = false;
 };
 
+/**
+ * @brief Why the early-exit cascade (DetectOptions::precheck) rejected a frame
+ */
+enum class PrecheckReject : std::uint8_t {
+    /// @brief Not rejected (or the cascade did not run)
+    None = 0,
+
+    /// @brief Thumbnail has too few marker-colored pixels
+    FewColors,
+
+    /// @brief Thumbnail shows fewer distinct marker colors than a board has
+    FewHues,
+
+    /// @brief Coarse mask has no blob large enough to be a marker
+    NoBlob
+};
+
+/**
+ * @brief Per-stage timings and counters of one detection call
+ * 
+ * Filled on every call (also when no marker is found), independently of
+ * DetectOptions::debug. Stages that were not reached keep a time of 0.
+ */
+struct DetectionStats {
+    // === Stage timings (milliseconds) ===
+    /// @brief (1) Segmentation, including the pyramid downscale
+    double seg_ms = 0.0;
+
+    /// @brief (2) Quad extraction, back-mapping and corner refinement
+    double quad_ms = 0.0;
+
+    /// @brief (3) Warp to square and warped-mask segmentation
+    double warp_ms = 0.0;
+
+    /// @brief (4) Grid validation (seams, cells, colorful fallback)
+    double grid_ms = 0.0;
+
+    /// @brief (5) Final polygon step
+    double refine_ms = 0.0;
+
+    /// @brief (0) Early-exit cascade (0 unless DetectOptions::precheck)
+    double precheck_ms = 0.0;
+
+    /// @brief Whole call, from input guard to result
+    double total_ms = 0.0;
+
+    // === Counters ===
+    /// @brief Nonzero pixels of the full-frame (or pyramid) allowed-color mask
+    int mask_nonzero = 0;
+
+    /// @brief Sparse-mask relaxation steps taken by the full-frame segmentation (0-2)
+    int relax_attempts = 0;
+
+    /// @brief True if the white-rim safety brake kept the full-frame mask unchanged
+    bool rim_brake = false;
+
+    /// @brief True if the warped mask was too sparse and re-segmented with relaxed S/V
+    bool warped_relax = false;
+
+    /// @brief True if the warped mask was obtained by warping the frame mask
+    bool mask_warped = false;
+
+    /// @brief True if the warped frame mask failed and the warped view was re-segmented
+    bool warped_resegmented = false;
+
+    /// @brief True if grid validation sampled the frame mask on a lattice (no warp)
+    bool lattice = false;
+
+    /// @brief True if segmentation ran on a max_side-downscaled copy
+    bool pyramid = false;
+
+    /// @brief True if segmentation and warping ran on the OpenCL device
+    bool opencl = false;
+
+    /// @brief Stage of the early-exit cascade that rejected the frame (None = passed or off)
+    PrecheckReject precheck_reject = PrecheckReject::None;
+
+    /// @brief True if a quad was found (stage 2 succeeded)
+    bool quad_found = false;
+
+    /// @brief True if a marker was reported
+    bool found = false;
+};
+
+/**
+ * @brief Where the per-pixel stages of the pipeline run
+ */
+enum class ComputeBackend {
+    /// @brief Host cv::Mat code (fused LUT classifier, SIMD)
+    Cpu,
+
+    /// @brief OpenCV T-API (cv::UMat) on the default OpenCL device
+    /// @note Frame segmentation and the warp run on the device; only the frame
+    ///       mask and the warped square are downloaded. Falls back to Cpu when
+    ///       no OpenCL device is available
+    OpenCL
+};
+
+/**
+ * @brief Source of the warped-square mask used for grid validation
+ */
+enum class WarpedMaskSource {
+    /// @brief Re-run segmentation on the warped BGR square (with one relaxed retry)
+    Segment,
+
+    /// @brief Warp the stage-1 frame mask through the same homography (INTER_NEAREST)
+    /// @note Skips the second segmentation; see DetectOptions::warped_mask_fallback
+    FrameMask,
+
+    /// @brief No warped square: sample the frame mask and image on a sparse lattice
+    ///        of cell interiors and seam lines mapped through the homography
+    /// @note A few hundred lookups instead of the N×N warp and segmentation; see
+    ///       grid::latticeMaskChecks() and DetectOptions::warped_mask_fallback
+    Lattice
+};
+
 /**
  * @brief Configuration options for marker detection pipeline
  * 
@@ -47,6 +170,10 @@ struct DetectOptions {
     
     /// @brief Output directory for debug artifacts (created if non-existent)
     std::string save_debug_dir = "out";
+
+    /// @brief Background writer for debug artifacts (sampling, format, queue budget)
+    /// @note nullptr = every image's artifacts are written synchronously as PNG
+    std::shared_ptr<DebugWriter> debug_writer;
     
     /// @brief Resolution of warped square image for grid validation (NxN pixels)
     /// @note Minimum 32, recommended 320+ for accuracy
@@ -61,10 +188,46 @@ struct DetectOptions {
     /// @note Lower values increase sensitivity but may cause false positives
     double min_cell_fraction = 0.15;
 
+    /// @brief Grid layout of the marker (rows x cols cells; 3x3 reference board)
+    /// @note Seams, cells and the colorful fallback all follow this layout
+    int grid_rows = 3;
+
+    /// @brief See grid_rows
+    int grid_cols = 3;
+
     // === Performance and Preprocessing ===
-    /// @brief Resize input so max(width,height) ≤ max_side (0 = disable)
-    /// @note Improves performance for high-resolution images
+    /// @brief Coarse-to-fine limit: segmentation and quad extraction run on a copy
+    ///        downscaled so max(width,height) ≤ max_side (0 = disable)
+    /// @note The quad is mapped back to full resolution before warping and coverage
     int max_side = 1024;
+
+    /// @brief Refine pyramid-mapped quad corners to sub-pixel accuracy in full-res ROIs
+    /// @note Only used when the frame was downscaled by max_side
+    bool refine_corners = true;
+
+    /// @brief Run the early-exit cascade (thumbnail colors, coarse blob) before segmentation
+    /// @note Frames it rejects are reported as not found without full segmentation;
+    ///       see frame_precheck.hpp. detectInRoi() (tracking) skips it
+    bool precheck = false;
+
+    /// @brief Device for segmentation and the warp (see ComputeBackend)
+    ComputeBackend backend = ComputeBackend::Cpu;
+
+    /// @brief Horizontal stripes the CPU segmentation of one frame runs in
+    ///        (1 = serial, 0 = one per OpenCV thread), see SegOptions::stripes
+    /// @note Results are identical for every value; only useful when OpenCV has
+    ///       threads to spare (e.g. one large frame at a time, --frame-threads)
+    int seg_stripes = 1;
+
+    /// @brief Blob selection strategy of the quad finder
+    /// @note Components labels the mask once and traces only the largest blob (faster on clutter)
+    geom::QuadEngine quad_engine = geom::QuadEngine::Contours;
+
+    /// @brief How the warped-square mask for grid validation is produced
+    WarpedMaskSource warped_mask = WarpedMaskSource::Segment;
+
+    /// @brief With WarpedMaskSource::FrameMask or Lattice: re-segment the warped view if the grid check fails
+    bool warped_mask_fallback = false;
     
     /// @brief Gaussian blur kernel size for preprocessing (odd ≥3, 0 = disable)
     /// @note Helps with noisy images but may blur fine details
@@ -84,4 +247,8 @@ struct DetectOptions {
     /// @brief Global minimum value/brightness threshold (0-255)
     /// @note Higher values = reject darker colors
     int seg_vmin = 65;
+
+    /// @brief Marker palette, shared by segmentation and the early-exit cascade
+    ///        (nullptr = built-in palette), e.g. from ColorProfile::load()
+    std::shared_ptr<const ColorProfile> color_profile;
 };
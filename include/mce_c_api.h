@@ -0,0 +1,147 @@
+/**
+ * @file mce_c_api.h
+ * @brief Stable C ABI of the marker detector (shared library mce_shared)
+ *
+ * Lets services written in other languages (Go via cgo, Python via ctypes or
+ * cffi, ...) run detection in-process on raw pixel buffers instead of
+ * spawning the CLI. All structs are plain C and caller-owned.
+ *
+ * Threading: a detector handle may be used from any number of threads at
+ * once. Each concurrent call borrows a per-thread workspace from the handle's
+ * pool, so steady-state calls do not allocate.
+ *
+ * ABI rules: functions are only ever added; option structs carry their size
+ * (mce_options::struct_size) so that new trailing fields stay compatible
+ * with callers built against an older header.
+ *
+ * @example
+ * ```c
+ * mce_options opt;
+ * mce_options_init(&opt);
+ * mce_detector* det = mce_detector_create(&opt);
+ *
+ * mce_image img = { 0 };
+ * img.format = MCE_FORMAT_BGR;
+ * img.data = pixels; img.width = w; img.height = h; img.stride = w * 3;
+ *
+ * mce_result res;
+ * if (mce_detect(det, &img, &res) == MCE_OK) printf("%.2f%%\n", res.coverage_percent);
+ * mce_detector_destroy(det);
+ * ```
+ */
+#ifndef MCE_C_API_H
+#define MCE_C_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  if defined(MCE_BUILDING_SHARED)
+#    define MCE_API __declspec(dllexport)
+#  elif defined(MCE_USING_SHARED)
+#    define MCE_API __declspec(dllimport)
+#  else
+#    define MCE_API
+#  endif
+#else
+#  define MCE_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief ABI version returned by mce_abi_version() */
+#define MCE_ABI_VERSION 1
+
+/** @brief Result codes (negative = error) */
+typedef enum mce_status {
+    MCE_OK = 0,                     /**< Marker found, result filled */
+    MCE_NOT_FOUND = 1,              /**< No validated marker in the image */
+    MCE_ERR_INVALID_ARGUMENT = -1,  /**< Null pointer, bad size/stride/format */
+    MCE_ERR_INTERNAL = -2           /**< Unexpected failure; see mce_last_error() */
+} mce_status;
+
+/** @brief Layout of the pixels in mce_image */
+typedef enum mce_pixel_format {
+    MCE_FORMAT_BGR = 0,   /**< 3 bytes per pixel, B G R (used without copying) */
+    MCE_FORMAT_RGB = 1,   /**< 3 bytes per pixel, R G B */
+    MCE_FORMAT_BGRA = 2,  /**< 4 bytes per pixel, B G R A (alpha ignored) */
+    MCE_FORMAT_NV12 = 3   /**< 8-bit Y plane + interleaved UV plane at half resolution (used without copying) */
+} mce_pixel_format;
+
+/** @brief Caller-owned view of an image; nothing is retained after the call */
+typedef struct mce_image {
+    const uint8_t* data;      /**< First pixel (Y plane for NV12) */
+    int32_t width;            /**< Width in pixels (even for NV12) */
+    int32_t height;           /**< Height in pixels (even for NV12) */
+    int32_t stride;           /**< Bytes between rows of data */
+    int32_t format;           /**< mce_pixel_format */
+    const uint8_t* uv;        /**< NV12 only: UV plane (NULL = directly after the Y plane) */
+    int32_t uv_stride;        /**< NV12 only: bytes between UV rows (0 = stride) */
+} mce_image;
+
+/** @brief Detection options; always initialize with mce_options_init() */
+typedef struct mce_options {
+    uint32_t struct_size;       /**< sizeof(mce_options), set by mce_options_init() */
+    int32_t strict_grid;        /**< Nonzero: require seams and cells (default 1) */
+    double min_cell_fraction;   /**< Minimum allowed-color fraction per cell (default 0.15) */
+    int32_t max_side;           /**< Coarse-to-fine limit in pixels (default 1024, 0 = off) */
+    int32_t warp_size;          /**< Warped square side for grid validation (default 320) */
+    int32_t grid_rows;          /**< Grid rows (default 3) */
+    int32_t grid_cols;          /**< Grid columns (default 3) */
+    int32_t quad_engine;        /**< 0 = contours, 1 = connected components */
+    int32_t precheck;           /**< Nonzero: early-exit cascade for marker-free frames */
+    int32_t backend;            /**< 0 = CPU, 1 = OpenCL (falls back to CPU) */
+} mce_options;
+
+/** @brief Detection result written into caller-owned memory */
+typedef struct mce_result {
+    double coverage_percent;  /**< Marker area as percentage of the image (0-100) */
+    float polygon[8];         /**< 4 corners x0,y0,...,x3,y3, clockwise from top-left, in pixels */
+    int32_t grid_ok;          /**< Nonzero if grid validation passed */
+    double total_ms;          /**< Wall time of the detection (excluding format conversion) */
+} mce_result;
+
+/** @brief Opaque, thread-safe detector handle */
+typedef struct mce_detector mce_detector;
+
+/** @brief ABI version of the loaded library (MCE_ABI_VERSION it was built with) */
+MCE_API uint32_t mce_abi_version(void);
+
+/** @brief Fill @p opt with the library defaults */
+MCE_API void mce_options_init(mce_options* opt);
+
+/**
+ * @brief Create a detector
+ * @param opt Options (NULL = defaults); copied, may be freed afterwards
+ * @return Handle, or NULL on failure (see mce_last_error())
+ */
+MCE_API mce_detector* mce_detector_create(const mce_options* opt);
+
+/** @brief Destroy a detector; no call may be in flight on it. NULL is ignored */
+MCE_API void mce_detector_destroy(mce_detector* det);
+
+/**
+ * @brief Detect the marker in one image
+ * @param det Detector handle (shared between threads)
+ * @param img Input pixels
+ * @param out Result; filled only when MCE_OK is returned
+ * @return MCE_OK, MCE_NOT_FOUND or a negative error
+ */
+MCE_API mce_status mce_detect(mce_detector* det, const mce_image* img, mce_result* out);
+
+/** @brief Static English name of a status code */
+MCE_API const char* mce_status_string(mce_status status);
+
+/**
+ * @brief Message of the last error on the calling thread ("" if none)
+ * @note Valid until the next mce_* call on the same thread
+ */
+MCE_API const char* mce_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCE_C_API_H */
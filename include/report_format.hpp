@@ -0,0 +1,45 @@
+/**
+ * @file report_format.hpp
+ * @brief Small helpers shared by the JSON/CSV report writers
+ *
+ * Used by the stats aggregator, the golden-dataset scorer and the trace
+ * exporter so that their outputs escape strings and rank samples alike.
+ */
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace report {
+
+    /**
+     * @brief Nearest-rank percentile of sorted samples
+     *
+     * @param sorted Samples in ascending order
+     * @param q Quantile in [0,1]
+     * @return The sample at rank ceil(q·n) (at least the first), 0 if empty
+     */
+    inline double percentile(const std::vector<double>& sorted, double q) {
+        if (sorted.empty()) return 0.0;
+        const size_t rank = (size_t)std::ceil(q * (double)sorted.size());
+        return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+    }
+
+    /**
+     * @brief Write @p s as a quoted JSON string (quotes, backslash, control chars escaped)
+     */
+    inline void writeJsonString(std::ostream& os, std::string_view s) {
+        os << '"';
+        for (unsigned char c : s) {
+            if (c == '"' || c == '\\') os << '\\' << (char)c;
+            else if (c < 0x20) os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c
+                << std::dec << std::setfill(' ');
+            else os << (char)c;
+        }
+        os << '"';
+    }
+
+} // namespace report
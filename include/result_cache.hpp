@@ -0,0 +1,127 @@
+/**
+ * @file result_cache.hpp
+ * @brief Persistent detection results keyed by file content and options
+ *
+ * Re-processing an archive redoes decoding and detection for images whose
+ * results are already known. A ResultCache stores each DetectionResult (or
+ * "no marker") under the XXH64 hash of the encoded file bytes plus a hash of
+ * the result-affecting DetectOptions, in an append-only file that is
+ * memory-mapped on open. BatchRunner looks results up before decoding, so a
+ * hit costs one read of the file bytes and a hash-table lookup.
+ *
+ * File layout (little-endian): a 16-byte header ("MCERCACH", version, record
+ * size) followed by fixed-size records, each with its own checksum. A
+ * partial record at the end (e.g. from a killed run) is cut off on open, and
+ * records failing their checksum are skipped.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include "image_source.hpp"
+#include "marker_types.hpp"
+
+/**
+ * @brief XXH64 hash of @p size bytes (https://github.com/Cyan4973/xxHash)
+ */
+std::uint64_t xxh64(const void* data, size_t size, std::uint64_t seed = 0);
+
+/**
+ * @brief Hash of the DetectOptions fields that can change a result
+ *
+ * Covers thresholds, grid layout, resolution limits, engines, morphology and
+ * the color profile's palette; ignores debug output and parallelism
+ * (seg_stripes), which never change results.
+ *
+ * @param opt Detection options
+ * @param salt Extra caller state that changes results (e.g. reduced JPEG decode)
+ */
+std::uint64_t optionsHash(const DetectOptions& opt, std::uint64_t salt = 0);
+
+/**
+ * @brief Append-only, memory-mapped store of detection results
+ *
+ * @note Thread-safe: lookups and inserts may come from any thread. One
+ *       process should write a cache file at a time.
+ *
+ * @example
+ * ```cpp
+ * std::string err;
+ * auto cache = ResultCache::open("results.mcecache", &err);
+ * if (!cache) { std::cerr << err << "\n"; return 2; }
+ * bopt.cache = cache;          // BatchRunner now skips decode + detect on hits
+ * ```
+ */
+class ResultCache {
+public:
+    /// @brief Cache key: content hash and size of the encoded file, options hash
+    struct Key {
+        std::uint64_t content = 0;
+        std::uint64_t size = 0;
+        std::uint64_t options = 0;
+    };
+
+    /// @brief Most polygon vertices a record holds (results with more are not cached)
+    static constexpr int kMaxPoints = 8;
+
+    /**
+     * @brief Open (or create) a cache file
+     *
+     * @param path Cache file; created if missing
+     * @param error Receives the reason on failure (may be nullptr)
+     * @return The cache, or nullptr if the file cannot be created or is not a cache file
+     */
+    static std::shared_ptr<ResultCache> open(const std::string& path, std::string* error = nullptr);
+
+    ~ResultCache();
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    /// @brief Key of an encoded file's bytes under the options hash @p options
+    static Key key(const std::uint8_t* data, size_t size, std::uint64_t options);
+
+    /**
+     * @brief Look a result up
+     *
+     * @param k Key of the file and options
+     * @param result Receives the stored result (nullopt = no marker was found)
+     * @return True on a hit
+     */
+    bool find(const Key& k, std::optional<DetectionResult>& result) const;
+
+    /**
+     * @brief Record a result (nullopt = no marker) and append it to the file
+     * @return False if it cannot be stored (too many vertices, write error)
+     */
+    bool insert(const Key& k, const std::optional<DetectionResult>& result);
+
+    /// @brief Records available to find()
+    size_t size() const;
+
+    /// @brief find() calls that hit / missed so far
+    size_t hits() const;
+    size_t misses() const;
+
+private:
+    ResultCache() = default;
+
+    struct Entry {
+        Key key;
+        std::optional<DetectionResult> result;
+    };
+
+    static std::uint64_t slot(const Key& k);
+
+    mutable std::mutex m_;
+    MappedFile map_;                                                  ///< Records present at open
+    std::unordered_map<std::uint64_t, const std::uint8_t*> mapped_;   ///< Key slot → record in map_
+    std::unordered_map<std::uint64_t, Entry> appended_;               ///< Inserted this session
+    std::FILE* file_ = nullptr;                                       ///< Append handle
+    mutable size_t hits_ = 0;
+    mutable size_t misses_ = 0;
+};
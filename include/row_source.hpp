@@ -0,0 +1,81 @@
+/**
+ * @file row_source.hpp
+ * @brief Row-band access to images too large to hold decoded in memory
+ *
+ * MarkerDetector::detectStreaming() reads its input through a RowSource: one
+ * pass over horizontal strips to build the coarse detection view, then one
+ * rectangle (the quad's bounding box) at full resolution. A memory-mapped
+ * binary PGM/PPM file is read in place, so only the strip being processed is
+ * ever converted to BGR; a cv::Mat can be wrapped for images already decoded.
+ */
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <string>
+#include "image_source.hpp"
+
+/**
+ * @brief Random access to rectangles of a BGR image
+ *
+ * @note read() is const and implementations are safe to read concurrently.
+ */
+class RowSource {
+public:
+    virtual ~RowSource() = default;
+
+    /// @brief Size of the whole image
+    virtual cv::Size size() const = 0;
+
+    /**
+     * @brief Copy the region @p r of the image into @p out
+     *
+     * @param r Region inside the image (CV_Assert)
+     * @param out Receives r.height × r.width CV_8UC3 pixels; written in place if it
+     *            already has that size and type
+     */
+    virtual void read(const cv::Rect& r, cv::Mat& out) const = 0;
+};
+
+/**
+ * @brief RowSource over an image already in memory (not copied)
+ */
+class MatRowSource : public RowSource {
+public:
+    /// @param bgr Image (CV_8UC3); must outlive the source
+    explicit MatRowSource(const cv::Mat& bgr);
+
+    cv::Size size() const override { return bgr_.size(); }
+    void read(const cv::Rect& r, cv::Mat& out) const override;
+
+private:
+    cv::Mat bgr_;
+};
+
+/**
+ * @brief RowSource over a memory-mapped binary PGM (P5) or PPM (P6) file, 8 bits per sample
+ *
+ * Pixels are converted to BGR strip by strip straight from the mapping; pages
+ * of the mapping are clean file cache the kernel can reclaim.
+ */
+class NetpbmRowSource : public RowSource {
+public:
+    /**
+     * @brief Map @p path and parse its header
+     *
+     * @param path Image file
+     * @param error Receives the reason on failure (may be nullptr)
+     * @return The source, or nullptr if the file is not an 8-bit binary PGM/PPM
+     */
+    static std::unique_ptr<NetpbmRowSource> open(const std::string& path, std::string* error = nullptr);
+
+    cv::Size size() const override { return size_; }
+    void read(const cv::Rect& r, cv::Mat& out) const override;
+
+private:
+    NetpbmRowSource() = default;
+
+    MappedFile file_;
+    cv::Size size_;
+    int channels_ = 3;                      ///< 1 = PGM (gray), 3 = PPM (RGB)
+    const std::uint8_t* pixels_ = nullptr;  ///< First sample after the header
+};
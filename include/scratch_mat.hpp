@@ -0,0 +1,52 @@
+/**
+ * @file scratch_mat.hpp
+ * @brief Grow-only scratch image used by the per-thread workspaces
+ *
+ * A ScratchMat hands out views into a single allocation that only grows, so
+ * processing a smaller (or equally sized) frame never touches the allocator.
+ */
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+
+/**
+ * @brief Reusable backing store for one intermediate image
+ *
+ * view() returns a header of the requested size into the backing store.
+ * OpenCV functions that receive that header as output see a matching
+ * size/type and write in place instead of reallocating.
+ *
+ * Views are continuous, standalone headers (not ROIs of the store): filters
+ * that read past an ROI's edge (Sobel, dilate, GaussianBlur, ...) therefore
+ * apply their border rule at the view's edge instead of reading stale pixels
+ * of an earlier, larger frame, so results never depend on call history.
+ *
+ * @warning The returned view is overwritten by the next view() caller and
+ *          dangles once a larger view() grows the store; do not keep it
+ *          across frames
+ */
+class ScratchMat {
+public:
+    /**
+     * @brief Get a view of size @p sz and type @p type, growing the store if needed
+     */
+    cv::Mat& view(const cv::Size& sz, int type) {
+        const size_t need = (size_t)sz.width * (size_t)sz.height;
+        if (store_.empty() || store_.type() != type || store_.total() < need) {
+            const size_t keep = store_.type() == type ? store_.total() : 0;
+            store_.create(1, (int)std::max(keep, std::max<size_t>(need, 1)), type);
+        }
+        view_ = cv::Mat(sz, type, store_.data);
+        return view_;
+    }
+
+    /// @brief Current view (empty until view() is called)
+    cv::Mat& mat() { return view_; }
+
+    /// @brief Release the backing store
+    void release() { store_.release(); view_.release(); }
+
+private:
+    cv::Mat store_;   ///< 1×N continuous backing store
+    cv::Mat view_;
+};
@@ -0,0 +1,103 @@
+/**
+ * @file stats_aggregator.hpp
+ * @brief Batch-level summary of DetectionStats (percentiles per stage)
+ * 
+ * Collects the per-image stats of a batch and reports, for every pipeline
+ * stage, the p50/p95/p99/max latency and the image that was slowest, plus
+ * how often the segmentation fallbacks fired. Used by the CLI --stats option.
+ */
+#pragma once
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "marker_types.hpp"
+
+/**
+ * @brief Latency summary of one pipeline stage over a batch
+ */
+struct StageSummary {
+    std::string name;      ///< Stage name (decode, seg, quad, warp, grid, refine, total)
+    size_t n = 0;          ///< Images that reached the stage
+    double mean_ms = 0.0;  ///< Mean time
+    double p50_ms = 0.0;   ///< Median (nearest rank)
+    double p95_ms = 0.0;   ///< 95th percentile (nearest rank)
+    double p99_ms = 0.0;   ///< 99th percentile (nearest rank)
+    double max_ms = 0.0;   ///< Slowest image
+    std::string max_path;  ///< Path of the slowest image
+};
+
+/**
+ * @brief Accumulates DetectionStats and reports percentiles per stage
+ * 
+ * Stages after quad extraction only count images where a quad was found, and
+ * seg/quad skip frames rejected by the early-exit cascade, so a batch of
+ * mostly-empty frames does not drag the later percentiles to 0.
+ * 
+ * @note Not thread-safe: feed it from the batch sink (single thread)
+ * 
+ * @example
+ * ```cpp
+ * StatsAggregator agg;
+ * runner.run(paths, [&](const BatchItem& it) {
+ *     if (it.loaded) agg.add(it.path, it.stats, it.decode_ms);
+ * });
+ * agg.writeJson(std::cerr);
+ * ```
+ */
+class StatsAggregator {
+public:
+    /**
+     * @brief Record the stats of one processed image
+     * 
+     * @param path Image path (reported for the slowest image of each stage)
+     * @param st Stats of the detect call
+     * @param decode_ms Decode time of the image (0 if unknown)
+     */
+    void add(const std::string& path, const DetectionStats& st, double decode_ms = 0.0);
+
+    /// @brief Number of images recorded
+    size_t count() const { return paths_.size(); }
+
+    /// @brief Per-stage latency summaries, in pipeline order
+    std::vector<StageSummary> summary() const;
+
+    /**
+     * @brief Write the summary and counters as one JSON object
+     * 
+     * Layout: `{"images":N, "found":..., ..., "stages":{"seg":{"n":..,"p50_ms":..}, ...}}`
+     */
+    void writeJson(std::ostream& os) const;
+
+    /**
+     * @brief Write the per-stage summary as CSV (header + one row per stage)
+     * 
+     * Columns: stage,n,mean_ms,p50_ms,p95_ms,p99_ms,max_ms,max_path
+     */
+    void writeCsv(std::ostream& os) const;
+
+private:
+    /// @brief Samples of one stage: (time, index into paths_)
+    struct Samples {
+        std::vector<double> ms;
+        std::vector<size_t> who;
+    };
+
+    enum Stage { kDecode = 0, kSeg, kQuad, kWarp, kGrid, kRefine, kTotal, kStageCount };
+
+    Samples stages_[kStageCount];
+    std::vector<std::string> paths_;
+
+    // Counters
+    size_t found_ = 0;
+    size_t quad_found_ = 0;
+    size_t pyramid_ = 0;
+    size_t rim_brake_ = 0;
+    size_t warped_relax_ = 0;
+    size_t mask_warped_ = 0;
+    size_t warped_resegmented_ = 0;
+    size_t lattice_ = 0;
+    size_t relaxed_ = 0;          ///< Images with at least one relaxation step
+    long long relax_steps_ = 0;   ///< Sum of relaxation steps
+    size_t precheck_reject_[4] = {}; ///< Early-exit rejections, indexed by PrecheckReject
+};
@@ -3,7 +3,8 @@
  * @brief High-precision timing utilities for performance profiling
  * 
  * Provides a simple, lightweight timer class for measuring execution time
- * of code sections during development and debugging.
+ * of code sections during development and debugging. Finer, per-sub-step
+ * attribution (Chrome trace, Tracy, ITT, perf counters) is in trace.hpp.
  */
 #pragma once
 #include <chrono>
@@ -11,7 +12,8 @@
 /**
  * @brief High-precision timer for performance measurement
  * 
- * Uses std::chrono::high_resolution_clock for accurate timing measurements.
+ * Uses std::chrono::steady_clock, which is monotonic (unlike
+ * high_resolution_clock, which may alias the adjustable system clock).
  * Automatically starts timing on construction and provides millisecond precision.
  * 
  * @note Thread-safe for individual timer instances
@@ -31,7 +33,7 @@
 class Timer {
 public:
     /// @brief Clock type used for timing measurements
-    using clock = std::chrono::high_resolution_clock;
+    using clock = std::chrono::steady_clock;
 
     /**
      * @brief Constructor - automatically starts the timer
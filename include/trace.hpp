@@ -0,0 +1,125 @@
+/**
+ * @file trace.hpp
+ * @brief Compile-time switchable scope instrumentation for profiling
+ *
+ * MCE_TRACE_SCOPE("seg.clahe") marks the rest of the enclosing block as a
+ * named scope. Which backend receives the scopes is chosen at configure time
+ * (CMake option MCE_TRACE):
+ *
+ * - OFF (default): the macro expands to nothing; no code, no data.
+ * - CHROME: events are buffered per thread and written by writeChromeTrace()
+ *   as Chrome trace JSON (chrome://tracing, https://ui.perfetto.dev).
+ * - TRACY: every scope is also a Tracy zone (needs the Tracy client).
+ * - ITT: every scope is an ITT task (Intel VTune; needs ittnotify).
+ *
+ * MCE_TRACE_PERF=ON additionally reads per-thread perf_event counters
+ * (cycles, instructions, cache misses; Linux only) at every scope boundary,
+ * attached to Chrome events and summed by writeSummary(). Any enabled
+ * configuration keeps per-scope call counts and wall time (steady clock).
+ *
+ * @note Scope names must be string literals: sites are identified by them.
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+#if defined(MCE_TRACE_CHROME) || defined(MCE_TRACE_TRACY) || defined(MCE_TRACE_ITT) || defined(MCE_TRACE_PERF)
+#define MCE_TRACE_ENABLED 1
+#else
+#define MCE_TRACE_ENABLED 0
+#endif
+
+#if defined(MCE_TRACE_TRACY)
+#include <tracy/Tracy.hpp>
+#endif
+
+namespace trace {
+
+    /// @brief Hardware counter values (zero when perf counters are unavailable)
+    struct Counters {
+        std::uint64_t cycles = 0;         ///< CPU cycles
+        std::uint64_t instructions = 0;   ///< Retired instructions
+        std::uint64_t cache_misses = 0;   ///< Last-level cache misses
+    };
+
+    /**
+     * @brief One instrumented call site and its running totals
+     *
+     * Created once per MCE_TRACE_SCOPE (function-local static) and registered
+     * for writeSummary().
+     */
+    class Site {
+    public:
+        explicit Site(const char* name);
+        Site(const Site&) = delete;
+        Site& operator=(const Site&) = delete;
+
+        const char* name() const { return name_; }
+
+        std::atomic<std::uint64_t> calls{ 0 };
+        std::atomic<std::uint64_t> ns{ 0 };            ///< Inclusive wall time
+        std::atomic<std::uint64_t> cycles{ 0 };
+        std::atomic<std::uint64_t> instructions{ 0 };
+        std::atomic<std::uint64_t> cache_misses{ 0 };
+        std::atomic<void*> handle{ nullptr };          ///< Backend handle (ITT string handle)
+
+    private:
+        const char* name_;
+    };
+
+    /**
+     * @brief RAII scope around the rest of a block (use MCE_TRACE_SCOPE)
+     */
+    class Scope {
+    public:
+        explicit Scope(Site& site);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Site& site_;
+        std::int64_t t0_ns_;
+        Counters c0_;
+    };
+
+    /// @brief True if the library was built with any MCE_TRACE backend
+    constexpr bool enabled() { return MCE_TRACE_ENABLED != 0; }
+
+    /// @brief True if perf_event counters were compiled in and could be opened
+    bool countersAvailable();
+
+    /**
+     * @brief Write the buffered events as Chrome trace JSON
+     *
+     * Call when traced work has finished (threads still appending events are
+     * not synchronized with the writer).
+     *
+     * @return False without the CHROME backend or if @p path cannot be written
+     */
+    bool writeChromeTrace(const std::string& path);
+
+    /// @brief Per-scope table: calls, total and mean time, counters (nothing when disabled)
+    void writeSummary(std::ostream& os);
+
+    /// @brief Drop buffered events and zero every site's totals
+    void reset();
+}
+
+#define MCE_TRACE_CONCAT2(a, b) a##b
+#define MCE_TRACE_CONCAT(a, b) MCE_TRACE_CONCAT2(a, b)
+
+#if MCE_TRACE_ENABLED
+#define MCE_TRACE_SITE_SCOPE(name)                                                   \
+    static ::trace::Site MCE_TRACE_CONCAT(mce_trace_site_, __LINE__){ name };      \
+    const ::trace::Scope MCE_TRACE_CONCAT(mce_trace_scope_, __LINE__){ MCE_TRACE_CONCAT(mce_trace_site_, __LINE__) }
+#if defined(MCE_TRACE_TRACY)
+#define MCE_TRACE_SCOPE(name) ZoneScopedN(name); MCE_TRACE_SITE_SCOPE(name)
+#else
+#define MCE_TRACE_SCOPE(name) MCE_TRACE_SITE_SCOPE(name)
+#endif
+#else
+#define MCE_TRACE_SCOPE(name) static_cast<void>(0)
+#endif
@@ -0,0 +1,168 @@
+#include "batch_runner.hpp"
+#include "bounded_queue.hpp"
+#include "geometry.hpp"
+#include "image_source.hpp"
+#include "marker_detector.hpp"
+#include "result_cache.hpp"
+#include "row_source.hpp"
+#include "timer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <thread>
+
+namespace {
+    /// @brief Decoded frame waiting for a detection worker.
+    struct Frame {
+        BatchItem item;
+        cv::Mat bgr;
+        cv::Size full_size; ///< Size at full resolution (differs from bgr when reduced)
+        std::optional<ResultCache::Key> key; ///< Set when the result should be cached
+        std::unique_ptr<RowSource> rows;     ///< Set instead of bgr for streamed images
+    };
+
+    /// @brief Runs a callable when the enclosing scope is left, normally or by an exception.
+    template <typename F>
+    struct ScopeExit {
+        F f;
+        ~ScopeExit() { f(); }
+    };
+}
+
+BatchRunner::BatchRunner(const DetectOptions& opt, const BatchOptions& bopt)
+    : opt_(opt), bopt_(bopt)
+{
+    const int hw = std::max(1, (int)std::thread::hardware_concurrency());
+    jobs_ = bopt.jobs > 0 ? bopt.jobs : hw;
+    decoders_ = bopt.decode_threads > 0 ? bopt.decode_threads : std::max(1, jobs_ / 2);
+    depth_ = (size_t)(bopt.queue_depth > 0 ? bopt.queue_depth : 2 * jobs_);
+    // The decode reduction changes the pixels detect() sees, so it is part of the key.
+    // So does the streaming threshold, which picks the downscaling filter.
+    if (bopt.cache) {
+        options_hash_ = optionsHash(opt, (bopt.reduced_decode ? 1u : 0u) | ((std::uint64_t)std::max<std::int64_t>(0, bopt.stream_min_pixels) << 1));
+    }
+}
+
+void BatchRunner::run(const std::vector<std::string>& paths, const Sink& sink) const {
+    if (paths.empty()) return;
+
+    BoundedQueue<Frame> decoded(depth_);
+    // Results are small (no pixels), so the output queue only needs to absorb bursts.
+    BoundedQueue<BatchItem> done(depth_ + (size_t)jobs_);
+
+    std::atomic<size_t> next{ 0 };
+    std::atomic<int> decoders_left{ decoders_ };
+    std::atomic<int> workers_left{ jobs_ };
+    std::vector<std::thread> decoders, workers;
+
+    // Every stage is stopped and joined before the queues it uses go away,
+    // also when the sink (or starting a thread) throws: closed queues make
+    // blocked pushes fail, the stages wind down, and the exception propagates.
+    ScopeExit stop{ [&] {
+        decoded.close();
+        done.close();
+        for (auto& t : decoders) t.join();
+        for (auto& t : workers) t.join();
+    } };
+
+    // --- Decode stage: claims paths in order and runs ahead of the workers ---
+    for (int d = 0; d < decoders_; ++d) {
+        decoders.emplace_back([&] {
+            for (size_t i = next++; i < paths.size(); i = next++) {
+                Frame f;
+                f.item.index = i;
+                f.item.path = paths[i];
+                Timer t;
+                try {
+                    const int max_side = bopt_.reduced_decode ? opt_.max_side : 0;
+                    DecodedImage img;
+                    MappedFile file;
+                    if (bopt_.cache && file.open(paths[i])) {
+                        const auto key = ResultCache::key(file.data(), file.size(), options_hash_);
+                        if (bopt_.cache->find(key, f.item.result)) {
+                            f.item.cached = f.item.loaded = true;
+                            f.item.decode_ms = t.ms();
+                            if (!decoded.push(std::move(f))) break;
+                            continue;
+                        }
+                        f.key = key;
+                    }
+                    // Huge binary PGM/PPM files are read strip by strip by the worker instead.
+                    std::unique_ptr<NetpbmRowSource> rows;
+                    if (bopt_.stream_min_pixels > 0) rows = NetpbmRowSource::open(paths[i]);
+                    if (rows && (std::int64_t)rows->size().width * rows->size().height >= bopt_.stream_min_pixels) {
+                        f.full_size = rows->size();
+                        f.rows = std::move(rows);
+                    }
+                    else if (file.isOpen()) {
+                        decodeImageBuffer(file.data(), file.size(), max_side, img);
+                    }
+                    else {
+                        decodeImage(paths[i], max_side, img);
+                    }
+                    if (!f.rows) {
+                        f.bgr = std::move(img.bgr);
+                        f.full_size = img.full_size;
+                        f.item.decode_reduction = img.reduction;
+                    }
+                }
+                catch (const std::exception& e) {
+                    if (opt_.debug) std::cerr << "[debug] decode failed: " << paths[i] << " | " << e.what() << "\n";
+                }
+                f.item.decode_ms = t.ms();
+                f.item.loaded = !f.bgr.empty() || f.rows;
+                if (!f.item.loaded) f.key.reset(); // never cache a decode failure
+                if (!decoded.push(std::move(f))) break;
+            }
+            if (--decoders_left == 0) decoded.close();
+        });
+    }
+
+    // --- Detect stage: each worker owns its detector ---
+    for (int w = 0; w < jobs_; ++w) {
+        workers.emplace_back([&] {
+            MarkerDetector detector;
+            DetectorWorkspace ws; // scratch buffers stay warm across this worker's frames
+            while (auto f = decoded.pop()) {
+                if (f->item.loaded && !f->item.cached) {
+                    try {
+                        if (f->rows) f->item.result = detector.detectStreaming(*f->rows, opt_, ws, f->item.path);
+                        else f->item.result = detector.detect(f->bgr, opt_, ws, f->item.path);
+                        // Coverage is a ratio and needs no rescaling; the polygon does.
+                        if (f->item.result && !f->rows && f->full_size != f->bgr.size()) {
+                            auto& poly = f->item.result->polygon;
+                            poly = geom::mapQuadToSize(poly, f->bgr.size(), f->full_size);
+                        }
+                        if (f->key) bopt_.cache->insert(*f->key, f->item.result);
+                    }
+                    catch (const std::exception& e) {
+                        if (opt_.debug) std::cerr << "[debug] detect failed: " << f->item.path << " | " << e.what() << "\n";
+                    }
+                    f->item.stats = ws.stats;
+                }
+                f->bgr.release(); // free pixels before the item waits for output
+                f->rows.reset();
+                done.push(std::move(f->item));
+            }
+            if (--workers_left == 0) done.close();
+        });
+    }
+
+    // --- Output stage (caller thread): reorder by index if requested ---
+    std::map<size_t, BatchItem> pending;
+    size_t next_out = 0;
+    while (auto it = done.pop()) {
+        if (!bopt_.ordered) {
+            sink(*it);
+            continue;
+        }
+        pending.emplace(it->index, std::move(*it));
+        for (auto p = pending.find(next_out); p != pending.end(); p = pending.find(next_out)) {
+            sink(p->second);
+            pending.erase(p);
+            ++next_out;
+        }
+    }
+}
@@ -0,0 +1,161 @@
+#include "binary_morph.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace {
+    using Word = std::uint64_t;
+    constexpr int kWordBits = 64;
+    constexpr Word kLow7 = 0x7f7f7f7f7f7f7f7fULL;
+
+    static int wordsPerRow(int width) { return (width + kWordBits - 1) / kWordBits; }
+
+    // 0x80 in every nonzero byte of v, 0x00 elsewhere.
+    static inline Word nonzeroBytes(Word v) {
+        return (((v & kLow7) + kLow7) | v) & ~kLow7;
+    }
+
+    // Eight little-endian bytes → 8 bits (byte i nonzero → bit i). The multiply
+    // moves byte i's flag to bit 56 + i without carries.
+    static inline Word packBytes(Word v) {
+        return ((nonzeroBytes(v) >> 7) * 0x0102040810204080ULL) >> 56;
+    }
+
+    // 8 bits → eight bytes (bit i set → byte i = 255).
+    static inline Word unpackBits(Word b) {
+        const Word x = ((b & 0xFF) * 0x0101010101010101ULL) & 0x8040201008040201ULL;
+        return (nonzeroBytes(x) >> 7) * 0xFF;
+    }
+
+    static void packRow(const std::uint8_t* p, int width, Word* w) {
+        const int nw = wordsPerRow(width);
+        std::fill(w, w + nw, Word(0));
+        int x = 0;
+        if constexpr (std::endian::native == std::endian::little) {
+            for (; x + 8 <= width; x += 8) {
+                Word v;
+                std::memcpy(&v, p + x, sizeof(v));
+                w[x / kWordBits] |= packBytes(v) << (x % kWordBits);
+            }
+        }
+        for (; x < width; ++x) w[x / kWordBits] |= Word(p[x] != 0) << (x % kWordBits);
+    }
+
+    static void unpackRow(const Word* w, int width, std::uint8_t* p) {
+        int x = 0;
+        if constexpr (std::endian::native == std::endian::little) {
+            for (; x + 8 <= width; x += 8) {
+                const Word v = unpackBits(w[x / kWordBits] >> (x % kWordBits));
+                std::memcpy(p + x, &v, sizeof(v));
+            }
+        }
+        for (; x < width; ++x) p[x] = ((w[x / kWordBits] >> (x % kWordBits)) & 1) ? 255 : 0;
+    }
+
+    // A chain of 3×3 steps, pipelined by rows: step k turns its input row y
+    // into the horizontal min/max h_k(y) and, once h_k(y) is known, emits output
+    // row y-1 = min/max(h_k(y-2), h_k(y-1), h_k(y)) to step k+1. Rows outside the
+    // image and pixels past the right edge are the step's border (set for
+    // erosion, clear for dilation). Output row y of the last step is written
+    // after input row y + n has been read, so dst may alias src.
+    class Chain {
+    public:
+        Chain(const binmorph::Op* ops, int n, int rows, int width, Word* bits, cv::Mat& dst)
+            : ops_(ops), n_(n), rows_(rows), width_(width), nw_(wordsPerRow(width)),
+            tail_(width % kWordBits ? (Word(1) << (width % kWordBits)) - 1 : ~Word(0)),
+            bits_(bits), dst_(dst) {}
+
+        void push(int k, int y, const Word* row) {
+            if (k == n_) {
+                unpackRow(row, width_, dst_.ptr<std::uint8_t>(y));
+                return;
+            }
+            const bool erode = ops_[k] == binmorph::Op::Erode;
+            horizontal(row, ring(k, y), erode);
+            Word* out = output(k);
+            if (y >= 1) {
+                vertical(y >= 2 ? ring(k, y - 2) : nullptr, ring(k, y - 1), ring(k, y), out, erode);
+                push(k + 1, y - 1, out);
+            }
+            if (y == rows_ - 1) {
+                vertical(y >= 1 ? ring(k, y - 1) : nullptr, ring(k, y), nullptr, out, erode);
+                push(k + 1, y, out);
+            }
+        }
+
+    private:
+        // Storage: the packed input row, then per step three ring rows and one output row.
+        Word* ring(int k, int y) const { return bits_ + (size_t)nw_ * (1 + 4 * (size_t)k + (size_t)(y % 3)); }
+        Word* output(int k) const { return bits_ + (size_t)nw_ * (4 + 4 * (size_t)k); }
+
+        void horizontal(const Word* in, Word* h, bool erode) const {
+            const Word border = erode ? ~Word(0) : Word(0);
+            const auto load = [&](int i) {
+                return i + 1 < nw_ ? in[i] : (in[i] & tail_) | (border & ~tail_);
+            };
+            Word prev = border, cur = load(0);
+            for (int i = 0; i < nw_; ++i) {
+                const Word next = i + 1 < nw_ ? load(i + 1) : border;
+                const Word left = (cur << 1) | (prev >> (kWordBits - 1));    // pixel x-1 at bit x
+                const Word right = (cur >> 1) | (next << (kWordBits - 1));   // pixel x+1 at bit x
+                h[i] = erode ? (left & cur & right) : (left | cur | right);
+                prev = cur;
+                cur = next;
+            }
+        }
+
+        void vertical(const Word* a, const Word* b, const Word* c, Word* out, bool erode) const {
+            const Word border = erode ? ~Word(0) : Word(0);
+            for (int i = 0; i < nw_; ++i) {
+                const Word u = a ? a[i] : border;
+                const Word d = c ? c[i] : border;
+                out[i] = erode ? (u & b[i] & d) : (u | b[i] | d);
+            }
+        }
+
+        const binmorph::Op* ops_;
+        int n_, rows_, width_, nw_;
+        Word tail_;   ///< Valid bits of a row's last word
+        Word* bits_;
+        cv::Mat& dst_;
+    };
+
+    static void applyOps(const cv::Mat& src, cv::Mat& dst, binmorph::Workspace& ws) {
+        binmorph::apply(src, dst, ws.ops.data(), (int)ws.ops.size(), ws);
+    }
+}
+
+void binmorph::apply(const cv::Mat& src, cv::Mat& dst, const Op* ops, int n, Workspace& ws) {
+    CV_Assert(!src.empty() && src.type() == CV_8UC1 && n >= 0 && (n == 0 || ops));
+    MCE_TRACE_SCOPE("morph.packed");
+    const int nw = wordsPerRow(src.cols);
+    ws.bits.resize((size_t)nw * (1 + 4 * (size_t)n));
+    dst.create(src.size(), CV_8UC1);
+
+    Chain chain(ops, n, src.rows, src.cols, ws.bits.data(), dst);
+    for (int y = 0; y < src.rows; ++y) {
+        packRow(src.ptr<std::uint8_t>(y), src.cols, ws.bits.data());
+        chain.push(0, y, ws.bits.data());
+    }
+}
+
+void binmorph::openClose(const cv::Mat& src, cv::Mat& dst, int open_iter, int close_iter, Workspace& ws) {
+    open_iter = std::max(0, open_iter);
+    close_iter = std::max(0, close_iter);
+    ws.ops.clear();
+    ws.ops.insert(ws.ops.end(), (size_t)open_iter, Op::Erode);
+    ws.ops.insert(ws.ops.end(), (size_t)(open_iter + close_iter), Op::Dilate);
+    ws.ops.insert(ws.ops.end(), (size_t)close_iter, Op::Erode);
+    applyOps(src, dst, ws);
+}
+
+void binmorph::close(const cv::Mat& src, cv::Mat& dst, int iter, Workspace& ws) {
+    openClose(src, dst, 0, iter, ws);
+}
+
+void binmorph::dilate(const cv::Mat& src, cv::Mat& dst, int iter, Workspace& ws) {
+    ws.ops.assign((size_t)std::max(0, iter), Op::Dilate);
+    applyOps(src, dst, ws);
+}
@@ -0,0 +1,205 @@
+#include "color_profile.hpp"
+#include "color_segmenter.hpp"
+#include "marker_types.hpp"
+
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <iterator>
+using namespace cv;
+
+namespace {
+    static int clampi(int v, int lo, int hi) { return std::max(lo, std::min(hi, v)); }
+
+    // Built-in marker palette.
+    constexpr ColorRange kBuiltinPalette[] = {
+        { {   0,  10,  80, 255, 50 }, MarkerColor::Red },
+        { { 170, 180,  80, 255, 50 }, MarkerColor::Red },
+        { {  40,  85,  60, 255, 50 }, MarkerColor::Green },
+        { {  20,  35,  80, 255, 70 }, MarkerColor::Yellow },
+        { {  90, 130,  60, 255, 50 }, MarkerColor::Blue },
+        { { 135, 165,  60, 255, 50 }, MarkerColor::Magenta },
+        { {  85, 100,  60, 255, 60 }, MarkerColor::Cyan },
+    };
+
+    // White/highlight suppression: S ≤ smax and V ≥ vmin.
+    constexpr int kBuiltinWhiteSmax = 60;
+    constexpr int kBuiltinWhiteVmin = 210;
+
+    struct ColorName { MarkerColor color; const char* name; };
+    constexpr ColorName kColorNames[] = {
+        { MarkerColor::Red, "red" }, { MarkerColor::Green, "green" }, { MarkerColor::Yellow, "yellow" },
+        { MarkerColor::Blue, "blue" }, { MarkerColor::Magenta, "magenta" }, { MarkerColor::Cyan, "cyan" },
+    };
+
+    static const char* colorName(MarkerColor c) {
+        for (const auto& n : kColorNames) if (n.color == c) return n.name;
+        return "none";
+    }
+
+    static int tableKey(int smin, int vmin) {
+        return (clampi(smin, 0, 255) << 8) | clampi(vmin, 0, 255);
+    }
+
+    // Reason a palette cannot be compiled ("" = valid).
+    static std::string invalidReason(const std::vector<ColorRange>& colors, int white_smax, int white_vmin) {
+        if (colors.empty()) return "palette has no colors";
+        auto in = [](int v, int lo, int hi) { return v >= lo && v <= hi; };
+        for (size_t i = 0; i < colors.size(); ++i) {
+            const HsvRange& r = colors[i].range;
+            const std::string at = "color " + std::to_string(i) + ": ";
+            if (colors[i].color == MarkerColor::None || (int)colors[i].color > (int)MarkerColor::Cyan) return at + "unknown color";
+            if (!in(r.hmin, 0, 180) || !in(r.hmax, 0, 180) || r.hmin > r.hmax) return at + "hue range must be within 0-180";
+            if (!in(r.smin, 0, 255) || !in(r.smax, 0, 255) || r.smin > r.smax) return at + "saturation range must be within 0-255";
+            if (!in(r.vmin, 0, 255)) return at + "value floor must be within 0-255";
+        }
+        if (!in(white_smax, 0, 255) || !in(white_vmin, 0, 255)) return "white cut must be within 0-255";
+        return std::string();
+    }
+
+    // [lo, hi] integer pair of a profile entry.
+    static bool readPair(const FileNode& n, int& lo, int& hi) {
+        if (!n.isSeq() || n.size() != 2 || !n[0].isInt() || !n[1].isInt()) return false;
+        lo = (int)n[0];
+        hi = (int)n[1];
+        return true;
+    }
+}
+
+const std::shared_ptr<const ColorProfile>& ColorProfile::builtin() {
+    static const std::shared_ptr<const ColorProfile> p = compile(
+        std::vector<ColorRange>(std::begin(kBuiltinPalette), std::end(kBuiltinPalette)),
+        kBuiltinWhiteSmax, kBuiltinWhiteVmin, "builtin");
+    return p;
+}
+
+std::shared_ptr<const ColorProfile> ColorProfile::compile(std::vector<ColorRange> colors,
+    int white_smax, int white_vmin, std::string name)
+{
+    const std::string why = invalidReason(colors, white_smax, white_vmin);
+    if (!why.empty()) CV_Error(Error::StsBadArg, why);
+
+    std::shared_ptr<ColorProfile> p(new ColorProfile());
+    p->colors_ = std::move(colors);
+    p->white_smax_ = white_smax;
+    p->white_vmin_ = white_vmin;
+    p->name_ = std::move(name);
+
+    // Floors every default configuration starts from, with their relaxation steps.
+    (void)p->chain(SegOptions{}.smin, SegOptions{}.vmin);
+    (void)p->chain(DetectOptions{}.seg_smin, DetectOptions{}.seg_vmin);
+    (void)p->table(0, 0);   // eligibility table of the segmenter's slack map
+    return p;
+}
+
+ClassTable ColorProfile::build(int smin, int vmin) const {
+    ClassTable t;
+    t.smin = clampi(smin, 0, 255);
+    t.vmin = clampi(vmin, 0, 255);
+    t.entry.assign((size_t)kHueBins * 256, 0);
+    for (const auto& c : colors_) {
+        const int sfloor = std::max(c.range.smin, t.smin);
+        const int vfloor = std::max(c.range.vmin, t.vmin);
+        for (int h = c.range.hmin; h <= std::min(kHueBins - 1, c.range.hmax); ++h) {
+            for (int sat = sfloor; sat <= c.range.smax; ++sat) {
+                uint16_t& e = t.entry[(size_t)h * 256 + sat];
+                const bool taken = (e >> 8) != 0;
+                if (!taken || vfloor < (e & 0xFF)) {
+                    e = (uint16_t)(((int)c.color << 8) | vfloor);
+                }
+            }
+        }
+    }
+    return t;
+}
+
+const ClassTable& ColorProfile::table(int smin, int vmin) const {
+    const int key = tableKey(smin, vmin);
+    std::lock_guard<std::mutex> lk(m_);
+    auto it = tables_.find(key);
+    if (it == tables_.end()) {
+        it = tables_.emplace(key, std::make_unique<const ClassTable>(build(smin, vmin))).first;
+    }
+    return *it->second;
+}
+
+ColorProfile::Chain ColorProfile::chain(int smin, int vmin) const {
+    Chain c{};
+    smin = clampi(smin, 0, 255);
+    vmin = clampi(vmin, 0, 255);
+    for (int i = 0; i <= kRelaxSteps; ++i) {
+        c[(size_t)i] = &table(smin, vmin);
+        smin = clampi(smin - kRelaxDelta, 0, 255);
+        vmin = clampi(vmin - kRelaxDelta, 0, 255);
+    }
+    return c;
+}
+
+std::shared_ptr<const ColorProfile> ColorProfile::load(const std::string& path, std::string* error) {
+    auto fail = [&](const std::string& why) -> std::shared_ptr<const ColorProfile> {
+        if (error) *error = path + ": " + why;
+        return nullptr;
+    };
+
+    try {
+        FileStorage fs(path, FileStorage::READ);
+        if (!fs.isOpened()) return fail("cannot open profile");
+
+        int white_smax = kBuiltinWhiteSmax, white_vmin = kBuiltinWhiteVmin;
+        if (!fs["white_smax"].empty()) {
+            if (!fs["white_smax"].isInt()) return fail("white_smax must be an integer");
+            white_smax = (int)fs["white_smax"];
+        }
+        if (!fs["white_vmin"].empty()) {
+            if (!fs["white_vmin"].isInt()) return fail("white_vmin must be an integer");
+            white_vmin = (int)fs["white_vmin"];
+        }
+
+        const FileNode list = fs["colors"];
+        if (!list.isSeq()) return fail("'colors' must be a list");
+        std::vector<ColorRange> colors;
+        for (size_t i = 0; i < list.size(); ++i) {
+            const FileNode n = list[(int)i];
+            const std::string at = "color " + std::to_string(i) + ": ";
+            if (!n.isMap()) return fail(at + "expected a mapping");
+
+            const std::string cname = n["color"].isString() ? (std::string)n["color"] : std::string();
+            ColorRange c{ {}, MarkerColor::None };
+            for (const auto& cn : kColorNames) if (cname == cn.name) c.color = cn.color;
+            if (c.color == MarkerColor::None) return fail(at + "unknown color '" + cname + "'");
+
+            if (!readPair(n["h"], c.range.hmin, c.range.hmax)) return fail(at + "'h' must be [min, max]");
+            if (!readPair(n["s"], c.range.smin, c.range.smax)) return fail(at + "'s' must be [min, max]");
+            if (!n["v_min"].isInt()) return fail(at + "'v_min' must be an integer");
+            c.range.vmin = (int)n["v_min"];
+            colors.push_back(c);
+        }
+
+        const std::string why = invalidReason(colors, white_smax, white_vmin);
+        if (!why.empty()) return fail(why);
+        const std::string name = fs["name"].isString() ? (std::string)fs["name"] : path;
+        return compile(std::move(colors), white_smax, white_vmin, name);
+    }
+    catch (const cv::Exception& e) {
+        return fail(e.err);  // parse error
+    }
+}
+
+bool ColorProfile::save(const std::string& path) const {
+    try {
+        FileStorage fs(path, FileStorage::WRITE);
+        if (!fs.isOpened()) return false;
+        fs << "name" << name_ << "white_smax" << white_smax_ << "white_vmin" << white_vmin_;
+        fs << "colors" << "[";
+        for (const auto& c : colors_) {
+            fs << "{:" << "color" << colorName(c.color)
+                << "h" << "[:" << c.range.hmin << c.range.hmax << "]"
+                << "s" << "[:" << c.range.smin << c.range.smax << "]"
+                << "v_min" << c.range.vmin << "}";
+        }
+        fs << "]";
+        return true;
+    }
+    catch (const cv::Exception&) {
+        return false;
+    }
+}
@@ -1,122 +1,734 @@
 ﻿#include <opencv2/imgproc.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/core/ocl.hpp>
 #include "color_segmenter.hpp"
+#include "trace.hpp"
+
+#include <array>
+#include <vector>
 using namespace cv;
 
 namespace {
-    struct HsvRange { int hmin, hmax, smin, smax, vmin, vmax; };
+    static int clampi(int v, int lo, int hi) { return std::max(lo, std::min(hi, v)); }
+
+    constexpr int kHueBins = ColorProfile::kHueBins;
 
-    static Mat inRangeH(const Mat& hsv, const HsvRange& r) {
-        Mat mask;
-        inRange(hsv, Scalar(r.hmin, r.smin, r.vmin),
-            Scalar(r.hmax, r.smax, r.vmax), mask);
-        return mask;
+    // Palette of a call (SegOptions::profile, default the built-in one).
+    static const ColorProfile& profileOf(const SegOptions& opt) {
+        return opt.profile ? *opt.profile : *ColorProfile::builtin();
     }
 
-    static int clampi(int v, int lo, int hi) { return std::max(lo, std::min(hi, v)); }
+    // One row of the fused classifier. The table gather is scalar (8-bit
+    // gathers have no SIMD form); the V / white tests run vectorized.
+    static void classifyRow(const uchar* hsv, const uint16_t* lut, int width,
+        int white_smax, int white_vmin, uchar* lab, uchar* flo, uchar* out, uchar* labOut)
+    {
+        for (int x = 0; x < width; ++x) {
+            const int h = std::min((int)hsv[3 * x], kHueBins - 1);
+            const uint16_t e = lut[h * 256 + hsv[3 * x + 1]];
+            lab[x] = (uchar)(e >> 8);
+            flo[x] = (uchar)(e & 0xFF);
+        }
 
-    // Build the allowed-colors mask from base HSV ranges, clamped by global S/V floors.
-    static Mat buildAllowedMaskHSV(const Mat& hsv, int smin, int vmin) {
-        HsvRange red1{ 0,  10,  80,255,  50,255 };
-        HsvRange red2{ 170, 180,  80,255,  50,255 };
-        HsvRange green{ 40,  85,  60,255,  50,255 };
-        HsvRange yellow{ 20,  35,  80,255,  70,255 };
-        HsvRange blue{ 90, 130,  60,255,  50,255 };
-        HsvRange magenta{ 135, 165,  60,255,  50,255 };
-        HsvRange cyan{ 85, 100,  60,255,  60,255 };
-
-        auto applySV = [&](HsvRange r) {
-            r.smin = clampi(std::max(r.smin, smin), 0, 255);
-            r.vmin = clampi(std::max(r.vmin, vmin), 0, 255);
-            return r;
-        };
-
-        red1 = applySV(red1);
-        red2 = applySV(red2);
-        green = applySV(green);
-        yellow = applySV(yellow);
-        blue = applySV(blue);
-        magenta = applySV(magenta);
-        cyan = applySV(cyan);
-
-        Mat mask = inRangeH(hsv, red1) | inRangeH(hsv, red2)
-            | inRangeH(hsv, green) | inRangeH(hsv, yellow)
-            | inRangeH(hsv, blue) | inRangeH(hsv, magenta)
-            | inRangeH(hsv, cyan);
-
-        // Suppress white/highlights (low S, high V).
-        Mat white;
-        inRange(hsv, Scalar(0, 0, 210), Scalar(180, 60, 255), white);
-        bitwise_and(mask, ~white, mask);
-
-        return mask;
-    }
-
-    // Gentle S/V relaxation if the mask is extremely sparse.
-    static void gentleRelaxIfSparse(const Mat& hsv, Mat& mask, int& smin, int& vmin) {
-        const double total = (double)hsv.total();
-        for (int attempt = 0; attempt < 2; ++attempt) {
-            const double frac = (double)countNonZero(mask) / std::max(1.0, total);
-            if (frac >= 0.001) break; // ≥0.1% is enough — do not relax further
-            smin = clampi(smin - 10, 0, 255);
-            vmin = clampi(vmin - 10, 0, 255);
-            mask = buildAllowedMaskHSV(hsv, smin, vmin);
+        int x = 0;
+#if CV_SIMD
+        const v_uint8 zero = vx_setzero_u8();
+        const v_uint8 wS = vx_setall_u8((uchar)white_smax);
+        const v_uint8 wV = vx_setall_u8((uchar)white_vmin);
+        for (; x <= width - v_uint8::nlanes; x += v_uint8::nlanes) {
+            v_uint8 vh, vs, vv;
+            v_load_deinterleave(hsv + 3 * x, vh, vs, vv);
+            const v_uint8 l = vx_load(lab + x);
+            const v_uint8 white = (vs <= wS) & (vv >= wV);
+            const v_uint8 m = (l != zero) & (vv >= vx_load(flo + x)) & ~white;
+            v_store(out + x, m);
+            if (labOut) v_store(labOut + x, l & m);
+        }
+        vx_cleanup();
+#endif
+        for (; x < width; ++x) {
+            const int sat = hsv[3 * x + 1], val = hsv[3 * x + 2];
+            const bool white = sat <= white_smax && val >= white_vmin;
+            const bool pass = lab[x] != 0 && val >= flo[x] && !white;
+            out[x] = pass ? 255 : 0;
+            if (labOut) labOut[x] = pass ? lab[x] : 0;
+        }
+    }
+
+    static void classifyInto(const Mat& hsv, const ColorProfile& prof, const ClassTable& table,
+        Mat& mask, Mat* labels, std::vector<uchar>& rowbuf)
+    {
+        CV_Assert(!hsv.empty() && hsv.type() == CV_8UC3);
+
+        mask.create(hsv.size(), CV_8UC1);
+        if (labels) labels->create(hsv.size(), CV_8UC1);
+
+        rowbuf.resize((size_t)hsv.cols * 2);
+        for (int y = 0; y < hsv.rows; ++y) {
+            classifyRow(hsv.ptr<uchar>(y), table.entry.data(), hsv.cols,
+                prof.whiteSmax(), prof.whiteVmin(), rowbuf.data(), rowbuf.data() + hsv.cols,
+                mask.ptr<uchar>(y), labels ? labels->ptr<uchar>(y) : nullptr);
+        }
+    }
+
+    // --- Slack map: every relaxation level from one classification ------
+    // A pixel passes the floors (S, V) iff some color admits it at floors
+    // (0, 0) and s >= S, v >= V: the global floors are common to all colors.
+    // So one pass stores its slack, the uniform floor drop it needs,
+    // max(0, smin - s, vmin - v), and the mask of relaxation step k is
+    // `slack <= k * kRelaxDelta` (see ColorProfile::chain()).
+
+    constexpr uchar kNeverPasses = 255;   // slack of pixels no drop admits
+    constexpr uchar kMaxSlack = 254;
+
+    // Mask fraction below which the floors are relaxed (≥0.1% is enough).
+    constexpr double kSparseFrac = 0.001;
+
+    // One row of the slack map plus the base mask (slack == 0). `lut` is the
+    // table at floors (0, 0); the gather is scalar, the rest vectorized.
+    static void slackRow(const uchar* hsv, const uint16_t* lut, int width, int smin, int vmin,
+        int white_smax, int white_vmin, uchar* lab, uchar* flo, uchar* slack, uchar* out)
+    {
+        for (int x = 0; x < width; ++x) {
+            const int h = std::min((int)hsv[3 * x], kHueBins - 1);
+            const uint16_t e = lut[h * 256 + hsv[3 * x + 1]];
+            lab[x] = (uchar)(e >> 8);
+            flo[x] = (uchar)(e & 0xFF);
         }
+
+        int x = 0;
+#if CV_SIMD
+        const v_uint8 zero = vx_setzero_u8();
+        const v_uint8 wS = vx_setall_u8((uchar)white_smax);
+        const v_uint8 wV = vx_setall_u8((uchar)white_vmin);
+        const v_uint8 fS = vx_setall_u8((uchar)smin);
+        const v_uint8 fV = vx_setall_u8((uchar)vmin);
+        const v_uint8 cap = vx_setall_u8(kMaxSlack);
+        const v_uint8 never = vx_setall_u8(kNeverPasses);
+        for (; x <= width - v_uint8::nlanes; x += v_uint8::nlanes) {
+            v_uint8 vh, vs, vv;
+            v_load_deinterleave(hsv + 3 * x, vh, vs, vv);
+            const v_uint8 white = (vs <= wS) & (vv >= wV);
+            const v_uint8 ok = (vx_load(lab + x) != zero) & (vv >= vx_load(flo + x)) & ~white;
+            const v_uint8 sl = v_select(ok, v_min(v_max(fS - vs, fV - vv), cap), never); // saturating
+            v_store(slack + x, sl);
+            v_store(out + x, sl == zero);
+        }
+        vx_cleanup();
+#endif
+        for (; x < width; ++x) {
+            const int sat = hsv[3 * x + 1], val = hsv[3 * x + 2];
+            const bool white = sat <= white_smax && val >= white_vmin;
+            const bool ok = lab[x] != 0 && val >= flo[x] && !white;
+            const int need = std::min((int)kMaxSlack, std::max(0, std::max(smin - sat, vmin - val)));
+            slack[x] = ok ? (uchar)need : kNeverPasses;
+            out[x] = slack[x] == 0 ? 255 : 0;
+        }
+    }
+
+    // Slack map and base mask of `hsv` for the (clamped) floors smin / vmin.
+    static void slackInto(const Mat& hsv, const ColorProfile& prof, int smin, int vmin,
+        Mat& slack, Mat& mask, std::vector<uchar>& rowbuf)
+    {
+        CV_Assert(!hsv.empty() && hsv.type() == CV_8UC3);
+        const ClassTable& any = prof.table(0, 0);
+        slack.create(hsv.size(), CV_8UC1);
+        mask.create(hsv.size(), CV_8UC1);
+
+        rowbuf.resize((size_t)hsv.cols * 2);
+        for (int y = 0; y < hsv.rows; ++y) {
+            slackRow(hsv.ptr<uchar>(y), any.entry.data(), hsv.cols, smin, vmin,
+                prof.whiteSmax(), prof.whiteVmin(), rowbuf.data(), rowbuf.data() + hsv.cols,
+                slack.ptr<uchar>(y), mask.ptr<uchar>(y));
+        }
+    }
+
+    // Pixels with slack <= d for every d (cumulative slack histogram).
+    static std::array<double, 256> slackCounts(const Mat& slack) {
+        std::array<double, 256> cum{};
+        std::array<int64, 256> hist{};
+        for (int y = 0; y < slack.rows; ++y) {
+            const uchar* p = slack.ptr<uchar>(y);
+            for (int x = 0; x < slack.cols; ++x) ++hist[p[x]];
+        }
+        double run = 0.0;
+        for (int d = 0; d < 256; ++d) cum[(size_t)d] = run += (double)hist[(size_t)d];
+        return cum;
+    }
+
+    static bool isSparse(double nz, double total) {
+        return nz / std::max(1.0, total) < kSparseFrac;
+    }
+
+    // Shared 3×3 structuring element (read-only, safe to share across threads).
+    static const Mat& kernel3x3() {
+        static const Mat k = getStructuringElement(MORPH_RECT, Size(3, 3));
+        return k;
     }
 }
 
 namespace {
     // --- White-Rim Booster helpers ---------------------------------------
+    // Templated over cv::Mat (CPU) and cv::UMat (OpenCL); Mat buffers are
+    // pre-sized ScratchMat views, so the CPU path writes in place.
+
+    // Intermediate images of the booster and of the rim brake.
+    template <class M>
+    struct RimBuffers {
+        M& white_cand;
+        M& white_hi;
+        M& v_blur;
+        M& v_diff;
+        M& v_sharp;
+        M& gx;
+        M& gy;
+        M& edges;
+        M& rim;
+        M& removed;
+        M& v_win;
+        binmorph::Workspace* morph;   ///< Packed morphology buffers (CPU only)
+    };
+
+    static RimBuffers<Mat> rimBuffers(SegWorkspace& ws, const Size& sz) {
+        return { ws.white_cand.view(sz, CV_8UC1), ws.white_hi.view(sz, CV_8UC1),
+            ws.v_blur.view(sz, CV_8UC1), ws.v_diff.view(sz, CV_16SC1), ws.v_sharp.view(sz, CV_8UC1),
+            ws.gx.view(sz, CV_16SC1), ws.gy.view(sz, CV_16SC1), ws.edges.view(sz, CV_8UC1),
+            ws.rim.view(sz, CV_8UC1), ws.tmp.view(sz, CV_8UC1), ws.v_win.view(sz, CV_8UC1), &ws.bitmorph };
+    }
+
+    static RimBuffers<UMat> rimBuffers(OclSegWorkspace& ws) {
+        return { ws.white_cand, ws.white_hi, ws.v_blur, ws.v_diff, ws.v_sharp,
+            ws.gx, ws.gy, ws.edges, ws.rim, ws.removed, ws.v_win, nullptr };
+    }
+
+    // 3×3 dilations of a 0/255 mask: bit-packed chain on the CPU, cv::dilate() on the device.
+    static void dilate3x3(const Mat& src, Mat& dst, int iter, RimBuffers<Mat>& b) {
+        binmorph::dilate(src, dst, iter, *b.morph);
+    }
+
+    static void dilate3x3(const UMat& src, UMat& dst, int iter, RimBuffers<UMat>&) {
+        cv::dilate(src, dst, kernel3x3(), cv::Point(-1, -1), iter);
+    }
 
     // Mild unsharp mask on the V channel to emphasize blurry bright rims.
-    static void unsharp_on_V(const cv::Mat& hsv, cv::Mat& V_sharp, double sigma = 1.0, double amount = 1.0) {
-        CV_Assert(hsv.type() == CV_8UC3);
-        std::vector<cv::Mat> ch; cv::split(hsv, ch);
-        cv::Mat V_blur; cv::GaussianBlur(ch[2], V_blur, cv::Size(), sigma, sigma);
-        cv::Mat diff; cv::subtract(ch[2], V_blur, diff, cv::noArray(), CV_16S);
-        cv::Mat add;  cv::addWeighted(ch[2], 1.0, diff, amount, 0.0, add, CV_8U);
-        V_sharp = add;
+    template <class M>
+    static void unsharp_on_V(const M& V, RimBuffers<M>& b, M& V_sharp,
+        double sigma = 1.0, double amount = 1.0)
+    {
+        CV_Assert(V.type() == CV_8U);
+        MCE_TRACE_SCOPE("seg.rim.unsharp");
+        cv::GaussianBlur(V, b.v_blur, cv::Size(), sigma, sigma);
+        cv::subtract(V, b.v_blur, b.v_diff, cv::noArray(), CV_16S);
+        cv::addWeighted(V, 1.0, b.v_diff, amount, 0.0, V_sharp, CV_8U);
     }
 
     // Bright edges from V_sharp (Sobel magnitude + threshold).
-    static cv::Mat bright_edges_from_V(const cv::Mat& V_sharp, int edge_thresh = 25) {
+    template <class M>
+    static void bright_edges_from_V(const M& V_sharp, RimBuffers<M>& b, M& edges,
+        int edge_thresh = 25)
+    {
         CV_Assert(V_sharp.type() == CV_8U);
-        cv::Mat gx, gy, mag;
+        MCE_TRACE_SCOPE("seg.rim.sobel");
+        M& gx = b.gx;
+        M& gy = b.gy;
         cv::Sobel(V_sharp, gx, CV_16S, 1, 0, 3);
         cv::Sobel(V_sharp, gy, CV_16S, 0, 1, 3);
-        cv::Mat ax = cv::abs(gx), ay = cv::abs(gy);
-        cv::add(ax, ay, mag, cv::noArray(), CV_16S);
-        cv::Mat mag8u; cv::convertScaleAbs(mag, mag8u, 0.5); // light normalization
-        cv::Mat edges; cv::threshold(mag8u, edges, edge_thresh, 255, cv::THRESH_BINARY);
-        return edges;
+        // |gx| + |gy| in place (same saturation as abs()/add()).
+        cv::absdiff(gx, cv::Scalar::all(0), gx);
+        cv::absdiff(gy, cv::Scalar::all(0), gy);
+        cv::add(gx, gy, gx, cv::noArray(), CV_16S);
+        cv::convertScaleAbs(gx, edges, 0.5); // light normalization
+        cv::threshold(edges, edges, edge_thresh, 255, cv::THRESH_BINARY);
     }
 
-    // Build white_rim: white candidate (low S, high V) ∧ expanded bright edges.
-    static cv::Mat build_white_rim(const cv::Mat& hsv, int s_max = 110, int v_min = 200,
-        int edge_thresh = 25, int dil_iter = 1)
+    // White candidates (low S & high V, or strong highlights) into b.white_cand.
+    template <class M>
+    static void white_candidates(const M& hsv, RimBuffers<M>& b, int s_max = 110, int v_min = 200)
     {
         CV_Assert(hsv.type() == CV_8UC3);
-        // (1) white candidates
-        cv::Mat white1, white2, white_cand;
-        cv::inRange(hsv, cv::Scalar(0, 0, v_min), cv::Scalar(180, s_max, 255), white1); // low S & high V
-        cv::inRange(hsv, cv::Scalar(0, 0, 220), cv::Scalar(180, 255, 255), white2);   // strong highlights
-        white_cand = white1 | white2;
+        MCE_TRACE_SCOPE("seg.rim.white_inRange");
+        M& white_cand = b.white_cand;
+        cv::inRange(hsv, cv::Scalar(0, 0, v_min), cv::Scalar(180, s_max, 255), white_cand); // low S & high V
+        cv::inRange(hsv, cv::Scalar(0, 0, 220), cv::Scalar(180, 255, 255), b.white_hi);    // strong highlights
+        cv::bitwise_or(white_cand, b.white_hi, white_cand);
+    }
 
+    // white_rim = b.white_cand ∧ expanded bright edges of V.
+    template <class M>
+    static void rim_from_candidates(const M& V, RimBuffers<M>& b, M& white_rim,
+        int edge_thresh = 25, int dil_iter = 1)
+    {
         // (2) bright edges from V_sharp
-        cv::Mat V_sharp; unsharp_on_V(hsv, V_sharp);
-        cv::Mat edges = bright_edges_from_V(V_sharp, edge_thresh);
-        cv::Mat edges_dil = edges;
-        if (dil_iter > 0) {
-            cv::Mat k = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
-            cv::dilate(edges_dil, edges_dil, k, cv::Point(-1, -1), dil_iter);
-        }
+        unsharp_on_V(V, b, b.v_sharp);
+        M& edges = b.edges;
+        bright_edges_from_V(b.v_sharp, b, edges, edge_thresh);
+        MCE_TRACE_SCOPE("seg.rim.dilate");
+        if (dil_iter > 0) dilate3x3(edges, edges, dil_iter, b);
 
         // (3) rim = white that lies on/near a bright edge
-        cv::Mat white_rim; cv::bitwise_and(white_cand, edges_dil, white_rim);
-        if (dil_iter > 0) {
-            cv::Mat k = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
-            cv::dilate(white_rim, white_rim, k, cv::Point(-1, -1), 1);
+        cv::bitwise_and(b.white_cand, edges, white_rim);
+        if (dil_iter > 0) dilate3x3(white_rim, white_rim, 1, b);
+    }
+
+    // Build white_rim: white candidate (low S, high V) ∧ expanded bright edges.
+    template <class M>
+    static void build_white_rim(const M& hsv, const M& V, RimBuffers<M>& b,
+        M& white_rim, int s_max = 110, int v_min = 200, int edge_thresh = 25, int dil_iter = 1)
+    {
+        // (1) white candidates
+        white_candidates(hsv, b, s_max, v_min);
+        rim_from_candidates(V, b, white_rim, edge_thresh, dil_iter);
+    }
+
+    // Halo around the mask's bounding box for the booster window. The booster
+    // works on a copy of V inside the window, and the rim at a pixel depends on
+    // V within 6 px (unsharp blur σ=1: 3, Sobel, edge dilation, rim dilation),
+    // so 8 px leaves it exact inside the box.
+    constexpr int kRimHalo = 8;
+
+    // --- Intra-frame stripes (SegOptions::stripes) ------------------------
+    // A striped stage copies each stripe plus a halo into standalone per-stripe
+    // buffers and runs the same OpenCV calls as the serial path on them. Rows
+    // farther than the filters' reach from a cut see exactly the serial inputs,
+    // so the inner rows, which are the only ones kept, are bit-identical.
+
+    // Below this stripe height the halo copies outweigh the parallel gain.
+    constexpr int kMinStripeRows = 64;
+
+    // Reach of rim_from_candidates() (see kRimHalo).
+    constexpr int kRimStripeHalo = 6;
+
+    static int stripeCount(int rows, int requested) {
+        const int n = requested > 0 ? requested : std::max(1, getNumThreads());
+        return std::max(1, std::min(n, rows / kMinStripeRows));
+    }
+
+    static Range withHalo(const Range& r, int halo, int rows) {
+        return Range(std::max(0, r.start - halo), std::min(rows, r.end + halo));
+    }
+
+    // Copy rows `e` of `src` into a standalone buffer.
+    static Mat& copyRows(const Mat& src, const Range& e, ScratchMat& dst) {
+        Mat& d = dst.view(Size(src.cols, e.size()), src.type());
+        src.rowRange(e).copyTo(d);
+        return d;
+    }
+
+    // body(stripe workspace, rows) for n stripes of `rows` on OpenCV's thread pool.
+    template <class Body>
+    static void forStripes(int rows, int n, SegWorkspace& ws, Body body) {
+        if ((int)ws.stripes.size() < n) ws.stripes.resize((size_t)n);
+        parallel_for_(Range(0, n), [&](const Range& range) {
+            for (int i = range.start; i < range.end; ++i) {
+                const Range r((int)((int64)rows * i / n), (int)((int64)rows * (i + 1) / n));
+                body(ws.stripes[(size_t)i], r);
+            }
+        }, n);
+    }
+
+    // --- Segmentation stages shared by the static and instance APIs ------
+
+    // prepareInto() in stripes: blur (halo ksize/2), HSV and V per stripe; CLAHE
+    // builds tile histograms across stripes and runs once in between (OpenCV
+    // already spreads its tiles over the thread pool).
+    static void prepareStriped(const Mat& bgr, int blur_ksize, int n, SegWorkspace& ws) {
+        const Size sz = bgr.size();
+        const bool blur = blur_ksize >= 3 && (blur_ksize % 2) == 1;
+        Mat& hsv = ws.hsv.view(sz, CV_8UC3);
+        Mat& Vraw = ws.v_raw.view(sz, CV_8UC1);
+        forStripes(sz.height, n, ws, [&](SegWorkspace& sw, const Range& r) {
+            Mat src = bgr.rowRange(r);
+            if (blur) {
+                MCE_TRACE_SCOPE("seg.blur");
+                const Range e = withHalo(r, blur_ksize / 2, sz.height);
+                Mat& in = copyRows(bgr, e, sw.stripe_in);
+                Mat& out = sw.blurred.view(in.size(), CV_8UC3);
+                GaussianBlur(in, out, Size(blur_ksize, blur_ksize), 0.0);
+                src = out.rowRange(r.start - e.start, r.end - e.start);
+            }
+            Mat hsvS = hsv.rowRange(r);
+            Mat vS = Vraw.rowRange(r);
+            MCE_TRACE_SCOPE("seg.cvtColor");
+            cvtColor(src, hsvS, COLOR_BGR2HSV);
+            extractChannel(hsvS, vS, 2);
+        });
+
+        Mat& V = ws.v.view(sz, CV_8UC1);
+        {
+            MCE_TRACE_SCOPE("seg.clahe");
+            if (!ws.clahe) ws.clahe = createCLAHE(2.0, Size(8, 8));
+            ws.clahe->apply(Vraw, V);
+        }
+
+        forStripes(sz.height, n, ws, [&](SegWorkspace&, const Range& r) {
+            Mat hsvS = hsv.rowRange(r);
+            insertChannel(V.rowRange(r), hsvS, 2);
+        });
+    }
+
+    // Optional pre-blur, HSV conversion and CLAHE on V (ws.hsv, ws.v, ws.v_raw).
+    static void prepareInto(const Mat& bgr, int blur_ksize, SegWorkspace& ws, int stripes = 1) {
+        const Size sz = bgr.size();
+
+        // A caller ROI lets the serial blur read pixels outside it, which the
+        // stripe copies would not see: such inputs stay serial.
+        const int n = bgr.isSubmatrix() ? 1 : stripeCount(sz.height, stripes);
+        if (n > 1) {
+            prepareStriped(bgr, blur_ksize, n, ws);
+            return;
+        }
+
+        // Optional Gaussian blur (as in original).
+        Mat src = bgr;
+        if (blur_ksize >= 3 && (blur_ksize % 2) == 1) {
+            MCE_TRACE_SCOPE("seg.blur");
+            src = ws.blurred.view(sz, CV_8UC3);
+            GaussianBlur(bgr, src, Size(blur_ksize, blur_ksize), 0.0);
         }
-        return white_rim;
+
+        // Convert to HSV + CLAHE on V (preserved from original).
+        Mat& hsv = ws.hsv.view(sz, CV_8UC3);
+        Mat& Vraw = ws.v_raw.view(sz, CV_8UC1);
+        {
+            MCE_TRACE_SCOPE("seg.cvtColor");
+            cvtColor(src, hsv, COLOR_BGR2HSV);
+            extractChannel(hsv, Vraw, 2);
+        }
+        MCE_TRACE_SCOPE("seg.clahe");
+        if (!ws.clahe) ws.clahe = createCLAHE(2.0, Size(8, 8));
+        Mat& V = ws.v.view(sz, CV_8UC1);
+        ws.clahe->apply(Vraw, V);
+        insertChannel(V, hsv, 2);
+    }
+
+    // --- NV12 input ------------------------------------------------------
+    // In BT.601 limited range, R,G,B = L + offset(U,V) with L = 1.164·(Y−16).
+    // Adding L shifts all three channels equally, so hue and max−min depend on
+    // chroma only; V = L + max offset and S = (max−min)/V follow per pixel.
+
+    struct ChromaEntry {
+        uint8_t hue;        // OpenCV 8-bit hue (0-179)
+        int16_t max_off;    // max(R,G,B) − L
+        int16_t min_off;    // min(R,G,B) − L
+    };
+
+    static const std::vector<ChromaEntry>& chromaLut() {
+        static const std::vector<ChromaEntry> lut = [] {
+            std::vector<ChromaEntry> t((size_t)256 * 256);
+            for (int u = 0; u < 256; ++u) {
+                for (int v = 0; v < 256; ++v) {
+                    const double du = u - 128.0, dv = v - 128.0;
+                    const double r = 1.596 * dv;
+                    const double g = -0.813 * dv - 0.391 * du;
+                    const double b = 2.018 * du;
+                    const double mx = std::max(r, std::max(g, b));
+                    const double mn = std::min(r, std::min(g, b));
+                    const double c = mx - mn;
+                    double h = 0.0;
+                    if (c > 1e-9) {
+                        if (mx == r)      h = 60.0 * (g - b) / c;
+                        else if (mx == g) h = 120.0 + 60.0 * (b - r) / c;
+                        else              h = 240.0 + 60.0 * (r - g) / c;
+                        if (h < 0.0) h += 360.0;
+                    }
+                    int h8 = cvRound(h * 0.5);
+                    if (h8 >= kHueBins) h8 -= kHueBins;
+                    t[(size_t)u * 256 + v] = { (uint8_t)h8, (int16_t)cvRound(mx), (int16_t)cvRound(mn) };
+                }
+            }
+            return t;
+        }();
+        return lut;
+    }
+
+    // Y (16-235) expanded to full-range luma L.
+    static const Mat& lumaLut() {
+        static const Mat lut = [] {
+            Mat t(1, 256, CV_8UC1);
+            for (int i = 0; i < 256; ++i) t.at<uchar>(0, i) = saturate_cast<uchar>(1.164 * (i - 16));
+            return t;
+        }();
+        return lut;
+    }
+
+    // NV12 counterpart of prepareInto(): blur and CLAHE act on luma, hue and
+    // saturation come from the chroma table. Chroma is already smoothed by
+    // 4:2:0 subsampling and is not blurred again.
+    static void prepareNV12Into(const Mat& y, const Mat& uv, int blur_ksize, SegWorkspace& ws) {
+        const Size sz = y.size();
+        Mat& L = ws.luma.view(sz, CV_8UC1);
+        if (blur_ksize >= 3 && (blur_ksize % 2) == 1) {
+            MCE_TRACE_SCOPE("seg.blur");
+            GaussianBlur(y, L, Size(blur_ksize, blur_ksize), 0.0);
+            LUT(L, lumaLut(), L);
+        }
+        else {
+            LUT(y, lumaLut(), L);
+        }
+        Mat& V = ws.v.view(sz, CV_8UC1);
+        {
+            MCE_TRACE_SCOPE("seg.clahe");
+            if (!ws.clahe) ws.clahe = createCLAHE(2.0, Size(8, 8));
+            ws.clahe->apply(L, V);
+        }
+
+        MCE_TRACE_SCOPE("seg.nv12_chroma");
+
+        Mat& hsv = ws.hsv.view(sz, CV_8UC3);
+        Mat& Vraw = ws.v_raw.view(sz, CV_8UC1);
+        const ChromaEntry* lut = chromaLut().data();
+        for (int r = 0; r < sz.height; ++r) {
+            const uchar* l = L.ptr<uchar>(r);
+            const uchar* c = uv.ptr<uchar>(r / 2);
+            uchar* vc = V.ptr<uchar>(r);   // CLAHE'd luma in, CLAHE'd V out
+            uchar* vr = Vraw.ptr<uchar>(r);
+            uchar* o = hsv.ptr<uchar>(r);
+            for (int x = 0; x < sz.width; ++x) {
+                const ChromaEntry& e = lut[(size_t)c[2 * (x / 2)] * 256 + c[2 * (x / 2) + 1]];
+                const int vmax = clampi(l[x] + e.max_off, 0, 255);
+                const int vmin = clampi(l[x] + e.min_off, 0, 255);
+                const int sat = vmax > 0 ? (255 * (vmax - vmin) + vmax / 2) / vmax : 0;
+                const int val = clampi(vc[x] + e.max_off, 0, 255);
+                o[3 * x] = e.hue;
+                o[3 * x + 1] = (uchar)sat;
+                o[3 * x + 2] = (uchar)val;
+                vr[x] = (uchar)vmax;
+                vc[x] = (uchar)val;
+            }
+        }
+    }
+
+    // Morphological cleanup: open, then close. The CPU runs both as one packed
+    // chain (equal to the two morphologyEx() calls); the device keeps OpenCV's.
+    static void morphClean(Mat& mask, const SegOptions& opt, binmorph::Workspace& ws) {
+        if (opt.open_iter > 0 || opt.close_iter > 0) binmorph::openClose(mask, mask, opt.open_iter, opt.close_iter, ws);
+    }
+
+    static void morphClean(UMat& mask, const SegOptions& opt) {
+        const Mat& k = kernel3x3();
+        if (opt.open_iter > 0)  morphologyEx(mask, mask, MORPH_OPEN, k, Point(-1, -1), opt.open_iter);
+        if (opt.close_iter > 0) morphologyEx(mask, mask, MORPH_CLOSE, k, Point(-1, -1), opt.close_iter);
+    }
+
+    // Classification, white-rim removal, relaxation and morphology on a prepared image.
+    // `classify()` builds the base color mask into `mask` (global S/V floors).
+    // `relaxedCount(k)` returns the mask size at relaxation step k and
+    // `relax(k)` makes `mask` that step's mask (without the booster).
+    // `makeBuffers(size)` returns the booster's RimBuffers for a window of that size.
+    // `rim(V, buffers, white_rim)` and `morph(mask)` run the booster's rim and the
+    // cleanup (serial or striped).
+    template <class M, class Buffers, class Classify, class Count, class Relax, class Rim, class Morph>
+    static void cleanMask(const M& hsv, const M& V,
+        Buffers makeBuffers, SegStats& stats, M& mask, Classify classify,
+        Count relaxedCount, Relax relax, Rim rim, Morph morph)
+    {
+        stats = SegStats{};
+        const double total = (double)hsv.total();
+
+        // Base color mask with global S/V floors.
+        double nz = 0.0;
+        {
+            MCE_TRACE_SCOPE("seg.classify");
+            classify();
+            nz = (double)cv::countNonZero(mask);
+        }
+
+        // --- Stage 0.5: White Rim Booster (detach blurry white border if present) ---
+        // Only mask pixels can be removed, and a rim pixel lies within 1 px of a
+        // white candidate. So the booster runs only in the mask's bounding box
+        // (plus kRimHalo) and only if a white candidate touches the mask there;
+        // the result equals the full-frame booster. A sparse mask is replaced by
+        // a relaxed one below (the rim only removes pixels), so it skips the booster.
+        const bool sparse = isSparse(nz, total);
+        stats.rim_skipped = sparse;
+        const Rect box = sparse ? Rect() : cv::boundingRect(mask);
+        if (!box.empty()) {
+            MCE_TRACE_SCOPE("seg.rim_booster");
+            const Rect win = Rect(box.x - kRimHalo, box.y - kRimHalo,
+                box.width + 2 * kRimHalo, box.height + 2 * kRimHalo) & Rect(Point(0, 0), hsv.size());
+            RimBuffers<M> b = makeBuffers(win.size());
+            const M hsvW = hsv(win);
+            V(win).copyTo(b.v_win);
+            const M& VW = b.v_win;
+            M maskW = mask(win);
+
+            white_candidates(hsvW, b, /*s_max=*/110, /*v_min=*/200);
+            dilate3x3(maskW, b.removed, 1, b);
+            cv::bitwise_and(b.removed, b.white_cand, b.removed);
+
+            if (cv::countNonZero(b.removed) == 0) {
+                stats.rim_skipped = true; // no white next to the mask: the rim cannot remove anything
+            }
+            else {
+                // Build a plausible white rim and subtract it from the mask, with safety brake.
+                M& white_rim = b.rim;
+                rim(VW, b, white_rim);
+
+                const int nzMask = cv::countNonZero(maskW); // the mask is zero outside the box
+                const double nz0 = std::max(1.0, (double)nzMask);
+                cv::bitwise_and(maskW, white_rim, b.removed);
+                const double nz1 = (double)nzMask - (double)cv::countNonZero(b.removed);
+
+                // Brake: if we removed too much (>30%), keep the original mask.
+                if (nz1 >= 0.65 * nz0) {
+                    cv::subtract(maskW, white_rim, maskW); // binary masks: mask ∧ ¬rim
+                    stats.rim_applied = true;
+                    nz = nz1;
+                }
+                else {
+                    stats.rim_braked = true; // keep mask as-is
+                }
+            }
+        }
+
+
+        // Gentle relaxation only if the mask is extremely sparse: pick the first
+        // step whose mask is large enough, then build that mask once.
+        int step = 0;
+        {
+            MCE_TRACE_SCOPE("seg.relax");
+            while (step < ColorProfile::kRelaxSteps && isSparse(nz, total)) nz = relaxedCount(++step);
+            if (step > 0) relax(step);
+        }
+        stats.relax_attempts = step;
+
+        MCE_TRACE_SCOPE("seg.morphology");
+        morph(mask);
+    }
+
+    // --- Striped stages of the CPU mask ----------------------------------
+
+    // Per-pixel slack map and base mask: stripes need no halo.
+    static void slackStriped(const Mat& hsv, const ColorProfile& prof, int smin, int vmin,
+        Mat& slack, Mat& mask, int n, SegWorkspace& ws)
+    {
+        if (n <= 1) {
+            slackInto(hsv, prof, smin, vmin, slack, mask, ws.row);
+            return;
+        }
+        mask.create(hsv.size(), CV_8UC1);
+        forStripes(hsv.rows, n, ws, [&](SegWorkspace& sw, const Range& r) {
+            Mat sl = slack.rowRange(r);
+            Mat m = mask.rowRange(r);
+            slackInto(hsv.rowRange(r), prof, smin, vmin, sl, m, sw.row);
+        });
+    }
+
+    // Slack map relative to floors lowered by d: unreachable pixels stay unreachable.
+    static void lowerSlack(Mat& slack, int d) {
+        Mat lut(1, 256, CV_8U);
+        for (int i = 0; i < 256; ++i) lut.at<uchar>(i) = (uchar)(i == kNeverPasses ? i : std::max(0, i - d));
+        LUT(slack, lut, slack);
+    }
+
+    // rim_from_candidates() over the booster window in stripes (halo kRimStripeHalo).
+    static void rimStriped(const Mat& VW, RimBuffers<Mat>& b, Mat& white_rim, int requested, SegWorkspace& ws) {
+        const int n = stripeCount(VW.rows, requested);
+        if (n <= 1) {
+            rim_from_candidates(VW, b, white_rim, /*edge_thresh=*/25, /*dil=*/1);
+            return;
+        }
+        forStripes(VW.rows, n, ws, [&](SegWorkspace& sw, const Range& r) {
+            const Range e = withHalo(r, kRimStripeHalo, VW.rows);
+            RimBuffers<Mat> sb = rimBuffers(sw, Size(VW.cols, e.size()));
+            VW.rowRange(e).copyTo(sb.v_win);
+            b.white_cand.rowRange(e).copyTo(sb.white_cand);
+            rim_from_candidates(sb.v_win, sb, sb.rim, /*edge_thresh=*/25, /*dil=*/1);
+            Mat dst = white_rim.rowRange(r);
+            sb.rim.rowRange(r.start - e.start, r.end - e.start).copyTo(dst);
+        });
+    }
+
+    // morphClean() in stripes: open and close reach 2 px per iteration each.
+    static void morphStriped(Mat& mask, const SegOptions& opt, int n, SegWorkspace& ws) {
+        const int halo = 2 * (std::max(0, opt.open_iter) + std::max(0, opt.close_iter));
+        if (n <= 1 || halo == 0 || mask.isSubmatrix()) {
+            morphClean(mask, opt, ws.bitmorph);
+            return;
+        }
+        Mat& out = ws.morph.view(mask.size(), CV_8UC1);
+        forStripes(mask.rows, n, ws, [&](SegWorkspace& sw, const Range& r) {
+            const Range e = withHalo(r, halo, mask.rows);
+            Mat& t = copyRows(mask, e, sw.tmp);
+            morphClean(t, opt, sw.bitmorph);
+            Mat dst = out.rowRange(r);
+            t.rowRange(r.start - e.start, r.end - e.start).copyTo(dst);
+        });
+        out.copyTo(mask);
+    }
+
+    // `cache` (optional) describes the slack map left in ws.slack by an earlier
+    // call on the same `hsv`; a uniform drop of both floors reuses it.
+    static void maskFromPrepared(const Mat& hsv, const Mat& V, const SegOptions& opt,
+        SegWorkspace& ws, Mat& mask, SlackCache* cache = nullptr)
+    {
+        const int n = stripeCount(hsv.rows, opt.stripes);
+        const std::shared_ptr<const ColorProfile>& prof = opt.profile ? opt.profile : ColorProfile::builtin();
+        const int smin = clampi(opt.smin, 0, 255), vmin = clampi(opt.vmin, 0, 255);
+        Mat& slack = ws.slack.view(hsv.size(), CV_8UC1);
+        const int drop = cache ? cache->smin - smin : -1;
+        const bool reuse = cache && cache->profile == prof && drop >= 0 && cache->vmin - vmin == drop;
+
+        std::array<double, 256> counts{};
+        bool counted = false;
+        cleanMask(hsv, V, [&](const Size& sz) { return rimBuffers(ws, sz); }, ws.stats, mask,
+            [&] {
+                if (!reuse) {
+                    slackStriped(hsv, *prof, smin, vmin, slack, mask, n, ws);
+                    return;
+                }
+                if (drop > 0) lowerSlack(slack, drop);
+                compare(slack, 0, mask, CMP_EQ);
+            },
+            [&](int step) {
+                if (!counted) { counts = slackCounts(slack); counted = true; }
+                return counts[(size_t)std::min<int>(kMaxSlack, step * ColorProfile::kRelaxDelta)];
+            },
+            [&](int step) { compare(slack, std::min<int>(kMaxSlack, step * ColorProfile::kRelaxDelta), mask, CMP_LE); },
+            [&](const Mat& VW, RimBuffers<Mat>& b, Mat& rim) { rimStriped(VW, b, rim, opt.stripes, ws); },
+            [&](Mat& m) { morphStriped(m, opt, n, ws); });
+        ws.stats.stripes = n;
+        ws.stats.slack_reused = reuse;
+        if (cache) *cache = SlackCache{ prof, smin, vmin };
+    }
+
+    // --- OpenCL (T-API) path ---------------------------------------------
+
+    // Union of the per-color inRange() masks minus white highlights; equal to
+    // the fused LUT classifier (see ClassTable) for the same HSV input.
+    static void classifyOcl(const UMat& hsv, const ColorProfile& prof, const ClassTable& table,
+        UMat& mask, OclSegWorkspace& ws)
+    {
+        mask.create(hsv.size(), CV_8UC1);
+        mask.setTo(Scalar::all(0));
+        for (const auto& c : prof.colors()) {
+            const int sfloor = std::max(c.range.smin, table.smin);
+            const int vfloor = std::max(c.range.vmin, table.vmin);
+            MCE_TRACE_SCOPE("seg.color_inRange");
+            inRange(hsv, Scalar(c.range.hmin, sfloor, vfloor), Scalar(c.range.hmax, c.range.smax, 255), ws.color);
+            bitwise_or(mask, ws.color, mask);
+        }
+        inRange(hsv, Scalar(0, 0, prof.whiteVmin()), Scalar(255, prof.whiteSmax(), 255), ws.color);
+        subtract(mask, ws.color, mask);
+    }
+
+    // Device counterpart of prepareInto().
+    static void prepareOcl(const UMat& bgr, int blur_ksize, OclSegWorkspace& ws) {
+        const UMat* src = &bgr;
+        if (blur_ksize >= 3 && (blur_ksize % 2) == 1) {
+            MCE_TRACE_SCOPE("seg.blur");
+            GaussianBlur(bgr, ws.blurred, Size(blur_ksize, blur_ksize), 0.0);
+            src = &ws.blurred;
+        }
+        {
+            MCE_TRACE_SCOPE("seg.cvtColor");
+            cvtColor(*src, ws.hsv, COLOR_BGR2HSV);
+            extractChannel(ws.hsv, ws.v_raw, 2);
+        }
+        MCE_TRACE_SCOPE("seg.clahe");
+        if (!ws.clahe) ws.clahe = createCLAHE(2.0, Size(8, 8));
+        ws.clahe->apply(ws.v_raw, ws.v);
+        insertChannel(ws.v, ws.hsv, 2);
     }
 }
 
@@ -126,53 +738,96 @@ Mat ColorSegmenter::allowedMaskHSV(const Mat& bgr) {
 }
 
 Mat ColorSegmenter::allowedMaskHSV(const Mat& bgr, const SegOptions& opt) {
-    CV_Assert(!bgr.empty() && bgr.type() == CV_8UC3);
+    SegWorkspace ws;
+    Mat mask;
+    allowedMaskHSV(bgr, opt, ws, mask);
+    return mask;
+}
 
-    // Optional Gaussian blur (as in original).
-    Mat src = bgr;
-    if (opt.blur_ksize >= 3 && (opt.blur_ksize % 2) == 1) {
-        GaussianBlur(bgr, src, Size(opt.blur_ksize, opt.blur_ksize), 0.0);
-    }
+void ColorSegmenter::allowedMaskHSV(const Mat& bgr, const SegOptions& opt, SegWorkspace& ws, Mat& mask) {
+    CV_Assert(!bgr.empty() && bgr.type() == CV_8UC3);
+    prepareInto(bgr, opt.blur_ksize, ws, opt.stripes);
+    const Size sz = bgr.size();
+    maskFromPrepared(ws.hsv.view(sz, CV_8UC3), ws.v.view(sz, CV_8UC1), opt, ws, mask);
+}
 
-    // Convert to HSV + CLAHE on V (preserved from original).
-    Mat hsv; cvtColor(src, hsv, COLOR_BGR2HSV);
-    std::vector<Mat> ch; split(hsv, ch);
-    Ptr<CLAHE> clahe = createCLAHE();
-    clahe->setClipLimit(2.0);
-    clahe->setTilesGridSize(Size(8, 8));
-    clahe->apply(ch[2], ch[2]);
-    merge(ch, hsv);
+bool ColorSegmenter::openclAvailable() {
+    return cv::ocl::haveOpenCL() && cv::ocl::useOpenCL();
+}
 
-    // Base color mask with global S/V floors.
-    int smin = opt.smin;
-    int vmin = opt.vmin;
-    Mat mask = buildAllowedMaskHSV(hsv, smin, vmin);
+void ColorSegmenter::allowedMaskOCL(const UMat& bgr, const SegOptions& opt, OclSegWorkspace& ws, Mat& mask) {
+    CV_Assert(!bgr.empty() && bgr.type() == CV_8UC3);
+    prepareOcl(bgr, opt.blur_ksize, ws);
+    // The device classifier builds each relaxation step's mask from its table.
+    const ColorProfile& prof = profileOf(opt);
+    const ColorProfile::Chain chain = prof.chain(opt.smin, opt.vmin);
+    cleanMask(ws.hsv, ws.v, [&](const Size&) { return rimBuffers(ws); }, ws.stats, ws.mask,
+        [&] { classifyOcl(ws.hsv, prof, *chain[0], ws.mask, ws); },
+        [&](int step) {
+            classifyOcl(ws.hsv, prof, *chain[(size_t)step], ws.mask, ws);
+            return (double)countNonZero(ws.mask);
+        },
+        [](int) {},
+        [](const UMat& VW, RimBuffers<UMat>& b, UMat& rim) { rim_from_candidates(VW, b, rim, /*edge_thresh=*/25, /*dil=*/1); },
+        [&](UMat& m) { morphClean(m, opt); });
+    ws.mask.copyTo(mask); // the only download: one 8-bit plane
+}
 
-    // --- Stage 0.5: White Rim Booster (detach blurry white border if present) ---
-    {
-        // Build a plausible white rim and subtract it from the mask, with safety brake.
-        cv::Mat white_rim = build_white_rim(hsv, /*s_max=*/110, /*v_min=*/200, /*edge_thresh=*/25, /*dil=*/1);
+void ColorSegmenter::prepare(const Mat& bgr, int blur_ksize, int stripes) {
+    CV_Assert(!bgr.empty() && bgr.type() == CV_8UC3);
+    prepareInto(bgr, blur_ksize, ws_, stripes);
+    const Size sz = bgr.size();
+    slack_ = SlackCache{};
+    hsv_ = ws_.hsv.view(sz, CV_8UC3);
+    v_ = ws_.v.view(sz, CV_8UC1);
+    v_raw_ = ws_.v_raw.view(sz, CV_8UC1);
+}
 
-        const double nz0 = std::max(1.0, (double)cv::countNonZero(mask));
-        cv::Mat mask_after = mask.clone();
-        cv::bitwise_and(mask_after, ~white_rim, mask_after);
-        const double nz1 = (double)cv::countNonZero(mask_after);
+void ColorSegmenter::prepareNV12(const Mat& y, const Mat& uv, int blur_ksize) {
+    CV_Assert(!y.empty() && y.type() == CV_8UC1 && uv.type() == CV_8UC2);
+    CV_Assert(y.cols % 2 == 0 && y.rows % 2 == 0 && uv.cols * 2 == y.cols && uv.rows * 2 == y.rows);
+    prepareNV12Into(y, uv, blur_ksize, ws_);
+    const Size sz = y.size();
+    slack_ = SlackCache{};
+    hsv_ = ws_.hsv.view(sz, CV_8UC3);
+    v_ = ws_.v.view(sz, CV_8UC1);
+    v_raw_ = ws_.v_raw.view(sz, CV_8UC1);
+}
 
-        // Brake: if we removed too much (>30%), keep the original mask.
-        if (nz1 >= 0.65 * nz0) {
-            mask = mask_after;
-        }
-        // else: keep mask as-is
-    }
+void ColorSegmenter::setPrepared(const Mat& hsv) {
+    CV_Assert(!hsv.empty() && hsv.type() == CV_8UC3);
+    const Size sz = hsv.size();
+    slack_ = SlackCache{};
+    hsv_ = ws_.hsv.view(sz, CV_8UC3);
+    if (hsv.data != hsv_.data) hsv.copyTo(hsv_);
+    v_ = ws_.v.view(sz, CV_8UC1);
+    extractChannel(hsv_, v_, 2);
+    v_raw_ = Mat();
+}
 
+void ColorSegmenter::mask(const SegOptions& opt, Mat& mask) {
+    CV_Assert(!hsv_.empty() && "prepare() must be called first");
+    maskFromPrepared(hsv_, v_, opt, ws_, mask, &slack_);
+}
 
-    // Gentle relaxation only if the mask is extremely sparse.
-    gentleRelaxIfSparse(hsv, mask, smin, vmin);
+void ColorSegmenter::segment(const Mat& bgr, const SegOptions& opt, Mat& mask) {
+    prepare(bgr, opt.blur_ksize, opt.stripes);
+    this->mask(opt, mask);
+}
 
-    // Morphological cleanup (same as original).
-    Mat k = getStructuringElement(MORPH_RECT, Size(3, 3));
-    if (opt.open_iter > 0)  morphologyEx(mask, mask, MORPH_OPEN, k, Point(-1, -1), opt.open_iter);
-    if (opt.close_iter > 0) morphologyEx(mask, mask, MORPH_CLOSE, k, Point(-1, -1), opt.close_iter);
+void ColorSegmenter::whiteRimMask(const Mat& hsv, SegWorkspace& ws, Mat& rim) {
+    CV_Assert(!hsv.empty() && hsv.type() == CV_8UC3);
+    Mat& V = ws.v.view(hsv.size(), CV_8UC1);
+    extractChannel(hsv, V, 2);
+    rim.create(hsv.size(), CV_8UC1);
+    RimBuffers<Mat> b = rimBuffers(ws, hsv.size());
+    build_white_rim(hsv, V, b, rim, /*s_max=*/110, /*v_min=*/200, /*edge_thresh=*/25, /*dil=*/1);
+}
 
-    return mask;
-}
\ No newline at end of file
+void ColorSegmenter::classifyHSV(const Mat& hsv, int smin, int vmin, Mat& mask, Mat* labels,
+    const ColorProfile* profile)
+{
+    const ColorProfile& prof = profile ? *profile : *ColorProfile::builtin();
+    std::vector<uchar> rowbuf;
+    classifyInto(hsv, prof, prof.table(smin, vmin), mask, labels, rowbuf);
+}
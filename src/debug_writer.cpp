@@ -0,0 +1,331 @@
+#include "debug_writer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace {
+    /// @brief Identical artifacts are recognised among this many recent writes.
+    constexpr size_t kDedupWindow = 64;
+
+    /// @brief FNV-1a over type, size and pixels (the dedup key).
+    static std::uint64_t contentHash(const cv::Mat& img) {
+        std::uint64_t h = 1469598103934665603ull;
+        auto mix = [&](const unsigned char* p, size_t n) {
+            for (size_t i = 0; i < n; ++i) { h ^= p[i]; h *= 1099511628211ull; }
+        };
+        const int meta[3] = { img.type(), img.rows, img.cols };
+        mix(reinterpret_cast<const unsigned char*>(meta), sizeof(meta));
+        const size_t row = (size_t)img.cols * img.elemSize();
+        for (int y = 0; y < img.rows; ++y) mix(img.ptr<unsigned char>(y), row);
+        return h;
+    }
+
+    // --- QOI (https://qoiformat.org/qoi-specification.pdf) ---------------
+    constexpr std::uint8_t kQoiIndex = 0x00, kQoiDiff = 0x40, kQoiLuma = 0x80, kQoiRun = 0xc0;
+    constexpr std::uint8_t kQoiRgb = 0xfe, kQoiRgba = 0xff;
+    constexpr std::uint8_t kQoiEnd[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    constexpr size_t kQoiHeader = 14;
+
+    struct Rgba {
+        std::uint8_t r, g, b, a;
+        bool operator==(const Rgba& o) const { return r == o.r && g == o.g && b == o.b && a == o.a; }
+    };
+
+    static int qoiHash(const Rgba& p) { return (p.r * 3 + p.g * 5 + p.b * 7 + p.a * 11) % 64; }
+
+    static void putU32(std::vector<std::uint8_t>& out, std::uint32_t v) {
+        for (int s = 24; s >= 0; s -= 8) out.push_back((std::uint8_t)(v >> s));
+    }
+
+    static std::uint32_t getU32(const std::uint8_t* p) {
+        return ((std::uint32_t)p[0] << 24) | ((std::uint32_t)p[1] << 16) | ((std::uint32_t)p[2] << 8) | p[3];
+    }
+}
+
+std::vector<std::uint8_t> encodeQoi(const cv::Mat& img) {
+    CV_Assert(!img.empty() && img.depth() == CV_8U);
+    const int cn = img.channels();
+    CV_Assert(cn == 1 || cn == 3 || cn == 4);
+
+    std::vector<std::uint8_t> out;
+    out.reserve(kQoiHeader + img.total() + sizeof(kQoiEnd));
+    out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+    putU32(out, (std::uint32_t)img.cols);
+    putU32(out, (std::uint32_t)img.rows);
+    out.push_back(cn == 4 ? 4 : 3);
+    out.push_back(0); // sRGB
+
+    Rgba index[64] = {};
+    Rgba prev{ 0, 0, 0, 255 };
+    int run = 0;
+    for (int y = 0; y < img.rows; ++y) {
+        const std::uint8_t* p = img.ptr<std::uint8_t>(y);
+        for (int x = 0; x < img.cols; ++x, p += cn) {
+            const Rgba px = cn == 1 ? Rgba{ p[0], p[0], p[0], 255 }
+                : Rgba{ p[2], p[1], p[0], cn == 4 ? p[3] : (std::uint8_t)255 };
+            if (px == prev) {
+                if (++run == 62) { out.push_back((std::uint8_t)(kQoiRun | (run - 1))); run = 0; }
+                continue;
+            }
+            if (run > 0) { out.push_back((std::uint8_t)(kQoiRun | (run - 1))); run = 0; }
+
+            const int h = qoiHash(px);
+            if (index[h] == px) {
+                out.push_back((std::uint8_t)(kQoiIndex | h));
+            }
+            else {
+                index[h] = px;
+                if (px.a == prev.a) {
+                    const int dr = (signed char)(px.r - prev.r);
+                    const int dg = (signed char)(px.g - prev.g);
+                    const int db = (signed char)(px.b - prev.b);
+                    const int dr_dg = dr - dg, db_dg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        out.push_back((std::uint8_t)(kQoiDiff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                    }
+                    else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+                        out.push_back((std::uint8_t)(kQoiLuma | (dg + 32)));
+                        out.push_back((std::uint8_t)((dr_dg + 8) << 4 | (db_dg + 8)));
+                    }
+                    else {
+                        out.insert(out.end(), { kQoiRgb, px.r, px.g, px.b });
+                    }
+                }
+                else {
+                    out.insert(out.end(), { kQoiRgba, px.r, px.g, px.b, px.a });
+                }
+            }
+            prev = px;
+        }
+    }
+    if (run > 0) out.push_back((std::uint8_t)(kQoiRun | (run - 1)));
+    out.insert(out.end(), std::begin(kQoiEnd), std::end(kQoiEnd));
+    return out;
+}
+
+cv::Mat decodeQoi(const std::vector<std::uint8_t>& data) {
+    if (data.size() < kQoiHeader + sizeof(kQoiEnd) || std::memcmp(data.data(), "qoif", 4) != 0) return cv::Mat();
+    const std::uint32_t w = getU32(&data[4]), h = getU32(&data[8]);
+    const int cn = data[12];
+    if (w == 0 || h == 0 || (cn != 3 && cn != 4) || (std::uint64_t)w * h > (std::uint64_t)1 << 30) return cv::Mat();
+
+    cv::Mat img((int)h, (int)w, CV_8UC(cn));
+    Rgba index[64] = {};
+    Rgba px{ 0, 0, 0, 255 };
+    size_t pos = kQoiHeader;
+    const size_t end = data.size() - sizeof(kQoiEnd);
+    int run = 0;
+    for (int y = 0; y < img.rows; ++y) {
+        std::uint8_t* p = img.ptr<std::uint8_t>(y);
+        for (int x = 0; x < img.cols; ++x, p += cn) {
+            if (run > 0) {
+                --run;
+            }
+            else if (pos < end) {
+                const std::uint8_t b = data[pos++];
+                if (b == kQoiRgb) {
+                    if (pos + 3 > end) return cv::Mat();
+                    px.r = data[pos]; px.g = data[pos + 1]; px.b = data[pos + 2];
+                    pos += 3;
+                }
+                else if (b == kQoiRgba) {
+                    if (pos + 4 > end) return cv::Mat();
+                    px = Rgba{ data[pos], data[pos + 1], data[pos + 2], data[pos + 3] };
+                    pos += 4;
+                }
+                else if ((b & 0xc0) == kQoiIndex) {
+                    px = index[b & 0x3f];
+                }
+                else if ((b & 0xc0) == kQoiDiff) {
+                    px.r = (std::uint8_t)(px.r + ((b >> 4) & 3) - 2);
+                    px.g = (std::uint8_t)(px.g + ((b >> 2) & 3) - 2);
+                    px.b = (std::uint8_t)(px.b + (b & 3) - 2);
+                }
+                else if ((b & 0xc0) == kQoiLuma) {
+                    if (pos + 1 > end) return cv::Mat();
+                    const std::uint8_t b2 = data[pos++];
+                    const int dg = (b & 0x3f) - 32;
+                    px.r = (std::uint8_t)(px.r + dg - 8 + ((b2 >> 4) & 0x0f));
+                    px.g = (std::uint8_t)(px.g + dg);
+                    px.b = (std::uint8_t)(px.b + dg - 8 + (b2 & 0x0f));
+                }
+                else {
+                    run = b & 0x3f;
+                }
+                index[qoiHash(px)] = px;
+            }
+            else {
+                return cv::Mat(); // truncated
+            }
+            p[0] = px.b; p[1] = px.g; p[2] = px.r;
+            if (cn == 4) p[3] = px.a;
+        }
+    }
+    return img;
+}
+
+DebugWriter::DebugWriter(const DebugWriterOptions& opt) : opt_(opt) {
+    opt_.sample_rate = std::clamp(opt_.sample_rate, 0.0, 1.0);
+    const int n = std::max(1, opt_.threads);
+    for (int i = 0; i < n; ++i) workers_.emplace_back([this] { run(); });
+}
+
+DebugWriter::~DebugWriter() {
+    flush();
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        stop_ = true;
+    }
+    has_work_.notify_all();
+    for (auto& t : workers_) t.join();
+}
+
+const char* DebugWriter::extension(DebugFormat format) {
+    return format == DebugFormat::Qoi ? ".qoi" : ".png";
+}
+
+bool DebugWriter::sample() {
+    std::lock_guard<std::mutex> lk(m_);
+    sample_acc_ += opt_.sample_rate;
+    if (sample_acc_ >= 1.0) {
+        sample_acc_ -= 1.0;
+        ++stats_.images_sampled;
+        return true;
+    }
+    ++stats_.images_skipped;
+    return false;
+}
+
+bool DebugWriter::submit(const cv::Mat& img, const std::string& stem) {
+    CV_Assert(!img.empty() && img.depth() == CV_8U);
+    CV_Assert(img.channels() == 1 || img.channels() == 3 || img.channels() == 4);
+    const size_t bytes = img.total() * img.elemSize();
+    const std::string path = stem + extension(opt_.format);
+    {
+        // Reserve the budget first so the copy is only made for accepted artifacts;
+        // one artifact larger than the whole budget still passes an empty queue.
+        std::lock_guard<std::mutex> lk(m_);
+        if (queued_bytes_ > 0 && queued_bytes_ + bytes > opt_.max_queued_bytes) {
+            ++stats_.dropped;
+            if (opt_.verbose) std::cerr << "[debug] queue full, dropped: " << path << "\n";
+            return false;
+        }
+        queued_bytes_ += bytes;
+    }
+    Job job{ img.clone(), path };
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        q_.push_back(std::move(job));
+    }
+    has_work_.notify_one();
+    return true;
+}
+
+void DebugWriter::flush() {
+    std::unique_lock<std::mutex> lk(m_);
+    idle_.wait(lk, [&] { return q_.empty() && busy_ == 0 && queued_bytes_ == 0; });
+}
+
+DebugWriterStats DebugWriter::stats() const {
+    std::lock_guard<std::mutex> lk(m_);
+    return stats_;
+}
+
+void DebugWriter::run() {
+    for (;;) {
+        std::unique_lock<std::mutex> lk(m_);
+        has_work_.wait(lk, [&] { return stop_ || !q_.empty(); });
+        if (q_.empty()) return; // stopped and drained
+        Job job = std::move(q_.front());
+        q_.pop_front();
+        ++busy_;
+        lk.unlock();
+
+        write(job);
+
+        lk.lock();
+        queued_bytes_ -= job.img.total() * job.img.elemSize();
+        --busy_;
+        if (q_.empty() && busy_ == 0) idle_.notify_all();
+    }
+}
+
+void DebugWriter::write(const Job& job) {
+    auto count = [&](std::uint64_t DebugWriterStats::* field) {
+        std::lock_guard<std::mutex> lk(m_);
+        ++(stats_.*field);
+    };
+    const fs::path path(job.path);
+    try {
+        const std::string dir = path.parent_path().string();
+        if (!dir.empty()) {
+            std::lock_guard<std::mutex> lk(dirs_m_);
+            if (dirs_.insert(dir).second) fs::create_directories(dir);
+        }
+
+        std::uint64_t h = 0;
+        if (opt_.dedup) {
+            h = contentHash(job.img);
+            std::string src;
+            {
+                std::lock_guard<std::mutex> lk(dedup_m_);
+                for (auto it = recent_.rbegin(); it != recent_.rend(); ++it) {
+                    if (it->first == h) { src = it->second; break; }
+                }
+            }
+            if (!src.empty() && src != job.path) {
+                std::error_code ec;
+                fs::remove(path, ec);
+                fs::create_hard_link(src, path, ec);
+                if (ec) fs::copy_file(src, path, fs::copy_options::overwrite_existing, ec);
+                if (!ec) {
+                    count(&DebugWriterStats::deduplicated);
+                    if (opt_.verbose) std::cerr << "[debug] linked: " << job.path << " -> " << src << "\n";
+                    return;
+                }
+            }
+        }
+
+        // The path may be a hard link from an earlier dedup: unlink it so the
+        // truncating write below cannot rewrite the inode it shares.
+        {
+            std::error_code ec;
+            fs::remove(path, ec);
+        }
+
+        bool ok = false;
+        if (opt_.format == DebugFormat::Qoi) {
+            const std::vector<std::uint8_t> bytes = encodeQoi(job.img);
+            std::ofstream f(path, std::ios::binary | std::ios::trunc);
+            ok = (bool)f.write(reinterpret_cast<const char*>(bytes.data()), (std::streamsize)bytes.size());
+        }
+        else if (opt_.format == DebugFormat::PngFast) {
+            ok = cv::imwrite(job.path, job.img, { cv::IMWRITE_PNG_COMPRESSION, 0 });
+        }
+        else {
+            ok = cv::imwrite(job.path, job.img);
+        }
+        if (!ok) {
+            count(&DebugWriterStats::failed);
+            if (opt_.verbose) std::cerr << "[debug] save failed: " << job.path << "\n";
+            return;
+        }
+        if (opt_.dedup) {
+            std::lock_guard<std::mutex> lk(dedup_m_);
+            recent_.emplace_back(h, job.path);
+            if (recent_.size() > kDedupWindow) recent_.pop_front();
+        }
+        count(&DebugWriterStats::written);
+        if (opt_.verbose) std::cerr << "[debug] saved: " << job.path << "\n";
+    }
+    catch (const std::exception& e) {
+        count(&DebugWriterStats::failed);
+        if (opt_.verbose) std::cerr << "[debug] save failed: " << job.path << " | " << e.what() << "\n";
+    }
+}
@@ -0,0 +1,93 @@
+﻿#include "frame_precheck.hpp"
+#include "color_profile.hpp"
+#include "color_segmenter.hpp"
+
+#include <algorithm>
+using namespace cv;
+
+namespace {
+    // Downscale `src` so max(width,height) ≤ side (INTER_AREA); returns src if already small.
+    static Mat shrink(const Mat& src, int side, ScratchMat& store) {
+        const int long_side = std::max(src.cols, src.rows);
+        if (side <= 0 || long_side <= side) return src;
+        const double s = (double)side / (double)long_side;
+        const Size sz(std::max(1, cvRound(src.cols * s)), std::max(1, cvRound(src.rows * s)));
+        Mat& dst = store.view(sz, CV_8UC3);
+        resize(src, dst, sz, 0.0, 0.0, INTER_AREA);
+        return dst;
+    }
+
+    // HSV + CLAHE on V (as the segmenter) and the fused classifier.
+    static void classify(const Mat& bgr, const precheck::PrecheckOptions& opt,
+        precheck::PrecheckWorkspace& ws, bool want_labels)
+    {
+        cvtColor(bgr, ws.hsv, COLOR_BGR2HSV);
+        extractChannel(ws.hsv, ws.v, 2);
+        if (!ws.clahe) ws.clahe = createCLAHE(2.0, Size(8, 8));
+        ws.clahe->apply(ws.v, ws.v_eq);
+        insertChannel(ws.v_eq, ws.hsv, 2);
+        ColorSegmenter::classifyHSV(ws.hsv, opt.smin, opt.vmin, ws.mask,
+            want_labels ? &ws.labels : nullptr, opt.profile.get());
+    }
+}
+
+precheck::PrecheckOptions precheck::optionsFor(const DetectOptions& opt) {
+    PrecheckOptions p;
+    p.smin = std::max(0, opt.seg_smin - 20);
+    p.vmin = std::max(0, opt.seg_vmin - 20);
+    p.profile = opt.color_profile;
+    if (p.profile) {
+        // A palette with fewer colors can never show min_hues of them.
+        bool seen[256] = {};
+        int distinct = 0;
+        for (const ColorRange& c : p.profile->colors()) {
+            if (!seen[(uchar)c.color]) { seen[(uchar)c.color] = true; ++distinct; }
+        }
+        p.min_hues = std::max(1, std::min(p.min_hues, distinct));
+    }
+    return p;
+}
+
+PrecheckReject precheck::run(const Mat& bgr, const PrecheckOptions& opt, PrecheckWorkspace& ws) {
+    CV_Assert(!bgr.empty() && bgr.type() == CV_8UC3);
+
+    // One full-frame read: coarse copy first, thumbnail from the coarse copy.
+    const Mat coarse = shrink(bgr, opt.coarse_side, ws.coarse);
+    const Mat thumb = shrink(coarse, opt.thumb_side, ws.thumb);
+
+    // (A) Thumbnail: enough marker-colored pixels of enough distinct colors.
+    classify(thumb, opt, ws, /*want_labels=*/true);
+    const int colored = countNonZero(ws.mask);
+    if ((double)colored < std::max(1.0, opt.min_color_frac * (double)thumb.total())) {
+        return PrecheckReject::FewColors;
+    }
+    bool seen[8] = {};
+    int hues = 0;
+    for (int y = 0; y < ws.labels.rows; ++y) {
+        const uchar* l = ws.labels.ptr<uchar>(y);
+        for (int x = 0; x < ws.labels.cols; ++x) {
+            if (l[x] != 0 && l[x] < 8 && !seen[l[x]]) { seen[l[x]] = true; ++hues; }
+        }
+    }
+    if (hues < opt.min_hues) return PrecheckReject::FewHues;
+
+    // (B) Coarse mask: one closed blob large enough to be a marker.
+    classify(coarse, opt, ws, /*want_labels=*/false);
+    binmorph::close(ws.mask, ws.mask, 1, ws.morph);
+    const int n = connectedComponentsWithStats(ws.mask, ws.cc_labels, ws.cc_stats, ws.cc_centroids, 8, CV_32S);
+    int largest = 0;
+    for (int i = 1; i < n; ++i) largest = std::max(largest, ws.cc_stats.at<int>(i, CC_STAT_AREA));
+    if ((double)largest < opt.min_blob_frac * (double)coarse.total()) return PrecheckReject::NoBlob;
+
+    return PrecheckReject::None;
+}
+
+const char* precheck::rejectName(PrecheckReject r) {
+    switch (r) {
+    case PrecheckReject::None:      return "none";
+    case PrecheckReject::FewColors: return "few_colors";
+    case PrecheckReject::FewHues:   return "few_hues";
+    case PrecheckReject::NoBlob:    return "no_blob";
+    }
+    return "unknown";
+}
@@ -0,0 +1,417 @@
+#include "frame_server.hpp"
+#include "bounded_queue.hpp"
+#include "geometry.hpp"
+#include "image_source.hpp"
+#include "marker_detector.hpp"
+#include "timer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    /// @brief One JSON result line on its way to a stream's writer.
+    struct Reply {
+        std::uint64_t seq = 0;
+        std::string line;
+        bool end = false; ///< Sentinel: seq is the total number of replies
+    };
+
+    /**
+     * @brief Per-stream result queue (workers → writer thread).
+     *
+     * The reader takes one credit per frame before queueing it and the writer
+     * gives it back once the reply is written (or dropped), so at most
+     * `credits` replies are ever outstanding. `done` holds that many plus the
+     * end sentinel, hence a worker's push never waits on a slow client.
+     */
+    struct Stream {
+        explicit Stream(size_t credits) : done(credits + 2), free_(credits) {}
+        BoundedQueue<Reply> done;
+
+        void acquire() {
+            std::unique_lock<std::mutex> lk(m_);
+            cv_.wait(lk, [&] { return free_ > 0; });
+            --free_;
+        }
+
+        void release() {
+            {
+                std::lock_guard<std::mutex> lk(m_);
+                ++free_;
+            }
+            cv_.notify_one();
+        }
+
+    private:
+        size_t free_;
+        std::mutex m_;
+        std::condition_variable cv_;
+    };
+
+    static std::uint32_t le32(const std::uint8_t* p) {
+        return (std::uint32_t)p[0] | ((std::uint32_t)p[1] << 8)
+            | ((std::uint32_t)p[2] << 16) | ((std::uint32_t)p[3] << 24);
+    }
+
+    static void putLe32(std::uint8_t* p, std::uint32_t v) {
+        p[0] = (std::uint8_t)v; p[1] = (std::uint8_t)(v >> 8);
+        p[2] = (std::uint8_t)(v >> 16); p[3] = (std::uint8_t)(v >> 24);
+    }
+
+    static long sysRead(int fd, void* buf, size_t n) {
+#ifdef _WIN32
+        return _read(fd, buf, (unsigned)std::min<size_t>(n, 1u << 30));
+#else
+        return (long)::read(fd, buf, n);
+#endif
+    }
+
+    static long sysWrite(int fd, const void* buf, size_t n) {
+#ifdef _WIN32
+        return _write(fd, buf, (unsigned)std::min<size_t>(n, 1u << 30));
+#else
+        return (long)::write(fd, buf, n);
+#endif
+    }
+
+    /// @brief Read exactly n bytes. Returns the number read (< n on EOF/error).
+    static size_t readFull(int fd, void* buf, size_t n) {
+        size_t got = 0;
+        auto* p = static_cast<std::uint8_t*>(buf);
+        while (got < n) {
+            const long r = sysRead(fd, p + got, n - got);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) break;
+            got += (size_t)r;
+        }
+        return got;
+    }
+
+    static bool writeFull(int fd, const std::string& s) {
+        size_t put = 0;
+        while (put < s.size()) {
+            const long w = sysWrite(fd, s.data() + put, s.size() - put);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            put += (size_t)w;
+        }
+        return true;
+    }
+
+    /// @brief Format one result record (JSON line, no pretty-printing).
+    static std::string formatReply(std::uint32_t id, const char* status,
+        const std::optional<DetectionResult>& res = std::nullopt, double ms = 0.0)
+    {
+        std::ostringstream os;
+        os << std::fixed << std::setprecision(3);
+        os << "{\"id\":" << id << ",\"status\":\"" << status << '"';
+        if (res) {
+            os << ",\"coverage\":" << res->coverage_percent
+                << ",\"grid_ok\":" << (res->grid_ok ? "true" : "false")
+                << ",\"polygon\":[";
+            for (size_t i = 0; i < res->polygon.size(); ++i) {
+                if (i) os << ',';
+                os << '[' << res->polygon[i].x << ',' << res->polygon[i].y << ']';
+            }
+            os << ']';
+        }
+        os << ",\"ms\":" << ms << "}\n";
+        return os.str();
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Frame header
+// -----------------------------------------------------------------------------
+
+bool parseFrameHeader(const std::uint8_t* b, FrameHeader& out) {
+    if (std::memcmp(b, "MCE1", 4) != 0) return false;
+    out.id = le32(b + 4);
+    out.kind = le32(b + 8);
+    out.width = le32(b + 12);
+    out.height = le32(b + 16);
+    out.length = le32(b + 20);
+
+    if (out.length > kMaxFramePayload) return false;
+    if (out.kind == FrameHeader::Encoded) return out.length > 0;
+    if (out.kind == FrameHeader::RawBgr) {
+        const std::uint64_t need = (std::uint64_t)out.width * out.height * 3u;
+        return out.width > 0 && out.height > 0
+            && out.width <= (std::uint32_t)std::numeric_limits<int>::max()
+            && out.height <= (std::uint32_t)std::numeric_limits<int>::max()
+            && need == out.length;
+    }
+    return false;
+}
+
+void writeFrameHeader(const FrameHeader& hdr, std::uint8_t* b) {
+    std::memcpy(b, "MCE1", 4);
+    putLe32(b + 4, hdr.id);
+    putLe32(b + 8, hdr.kind);
+    putLe32(b + 12, hdr.width);
+    putLe32(b + 16, hdr.height);
+    putLe32(b + 20, hdr.length);
+}
+
+// -----------------------------------------------------------------------------
+// FrameServer
+// -----------------------------------------------------------------------------
+
+struct FrameServer::Job {
+    FrameHeader hdr;
+    std::vector<std::uint8_t> payload;
+    std::uint32_t charged = 0; ///< Payload bytes held against Shared's budget
+    std::uint64_t seq = 0;
+    std::shared_ptr<Stream> stream;
+};
+
+struct FrameServer::Shared {
+    explicit Shared(size_t depth) : jobs(depth) {}
+    BoundedQueue<Job> jobs;
+
+    /// @brief Charge @p bytes of payload, waiting while the server-wide budget is spent
+    void acquire(std::uint32_t bytes) {
+        std::unique_lock<std::mutex> lk(m);
+        cv.wait(lk, [&] { return used + bytes <= kServePayloadBudget; });
+        used += bytes;
+    }
+
+    void release(std::uint32_t bytes) {
+        if (!bytes) return;
+        {
+            std::lock_guard<std::mutex> lk(m);
+            used -= bytes;
+        }
+        cv.notify_all();
+    }
+
+    std::uint64_t used = 0;
+    std::mutex m;
+    std::condition_variable cv;
+};
+
+FrameServer::FrameServer(const DetectOptions& opt, const BatchOptions& bopt)
+    : opt_(opt), bopt_(bopt)
+{
+    const int hw = std::max(1, (int)std::thread::hardware_concurrency());
+    jobs_ = bopt.jobs > 0 ? bopt.jobs : hw;
+    const size_t depth = (size_t)(bopt.queue_depth > 0 ? bopt.queue_depth : 2 * jobs_);
+    shared_ = std::make_shared<Shared>(depth);
+
+    // Workers live as long as the server: detector state and workspaces stay warm.
+    for (int w = 0; w < jobs_; ++w) {
+        workers_.emplace_back([this] {
+            MarkerDetector detector;
+            DetectorWorkspace ws;
+            while (auto job = shared_->jobs.pop()) {
+                Timer t;
+                Reply r;
+                r.seq = job->seq;
+                const FrameHeader& h = job->hdr;
+
+                cv::Mat bgr;
+                cv::Size full;
+                if (h.kind == FrameHeader::RawBgr) {
+                    // Zero-copy view of the payload
+                    bgr = cv::Mat((int)h.height, (int)h.width, CV_8UC3, job->payload.data());
+                    full = bgr.size();
+                }
+                else {
+                    DecodedImage img;
+                    try {
+                        decodeImageBuffer(job->payload.data(), job->payload.size(),
+                            bopt_.reduced_decode ? opt_.max_side : 0, img);
+                    }
+                    catch (const std::exception& e) {
+                        if (opt_.debug) std::cerr << "[debug] decode failed: id=" << h.id << " | " << e.what() << "\n";
+                    }
+                    bgr = std::move(img.bgr);
+                    full = img.full_size;
+                }
+
+                if (bgr.empty()) {
+                    r.line = formatReply(h.id, "decode_error", std::nullopt, t.ms());
+                }
+                else {
+                    try {
+                        auto res = detector.detect(bgr, opt_, ws);
+                        if (res && full != bgr.size()) {
+                            res->polygon = geom::mapQuadToSize(res->polygon, bgr.size(), full);
+                        }
+                        r.line = formatReply(h.id, res ? "ok" : "not_found", res, t.ms());
+                    }
+                    catch (const std::exception& e) {
+                        if (opt_.debug) std::cerr << "[debug] detect failed: id=" << h.id << " | " << e.what() << "\n";
+                        r.line = formatReply(h.id, "error", std::nullopt, t.ms());
+                    }
+                }
+                job->payload = {}; // free pixels before the reply waits for output
+                shared_->release(job->charged);
+                job->stream->done.push(std::move(r)); // never blocks, see Stream
+            }
+        });
+    }
+}
+
+FrameServer::~FrameServer() {
+    shared_->jobs.close();
+    for (auto& t : workers_) t.join();
+}
+
+size_t FrameServer::serveStream(int in_fd, int out_fd) {
+    auto stream = std::make_shared<Stream>((size_t)(2 * jobs_));
+
+    // --- Writer: emits replies in submission order (or as they finish) ---
+    std::thread writer([&] {
+        std::map<std::uint64_t, std::string> pending;
+        std::uint64_t next_out = 0;
+        std::uint64_t total = std::numeric_limits<std::uint64_t>::max();
+        bool ok = true; // stop writing (but keep draining) once the peer is gone
+        while (next_out < total) {
+            auto r = stream->done.pop();
+            if (!r) break;
+            if (r->end) { total = r->seq; continue; }
+            if (!bopt_.ordered) {
+                ok = ok && writeFull(out_fd, r->line);
+                stream->release();
+                ++next_out;
+                continue;
+            }
+            pending.emplace(r->seq, std::move(r->line));
+            for (auto p = pending.find(next_out); p != pending.end(); p = pending.find(next_out)) {
+                ok = ok && writeFull(out_fd, p->second);
+                stream->release();
+                pending.erase(p);
+                ++next_out;
+            }
+        }
+    });
+
+    // --- Reader (this thread): parse frames and hand them to the pool ---
+    std::uint64_t seq = 0;
+    std::uint8_t raw[kFrameHeaderSize];
+    for (;;) {
+        const size_t got = readFull(in_fd, raw, kFrameHeaderSize);
+        if (got == 0) break; // clean EOF between frames
+
+        // Bound this stream's in-flight frames before reading the next payload,
+        // so a client that stops reading only ever stalls itself.
+        stream->acquire();
+
+        Job job;
+        bool hdr_ok = got == kFrameHeaderSize && parseFrameHeader(raw, job.hdr);
+        if (hdr_ok) {
+            // Payloads of all connections share one budget, so the number of
+            // clients does not multiply the memory held by in-flight frames.
+            shared_->acquire(job.hdr.length);
+            job.charged = job.hdr.length;
+            try {
+                job.payload.resize(job.hdr.length);
+            }
+            catch (const std::bad_alloc&) {
+                hdr_ok = false;
+            }
+        }
+        if (!hdr_ok || readFull(in_fd, job.payload.data(), job.payload.size()) != job.payload.size()) {
+            // The stream cannot be resynchronized after a bad frame: answer it and stop.
+            if (opt_.debug) std::cerr << "[debug] serve: bad frame #" << seq << "\n";
+            job.payload = {};
+            shared_->release(job.charged);
+            stream->done.push(Reply{ seq++, formatReply(hdr_ok ? job.hdr.id : 0, "bad_frame") });
+            break;
+        }
+
+        job.seq = seq++;
+        job.stream = stream;
+        const std::uint32_t charged = job.charged;
+        if (!shared_->jobs.push(std::move(job))) {
+            shared_->release(charged);
+            stream->release();
+            break;
+        }
+    }
+
+    stream->done.push(Reply{ seq, std::string(), true });
+    writer.join();
+    return (size_t)seq;
+}
+
+#ifdef _WIN32
+bool FrameServer::serveUnixSocket(const std::string&) {
+    std::cerr << "Unix sockets are not supported on this platform; use --serve with stdin\n";
+    return false;
+}
+#else
+bool FrameServer::serveUnixSocket(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Invalid socket path: " << path << "\n";
+        return false;
+    }
+    const int lfd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) {
+        std::cerr << "socket() failed: " << std::strerror(errno) << "\n";
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    ::unlink(path.c_str());
+    if (::bind(lfd, (const sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(lfd, 16) != 0) {
+        std::cerr << "Cannot listen on " << path << ": " << std::strerror(errno) << "\n";
+        ::close(lfd);
+        return false;
+    }
+    if (opt_.debug) std::cerr << "[debug] serve: listening on " << path << "\n";
+
+    // Connection threads are detached so finished clients release their
+    // resources at once; the live count lets shutdown wait for the rest.
+    struct Live {
+        int count = 0;
+        std::mutex m;
+        std::condition_variable cv;
+    };
+    auto live = std::make_shared<Live>();
+
+    for (;;) {
+        const int cfd = ::accept(lfd, nullptr, nullptr);
+        if (cfd < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "accept() failed: " << std::strerror(errno) << "\n";
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lk(live->m);
+            ++live->count;
+        }
+        std::thread([this, cfd, live] {
+            serveStream(cfd, cfd);
+            ::close(cfd);
+            std::lock_guard<std::mutex> lk(live->m);
+            if (--live->count == 0) live->cv.notify_all();
+        }).detach();
+    }
+    {
+        std::unique_lock<std::mutex> lk(live->m);
+        live->cv.wait(lk, [&] { return live->count == 0; });
+    }
+    ::close(lfd);
+    ::unlink(path.c_str());
+    return true;
+}
+#endif
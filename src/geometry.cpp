@@ -1,5 +1,7 @@
 ﻿#include "geometry.hpp"
+#include "trace.hpp"
 #include <algorithm>
+#include <climits>
 #include <cmath>
 
 using namespace cv;
@@ -37,70 +39,212 @@ namespace {
         }
         return out;
     }
+
+    /// @brief Fit 4 corners to a contour: convex approxPolyDP quad, else minAreaRect.
+    static vector<Point2f> quadFromContour(const vector<Point>& contour, vector<Point>& approx) {
+        MCE_TRACE_SCOPE("quad.approxPolyDP");
+        // Try direct polygon approximation.
+        approxPolyDP(contour, approx, 0.02 * arcLength(contour, true), true);
+        if (approx.size() == 4 && isContourConvex(approx)) {
+            vector<Point2f> q;
+            q.reserve(4);
+            for (auto& p : approx) q.push_back(Point2f((float)p.x, (float)p.y));
+            return sortClockwiseTL(q);
+        }
+
+        // Fallback: minAreaRect box.
+        RotatedRect rr = minAreaRect(contour);
+        Point2f p4[4];
+        rr.points(p4);
+        vector<Point2f> q{ p4[0], p4[1], p4[2], p4[3] };
+        return sortClockwiseTL(q);
+    }
+
+    /// @brief Largest external contour of ws.closed by area (QuadEngine::Contours).
+    static const vector<Point>* largestContour(geom::QuadWorkspace& ws) {
+        MCE_TRACE_SCOPE("quad.findContours");
+        auto& contours = ws.contours;
+        findContours(ws.closed, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
+
+        // Select largest contour by area (by index, no copies).
+        double bestA = 0.0;
+        int bestIdx = -1;
+        for (int i = 0; i < (int)contours.size(); ++i) {
+            double a = contourArea(contours[i]);
+            if (a > bestA) { bestA = a; bestIdx = i; }
+        }
+        return bestIdx < 0 ? nullptr : &contours[bestIdx];
+    }
+
+    /// @brief Outer contour of the largest connected component (QuadEngine::Components).
+    static const vector<Point>* largestBlobContour(geom::QuadWorkspace& ws) {
+        MCE_TRACE_SCOPE("quad.connectedComponents");
+        const int n = connectedComponentsWithStats(ws.closed, ws.labels, ws.stats, ws.centroids, 8, CV_32S);
+
+        int bestLabel = -1, bestArea = 0;
+        for (int l = 1; l < n; ++l) { // label 0 is background
+            const int a = ws.stats.at<int>(l, CC_STAT_AREA);
+            if (a > bestArea) { bestArea = a; bestLabel = l; }
+        }
+        if (bestLabel < 0) return nullptr;
+
+        const Rect box(ws.stats.at<int>(bestLabel, CC_STAT_LEFT),
+            ws.stats.at<int>(bestLabel, CC_STAT_TOP),
+            ws.stats.at<int>(bestLabel, CC_STAT_WIDTH),
+            ws.stats.at<int>(bestLabel, CC_STAT_HEIGHT));
+
+        // Isolate the blob inside its bounding box, with a zero border so the
+        // tracer never touches the image edge.
+        ws.blob.create(box.height + 2, box.width + 2, CV_8UC1);
+        ws.blob.setTo(Scalar::all(0));
+        Mat inner = ws.blob(Rect(1, 1, box.width, box.height));
+        compare(ws.labels(box), Scalar(bestLabel), inner, CMP_EQ);
+
+        auto& contours = ws.contours;
+        findContours(ws.blob, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE,
+            Point(box.x - 1, box.y - 1));
+        if (contours.empty()) return nullptr;
+
+        // One 8-connected component has one outer contour; guard anyway.
+        size_t bestIdx = 0;
+        double bestA = contourArea(contours[0]);
+        for (size_t i = 1; i < contours.size(); ++i) {
+            const double a = contourArea(contours[i]);
+            if (a > bestA) { bestA = a; bestIdx = i; }
+        }
+        return &contours[bestIdx];
+    }
+
+    // remap()'s fixed point: 1/32 px sample coordinates, the integer part in a
+    // CV_16SC2 map and the fraction as an index into its bilinear weight table.
+    constexpr int kWarpTab = INTER_TAB_SIZE;
+    constexpr double kWarpClamp = (double)(INT_MAX / 2);
+
+    /// @brief Perspective warp onto an N×N square (N a compile-time constant).
+    ///
+    /// Sample coordinates are generated for a band of rows in fixed-length
+    /// batches into stack buffers, then gathered by OpenCV's vectorized remap()
+    /// with INTER_LINEAR and BORDER_REPLICATE: the same maps warpPerspective
+    /// builds, without its per-call tiling, block dispatch and map allocation.
+    template <int N>
+    struct SquareWarper {
+        static constexpr int kBand = 16;
+        static_assert(N % kBand == 0, "square size must be a whole number of bands");
+
+        static void run(const Mat& src, const double* M, Mat& dst) {
+            short xy[kBand * N * 2];
+            ushort frac[kBand * N];
+            double fx[N], fy[N];
+            for (int v0 = 0; v0 < N; v0 += kBand) {
+                for (int r = 0; r < kBand; ++r) {
+                    const int v = v0 + r;
+                    const double X0 = M[1] * v + M[2];
+                    const double Y0 = M[4] * v + M[5];
+                    const double W0 = M[7] * v + M[8];
+                    for (int u = 0; u < N; ++u) {
+                        const double W = W0 + M[6] * u;
+                        const double k = W != 0.0 ? kWarpTab / W : 0.0;
+                        fx[u] = std::clamp((X0 + M[0] * u) * k, -kWarpClamp, kWarpClamp);
+                        fy[u] = std::clamp((Y0 + M[3] * u) * k, -kWarpClamp, kWarpClamp);
+                    }
+                    short* m = xy + r * N * 2;
+                    ushort* a = frac + r * N;
+                    for (int u = 0; u < N; ++u) {
+                        const int X = cvRound(fx[u]), Y = cvRound(fy[u]);
+                        m[2 * u] = saturate_cast<short>(X >> INTER_BITS);
+                        m[2 * u + 1] = saturate_cast<short>(Y >> INTER_BITS);
+                        a[u] = (ushort)((Y & (kWarpTab - 1)) * kWarpTab + (X & (kWarpTab - 1)));
+                    }
+                }
+                Mat band = dst.rowRange(v0, v0 + kBand);
+                remap(src, band, Mat(kBand, N, CV_16SC2, xy), Mat(kBand, N, CV_16UC1, frac),
+                    INTER_LINEAR, BORDER_REPLICATE);
+            }
+        }
+    };
+
+    using WarpFn = void (*)(const Mat&, const double*, Mat&);
+
+    /// @brief Specialized warp for an N×N square (nullptr = none). Sizes: the
+    ///        usual warp_size values and their NV12 chroma halves.
+    static WarpFn fixedWarp(int N) {
+        switch (N) {
+        case 64:  return &SquareWarper<64>::run;
+        case 128: return &SquareWarper<128>::run;
+        case 160: return &SquareWarper<160>::run;
+        case 256: return &SquareWarper<256>::run;
+        case 320: return &SquareWarper<320>::run;
+        default:  return nullptr;
+        }
+    }
 }
 
 std::optional<std::vector<Point2f>>
 geom::findStrongQuad(const Mat& allowedMask) {
+    QuadWorkspace ws;
+    return findStrongQuad(allowedMask, ws);
+}
+
+std::optional<std::vector<Point2f>>
+geom::findStrongQuad(const Mat& allowedMask, QuadWorkspace& ws, QuadEngine engine) {
     CV_Assert(!allowedMask.empty() && allowedMask.type() == CV_8UC1);
 
     // Conservative tweak: single 3×3 close to fill small holes.
-    Mat work = allowedMask.clone();
-    Mat k3 = getStructuringElement(MORPH_RECT, Size(3, 3));
-    morphologyEx(work, work, MORPH_CLOSE, k3, Point(-1, -1), 1);
-
-    vector<vector<Point>> contours;
-    findContours(work, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-    if (contours.empty()) return std::nullopt;
-
-    // Select largest contour by area.
-    double bestA = 0.0;
-    vector<Point> best;
-    for (auto& c : contours) {
-        double a = contourArea(c);
-        if (a > bestA) { bestA = a; best = c; }
+    binmorph::close(allowedMask, ws.closed, 1, ws.morph);
+
+    const vector<Point>* bestPtr = (engine == QuadEngine::Components)
+        ? largestBlobContour(ws)
+        : largestContour(ws);
+    if (!bestPtr) return std::nullopt;
+    return quadFromContour(*bestPtr, ws.approx);
+}
+
+std::vector<std::vector<Point2f>>
+geom::findQuadCandidates(const Mat& allowedMask, QuadWorkspace& ws, int max_quads, double min_area_frac) {
+    CV_Assert(!allowedMask.empty() && allowedMask.type() == CV_8UC1);
+    std::vector<std::vector<Point2f>> out;
+    if (max_quads <= 0) return out;
+
+    // Same preprocessing as findStrongQuad().
+    binmorph::close(allowedMask, ws.closed, 1, ws.morph);
+
+    auto& contours = ws.contours;
+    {
+        MCE_TRACE_SCOPE("quad.findContours");
+        findContours(ws.closed, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
     }
-    if (best.empty()) return std::nullopt;
-
-    // Try direct polygon approximation.
-    vector<Point> approx;
-    approxPolyDP(best, approx, 0.02 * arcLength(best, true), true);
-    if (approx.size() == 4 && isContourConvex(approx)) {
-        vector<Point2f> q;
-        q.reserve(4);
-        for (auto& p : approx) q.push_back(Point2f((float)p.x, (float)p.y));
-        return sortClockwiseTL(q);
+
+    // Rank contours by area (indices only) and keep the K largest above the floor.
+    const double minA = std::max(0.0, min_area_frac) * (double)allowedMask.total();
+    vector<std::pair<double, int>> ranked;
+    ranked.reserve(contours.size());
+    for (int i = 0; i < (int)contours.size(); ++i) {
+        const double a = contourArea(contours[i]);
+        if (a > 0.0 && a >= minA) ranked.push_back({ a, i });
     }
+    const size_t k = std::min(ranked.size(), (size_t)max_quads);
+    std::partial_sort(ranked.begin(), ranked.begin() + k, ranked.end(),
+        [](const auto& a, const auto& b) { return a.first > b.first; });
 
-    // Fallback: minAreaRect box.
-    RotatedRect rr = minAreaRect(best);
-    Point2f p4[4];
-    rr.points(p4);
-    vector<Point2f> q{ p4[0], p4[1], p4[2], p4[3] };
-    return sortClockwiseTL(q);
+    out.reserve(k);
+    for (size_t i = 0; i < k; ++i) {
+        out.push_back(quadFromContour(contours[ranked[i].second], ws.approx));
+    }
+    return out;
 }
 
 cv::Mat geom::warpToSquare(const Mat& bgr, const vector<Point2f>& quad, int N) {
     CV_Assert(!bgr.empty() && bgr.type() == CV_8UC3);
     CV_Assert(quad.size() == 4 && N > 0);
 
-    vector<Point2f> src = sortClockwiseTL(quad);
-    vector<Point2f> dst{
-        {0.f, 0.f}, {(float)N - 1, 0.f},
-        {(float)N - 1, (float)N - 1}, {0.f, (float)N - 1}
-    };
-    Mat H = getPerspectiveTransform(src, dst);
-    Mat out;
-    warpPerspective(bgr, out, H, Size(N, N), INTER_LINEAR, BORDER_REPLICATE);
+    Mat Hinv, out;
+    invert(squareHomography(quad, N), Hinv, DECOMP_LU);
+    warpSquare(bgr, Hinv, N, out);
     return out;
 }
 
-geom::WarpResult geom::warpToSquareWithH(const cv::Mat& bgr,
-    const std::vector<cv::Point2f>& quad,
-    int N)
-{
-    CV_Assert(!bgr.empty() && bgr.type() == CV_8UC3);
+cv::Mat geom::squareHomography(const std::vector<cv::Point2f>& quad, int N) {
     CV_Assert(quad.size() == 4 && N > 0);
-
     std::vector<Point2f> src = sortClockwiseTL(quad);
     std::vector<Point2f> dst{
         Point2f(0.f,          0.f),
@@ -108,13 +252,143 @@ geom::WarpResult geom::warpToSquareWithH(const cv::Mat& bgr,
         Point2f((float)N - 1,(float)N - 1),
         Point2f(0.f,         (float)N - 1)
     };
+    return getPerspectiveTransform(src, dst);
+}
 
-    Mat H = getPerspectiveTransform(src, dst);
-    Mat out;
-    warpPerspective(bgr, out, H, Size(N, N), INTER_LINEAR, BORDER_REPLICATE);
+geom::WarpResult geom::warpToSquareWithH(const cv::Mat& bgr,
+    const std::vector<cv::Point2f>& quad,
+    int N)
+{
+    WarpResult res;
+    warpToSquareWithH(bgr, quad, N, res);
+    return res;
+}
 
-    Mat Hinv; invert(H, Hinv, DECOMP_SVD);
-    return { out, H, Hinv };
+bool geom::hasFixedWarp(int N) {
+    return fixedWarp(N) != nullptr;
+}
+
+void geom::warpSquare(const cv::Mat& src, const cv::Mat& Hinv, int N, cv::Mat& dst) {
+    CV_Assert(!src.empty() && src.depth() == CV_8U && N > 0);
+    CV_Assert(Hinv.rows == 3 && Hinv.cols == 3 && Hinv.type() == CV_64F);
+
+    MCE_TRACE_SCOPE("warp.square");
+    const WarpFn fn = fixedWarp(N);
+    if (!fn) {
+        warpPerspective(src, dst, Hinv, Size(N, N), INTER_LINEAR | WARP_INVERSE_MAP, BORDER_REPLICATE);
+        return;
+    }
+    CV_Assert(dst.data != src.data);
+    dst.create(N, N, src.type());
+    const Mat M = Hinv.isContinuous() ? Hinv : Hinv.clone();
+    fn(src, M.ptr<double>(), dst);
+}
+
+void geom::warpToSquareWithH(const cv::Mat& bgr,
+    const std::vector<cv::Point2f>& quad,
+    int N,
+    WarpResult& out)
+{
+    CV_Assert(!bgr.empty() && bgr.type() == CV_8UC3);
+    CV_Assert(quad.size() == 4 && N > 0);
+
+    // The warp samples through the inverse: compute it once (LU, as
+    // warpPerspective would internally) and keep it as Hinv.
+    out.H = squareHomography(quad, N);
+    invert(out.H, out.Hinv, DECOMP_LU);
+    warpSquare(bgr, out.Hinv, N, out.image);
+}
+
+void geom::warpToSquareWithH(const cv::UMat& bgr,
+    const cv::Point& origin,
+    const std::vector<cv::Point2f>& quad,
+    int N,
+    WarpResult& out)
+{
+    CV_Assert(!bgr.empty() && bgr.type() == CV_8UC3);
+    CV_Assert(quad.size() == 4 && N > 0);
+
+    // H maps frame coordinates; the device image is offset by `origin`, so the
+    // device samples through T^-1 · Hinv with T the offset translation.
+    out.H = squareHomography(quad, N);
+    invert(out.H, out.Hinv, DECOMP_LU);
+    const Mat Tinv = (Mat_<double>(3, 3) << 1, 0, -origin.x, 0, 1, -origin.y, 0, 0, 1);
+    warpPerspective(bgr, out.device, Mat(Tinv * out.Hinv), Size(N, N),
+        INTER_LINEAR | WARP_INVERSE_MAP, BORDER_REPLICATE);
+    out.device.copyTo(out.image);
+}
+
+void geom::warpToSquareWithH(const cv::Mat& y,
+    const cv::Mat& uv,
+    const std::vector<cv::Point2f>& quad,
+    int N,
+    WarpResult& out)
+{
+    CV_Assert(!y.empty() && y.type() == CV_8UC1 && uv.type() == CV_8UC2);
+    CV_Assert(uv.cols * 2 == y.cols && uv.rows * 2 == y.rows);
+    CV_Assert(quad.size() == 4 && N > 0 && N % 2 == 0);
+
+    out.H = squareHomography(quad, N);
+    invert(out.H, out.Hinv, DECOMP_LU);
+    warpSquare(y, out.Hinv, N, out.image);
+
+    // Chroma sample (i, j) sits at luma (2i + 0.5, 2j + 0.5) in both planes:
+    // H_uv = D · H · U with U: chroma → luma (source), D: luma → chroma (square),
+    // sampled through H_uv^-1 = U^-1 · Hinv · D^-1.
+    const Mat Uinv = (Mat_<double>(3, 3) << 0.5, 0, -0.25, 0, 0.5, -0.25, 0, 0, 1);
+    const Mat Dinv = (Mat_<double>(3, 3) << 2, 0, 0.5, 0, 2, 0.5, 0, 0, 1);
+    warpSquare(uv, Mat(Uinv * out.Hinv * Dinv), N / 2, out.uv);
+}
+
+std::vector<Point2f> geom::mapQuadToSize(const vector<Point2f>& quad,
+    const Size& from,
+    const Size& to)
+{
+    CV_Assert(from.width > 0 && from.height > 0);
+    const float sx = (float)to.width / (float)from.width;
+    const float sy = (float)to.height / (float)from.height;
+
+    vector<Point2f> out;
+    out.reserve(quad.size());
+    for (auto& p : quad) {
+        out.push_back(Point2f((p.x + 0.5f) * sx - 0.5f, (p.y + 0.5f) * sy - 0.5f));
+    }
+    return out;
+}
+
+std::vector<Point2f> geom::refineQuadCorners(const Mat& bgr,
+    const vector<Point2f>& quad,
+    int radius)
+{
+    CV_Assert(!bgr.empty() && (bgr.type() == CV_8UC3 || bgr.type() == CV_8UC1));
+    if (radius < 1) return quad;
+    MCE_TRACE_SCOPE("quad.refine_corners");
+
+    // cornerSubPix needs the window plus a small border inside the ROI.
+    const int half = radius + 3;
+    const Rect bounds(0, 0, bgr.cols, bgr.rows);
+    const TermCriteria crit(TermCriteria::EPS + TermCriteria::COUNT, 20, 0.05);
+
+    vector<Point2f> out = quad;
+    for (auto& p : out) {
+        const Rect roi = Rect(cvRound(p.x) - half, cvRound(p.y) - half, 2 * half + 1, 2 * half + 1) & bounds;
+        if (roi.width < 2 * radius + 5 || roi.height < 2 * radius + 5) continue;
+
+        Mat gray;
+        if (bgr.channels() == 1) bgr(roi).copyTo(gray); // luma (NV12 Y plane)
+        else cvtColor(bgr(roi), gray, COLOR_BGR2GRAY);
+        vector<Point2f> pt{ Point2f(p.x - (float)roi.x, p.y - (float)roi.y) };
+        cornerSubPix(gray, pt, Size(radius, radius), Size(-1, -1), crit);
+
+        const Point2f refined(pt[0].x + (float)roi.x, pt[0].y + (float)roi.y);
+        const Point2f d = refined - p;
+        // Keep the coarse corner if refinement wandered off (weak or ambiguous gradient).
+        if (std::isfinite(refined.x) && std::isfinite(refined.y)
+            && std::abs(d.x) <= (float)radius && std::abs(d.y) <= (float)radius) {
+            p = refined;
+        }
+    }
+    return out;
 }
 
 double geom::polygonCoveragePercent(const vector<Point2f>& poly, const Size& sz) {
@@ -124,3 +398,29 @@ double geom::polygonCoveragePercent(const vector<Point2f>& poly, const Size& sz)
     if (total <= 0.0) return 0.0;
     return 100.0 * A / total;
 }
+
+double geom::unionCoveragePercent(const vector<vector<Point2f>>& polys, const Size& sz,
+    int max_side, ScratchMat& raster)
+{
+    CV_Assert(sz.width > 0 && sz.height > 0 && max_side > 0);
+    const double s = std::min(1.0, (double)max_side / (double)std::max(sz.width, sz.height));
+    const Size rs(std::max(1, cvRound(sz.width * s)), std::max(1, cvRound(sz.height * s)));
+    Mat& r = raster.view(rs, CV_8UC1);
+    r.setTo(Scalar::all(0));
+
+    // One fill per polygon: a single fillPoly() over all of them uses even-odd
+    // parity, which would punch holes where polygons overlap.
+    constexpr int kShift = 4; // sub-pixel vertices
+    vector<Point> p;
+    for (const auto& poly : polys) {
+        if (poly.size() < 3) continue;
+        p.clear();
+        for (const auto& q : poly) {
+            p.emplace_back(cvRound(q.x * s * (1 << kShift)), cvRound(q.y * s * (1 << kShift)));
+        }
+        const Point* pts = p.data();
+        const int n = (int)p.size();
+        fillPoly(r, &pts, &n, 1, Scalar(255), LINE_8, kShift);
+    }
+    return 100.0 * (double)countNonZero(r) / (double)r.total();
+}
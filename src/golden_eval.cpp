@@ -0,0 +1,146 @@
+#include "golden_eval.hpp"
+#include "report_format.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <numeric>
+
+namespace fs = std::filesystem;
+
+namespace {
+    static std::string trim(const std::string& s) {
+        const size_t a = s.find_first_not_of(" \t\r");
+        if (a == std::string::npos) return std::string();
+        const size_t b = s.find_last_not_of(" \t\r");
+        return s.substr(a, b - a + 1);
+    }
+
+    /// @brief Parse a finite double covering the whole field.
+    static std::optional<double> parseNumber(const std::string& s) {
+        if (s.empty()) return std::nullopt;
+        char* end = nullptr;
+        const double v = std::strtod(s.c_str(), &end);
+        if (end != s.c_str() + s.size() || !std::isfinite(v)) return std::nullopt;
+        return v;
+    }
+}
+
+std::optional<std::vector<GoldenEntry>>
+loadGoldenManifest(std::istream& is, const std::string& base_dir, std::string* error)
+{
+    auto fail = [&](size_t line, const std::string& why) -> std::optional<std::vector<GoldenEntry>> {
+        if (error) *error = "line " + std::to_string(line) + ": " + why;
+        return std::nullopt;
+    };
+
+    std::vector<GoldenEntry> out;
+    std::string line;
+    size_t lineno = 0;
+    bool first = true;
+    while (std::getline(is, line)) {
+        ++lineno;
+        const std::string t = trim(line);
+        if (t.empty() || t[0] == '#') continue;
+
+        // The last comma splits path and value, so paths may contain commas.
+        const size_t comma = t.rfind(',');
+        if (comma == std::string::npos) return fail(lineno, "expected <path>,<coverage>");
+        const std::string path = trim(t.substr(0, comma));
+        const std::string value = trim(t.substr(comma + 1));
+
+        GoldenEntry e;
+        if (value.empty() || value == "none" || value == "-") {
+            e.expected_coverage = std::nullopt;
+        }
+        else if (auto v = parseNumber(value)) {
+            if (*v < 0.0 || *v > 100.0) return fail(lineno, "coverage must be in [0,100]");
+            e.expected_coverage = *v;
+        }
+        else if (first) {
+            first = false;  // header row, e.g. "path,coverage"
+            continue;
+        }
+        else {
+            return fail(lineno, "invalid coverage '" + value + "'");
+        }
+        first = false;
+
+        if (path.empty()) return fail(lineno, "empty path");
+        const fs::path p(path);
+        const bool relative = p.is_relative() && !p.has_root_directory();
+        e.path = (relative && !base_dir.empty()) ? (fs::path(base_dir) / p).string() : path;
+        out.push_back(std::move(e));
+    }
+    return out;
+}
+
+void AccuracyScorer::add(const std::string& path,
+    std::optional<double> expected,
+    const std::optional<DetectionResult>& got)
+{
+    ++images_;
+    if (!expected) {
+        if (got) { ++fp_; misses_.push_back(path); }
+        else ++tn_;
+        return;
+    }
+    if (!got) {
+        ++fn_;
+        misses_.push_back(path);
+        return;
+    }
+    ++tp_;
+    const double err = std::abs(got->coverage_percent - *expected);
+    if (err > tol_pct_) ++over_tol_;
+    abs_err_.push_back(err);
+    err_path_.push_back(path);
+}
+
+AccuracyReport AccuracyScorer::report() const {
+    AccuracyReport r;
+    r.images = images_;
+    r.true_pos = tp_;
+    r.false_pos = fp_;
+    r.false_neg = fn_;
+    r.true_neg = tn_;
+    r.over_tol = over_tol_;
+    if (!abs_err_.empty()) {
+        std::vector<double> sorted = abs_err_;
+        std::sort(sorted.begin(), sorted.end());
+        r.mean_abs_err = std::accumulate(sorted.begin(), sorted.end(), 0.0) / (double)sorted.size();
+        r.p95_abs_err = report::percentile(sorted, 0.95);
+        const size_t k = (size_t)(std::max_element(abs_err_.begin(), abs_err_.end()) - abs_err_.begin());
+        r.max_abs_err = abs_err_[k];
+        r.worst_path = err_path_[k];
+    }
+    return r;
+}
+
+void AccuracyScorer::writeJson(std::ostream& os) const {
+    const AccuracyReport r = report();
+    const std::streamsize prec = os.precision();
+    os << std::fixed << std::setprecision(4);
+    os << "{\"images\":" << r.images
+        << ",\"tp\":" << r.true_pos
+        << ",\"fp\":" << r.false_pos
+        << ",\"fn\":" << r.false_neg
+        << ",\"tn\":" << r.true_neg
+        << ",\"over_tol\":" << r.over_tol
+        << ",\"tol_pct\":" << tol_pct_
+        << ",\"mae_pct\":" << r.mean_abs_err
+        << ",\"p95_abs_err_pct\":" << r.p95_abs_err
+        << ",\"max_abs_err_pct\":" << r.max_abs_err
+        << ",\"worst_path\":";
+    report::writeJsonString(os, r.worst_path);
+    os << ",\"misses\":[";
+    for (size_t i = 0; i < misses_.size(); ++i) {
+        if (i) os << ',';
+        report::writeJsonString(os, misses_[i]);
+    }
+    os << "]}";
+    os.unsetf(std::ios::floatfield);
+    os.precision(prec);
+}
@@ -1,24 +1,35 @@
 #include "grid_detector.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
 using namespace cv;
 
 namespace {
-    // Find the index of the minimum value in a 1D CV_32S Mat within [lo, hi).
-    static int minIndexInRange(const Mat& vec, int lo, int hi, bool isColVec) {
+    // Integral depth that cannot overflow for an 8-bit plane of this size.
+    static int integralDepth(const Mat& plane) {
+        return (double)plane.total() * 255.0 < (double)INT_MAX ? CV_32S : CV_64F;
+    }
+
+    // Value of integral image I at (y, x); I is CV_32S or CV_64F.
+    static double sumAt(const Mat& I, int y, int x) {
+        return I.depth() == CV_32S ? (double)I.at<int>(y, x) : I.at<double>(y, x);
+    }
+
+    // Sum of the source plane over r, in O(1).
+    static double rectSum(const Mat& I, const Rect& r) {
+        const int x1 = r.x + r.width, y1 = r.y + r.height;
+        return sumAt(I, y1, x1) - sumAt(I, r.y, x1) - sumAt(I, y1, r.x) + sumAt(I, r.y, r.x);
+    }
+
+    // Index of the minimum of profile(i) for i = lo, lo + step, ... < hi (first one on ties).
+    template <class Profile>
+    static int minIndexInRange(Profile profile, int lo, int hi, int step = 1) {
         int bestIdx = lo;
-        int bestVal = INT_MAX;
-        if (isColVec) {
-            // vec is 1 x W
-            for (int x = lo; x < hi; ++x) {
-                int v = vec.at<int>(0, x);
-                if (v < bestVal) { bestVal = v; bestIdx = x; }
-            }
-        }
-        else {
-            // vec is H x 1
-            for (int y = lo; y < hi; ++y) {
-                int v = vec.at<int>(y, 0);
-                if (v < bestVal) { bestVal = v; bestIdx = y; }
-            }
+        double bestVal = DBL_MAX;
+        for (int i = lo; i < hi; i += step) {
+            const double v = profile(i);
+            if (v < bestVal) { bestVal = v; bestIdx = i; }
         }
         return bestIdx;
     }
@@ -26,49 +37,76 @@ namespace {
     static bool near(int x, int target, int tol) {
         return std::abs(x - target) <= tol;
     }
-}
 
-namespace {
-    // Safe fraction of non-zero pixels in ROI (returns 0 on empty/invalid).
-    static double safeFraction(const Mat& roi) {
-        if (roi.empty()) return 0.0;
-        const double total = (double)roi.total();
-        if (total <= 0.0) return 0.0;
-        return (double)countNonZero(roi) / total;
+    // Seams k = 1..n-1 along a length-L axis, from the sums profile(i) of line i.
+    // Windows are expressed in tenths of a cell so that n = 3 reproduces the
+    // original [L/5, 2L/5) and [3L/5, 4L/5) ranges exactly. With steps > 0 only
+    // about that many evenly spaced lines per window are evaluated.
+    template <class Profile>
+    static bool findSeams(Profile profile, int L, int n, std::vector<int>& out, int steps = 0) {
+        out.clear();
+        bool ok = true;
+        for (int k = 1; k < n; ++k) {
+            const int a = (2 * k < n) ? 4 : (2 * k > n) ? 2 : 3; // lean towards the nearer border
+            const int lo = (int)((long long)L * (10 * k - a) / (10LL * n));
+            const int hi = (int)((long long)L * (10 * k + 6 - a) / (10LL * n));
+            const int step = steps > 0 ? std::max(1, (hi - lo + steps - 1) / steps) : 1;
+            const int s = minIndexInRange(profile, lo, hi, step);
+            ok = ok && near(s, (int)((long long)L * k / n), L / (2 * n));
+            if (!out.empty()) ok = ok && (s - out.back()) > L / (2 * n);
+            out.push_back(s);
+        }
+        return ok;
     }
 }
 
-grid::Seams grid::checkGridSeams(const Mat& mask) {
-    CV_Assert(!mask.empty() && mask.type() == CV_8UC1);
-    const int W = mask.cols, H = mask.rows;
+Rect grid::cellRect(const Size& size, int rows, int cols, int r, int c) {
+    const int cw = size.width / cols, ch = size.height / rows;
+    const int x = c * cw;
+    const int y = r * ch;
+    const int w = (c == cols - 1 ? size.width - x : cw);
+    const int h = (r == rows - 1 ? size.height - y : ch);
+    return Rect(x, y, w, h);
+}
 
-    Mat colsum, rowsum;
-    reduce(mask, colsum, 0, REDUCE_SUM, CV_32S); // 1 x W
-    reduce(mask, rowsum, 1, REDUCE_SUM, CV_32S); // H x 1
+void grid::integrateMask(const Mat& mask, GridWorkspace& ws) {
+    CV_Assert(!mask.empty() && mask.type() == CV_8UC1);
+    MCE_TRACE_SCOPE("grid.integrate_mask");
+    integral(mask, ws.mask_sum, integralDepth(mask));
+}
 
-    // Flexible search ranges for seams around ~1/3 and ~2/3.
-    const int vx1_lo = W / 5, vx1_hi = 2 * W / 5;
-    const int vx2_lo = 3 * W / 5, vx2_hi = 4 * W / 5;
-    const int hy1_lo = H / 5, hy1_hi = 2 * H / 5;
-    const int hy2_lo = 3 * H / 5, hy2_hi = 4 * H / 5;
+void grid::integrateColor(const Mat& hsv, const Mat& v, GridWorkspace& ws) {
+    CV_Assert(!hsv.empty() && hsv.type() == CV_8UC3);
+    CV_Assert(v.type() == CV_8UC1 && v.size() == hsv.size());
+    MCE_TRACE_SCOPE("grid.integrate_color");
+    extractChannel(hsv, ws.plane, 1);
+    integral(ws.plane, ws.s_sum, integralDepth(ws.plane));
+    integral(v, ws.v_sum, integralDepth(v));
+}
 
-    Seams s;
-    s.cx1 = minIndexInRange(colsum, vx1_lo, vx1_hi, /*isColVec=*/true);
-    s.cx2 = minIndexInRange(colsum, vx2_lo, vx2_hi, /*isColVec=*/true);
-    s.cy1 = minIndexInRange(rowsum, hy1_lo, hy1_hi, /*isColVec=*/false);
-    s.cy2 = minIndexInRange(rowsum, hy2_lo, hy2_hi, /*isColVec=*/false);
+grid::Seams grid::checkGridSeams(const Mat& mask) {
+    GridWorkspace ws;
+    return checkGridSeams(mask, ws);
+}
 
-    // Tolerant thresholds around ideal thirds.
-    const int tolX = W / 6;
-    const int tolY = H / 6;
+grid::Seams grid::checkGridSeams(const Mat& mask, GridWorkspace& ws) {
+    integrateMask(mask, ws);
+    return checkGridSeams(ws, 3, 3);
+}
 
-    const bool okX = near(s.cx1, W / 3, tolX) && near(s.cx2, 2 * W / 3, tolX);
-    const bool okY = near(s.cy1, H / 3, tolY) && near(s.cy2, 2 * H / 3, tolY);
+grid::Seams grid::checkGridSeams(const GridWorkspace& ws, int rows, int cols) {
+    CV_Assert(!ws.mask_sum.empty() && rows >= 1 && cols >= 1);
+    const Mat& I = ws.mask_sum;
+    const int W = I.cols - 1, H = I.rows - 1;
 
-    // Ensure seams are reasonably separated.
-    const bool spacing_ok = (s.cx2 - s.cx1) > W / 6 && (s.cy2 - s.cy1) > H / 6;
+    // Column x sums to I(H, x+1) - I(H, x); row y to I(y+1, W) - I(y, W).
+    auto colsum = [&](int x) { return sumAt(I, H, x + 1) - sumAt(I, H, x); };
+    auto rowsum = [&](int y) { return sumAt(I, y + 1, W) - sumAt(I, y, W); };
 
-    s.ok = okX && okY && spacing_ok;
+    Seams s;
+    const bool okX = findSeams(colsum, W, cols, s.cx);
+    const bool okY = findSeams(rowsum, H, rows, s.cy);
+    s.ok = okX && okY;
     return s;
 }
 
@@ -76,23 +114,189 @@ grid::CellsReport grid::checkGridCells(const Mat& mask, double minFraction) {
     CV_Assert(!mask.empty() && mask.type() == CV_8UC1);
     CV_Assert(mask.rows == mask.cols); // expect a square (warped) mask
 
-    const int N = mask.rows;
-    const int cell = N / 3;
+    GridWorkspace ws;
+    integrateMask(mask, ws);
+    return checkGridCells(ws, 3, 3, minFraction);
+}
+
+grid::CellsReport grid::checkGridCells(const GridWorkspace& ws, int rows, int cols, double minFraction) {
+    CV_Assert(!ws.mask_sum.empty() && rows >= 1 && cols >= 1);
+    const Size size(ws.mask_sum.cols - 1, ws.mask_sum.rows - 1);
 
-    CellsReport rep{};
+    CellsReport rep;
+    rep.rows = rows;
+    rep.cols = cols;
+    rep.frac.assign((size_t)rows * cols, 0.0);
     rep.ok = true;
 
-    for (int r = 0; r < 3; ++r) {
-        for (int c = 0; c < 3; ++c) {
-            const int x = c * cell;
-            const int y = r * cell;
-            const int w = (c == 2 ? N - x : cell);
-            const int h = (r == 2 ? N - y : cell);
-            Mat roi = mask(Rect(x, y, w, h));
-            const double f = safeFraction(roi);
-            rep.frac[r][c] = f;
+    for (int r = 0; r < rows; ++r) {
+        for (int c = 0; c < cols; ++c) {
+            const Rect roi = cellRect(size, rows, cols, r, c);
+            const double area = roi.area();
+            // The mask is 0/255, so sum / 255 is the non-zero count.
+            const double f = area > 0 ? rectSum(ws.mask_sum, roi) / (255.0 * area) : 0.0;
+            rep.frac[(size_t)r * cols + c] = f;
             if (f < minFraction) rep.ok = false;
         }
     }
     return rep;
 }
+
+int grid::countColorfulCells(const GridWorkspace& ws, int rows, int cols, double minS, double minV) {
+    CV_Assert(!ws.s_sum.empty() && !ws.v_sum.empty() && rows >= 1 && cols >= 1);
+    const Size size(ws.s_sum.cols - 1, ws.s_sum.rows - 1);
+
+    int okCells = 0;
+    for (int r = 0; r < rows; ++r) {
+        for (int c = 0; c < cols; ++c) {
+            const Rect roi = cellRect(size, rows, cols, r, c);
+            const double area = roi.area();
+            if (area <= 0) continue;
+            const double meanS = rectSum(ws.s_sum, roi) / area;
+            const double meanV = rectSum(ws.v_sum, roi) / area;
+            if (meanS >= minS && meanV >= minV) okCells++;
+        }
+    }
+    return okCells;
+}
+
+namespace {
+    // Point (x, y) mapped through the 3×3 homography M (row-major doubles).
+    static Point2d mapPoint(const double* M, double x, double y) {
+        const double w = M[6] * x + M[7] * y + M[8];
+        const double k = w != 0.0 ? 1.0 / w : 0.0;
+        return Point2d((M[0] * x + M[1] * y + M[2]) * k, (M[3] * x + M[4] * y + M[5]) * k);
+    }
+
+    // True if the nearest pixel of p is inside the mask and set (INTER_NEAREST,
+    // BORDER_CONSTANT 0).
+    static bool maskAt(const Mat& mask, const Point2d& p) {
+        const int x = cvRound(p.x), y = cvRound(p.y);
+        return x >= 0 && y >= 0 && x < mask.cols && y < mask.rows && mask.at<uchar>(y, x) != 0;
+    }
+
+    // Nearest pixel of p, clamped to the image (BORDER_REPLICATE).
+    static Point nearestClamped(const Size& size, const Point2d& p) {
+        return Point(std::clamp(cvRound(p.x), 0, size.width - 1), std::clamp(cvRound(p.y), 0, size.height - 1));
+    }
+
+    // Sample k of n evenly spaced over pixels [start, start + len) (pixel centers).
+    static double spread(int start, int len, int k, int n) {
+        return start - 0.5 + ((double)k + 0.5) * (double)len / (double)n;
+    }
+
+    // Calls fn(cell, x, y) for the k×k lattice points of every cell, cells row-major.
+    template <class Fn>
+    static void forCellPoints(int N, int rows, int cols, int k, Fn fn) {
+        for (int r = 0; r < rows; ++r) {
+            for (int c = 0; c < cols; ++c) {
+                const Rect rc = grid::cellRect(Size(N, N), rows, cols, r, c);
+                for (int j = 0; j < k; ++j) {
+                    for (int i = 0; i < k; ++i) {
+                        fn(r * cols + c, spread(rc.x, rc.width, i, k), spread(rc.y, rc.height, j, k));
+                    }
+                }
+            }
+        }
+    }
+}
+
+grid::LatticeMask grid::latticeMaskChecks(const Mat& mask, const Mat& square_to_mask, int N,
+    int rows, int cols, double minFraction, const LatticeOptions& lopt)
+{
+    CV_Assert(!mask.empty() && mask.type() == CV_8UC1);
+    CV_Assert(square_to_mask.rows == 3 && square_to_mask.cols == 3 && square_to_mask.type() == CV_64F);
+    CV_Assert(N > 0 && rows >= 1 && cols >= 1 && lopt.cell_samples >= 1 && lopt.line_samples >= 1);
+    MCE_TRACE_SCOPE("grid.lattice_mask");
+    const Mat M = square_to_mask.isContinuous() ? square_to_mask : square_to_mask.clone();
+    const double* H = M.ptr<double>();
+
+    LatticeMask out;
+    CellsReport& rep = out.cells;
+    rep.rows = rows;
+    rep.cols = cols;
+    rep.frac.assign((size_t)rows * cols, 0.0);
+    const int k = lopt.cell_samples;
+    forCellPoints(N, rows, cols, k, [&](int cell, double x, double y) {
+        if (maskAt(mask, mapPoint(H, x, y))) rep.frac[(size_t)cell] += 1.0;
+    });
+    rep.ok = true;
+    for (double& f : rep.frac) {
+        f /= (double)(k * k);
+        if (f < minFraction) rep.ok = false;
+    }
+
+    // Mask pixels on square column x (row y), at line_samples points along it.
+    const int L = lopt.line_samples;
+    auto colsum = [&](int x) {
+        int n = 0;
+        for (int t = 0; t < L; ++t) n += maskAt(mask, mapPoint(H, x, spread(0, N, t, L))) ? 1 : 0;
+        return (double)n;
+    };
+    auto rowsum = [&](int y) {
+        int n = 0;
+        for (int t = 0; t < L; ++t) n += maskAt(mask, mapPoint(H, spread(0, N, t, L), y)) ? 1 : 0;
+        return (double)n;
+    };
+    const bool okX = findSeams(colsum, N, cols, out.seams.cx, lopt.seam_steps);
+    const bool okY = findSeams(rowsum, N, rows, out.seams.cy, lopt.seam_steps);
+    out.seams.ok = okX && okY;
+    return out;
+}
+
+int grid::latticeColorfulCells(const Mat& image, const Mat& uv, const Mat& square_to_image,
+    int N, int rows, int cols, double minS, double minV, const LatticeOptions& lopt, LatticeWorkspace& ws)
+{
+    const bool nv12 = !uv.empty();
+    CV_Assert(!image.empty() && image.type() == (nv12 ? CV_8UC1 : CV_8UC3));
+    CV_Assert(!nv12 || (uv.type() == CV_8UC2 && uv.cols * 2 == image.cols && uv.rows * 2 == image.rows));
+    CV_Assert(square_to_image.rows == 3 && square_to_image.cols == 3 && square_to_image.type() == CV_64F);
+    CV_Assert(N > 0 && rows >= 1 && cols >= 1 && lopt.cell_samples >= 1);
+    MCE_TRACE_SCOPE("grid.lattice_colorful");
+    const Mat M = square_to_image.isContinuous() ? square_to_image : square_to_image.clone();
+    const double* H = M.ptr<double>();
+
+    // Gather the nearest pixel of every lattice point into one row, then convert
+    // that row to HSV. NV12 samples are gathered as 2×2 luma blocks sharing
+    // one chroma pair, so the row converts like a regular NV12 image.
+    const int k = lopt.cell_samples;
+    const int K = rows * cols * k * k;
+    if (nv12) {
+        ws.y.create(2, 2 * K, CV_8UC1);
+        ws.uv.create(1, K, CV_8UC2);
+    }
+    else {
+        ws.bgr.create(1, K, CV_8UC3);
+    }
+    int idx = 0;
+    forCellPoints(N, rows, cols, k, [&](int, double x, double y) {
+        const Point2d p = mapPoint(H, x, y);
+        const Point q = nearestClamped(image.size(), p);
+        if (nv12) {
+            const uchar l = image.at<uchar>(q);
+            ws.y.at<uchar>(0, 2 * idx) = ws.y.at<uchar>(0, 2 * idx + 1) = l;
+            ws.y.at<uchar>(1, 2 * idx) = ws.y.at<uchar>(1, 2 * idx + 1) = l;
+            // Chroma sample i sits at luma 2i + 0.5.
+            ws.uv.at<Vec2b>(idx) = uv.at<Vec2b>(nearestClamped(uv.size(), Point2d((p.x - 0.5) * 0.5, (p.y - 0.5) * 0.5)));
+        }
+        else {
+            ws.bgr.at<Vec3b>(idx) = image.at<Vec3b>(q);
+        }
+        ++idx;
+    });
+    if (nv12) cvtColorTwoPlane(ws.y, ws.uv, ws.bgr, COLOR_YUV2BGR_NV12);
+    cvtColor(ws.bgr, ws.hsv, COLOR_BGR2HSV);
+
+    int okCells = 0;
+    const int stride = nv12 ? 2 : 1;
+    for (int cell = 0; cell < rows * cols; ++cell) {
+        double sumS = 0.0, sumV = 0.0;
+        for (int i = cell * k * k; i < (cell + 1) * k * k; ++i) {
+            const Vec3b& px = ws.hsv.at<Vec3b>(0, i * stride);
+            sumS += px[1];
+            sumV += px[2];
+        }
+        if (sumS >= minS * k * k && sumV >= minV * k * k) okCells++;
+    }
+    return okCells;
+}
@@ -0,0 +1,257 @@
+#include "image_source.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// -----------------------------------------------------------------------------
+// MappedFile
+// -----------------------------------------------------------------------------
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+#ifdef _WIN32
+        std::swap(file_, other.file_);
+        std::swap(mapping_, other.mapping_);
+#endif
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& path) {
+    close();
+    // FILE_SHARE_WRITE: the result cache appends to the file it has mapped.
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (f == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(f, &sz) || sz.QuadPart <= 0) { CloseHandle(f); return false; }
+
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m) { CloseHandle(f); return false; }
+
+    void* p = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (!p) { CloseHandle(m); CloseHandle(f); return false; }
+
+    file_ = f;
+    mapping_ = m;
+    data_ = static_cast<const std::uint8_t*>(p);
+    size_ = (size_t)sz.QuadPart;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle((HANDLE)mapping_);
+    if (file_) CloseHandle((HANDLE)file_);
+    data_ = nullptr;
+    size_ = 0;
+    mapping_ = nullptr;
+    file_ = nullptr;
+}
+#else
+bool MappedFile::open(const std::string& path) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) { ::close(fd); return false; }
+
+    void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps its own reference to the file
+    if (p == MAP_FAILED) return false;
+
+    // The decoder reads the file front to back exactly once.
+    madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    data_ = static_cast<const std::uint8_t*>(p);
+    size_ = (size_t)st.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) munmap(const_cast<std::uint8_t*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+#endif
+
+// -----------------------------------------------------------------------------
+// Header probing
+// -----------------------------------------------------------------------------
+
+namespace {
+    static int be16(const std::uint8_t* p) { return (p[0] << 8) | p[1]; }
+
+    static std::uint32_t be32(const std::uint8_t* p) {
+        return ((std::uint32_t)p[0] << 24) | ((std::uint32_t)p[1] << 16)
+            | ((std::uint32_t)p[2] << 8) | (std::uint32_t)p[3];
+    }
+
+    // Orientation tag (0x0112) of IFD0 in an APP1 "Exif" payload, or 1.
+    static int exifOrientation(const std::uint8_t* p, size_t n) {
+        if (n < 14 || std::memcmp(p, "Exif\0\0", 6) != 0) return 1;
+        const std::uint8_t* t = p + 6; // TIFF header
+        n -= 6;
+        const bool le = t[0] == 'I' && t[1] == 'I';
+        if (!le && !(t[0] == 'M' && t[1] == 'M')) return 1;
+        auto u16 = [&](size_t o) { return le ? (t[o] | (t[o + 1] << 8)) : be16(t + o); };
+        auto u32 = [&](size_t o) {
+            return le ? ((std::uint32_t)t[o] | ((std::uint32_t)t[o + 1] << 8)
+                | ((std::uint32_t)t[o + 2] << 16) | ((std::uint32_t)t[o + 3] << 24)) : be32(t + o);
+        };
+        const size_t ifd = u32(4);
+        if (ifd + 2 > n) return 1;
+        const int count = u16(ifd);
+        for (int k = 0; k < count; ++k) {
+            const size_t e = ifd + 2 + 12 * (size_t)k;
+            if (e + 12 > n) break;
+            if (u16(e) == 0x0112) {
+                const int v = u16(e + 8);
+                return v >= 1 && v <= 8 ? v : 1;
+            }
+        }
+        return 1;
+    }
+
+    // Walk the JPEG marker segments up to the first SOFn frame header.
+    static std::optional<ImageHeader> probeJpeg(const std::uint8_t* d, size_t n) {
+        int orientation = 1;
+        size_t i = 2; // after SOI
+        while (i + 4 <= n) {
+            if (d[i] != 0xFF) return std::nullopt;
+            const std::uint8_t m = d[i + 1];
+            if (m == 0xFF) { ++i; continue; }                       // fill byte
+            if (m == 0x01 || (m >= 0xD0 && m <= 0xD8)) { i += 2; continue; } // no length
+            if (m == 0xD9 || m == 0xDA) return std::nullopt;     // EOI / SOS before SOF
+
+            const int len = be16(d + i + 2);
+            if (len < 2) return std::nullopt;
+
+            if (m == 0xE1 && i + 2 + (size_t)len <= n) {
+                const int o = exifOrientation(d + i + 4, (size_t)len - 2);
+                if (o != 1) orientation = o;
+            }
+
+            // SOF0..SOF15 except DHT (C4), JPG (C8) and DAC (CC)
+            const bool sof = m >= 0xC0 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC;
+            if (sof) {
+                if (i + 9 > n || len < 7) return std::nullopt;
+                ImageHeader h;
+                h.format = ImageHeader::Format::Jpeg;
+                h.height = be16(d + i + 5);
+                h.width = be16(d + i + 7);
+                h.orientation = orientation;
+                if (h.width <= 0 || h.height <= 0) return std::nullopt;
+                return h;
+            }
+            i += 2 + (size_t)len;
+        }
+        return std::nullopt;
+    }
+
+    static std::optional<ImageHeader> probePng(const std::uint8_t* d, size_t n) {
+        // 8-byte signature, then the IHDR chunk: length, "IHDR", width, height
+        if (n < 24 || std::memcmp(d + 12, "IHDR", 4) != 0) return std::nullopt;
+        const std::uint32_t w = be32(d + 16), h = be32(d + 20);
+        if (w == 0 || h == 0 || w > 0x7FFFFFFFu || h > 0x7FFFFFFFu) return std::nullopt;
+        ImageHeader hdr;
+        hdr.format = ImageHeader::Format::Png;
+        hdr.width = (int)w;
+        hdr.height = (int)h;
+        return hdr;
+    }
+
+    static int reducedFlag(int reduction) {
+        switch (reduction) {
+        case 2: return cv::IMREAD_REDUCED_COLOR_2;
+        case 4: return cv::IMREAD_REDUCED_COLOR_4;
+        case 8: return cv::IMREAD_REDUCED_COLOR_8;
+        default: return cv::IMREAD_COLOR;
+        }
+    }
+}
+
+std::optional<ImageHeader> probeImageHeader(const std::uint8_t* data, size_t size) {
+    if (!data || size < 4) return std::nullopt;
+    static const std::uint8_t kPngSig[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+    if (data[0] == 0xFF && data[1] == 0xD8) return probeJpeg(data, size);
+    if (size >= 8 && std::memcmp(data, kPngSig, 8) == 0) return probePng(data, size);
+    return std::nullopt;
+}
+
+int chooseDecodeReduction(const ImageHeader& hdr, int max_side) {
+    // Only JPEG decoders scale in the DCT domain; for other formats the
+    // reduced flags decode at full size and resize, which gains nothing.
+    if (hdr.format != ImageHeader::Format::Jpeg || max_side <= 0) return 1;
+    const int long_side = std::max(hdr.width, hdr.height);
+    int f = 1;
+    while (f < 8 && (long_side + 2 * f - 1) / (2 * f) >= max_side) f *= 2;
+    return f;
+}
+
+bool decodeImage(const std::string& path, int max_side, DecodedImage& out) {
+    MappedFile file;
+    if (!file.open(path)) {
+        out = DecodedImage{};
+        out.bgr = cv::imread(path, cv::IMREAD_COLOR);
+        out.full_size = out.bgr.size();
+        return !out.bgr.empty();
+    }
+    return decodeImageBuffer(file.data(), file.size(), max_side, out);
+}
+
+bool decodeImageBuffer(const std::uint8_t* data, size_t size, int max_side, DecodedImage& out) {
+    out = DecodedImage{};
+    if (!data || size == 0) return false;
+
+    // cv::Mat sizes are int: larger files cannot be wrapped.
+    if (size > (size_t)std::numeric_limits<int>::max()) return false;
+
+    // Zero-copy: imdecode reads straight from the caller's bytes.
+    const cv::Mat buf(1, (int)size, CV_8UC1, const_cast<std::uint8_t*>(data));
+    const auto hdr = probeImageHeader(data, size);
+    out.reduction = hdr ? chooseDecodeReduction(*hdr, max_side) : 1;
+    out.bgr = cv::imdecode(buf, reducedFlag(out.reduction));
+    if (out.bgr.empty()) return false;
+
+    if (out.reduction == 1) {
+        out.full_size = out.bgr.size();
+    }
+    else {
+        // imdecode applies EXIF orientation, so the stored width/height may be
+        // swapped. The reduced size tells unless it is square after rounding;
+        // then the probed orientation tag decides.
+        const int r = out.reduction;
+        const cv::Size stored((hdr->width + r - 1) / r, (hdr->height + r - 1) / r);
+        const cv::Size got = out.bgr.size();
+        bool swapped = hdr->orientation >= 5;
+        if (got == stored && got != cv::Size(stored.height, stored.width)) swapped = false;
+        else if (got == cv::Size(stored.height, stored.width) && got != stored) swapped = true;
+        out.full_size = swapped ? cv::Size(hdr->height, hdr->width) : cv::Size(hdr->width, hdr->height);
+    }
+    return true;
+}
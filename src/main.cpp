@@ -2,30 +2,62 @@
 #include <vector>
 #include <string>
 #include <cmath>
+#include <fstream>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/utils/logger.hpp>
 
-#include "marker_detector.hpp"
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <csignal>
+#endif
+
+#include "batch_runner.hpp"
+#include "color_segmenter.hpp"
+#include "debug_writer.hpp"
+#include "frame_server.hpp"
 #include "marker_types.hpp"
+#include "result_cache.hpp"
+#include "stats_aggregator.hpp"
+#include "trace.hpp"
 
 /// @brief Print CLI usage.
 static void print_usage(const char* argv0) {
     std::cerr << "Usage: " << argv0
         << " [--debug]"
-        << " [--save-debug <dir>]"
+        << " [--save-debug <dir>] [--debug-format png|png-fast|qoi]"
+        << " [--debug-sample <0..1>] [--debug-queue-mb <N>]"
         << " [--mode strict|loose]"
-        << " [--grid-threshold <0..1>]"
-        << " <image1> [image2 ...]\n";
+        << " [--grid-threshold <0..1>] [--grid <R>x<C>]"
+        << " [--max-side <px>] [--profile <colors.yaml>]"
+        << " [--quad-engine contours|components] [--backend cpu|opencl]"
+        << " [--warp-mask | --lattice] [--warp-mask-fallback] [--precheck]"
+        << " [--jobs <N>] [--frame-threads <N>] [--unordered] [--full-decode]"
+        << " [--stream <MP>] [--cache <file>]"
+        << " [--stats json|csv] [--stats-out <file>] [--trace <file.json>]"
+        << " <image1> [image2 ...]\n"
+        << "       " << argv0 << " --serve [--socket <path>] [options]"
+        << "   (framed requests on stdin or a Unix socket; see frame_server.hpp)\n";
 }
 
 int main(int argc, char** argv) {
     // Quieter OpenCV logs; avoid thread noise.
+    // Parallelism comes from the batch workers (--jobs), so OpenCV stays single-threaded
+    // unless --frame-threads splits each frame instead.
     cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_ERROR);
-    cv::setNumThreads(1); // optional
+    cv::setNumThreads(1);
 
     bool debug = false;
     DetectOptions opt;                 // defaults: strict_grid=true, min_cell_fraction=0.20, warp_size=300
+    BatchOptions bopt;
+    DebugWriterOptions wopt;           // --save-debug artifacts: written in the background
+    std::string stats_format;          // empty = no stats report
+    std::string stats_out;             // empty = stderr
+    bool serve = false;                // --serve: long-running frame server
+    std::string socket_path;           // empty = stdin/stdout
+    std::string trace_out;             // empty = no Chrome trace file
     std::vector<std::string> paths;
 
     // --- Parse arguments ---
@@ -44,6 +76,43 @@ int main(int argc, char** argv) {
             opt.save_debug = true;
             opt.save_debug_dir = argv[++i];
         }
+        else if (s == "--debug-format") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value after --debug-format (png|png-fast|qoi)\n";
+                return 2;
+            }
+            std::string fmt = argv[++i];
+            if (fmt == "png")           wopt.format = DebugFormat::Png;
+            else if (fmt == "png-fast") wopt.format = DebugFormat::PngFast;
+            else if (fmt == "qoi")      wopt.format = DebugFormat::Qoi;
+            else {
+                std::cerr << "Invalid --debug-format. Use png|png-fast|qoi\n";
+                return 2;
+            }
+        }
+        else if (s == "--debug-sample") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value after --debug-sample\n";
+                return 2;
+            }
+            wopt.sample_rate = std::stod(argv[++i]);
+            if (wopt.sample_rate < 0.0 || wopt.sample_rate > 1.0) {
+                std::cerr << "--debug-sample must be within 0..1\n";
+                return 2;
+            }
+        }
+        else if (s == "--debug-queue-mb") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value after --debug-queue-mb\n";
+                return 2;
+            }
+            const int mb = std::stoi(argv[++i]);
+            if (mb < 1) {
+                std::cerr << "--debug-queue-mb must be >= 1\n";
+                return 2;
+            }
+            wopt.max_queued_bytes = (size_t)mb << 20;
+        }
         else if (s == "--mode") {
             if (i + 1 >= argc) {
                 std::cerr << "Missing value after --mode (strict|loose)\n";
@@ -68,6 +137,188 @@ int main(int argc, char** argv) {
                 return 2;
             }
         }
+        else if (s == "--grid") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value after --grid (e.g. 3x3, 4x4)\n";
+                return 2;
+            }
+            const std::string layout = argv[++i];
+            const size_t x = layout.find('x');
+            if (x == std::string::npos
+                || layout.find_first_not_of("0123456789x") != std::string::npos
+                || x == 0 || x + 1 >= layout.size()) {
+                std::cerr << "Invalid --grid. Use <rows>x<cols>, e.g. 4x4\n";
+                return 2;
+            }
+            opt.grid_rows = std::stoi(layout.substr(0, x));
+            opt.grid_cols = std::stoi(layout.substr(x + 1));
+            if (opt.grid_rows < 2 || opt.grid_cols < 2 || opt.grid_rows > 16 || opt.grid_cols > 16) {
+                std::cerr << "--grid rows and cols must be in [2,16]\n";
+                return 2;
+            }
+        }
+        else if (s == "--max-side") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value after --max-side\n";
+                return 2;
+            }
+            opt.max_side = std::stoi(argv[++i]);
+            if (opt.max_side < 0) {
+                std::cerr << "--max-side must be >= 0 (0 = full resolution)\n";
+                return 2;
+            }
+        }
+        else if (s == "--profile") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing file after --profile\n";
+                return 2;
+            }
+            std::string err;
+            opt.color_profile = ColorProfile::load(argv[++i], &err);
+            if (!opt.color_profile) {
+                std::cerr << "Invalid --profile: " << err << "\n";
+                return 2;
+            }
+        }
+        else if (s == "--quad-engine") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value after --quad-engine (contours|components)\n";
+                return 2;
+            }
+            std::string engine = argv[++i];
+            if (engine == "contours")        opt.quad_engine = geom::QuadEngine::Contours;
+            else if (engine == "components") opt.quad_engine = geom::QuadEngine::Components;
+            else {
+                std::cerr << "Invalid --quad-engine. Use contours|components\n";
+                return 2;
+            }
+        }
+        else if (s == "--backend") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value after --backend (cpu|opencl)\n";
+                return 2;
+            }
+            std::string backend = argv[++i];
+            if (backend == "cpu")         opt.backend = ComputeBackend::Cpu;
+            else if (backend == "opencl") opt.backend = ComputeBackend::OpenCL;
+            else {
+                std::cerr << "Invalid --backend. Use cpu|opencl\n";
+                return 2;
+            }
+            if (opt.backend == ComputeBackend::OpenCL && !ColorSegmenter::openclAvailable()) {
+                std::cerr << "Warning: no OpenCL device available, using the CPU backend\n";
+            }
+        }
+        else if (s == "--precheck") {
+            opt.precheck = true;
+        }
+        else if (s == "--warp-mask") {
+            opt.warped_mask = WarpedMaskSource::FrameMask;
+        }
+        else if (s == "--warp-mask-fallback") {
+            if (opt.warped_mask != WarpedMaskSource::Lattice) opt.warped_mask = WarpedMaskSource::FrameMask;
+            opt.warped_mask_fallback = true;
+        }
+        else if (s == "--lattice") {
+            opt.warped_mask = WarpedMaskSource::Lattice;
+        }
+        else if (s == "--jobs") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value after --jobs\n";
+                return 2;
+            }
+            bopt.jobs = std::stoi(argv[++i]);
+            if (bopt.jobs < 0) {
+                std::cerr << "--jobs must be >= 0 (0 = all cores)\n";
+                return 2;
+            }
+        }
+        else if (s == "--frame-threads") {
+            // Intra-frame parallelism: segment each frame in stripes (for a few
+            // large frames; combine with --jobs 1).
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value after --frame-threads\n";
+                return 2;
+            }
+            const int n = std::stoi(argv[++i]);
+            if (n < 0) {
+                std::cerr << "--frame-threads must be >= 0 (0 = all cores)\n";
+                return 2;
+            }
+            opt.seg_stripes = n;
+            cv::setNumThreads(n == 0 ? -1 : n);
+        }
+        else if (s == "--unordered") {
+            bopt.ordered = false;
+        }
+        else if (s == "--full-decode") {
+            bopt.reduced_decode = false;
+        }
+        else if (s == "--stream") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing megapixels after --stream\n";
+                return 2;
+            }
+            const double mp = std::stod(argv[++i]);
+            if (mp <= 0.0) {
+                std::cerr << "--stream must be > 0 (megapixels)\n";
+                return 2;
+            }
+            bopt.stream_min_pixels = (std::int64_t)std::ceil(mp * 1e6);
+        }
+        else if (s == "--cache") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing file after --cache\n";
+                return 2;
+            }
+            std::string err;
+            bopt.cache = ResultCache::open(argv[++i], &err);
+            if (!bopt.cache) {
+                std::cerr << "Invalid --cache: " << err << "\n";
+                return 2;
+            }
+        }
+        else if (s == "--serve") {
+            serve = true;
+        }
+        else if (s == "--socket") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing path after --socket\n";
+                return 2;
+            }
+            socket_path = argv[++i];
+            serve = true;
+        }
+        else if (s == "--stats") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value after --stats (json|csv)\n";
+                return 2;
+            }
+            stats_format = argv[++i];
+            if (stats_format != "json" && stats_format != "csv") {
+                std::cerr << "Invalid --stats. Use json|csv\n";
+                return 2;
+            }
+        }
+        else if (s == "--trace") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing file after --trace\n";
+                return 2;
+            }
+#if defined(MCE_TRACE_CHROME)
+            trace_out = argv[++i];
+#else
+            std::cerr << "--trace needs a build with -DMCE_TRACE=CHROME\n";
+            return 2;
+#endif
+        }
+        else if (s == "--stats-out") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing file after --stats-out\n";
+                return 2;
+            }
+            stats_out = argv[++i];
+        }
 
         else {
             // Treat as image path.
@@ -75,6 +326,30 @@ int main(int argc, char** argv) {
         }
     }
 
+    if (opt.save_debug) {
+        wopt.verbose = debug;
+        opt.debug_writer = std::make_shared<DebugWriter>(wopt);
+    }
+
+    if (serve) {
+        if (!paths.empty()) {
+            std::cerr << "--serve does not take image paths\n";
+            return 2;
+        }
+        // Clients hang up at will: report write errors instead of dying on SIGPIPE.
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#else
+        std::signal(SIGPIPE, SIG_IGN);
+#endif
+        FrameServer server(opt, bopt);
+        if (debug) std::cerr << "[debug] serve: jobs=" << server.jobs() << "\n";
+        if (!socket_path.empty()) return server.serveUnixSocket(socket_path) ? 0 : 1;
+        server.serveStream(0, 1);
+        return 0;
+    }
+
     if (paths.empty()) {
         print_usage(argv[0]);
         return 2;
@@ -82,30 +357,70 @@ int main(int argc, char** argv) {
 
     if (debug) std::cerr << "[debug] OpenCV: " << CV_VERSION << "\n";
 
-    MarkerDetector detector;
+    BatchRunner runner(opt, bopt);
+    if (debug) std::cerr << "[debug] jobs=" << runner.jobs() << "\n";
     int exit_code = 0;
+    StatsAggregator stats;
+
+    // --- Process images (output stage runs on this thread) ---
+    runner.run(paths, [&](const BatchItem& item) {
+        // Cache hits ran no stages; their zero timings would skew the percentiles.
+        if (item.loaded && !item.cached && !stats_format.empty()) stats.add(item.path, item.stats, item.decode_ms);
 
-    // --- Process images ---
-    for (const auto& path : paths) {
-        cv::Mat bgr = cv::imread(path);
-        if (bgr.empty()) {
-            if (debug) std::cerr << "[debug] failed to load: " << path << "\n";
+        if (!item.loaded) {
+            if (debug) std::cerr << "[debug] failed to load: " << item.path << "\n";
             exit_code = 1;
-            continue; // no output line for this image
+            return; // no output line for this image
         }
 
-        auto resOpt = detector.detect(bgr, opt, path);
-        if (!resOpt) {
+        if (!item.result) {
             // In strict mode, failing grid validation or no quad → "not found".
             // Emit a minimal warning (stderr); do not print a result line.
-            if (!debug) std::cerr << "[warn] no marker detected (strict mode): " << path << "\n";
+            if (!debug) std::cerr << "[warn] no marker detected (strict mode): " << item.path << "\n";
             exit_code = 1;
-            continue;
+            return;
         }
 
         // Required output format to stdout: "<image_file> <coverage_percent>%"
-        int rounded = (int)std::lround(resOpt->coverage_percent);
-        std::cout << path << " " << rounded << "%\n";
+        int rounded = (int)std::lround(item.result->coverage_percent);
+        std::cout << item.path << " " << rounded << "%\n";
+    });
+
+    if (opt.debug_writer) {
+        opt.debug_writer->flush();
+        const DebugWriterStats ds = opt.debug_writer->stats();
+        if (debug) {
+            std::cerr << "[debug] artifacts: written=" << ds.written << " dedup=" << ds.deduplicated
+                << " dropped=" << ds.dropped << " failed=" << ds.failed
+                << " images sampled=" << ds.images_sampled << " skipped=" << ds.images_skipped << "\n";
+        }
+    }
+
+    if (bopt.cache && debug) {
+        std::cerr << "[debug] cache: hits=" << bopt.cache->hits() << " misses=" << bopt.cache->misses()
+            << " entries=" << bopt.cache->size() << "\n";
+    }
+
+    // --- Scope instrumentation (trace.hpp builds only) ---
+    if (!trace_out.empty() && !trace::writeChromeTrace(trace_out)) {
+        std::cerr << "Cannot write --trace file: " << trace_out << "\n";
+        exit_code = 2;
+    }
+    if (debug && trace::enabled()) trace::writeSummary(std::cerr);
+
+    // --- Batch stats report (p50/p95/p99 per stage) ---
+    if (!stats_format.empty()) {
+        std::ofstream file;
+        if (!stats_out.empty()) {
+            file.open(stats_out);
+            if (!file) {
+                std::cerr << "Cannot open --stats-out file: " << stats_out << "\n";
+                return 2;
+            }
+        }
+        std::ostream& os = stats_out.empty() ? std::cerr : file;
+        if (stats_format == "json") stats.writeJson(os);
+        else                        stats.writeCsv(os);
     }
 
     return exit_code;
@@ -1,12 +1,21 @@
 ﻿
-// High-level detector for a 3×3 colored marker.
+// High-level detector for a grid_rows × grid_cols colored marker (3×3 by default).
 // Pipeline:
-//   1) HSV color segmentation → binary mask of allowed colors.
-//   2) Extract a strong quadrilateral (outer board boundary).
-//   3) Warp quad to a square; validate 3×3 grid (debug/validation).
-//   4) Final polygon = initial quad (no refinement).
+//   0) Optional early-exit cascade (thumbnail colors, coarse blob).
+//   1) HSV color segmentation → binary mask of allowed colors
+//      (on a copy downscaled to max_side for large frames; NV12 input gets
+//      its HSV planes from Y/UV directly).
+//   2) Extract a strong quadrilateral (outer board boundary); when the frame
+//      was downscaled, map it back to full resolution and refine the corners.
+//   3) Warp quad to a square; validate the grid_rows × grid_cols grid on a
+//      re-segmented warped view or, optionally, on the warped frame mask.
+//   4) Final polygon = the quad from (2), corner-refined when the frame was
+//      downscaled (refine_corners).
 //   5) Compute coverage: polygon area / image area.
 //
+// detectStreaming() builds the coarse view of (1) from strips of a RowSource
+// and runs (3)-(5) on the quad's bounding box only.
+//
 // Notes:
 // - In strict mode, grid validation (cells check) is required for success.
 // - Seams are primarily diagnostic.
@@ -15,11 +24,16 @@
 #include "marker_detector.hpp"
 #include "marker_types.hpp"
 #include "color_segmenter.hpp"
+#include "debug_writer.hpp"
+#include "frame_precheck.hpp"
 #include "geometry.hpp"
 #include "grid_detector.hpp"
 #include "timer.hpp"
+#include "trace.hpp"
 
 #include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
 #include <filesystem>
 #include <string>
 
@@ -27,6 +41,20 @@ using namespace cv;
 namespace fs = std::filesystem;
 
 namespace {
+    /// @brief Markers covering less than this percentage of the image are rejected.
+    constexpr double kMinCovPct = 0.5;
+
+    /// @brief Colorful-cells fallback: minimum mean S and V of a cell (soft thresholds
+    ///        tuned for blurred, low-contrast markers).
+    constexpr double kColorfulMinS = 60.0;
+    constexpr double kColorfulMinV = 50.0;
+
+    /// @brief Union coverage is rasterized with the long side capped at this many pixels.
+    constexpr int kUnionRasterSide = 2048;
+
+    /// @brief Rows per strip read by detectStreaming().
+    constexpr int kStreamStripRows = 256;
+
     /// @brief Save helper with optional debug logging. Returns true on success.
     static bool saveIf(const cv::Mat& img,
         const fs::path& path,
@@ -68,6 +96,29 @@ namespace {
         return vis;
     }
 
+    /// @brief Input frame of one detect call: BGR, or the two planes of NV12.
+    struct Frame {
+        cv::Mat bgr;     // CV_8UC3 (empty for NV12)
+        cv::Mat y, uv;   // NV12 luma (CV_8UC1) and chroma (CV_8UC2, half size)
+        cv::Point origin{};  // top-left of this frame in the image (detectStreaming(): the quad region)
+        cv::Size image{};    // size of the whole image (empty = this frame)
+
+        bool nv12() const { return bgr.empty(); }
+        cv::Size size() const { return nv12() ? y.size() : bgr.size(); }
+        cv::Size imageSize() const { return image.empty() ? size() : image; }
+
+        /// @brief Image for corner refinement (gray-level source).
+        const cv::Mat& gray() const { return nv12() ? y : bgr; }
+
+        /// @brief BGR view for debug snapshots (converted only for NV12).
+        cv::Mat viewBgr() const {
+            if (!nv12()) return bgr;
+            cv::Mat out;
+            cv::cvtColorTwoPlane(y, uv, out, cv::COLOR_YUV2BGR_NV12);
+            return out;
+        }
+    };
+
     /// @brief Derive a base filename (without extension) for debug artifacts.
     static std::string makeBaseName(const std::string& path_hint) {
         if (path_hint.empty()) return "image";
@@ -75,198 +126,810 @@ namespace {
         std::string stem = p.stem().string();
         return stem.empty() ? "image" : stem;
     }
+
+    /// @brief Affine map from mask pixels (mask covers @p roi, possibly downscaled)
+    ///        to full-frame pixels, using the pixel-center convention of cv::resize.
+    static cv::Mat maskToFrame(const cv::Size& mask_size, const cv::Rect& roi) {
+        const double sx = (double)roi.width / (double)mask_size.width;
+        const double sy = (double)roi.height / (double)mask_size.height;
+        return (cv::Mat_<double>(3, 3) <<
+            sx, 0.0, 0.5 * sx - 0.5 + roi.x,
+            0.0, sy, 0.5 * sy - 0.5 + roi.y,
+            0.0, 0.0, 1.0);
+    }
+
+    /// @brief State shared by the pipeline stages of one detect call.
+    struct RunContext {
+        /// @param parent Context of the frame a candidate belongs to; the candidate
+        ///        inherits its capture decision (one sample per image, not per candidate).
+        RunContext(const DetectOptions& o, DetectorWorkspace& w, const std::string& hint,
+            const RunContext* parent = nullptr)
+            : opt(o), ws(w), stats(w.stats), base(makeBaseName(hint)), outdir(o.save_debug_dir),
+            capture(parent ? parent->capture
+                : o.save_debug && (!o.debug_writer || o.debug_writer->sample()))
+        {
+            if (capture && opt.debug && !parent) {
+                std::cerr << "[debug] save dir: " << fs::absolute(outdir).string() << "\n";
+            }
+        }
+
+        const DetectOptions& opt;
+        DetectorWorkspace& ws;
+        DetectionStats& stats;   // ws.stats (reset by the caller)
+        const std::string base;
+        const fs::path outdir;
+        const bool capture;      // save debug artifacts of this image (sampled)
+
+        Timer total;
+
+        // Last polygon overlay rendered, reused when the same polygon is saved again.
+        cv::Mat overlay;
+        std::vector<cv::Point2f> overlay_poly;
+
+        // Set by locateQuad(): the frame mask and the frame region it covers.
+        cv::Mat frame_mask;
+        cv::Rect mask_roi;
+
+        // OpenCL backend: the uploaded frame region (empty on the CPU path).
+        cv::UMat frame_dev;
+
+        /// @brief Save debug artifact <base><suffix>: queued on opt.debug_writer, else written now as PNG.
+        void save(const cv::Mat& img, const char* suffix) const {
+            if (!capture) return;
+            MCE_TRACE_SCOPE("debug.save");
+            const fs::path stem = outdir / (base + suffix);
+            if (opt.debug_writer) opt.debug_writer->submit(img, stem.string());
+            else saveIf(img, stem.string() + ".png", true, opt.debug);
+        }
+
+        /// @brief Polygon overlay of the frame (rendered once per distinct polygon).
+        const cv::Mat& polyOverlay(const Frame& frame, const std::vector<cv::Point2f>& poly) {
+            if (overlay.empty() || overlay_poly != poly) {
+                overlay = drawPolyOverlay(frame.viewBgr(), poly);
+                overlay_poly = poly;
+            }
+            return overlay;
+        }
+
+        /// @brief Stamp total time and the outcome; returns @p res unchanged.
+        std::optional<DetectionResult> finish(std::optional<DetectionResult> res) {
+            stats.total_ms = total.ms();
+            stats.found = res.has_value();
+            return res;
+        }
+    };
+
+    /// @brief Map DetectOptions to the segmenter's options.
+    static SegOptions makeSegOptions(const DetectOptions& opt) {
+        SegOptions sopt;
+        sopt.blur_ksize = opt.pre_blur_ksize;   // optional pre-blur
+        sopt.open_iter = opt.morph_open_iter;  // morphological cleanup
+        sopt.close_iter = opt.morph_close_iter;
+        sopt.smin = opt.seg_smin;         // global S floor
+        sopt.vmin = opt.seg_vmin;         // global V floor
+        sopt.stripes = opt.seg_stripes;   // intra-frame parallelism
+        sopt.profile = opt.color_profile; // marker palette
+        return sopt;
+    }
+
+    // Stage (0): early-exit cascade on the whole frame (when enabled).
+    // Returns false if the frame cannot contain a marker.
+    static bool passesPrecheck(const cv::Mat& bgr, RunContext& ctx)
+    {
+        if (!ctx.opt.precheck) return true;
+        MCE_TRACE_SCOPE("stage.precheck");
+        Timer t0;
+        ctx.stats.precheck_reject = precheck::run(bgr, precheck::optionsFor(ctx.opt), ctx.ws.precheck);
+        ctx.stats.precheck_ms = t0.ms();
+        const bool pass = ctx.stats.precheck_reject == PrecheckReject::None;
+        if (ctx.opt.debug && !pass) {
+            std::cerr << "[debug] precheck rejected: " << precheck::rejectName(ctx.stats.precheck_reject) << "\n";
+        }
+        return pass;
+    }
+
+    // Stage (1): segmentation of `roi` (downscaled to max_side if larger).
+    // Leaves the mask and its geometry in ctx.frame_mask / ctx.mask_roi.
+    static void segmentRoi(const Frame& frame, const cv::Rect& roi, RunContext& ctx)
+    {
+        const DetectOptions& opt = ctx.opt;
+        DetectorWorkspace& ws = ctx.ws;
+
+        // ---------------------------------------------------------------------
+        // (1) HSV segmentation of allowed marker colors
+        // ---------------------------------------------------------------------
+        MCE_TRACE_SCOPE("stage.segment");
+        Timer t1;
+        const SegOptions sopt = makeSegOptions(opt);
+
+        // Coarse-to-fine: large frames are segmented on a downscaled copy.
+        const cv::Size view_size = roi.size();
+        const int long_side = std::max(view_size.width, view_size.height);
+        cv::Size work_size = view_size;
+        if (opt.max_side > 0 && long_side > opt.max_side) {
+            const double s = (double)opt.max_side / (double)long_side;
+            work_size = cv::Size(std::max(1, cvRound(view_size.width * s)), std::max(1, cvRound(view_size.height * s)));
+            // 4:2:0 chroma needs even luma dimensions.
+            if (frame.nv12()) work_size = cv::Size(std::max(2, work_size.width & ~1), std::max(2, work_size.height & ~1));
+        }
+        const bool pyramid = work_size != view_size;
+        ctx.stats.pyramid = pyramid;
+        if (opt.debug && pyramid) {
+            std::cerr << "[debug] pyramid: " << view_size.width << "x" << view_size.height
+                << " -> " << work_size.width << "x" << work_size.height << "\n";
+        }
+
+        // The device path takes BGR only; NV12 frames always run on the CPU.
+        const bool ocl = opt.backend == ComputeBackend::OpenCL && !frame.nv12() && ColorSegmenter::openclAvailable();
+        if (opt.debug && opt.backend == ComputeBackend::OpenCL && !ocl) {
+            std::cerr << "[debug] OpenCL unavailable -> CPU backend\n";
+        }
+
+        cv::Mat& mask = ws.mask.view(work_size, CV_8UC1);
+        const SegStats* seg_stats = nullptr;
+        if (ocl) {
+            // One upload of the region; the warp in (3) reuses it.
+            frame.bgr(roi).copyTo(ws.frame_dev);
+            cv::UMat work = ws.frame_dev;
+            if (pyramid) {
+                MCE_TRACE_SCOPE("seg.resize");
+                cv::resize(ws.frame_dev, ws.small_dev, work_size, 0.0, 0.0, cv::INTER_AREA);
+                work = ws.small_dev;
+            }
+            ColorSegmenter::allowedMaskOCL(work, sopt, ws.ocl_seg, mask);
+            ctx.frame_dev = ws.frame_dev;
+            seg_stats = &ws.ocl_seg.stats;
+        }
+        else if (frame.nv12()) {
+            // Hue/saturation straight from chroma, brightness from luma (no BGR round trip).
+            CV_Assert(roi.x % 2 == 0 && roi.y % 2 == 0 && roi.width % 2 == 0 && roi.height % 2 == 0);
+            cv::Mat y = frame.y(roi);
+            cv::Mat uv = frame.uv(cv::Rect(roi.x / 2, roi.y / 2, roi.width / 2, roi.height / 2));
+            if (pyramid) {
+                MCE_TRACE_SCOPE("seg.resize");
+                const cv::Size half(work_size.width / 2, work_size.height / 2);
+                cv::Mat& ys = ws.small_y.view(work_size, CV_8UC1);
+                cv::Mat& uvs = ws.small_uv.view(half, CV_8UC2);
+                cv::resize(y, ys, work_size, 0.0, 0.0, cv::INTER_AREA);
+                cv::resize(uv, uvs, half, 0.0, 0.0, cv::INTER_AREA);
+                y = ys;
+                uv = uvs;
+            }
+            ws.seg.prepareNV12(y, uv, sopt.blur_ksize);
+            ws.seg.mask(sopt, mask);
+            seg_stats = &ws.seg.stats();
+        }
+        else {
+            const cv::Mat view = frame.bgr(roi);
+            cv::Mat work = view;
+            if (pyramid) {
+                MCE_TRACE_SCOPE("seg.resize");
+                work = ws.small.view(work_size, CV_8UC3);
+                cv::resize(view, work, work_size, 0.0, 0.0, cv::INTER_AREA);
+            }
+            ws.seg.segment(work, sopt, mask);
+            seg_stats = &ws.seg.stats();
+        }
+        ctx.stats.opencl = ocl;
+        ctx.frame_mask = mask;
+        ctx.mask_roi = roi;
+        ctx.stats.mask_nonzero = cv::countNonZero(mask);
+        ctx.stats.relax_attempts = seg_stats->relax_attempts;
+        ctx.stats.rim_brake = seg_stats->rim_braked;
+        ctx.stats.seg_ms = t1.ms();
+
+        if (opt.debug) std::cerr << "[debug] mask nonzero=" << ctx.stats.mask_nonzero << "\n";
+        ctx.save(mask, "_mask");
+    }
+
+    // Map a quad found in ctx.frame_mask to full-frame coordinates of `frame`.
+    static std::vector<cv::Point2f>
+        maskQuadToFrame(const Frame& frame, std::vector<cv::Point2f> quad, const RunContext& ctx)
+    {
+        // Map the coarse quad back to full resolution; one coarse pixel spans
+        // several full-res pixels, so snap the corners in small full-res ROIs.
+        const cv::Rect& roi = ctx.mask_roi;
+        const cv::Size work = ctx.frame_mask.size();
+        const bool pyramid = work != roi.size();
+        if (pyramid) quad = geom::mapQuadToSize(quad, work, roi.size());
+        for (auto& p : quad) p += cv::Point2f((float)roi.x, (float)roi.y);
+        if (pyramid && ctx.opt.refine_corners) {
+            const double inv = (double)std::max(roi.width, roi.height) / (double)std::max(work.width, work.height);
+            const int radius = std::clamp((int)std::ceil(2.0 * inv), 3, 21);
+            quad = geom::refineQuadCorners(frame.gray(), quad, radius);
+        }
+        return quad;
+    }
+
+    // Stages (1)+(2): segmentation and quad extraction inside `roi`.
+    // Returns the quad in full-frame coordinates of `frame`.
+    static std::optional<std::vector<cv::Point2f>>
+        locateQuad(const Frame& frame, const cv::Rect& roi, RunContext& ctx)
+    {
+        const DetectOptions& opt = ctx.opt;
+        segmentRoi(frame, roi, ctx);
+
+        // ---------------------------------------------------------------------
+        // (2) Extract a strong quadrilateral from the mask (outer board boundary)
+        // ---------------------------------------------------------------------
+        MCE_TRACE_SCOPE("stage.quad");
+        Timer t2;
+        auto quadOpt = geom::findStrongQuad(ctx.frame_mask, ctx.ws.quad, opt.quad_engine);
+
+        if (!quadOpt) {
+            ctx.stats.quad_ms = t2.ms();
+            if (opt.debug) std::cerr << "[debug] no quad found\n";
+            return std::nullopt;
+        }
+        ctx.stats.quad_found = true;
+
+        std::vector<cv::Point2f> quad = maskQuadToFrame(frame, std::move(*quadOpt), ctx);
+        ctx.stats.quad_ms = t2.ms();
+        if (ctx.capture) ctx.save(ctx.polyOverlay(frame, quad), "_poly");
+        return quad;
+    }
+
+    /// @brief Colorful-cells fallback: if at least 7 of 9 cells look "colorful enough".
+    static bool mostlyColorful(int okCells, int rows, int cols) {
+        return 9 * okCells >= 7 * rows * cols;
+    }
+
+    // Stage (4) decision, shared by the warped and the lattice checks.
+    // colorful() is only evaluated when it can change the outcome (or for the debug log).
+    template <class Colorful>
+    static bool gridVerdict(const grid::Seams& seams, const grid::CellsReport& cells,
+        Colorful colorful_fn, const DetectOptions& opt)
+    {
+        // The colorful fallback only matters when cells fail (and, in strict mode,
+        // seams pass); debug runs always evaluate it for the log.
+        const bool need_colorful = !cells.ok && (seams.ok || !opt.strict_grid);
+        const bool colorful = (need_colorful || opt.debug) && colorful_fn();
+
+        if (opt.debug) {
+            std::cerr << "[debug] seams: cx=";
+            for (int x : seams.cx) std::cerr << x << ' ';
+            std::cerr << "cy=";
+            for (int y : seams.cy) std::cerr << y << ' ';
+            std::cerr << "ok=" << seams.ok << "\n";
+            std::cerr << "[debug] cells ok=" << (cells.ok ? 1 : 0)
+                << " (min=" << opt.min_cell_fraction << ", " << cells.rows << "x" << cells.cols << ")\n";
+            std::cerr << "[debug] colorful>=7/9=" << (colorful ? "true" : "false") << "\n";
+        }
+
+        // Decision: in strict mode require BOTH seams and cells.
+        // In non-strict mode, allow the colorful fallback as a helper.
+        return (opt.strict_grid)
+            ? (seams.ok && (cells.ok || colorful))
+            : (cells.ok || colorful);
+    }
+
+    // Stages (3)+(4) on the warped square: warp, warped mask and grid validation.
+    static bool warpedGridCheck(const Frame& frame, const std::vector<cv::Point2f>& quad, RunContext& ctx)
+    {
+        const DetectOptions& opt = ctx.opt;
+        DetectorWorkspace& ws = ctx.ws;
+
+        // ---------------------------------------------------------------------
+        // (3) Warp to square & compute warped mask (for grid validation)
+        // ---------------------------------------------------------------------
+        MCE_TRACE_SCOPE("stage.warp_grid");
+        Timer t3;
+        int N = std::max(32, opt.warp_size);
+        if (frame.nv12()) N += N % 2; // whole chroma samples
+
+        // Warp the original image to a square using the quad
+        // (on the device when stage (1) uploaded the frame region; luma and
+        // chroma separately for NV12, leaving the warped luma in ws.warp.image).
+        if (!ctx.frame_dev.empty()) geom::warpToSquareWithH(ctx.frame_dev, ctx.mask_roi.tl(), quad, N, ws.warp);
+        else if (frame.nv12()) geom::warpToSquareWithH(frame.y, frame.uv, quad, N, ws.warp);
+        else geom::warpToSquareWithH(frame.bgr, quad, N, ws.warp);
+        const cv::Mat& warped = ws.warp.image;
+        cv::Mat& warpedMask = ws.warped_mask.view(warped.size(), CV_8UC1);
+
+        // Build a warped mask using the same segmentation options,
+        // but allow a one-time, local relaxation if the mask is too sparse.
+        // NOTE: this does NOT change the global mask in (1)—it only
+        // adapts the warped-view where blur/low saturation could hide colors.
+        // The warped HSV is prepared once and shared by both masks and (4).
+        SegOptions sopt_warp = makeSegOptions(opt);
+        bool prepared = false;
+        auto prepareWarped = [&] {
+            if (!prepared && frame.nv12()) ws.seg_warp.prepareNV12(warped, ws.warp.uv, sopt_warp.blur_ksize);
+            else if (!prepared) ws.seg_warp.prepare(warped, sopt_warp.blur_ksize);
+            prepared = true;
+        };
+        auto segmentWarped = [&] {
+            MCE_TRACE_SCOPE("warp.segment");
+            prepareWarped();
+            ws.seg_warp.mask(sopt_warp, warpedMask);
+
+            // One-shot local relaxation on warped-mask only (helps blurred/low-S cases).
+            const double totalW = std::max(1.0, (double)warped.total());
+            const double frac = (double)cv::countNonZero(warpedMask) / totalW;
+
+            // If the warped mask is very sparse (<3%), relax S/V a bit and try once more
+            // (the segmenter thresholds its slack map instead of classifying again).
+            if (frac < 0.03) {
+                sopt_warp.smin = std::max(0, sopt_warp.smin - 20);
+                sopt_warp.vmin = std::max(0, sopt_warp.vmin - 20);
+                // A slightly stronger close helps reconnect split color blobs.
+                sopt_warp.close_iter = std::max(1, sopt_warp.close_iter);
+                ws.seg_warp.mask(sopt_warp, warpedMask);
+                ctx.stats.warped_relax = true;
+            }
+        };
+
+        if (opt.warped_mask == WarpedMaskSource::FrameMask) {
+            // Reuse stage (1): carry the frame mask through the same homography.
+            MCE_TRACE_SCOPE("warp.frame_mask");
+            const cv::Mat Hm = ws.warp.H * maskToFrame(ctx.frame_mask.size(), ctx.mask_roi);
+            cv::warpPerspective(ctx.frame_mask, warpedMask, Hm, warped.size(),
+                cv::INTER_NEAREST, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+            ctx.stats.mask_warped = true;
+        }
+        else {
+            segmentWarped();
+        }
+
+        ctx.stats.warp_ms += t3.ms();
+
+        if (ctx.capture) {
+            cv::Mat warped_bgr = warped;
+            if (frame.nv12()) cv::cvtColorTwoPlane(warped, ws.warp.uv, warped_bgr, cv::COLOR_YUV2BGR_NV12);
+            ctx.save(warped_bgr, "_warped");
+            ctx.save(warpedMask, "_warped_mask");
+        }
+
+        // ---------------------------------------------------------------------
+        // (4) Grid validation: seams (diagnostics) + cells (decision)
+        //     - Strict mode requires cells.ok == true.
+        //     - Added a color/saturation fallback: if ≥7/9 of the cells are "colorful enough",
+        //       we accept the grid (helps blurred low-mask cases like p5).
+        // ---------------------------------------------------------------------
+
+        Timer t4;
+
+        // Fallback: consider cells "colorful" if their mean S and V are high enough.
+        // This check runs on the warped image's HSV planes (not on the mask), so it can
+        // still pass when the warped mask is under-segmented but colors are visibly present.
+        // S and pre-CLAHE V come from the segmenter's (pre-blurred) planes; the small
+        // blur does not move cell means, so no extra BGR→HSV conversion is needed.
+        // Their integrals are built once; the planes do not change on re-segmentation.
+        const int rows = std::max(1, opt.grid_rows);
+        const int cols = std::max(1, opt.grid_cols);
+        bool color_integrated = false;
+        auto colorful_cells_ge7 = [&]()->bool {
+            CV_Assert(warped.rows == warped.cols);
+            prepareWarped();
+            if (!color_integrated) grid::integrateColor(ws.seg_warp.hsv(), ws.seg_warp.rawV(), ws.grid);
+            color_integrated = true;
+
+            return mostlyColorful(grid::countColorfulCells(ws.grid, rows, cols, kColorfulMinS, kColorfulMinV), rows, cols);
+        };
+
+        auto validate = [&]() -> bool {
+            MCE_TRACE_SCOPE("grid.validate");
+            grid::integrateMask(warpedMask, ws.grid);
+            return gridVerdict(grid::checkGridSeams(ws.grid, rows, cols),
+                grid::checkGridCells(ws.grid, rows, cols, opt.min_cell_fraction), colorful_cells_ge7, opt);
+        };
+
+        bool grid_ok = validate();
+
+        // Opt-in fallback for the warped frame mask: re-segment the warped view.
+        if (!grid_ok && ctx.stats.mask_warped && opt.warped_mask_fallback) {
+            if (opt.debug) std::cerr << "[debug] warped frame mask failed the grid check -> re-segmenting\n";
+            segmentWarped();
+            ctx.stats.warped_resegmented = true;
+            grid_ok = validate();
+        }
+
+        ctx.stats.grid_ms += t4.ms();
+        return grid_ok;
+    }
+
+    // Stages (3)+(4) without a warped square (WarpedMaskSource::Lattice): the
+    // cell interiors and candidate seam lines of the virtual N×N square are
+    // mapped through the homography and looked up in the frame mask (and, for
+    // the colorful fallback, in the frame itself).
+    static bool latticeGridCheck(const Frame& frame, const std::vector<cv::Point2f>& quad, RunContext& ctx)
+    {
+        const DetectOptions& opt = ctx.opt;
+        MCE_TRACE_SCOPE("stage.lattice");
+        Timer t3;
+        const int N = std::max(32, opt.warp_size);
+        cv::Mat Hinv;
+        cv::invert(geom::squareHomography(quad, N), Hinv, cv::DECOMP_LU);
+        // Square -> frame -> mask pixels (the mask may be a downscaled frame region).
+        const cv::Mat toMask = cv::Mat(maskToFrame(ctx.frame_mask.size(), ctx.mask_roi).inv()) * Hinv;
+        ctx.stats.lattice = true;
+        ctx.stats.warp_ms += t3.ms();
+
+        Timer t4;
+        const int rows = std::max(1, opt.grid_rows);
+        const int cols = std::max(1, opt.grid_cols);
+        const grid::LatticeOptions lopt;
+        const grid::LatticeMask lm = grid::latticeMaskChecks(ctx.frame_mask, toMask, N, rows, cols,
+            opt.min_cell_fraction, lopt);
+        auto colorful = [&]() -> bool {
+            const int okCells = frame.nv12()
+                ? grid::latticeColorfulCells(frame.y, frame.uv, Hinv, N, rows, cols,
+                    kColorfulMinS, kColorfulMinV, lopt, ctx.ws.lattice)
+                : grid::latticeColorfulCells(frame.bgr, cv::Mat(), Hinv, N, rows, cols,
+                    kColorfulMinS, kColorfulMinV, lopt, ctx.ws.lattice);
+            return mostlyColorful(okCells, rows, cols);
+        };
+        const bool ok = gridVerdict(lm.seams, lm.cells, colorful, opt);
+        ctx.stats.grid_ms += t4.ms();
+        return ok;
+    }
+
+    // Stages (3)-(6): warp, grid validation and coverage for a full-frame quad.
+    static std::optional<DetectionResult>
+        verifyQuad(const Frame& frame, const std::vector<cv::Point2f>& quad, RunContext& ctx)
+    {
+        const DetectOptions& opt = ctx.opt;
+
+        bool grid_ok = false;
+        if (opt.warped_mask == WarpedMaskSource::Lattice) {
+            grid_ok = latticeGridCheck(frame, quad, ctx);
+            // Opt-in fallback: the full warp and re-segmentation.
+            if (!grid_ok && opt.warped_mask_fallback) {
+                if (opt.debug) std::cerr << "[debug] lattice failed the grid check -> warping and re-segmenting\n";
+                grid_ok = warpedGridCheck(frame, quad, ctx);
+                ctx.stats.warped_resegmented = true;
+            }
+        }
+        else {
+            grid_ok = warpedGridCheck(frame, quad, ctx);
+        }
+
+
+        // ---------------------------------------------------------------------
+        // (5) Final polygon = initial quad (no refinement)
+        // ---------------------------------------------------------------------
+        Timer t5;
+        std::vector<cv::Point2f> final_poly = quad;
+        // Kept for parity with prior runs; same content as _poly (the overlay is
+        // reused, and a DebugWriter with dedup links the file instead of encoding it).
+        if (ctx.capture) ctx.save(ctx.polyOverlay(frame, final_poly), "_poly_refined");
+        for (auto& p : final_poly) p += cv::Point2f((float)frame.origin.x, (float)frame.origin.y);
+        ctx.stats.refine_ms = t5.ms(); // near-zero; included for timing symmetry
+
+        // ---------------------------------------------------------------------
+        // (6) Coverage computation
+        // ---------------------------------------------------------------------
+        double cov = geom::polygonCoveragePercent(final_poly, frame.imageSize());
+        // Reject unrealistically tiny polygons (prevents 0% false positives).
+        if (cov < kMinCovPct) {
+            if (opt.debug) std::cerr << "[debug] coverage guard failed (" << cov << "%)\n";
+            return std::nullopt;
+        }
+
+        // Timing summary
+        if (opt.debug) {
+            const DetectionStats& st = ctx.stats;
+            std::cerr << "[time] seg=" << st.seg_ms << " ms, "
+                << "quad=" << st.quad_ms << " ms, "
+                << "warp=" << st.warp_ms << " ms, "
+                << "grid=" << st.grid_ms << " ms, "
+                << "refine=" << st.refine_ms << " ms, "
+                << "total=" << ctx.total.ms() << " ms\n";
+        }
+
+        // Package result
+        DetectionResult res;
+        res.polygon = final_poly;
+        res.coverage_percent = cov;
+        res.grid_ok = grid_ok;
+
+        // Strict mode: fail if grid validation did not pass.
+        if (opt.strict_grid && !grid_ok) {
+            if (opt.debug) std::cerr << "[debug] strict_grid=true -> not found\n";
+            return std::nullopt;
+        }
+        return res;
+    }
+
+    // Box-filter @p src by the integer factor f into @p coarse (ceil(W/f) × ceil(H/f)),
+    // one strip at a time. Each coarse pixel is the rounded mean of its f×f block;
+    // blocks on the right and bottom edges may be smaller. Block sums carry over
+    // between strips, so the strip height does not change the result.
+    static void reduceStrips(const RowSource& src, int f, DetectorWorkspace& ws, cv::Mat& coarse)
+    {
+        MCE_TRACE_SCOPE("stream.reduce");
+        const cv::Size size = src.size();
+        const int cw = coarse.cols;
+        std::vector<std::uint32_t>& sums = ws.stream_sums;
+        sums.assign((size_t)cw * 3, 0u);
+        int block_rows = 0;
+        int cy = 0;
+        for (int y0 = 0; y0 < size.height; y0 += kStreamStripRows) {
+            const int rows = std::min(kStreamStripRows, size.height - y0);
+            cv::Mat& strip = ws.stream_strip.view(cv::Size(size.width, rows), CV_8UC3);
+            {
+                MCE_TRACE_SCOPE("stream.read_strip");
+                src.read(cv::Rect(0, y0, size.width, rows), strip);
+            }
+            for (int r = 0; r < rows; ++r) {
+                const uchar* p = strip.ptr<uchar>(r);
+                std::uint32_t* s = sums.data();
+                for (int cx = 0; cx < cw; ++cx, s += 3) {
+                    const int xe = std::min(size.width, (cx + 1) * f);
+                    for (int x = cx * f; x < xe; ++x, p += 3) {
+                        s[0] += p[0];
+                        s[1] += p[1];
+                        s[2] += p[2];
+                    }
+                }
+                if (++block_rows < f && y0 + r + 1 < size.height) continue;
+
+                uchar* out = coarse.ptr<uchar>(cy++);
+                s = sums.data();
+                for (int cx = 0; cx < cw; ++cx, s += 3, out += 3) {
+                    const std::uint32_t n = (std::uint32_t)block_rows * (std::uint32_t)(std::min(size.width, (cx + 1) * f) - cx * f);
+                    for (int c = 0; c < 3; ++c) {
+                        out[c] = (uchar)((s[c] + n / 2) / n);
+                        s[c] = 0;
+                    }
+                }
+                block_rows = 0;
+            }
+        }
+        CV_Assert(cy == coarse.rows);
+    }
+}
+
+std::optional<DetectionResult>
+MarkerDetector::detect(const cv::Mat& bgr,
+    const DetectOptions& opt,
+    const std::string& image_path_hint) const
+{
+    DetectorWorkspace ws;
+    return detect(bgr, opt, ws, image_path_hint);
 }
 
 std::optional<DetectionResult>
 MarkerDetector::detect(const cv::Mat& bgr,
     const DetectOptions& opt,
+    DetectorWorkspace& ws,
     const std::string& image_path_hint) const
 {
     // Input guard
+    ws.stats = DetectionStats{};
     if (bgr.empty() || bgr.type() != CV_8UC3) return std::nullopt;
 
-    const std::string base = makeBaseName(image_path_hint);
-    const fs::path outdir = fs::path(opt.save_debug_dir);
-    if (opt.save_debug && opt.debug) {
-        std::cerr << "[debug] save dir: " << fs::absolute(outdir).string() << "\n";
-    }
+    MCE_TRACE_SCOPE("detect");
+    RunContext ctx(opt, ws, image_path_hint);
+    if (!passesPrecheck(bgr, ctx)) return ctx.finish(std::nullopt);
+    const Frame frame{ bgr, {}, {} };
+    auto quad = locateQuad(frame, cv::Rect(0, 0, bgr.cols, bgr.rows), ctx);
+    if (!quad) return ctx.finish(std::nullopt);
+    return ctx.finish(verifyQuad(frame, *quad, ctx));
+}
+
+std::optional<DetectionResult>
+MarkerDetector::detectNV12(const cv::Mat& y,
+    const cv::Mat& uv,
+    const DetectOptions& opt,
+    const std::string& image_path_hint) const
+{
+    DetectorWorkspace ws;
+    return detectNV12(y, uv, opt, ws, image_path_hint);
+}
+
+std::optional<DetectionResult>
+MarkerDetector::detectNV12(const cv::Mat& y,
+    const cv::Mat& uv,
+    const DetectOptions& opt,
+    DetectorWorkspace& ws,
+    const std::string& image_path_hint) const
+{
+    // Input guard
+    ws.stats = DetectionStats{};
+    if (y.empty() || y.type() != CV_8UC1 || uv.type() != CV_8UC2) return std::nullopt;
+    if (y.cols % 2 || y.rows % 2 || uv.cols * 2 != y.cols || uv.rows * 2 != y.rows) return std::nullopt;
+
+    MCE_TRACE_SCOPE("detectNV12");
+    // No precheck: the cascade works on BGR thumbnails.
+    RunContext ctx(opt, ws, image_path_hint);
+    const Frame frame{ {}, y, uv };
+    auto quad = locateQuad(frame, cv::Rect(0, 0, y.cols, y.rows), ctx);
+    if (!quad) return ctx.finish(std::nullopt);
+    return ctx.finish(verifyQuad(frame, *quad, ctx));
+}
+
+std::optional<DetectionResult>
+MarkerDetector::detectInRoi(const cv::Mat& bgr,
+    const cv::Rect& roi,
+    const DetectOptions& opt,
+    DetectorWorkspace& ws,
+    const std::string& image_path_hint) const
+{
+    // Input guard
+    ws.stats = DetectionStats{};
+    if (bgr.empty() || bgr.type() != CV_8UC3) return std::nullopt;
+    const cv::Rect r = roi & cv::Rect(0, 0, bgr.cols, bgr.rows);
+    if (r.empty()) return std::nullopt;
+
+    MCE_TRACE_SCOPE("detectInRoi");
+    RunContext ctx(opt, ws, image_path_hint);
+    const Frame frame{ bgr, {}, {} };
+    auto quad = locateQuad(frame, r, ctx);
+    if (!quad) return ctx.finish(std::nullopt);
+    return ctx.finish(verifyQuad(frame, *quad, ctx));
+}
+
+std::optional<DetectionResult>
+MarkerDetector::detectStreaming(const RowSource& src,
+    const DetectOptions& opt,
+    DetectorWorkspace& ws,
+    const std::string& image_path_hint) const
+{
+    // Input guard
+    ws.stats = DetectionStats{};
+    const cv::Size size = src.size();
+    if (size.width <= 0 || size.height <= 0) return std::nullopt;
 
-    // Timers (profiling in debug mode)
-    Timer total;
-    double t_seg = 0, t_quad = 0, t_warp = 0, t_grid = 0, t_refine = 0;
+    MCE_TRACE_SCOPE("detectStreaming");
+    RunContext ctx(opt, ws, image_path_hint);
 
-    // ---------------------------------------------------------------------
-    // (1) HSV segmentation of allowed marker colors
-    // ---------------------------------------------------------------------
+    // (1) Coarse view: the smallest integer reduction that fits max_side.
     Timer t1;
-    SegOptions sopt;
-    sopt.blur_ksize = opt.pre_blur_ksize;   // optional pre-blur
-    sopt.open_iter = opt.morph_open_iter;  // morphological cleanup
-    sopt.close_iter = opt.morph_close_iter;
-    sopt.smin = opt.seg_smin;         // global S floor
-    sopt.vmin = opt.seg_vmin;         // global V floor
-
-    cv::Mat mask = ColorSegmenter::allowedMaskHSV(bgr, sopt);
-    t_seg = t1.ms();
-
-    if (opt.debug) std::cerr << "[debug] mask nonzero=" << cv::countNonZero(mask) << "\n";
-    saveIf(mask, outdir / (base + "_mask.png"), opt.save_debug, opt.debug);
-
-    // ---------------------------------------------------------------------
-    // (2) Extract a strong quadrilateral from the mask (outer board boundary)
-    // ---------------------------------------------------------------------
-    Timer t2;
-    auto quadOpt = geom::findStrongQuad(mask);
-    t_quad = t2.ms();
+    const int long_side = std::max(size.width, size.height);
+    const int f = opt.max_side > 0 ? (long_side + opt.max_side - 1) / opt.max_side : 1;
+    cv::Mat& coarse = ws.stream_coarse.view(cv::Size((size.width + f - 1) / f, (size.height + f - 1) / f), CV_8UC3);
+    reduceStrips(src, f, ws, coarse);
+    const double reduce_ms = t1.ms();
+    if (opt.debug) {
+        std::cerr << "[debug] streaming: " << size.width << "x" << size.height
+            << " -> " << coarse.cols << "x" << coarse.rows << " (1/" << f << ")\n";
+    }
 
+    if (!passesPrecheck(coarse, ctx)) return ctx.finish(std::nullopt);
+    segmentRoi(Frame{ coarse, {}, {} }, cv::Rect(0, 0, coarse.cols, coarse.rows), ctx);
+    ctx.stats.seg_ms += reduce_ms;
+    ctx.stats.pyramid = f > 1;
+    ctx.frame_dev = cv::UMat(); // a device copy of the coarse view; the warp reads the region below
+
+    // (2) Quad on the coarse mask, mapped to image pixels (pixel centers of the f×f blocks).
+    Timer t2;
+    auto quadOpt = geom::findStrongQuad(ctx.frame_mask, ws.quad, opt.quad_engine);
     if (!quadOpt) {
+        ctx.stats.quad_ms = t2.ms();
         if (opt.debug) std::cerr << "[debug] no quad found\n";
-        return std::nullopt;
+        return ctx.finish(std::nullopt);
     }
-    const auto& quad = *quadOpt;
-    saveIf(drawPolyOverlay(bgr, quad), outdir / (base + "_poly.png"), opt.save_debug, opt.debug);
-
-    // ---------------------------------------------------------------------
-    // (3) Warp to square & compute warped mask (for grid validation)
-    // ---------------------------------------------------------------------
-    Timer t3;
-    const int N = std::max(32, opt.warp_size);
-
-    // Warp the original image to a square using the quad.
-    auto warpRes = geom::warpToSquareWithH(bgr, quad, N);
-    cv::Mat warped = warpRes.image;
-
-    // Build a warped mask using the same segmentation options,
-    // but allow a one-time, local relaxation if the mask is too sparse.
-    // NOTE: this does NOT change the global mask in (1)—it only
-    // adapts the warped-view where blur/low saturation could hide colors.
-    SegOptions sopt_warp = sopt;
-    cv::Mat warpedMask = ColorSegmenter::allowedMaskHSV(warped, sopt_warp);
-
-    // One-shot local relaxation on warped-mask only (helps blurred/low-S cases).
+    ctx.stats.quad_found = true;
+    std::vector<cv::Point2f> quad = std::move(*quadOpt);
+    const float half = 0.5f * (float)f - 0.5f;
+    for (auto& p : quad) p = cv::Point2f(p.x * (float)f + half, p.y * (float)f + half);
+
+    // Pull the quad's bounding box at full resolution, with room for the
+    // corner-refinement windows and the bilinear footprint of the warp.
+    const int radius = f > 1 && opt.refine_corners ? std::clamp((int)std::ceil(2.0 * f), 3, 21) : 0;
+    const int margin = radius + 2;
+    cv::Rect roi = cv::boundingRect(quad);
+    roi = cv::Rect(roi.x - margin, roi.y - margin, roi.width + 2 * margin, roi.height + 2 * margin)
+        & cv::Rect(0, 0, size.width, size.height);
+    if (roi.empty()) {
+        ctx.stats.quad_ms = t2.ms();
+        return ctx.finish(std::nullopt);
+    }
+    cv::Mat& full = ws.stream_roi.view(roi.size(), CV_8UC3);
     {
-        const double totalW = std::max(1.0, (double)warped.total());
-        const double frac = (double)cv::countNonZero(warpedMask) / totalW;
-
-        // If the warped mask is very sparse (<3%), relax S/V a bit and try once more.
-        if (frac < 0.03) {
-            sopt_warp.smin = std::max(0, sopt_warp.smin - 20);
-            sopt_warp.vmin = std::max(0, sopt_warp.vmin - 20);
-            // A slightly stronger close helps reconnect split color blobs.
-            sopt_warp.close_iter = std::max(1, sopt_warp.close_iter);
-            warpedMask = ColorSegmenter::allowedMaskHSV(warped, sopt_warp);
-        }
+        MCE_TRACE_SCOPE("stream.read_roi");
+        src.read(roi, full);
     }
 
-    t_warp = t3.ms();
-
-    saveIf(warped, outdir / (base + "_warped.png"), opt.save_debug, opt.debug);
-    saveIf(warpedMask, outdir / (base + "_warped_mask.png"), opt.save_debug, opt.debug);
-
-    // ---------------------------------------------------------------------
-    // (4) Grid validation: seams (diagnostics) + cells (decision)
-    //     - Strict mode requires cells.ok == true.
-    //     - Added a color/saturation fallback: if ≥7 of 9 cells are "colorful enough",
-    //       we accept the grid (helps blurred low-mask cases like p5).
-    // ---------------------------------------------------------------------
-
-    Timer t4;
-    auto seams = grid::checkGridSeams(warpedMask);
-    auto cells = grid::checkGridCells(warpedMask, opt.min_cell_fraction);
-
-    // Fallback: consider cells "colorful" if their mean S and V are high enough.
-    // This check runs on the warped BGR image (not on the mask), so it can still pass
-    // when the warped mask is under-segmented but colors are visibly present.
-    auto colorful_cells_ge7 = [&]()->bool {
-        CV_Assert(warped.type() == CV_8UC3 && warped.rows == warped.cols);
-        const int Nw = warped.rows;
-        const int cell = Nw / 3;
-
-        cv::Mat hsv; cv::cvtColor(warped, hsv, cv::COLOR_BGR2HSV);
-
-        int okCells = 0;
-        for (int r = 0; r < 3; ++r) {
-            for (int c = 0; c < 3; ++c) {
-                const int x = c * cell;
-                const int y = r * cell;
-                const int w = (c == 2 ? Nw - x : cell);
-                const int h = (r == 2 ? Nw - y : cell);
-                cv::Mat roi = hsv(cv::Rect(x, y, w, h));
-
-                // Average saturation and value in the cell.
-                const cv::Scalar meanHSV = cv::mean(roi);
-                const double meanS = meanHSV[1];
-                const double meanV = meanHSV[2];
-
-                // Soft thresholds tuned for blurred, low-contrast markers.
-                if (meanS >= 60.0 && meanV >= 50.0) {
-                    okCells++;
-                }
-            }
-        }
-        return okCells >= 7; // accept if at least 7 of 9 look "colorful"
-    }();
+    for (auto& p : quad) p -= cv::Point2f((float)roi.x, (float)roi.y);
+    if (radius > 0) quad = geom::refineQuadCorners(full, quad, radius);
+    ctx.stats.quad_ms = t2.ms();
+
+    // From here on the frame is the region; the coarse mask still covers the
+    // whole image, which lies at -roi.tl() in region coordinates.
+    Frame frame{ full, {}, {} };
+    frame.origin = roi.tl();
+    frame.image = size;
+    ctx.mask_roi = cv::Rect(-roi.x, -roi.y, coarse.cols * f, coarse.rows * f);
+    if (ctx.capture) ctx.save(ctx.polyOverlay(frame, quad), "_poly");
+    return ctx.finish(verifyQuad(frame, quad, ctx));
+}
+
+MultiDetectionResult
+MarkerDetector::detectAll(const cv::Mat& bgr,
+    const DetectOptions& opt,
+    int max_markers,
+    const std::string& image_path_hint) const
+{
+    DetectorWorkspace ws;
+    return detectAll(bgr, opt, ws, max_markers, image_path_hint);
+}
 
-    t_grid = t4.ms();
+MultiDetectionResult
+MarkerDetector::detectAll(const cv::Mat& bgr,
+    const DetectOptions& opt,
+    DetectorWorkspace& ws,
+    int max_markers,
+    const std::string& image_path_hint) const
+{
+    MultiDetectionResult out;
 
-    if (opt.debug) {
-        std::cerr << "[debug] seams: cx1=" << seams.cx1 << ", cx2=" << seams.cx2
-            << ", cy1=" << seams.cy1 << ", cy2=" << seams.cy2
-            << ", ok=" << seams.ok << "\n";
-        std::cerr << "[debug] cells ok=" << (cells.ok ? 1 : 0)
-            << " (min=" << opt.min_cell_fraction << ")\n";
-        std::cerr << "[debug] colorful>=7=" << (colorful_cells_ge7 ? "true" : "false") << "\n";
+    // Input guard
+    ws.stats = DetectionStats{};
+    if (bgr.empty() || bgr.type() != CV_8UC3 || max_markers <= 0) return out;
+
+    MCE_TRACE_SCOPE("detectAll");
+    // (1) One segmentation for the whole frame
+    RunContext ctx(opt, ws, image_path_hint);
+    if (!passesPrecheck(bgr, ctx)) {
+        ctx.finish(std::nullopt);
+        return out;
     }
+    const Frame frame{ bgr, {}, {} };
+    segmentRoi(frame, cv::Rect(0, 0, bgr.cols, bgr.rows), ctx);
 
-    // Decision: in strict mode require BOTH seams and cells.
-  // In non-strict mode, allow the colorful fallback as a helper.
-    const bool grid_ok =
-        (opt.strict_grid)
-        ? (seams.ok && (cells.ok || colorful_cells_ge7))
-        : (cells.ok || colorful_cells_ge7);
-
-
-    // ---------------------------------------------------------------------
-    // (5) Final polygon = initial quad (no refinement)
-    // ---------------------------------------------------------------------
-    Timer t5;
-    std::vector<cv::Point2f> final_poly = quad;
-    // Kept for parity with prior runs; same content as _poly.png.
-    saveIf(drawPolyOverlay(bgr, final_poly), outdir / (base + "_poly_refined.png"), opt.save_debug, opt.debug);
-    t_refine = t5.ms(); // near-zero; included for timing symmetry
-
-    // ---------------------------------------------------------------------
-    // (6) Coverage computation
-    // ---------------------------------------------------------------------
-    double cov = geom::polygonCoveragePercent(final_poly, bgr.size());
-    // Reject unrealistically tiny polygons (prevents 0% false positives).
-    const double kMinCovPct = 0.5; // percent
-    if (cov < kMinCovPct) {
-        if (opt.debug) std::cerr << "[debug] coverage guard failed (" << cov << "%)\n";
-        return std::nullopt;
+    // (2) Top-K candidates from the shared mask (tiny blobs would fail the coverage guard anyway)
+    Timer t2;
+    std::vector<std::vector<cv::Point2f>> cands =
+        geom::findQuadCandidates(ctx.frame_mask, ws.quad, max_markers, kMinCovPct / 100.0);
+    ctx.stats.quad_found = !cands.empty();
+    ctx.stats.quad_ms = t2.ms();
+    if (opt.debug) std::cerr << "[debug] quad candidates=" << cands.size() << "\n";
+    if (cands.empty()) {
+        ctx.finish(std::nullopt);
+        return out;
     }
 
-    // Timing summary
-    if (opt.debug) {
-        double t_total = total.ms();
-        std::cerr << "[time] seg=" << t_seg << " ms, "
-            << "quad=" << t_quad << " ms, "
-            << "warp=" << t_warp << " ms, "
-            << "grid=" << t_grid << " ms, "
-            << "refine=" << t_refine << " ms, "
-            << "total=" << t_total << " ms\n";
+    // (3)-(6) per candidate, each with its own workspace
+    const int n = (int)cands.size();
+    if ((int)ws.candidates.size() < n) ws.candidates.resize((size_t)n);
+    std::vector<std::optional<DetectionResult>> found((size_t)n);
+    const std::string base = makeBaseName(image_path_hint);
+
+    auto body = [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            DetectorWorkspace& cw = ws.candidates[(size_t)i];
+            cw.stats = DetectionStats{};
+            RunContext cctx(opt, cw, base + "_m" + std::to_string(i), &ctx);
+            cctx.frame_mask = ctx.frame_mask; // read-only, shared
+            cctx.mask_roi = ctx.mask_roi;
+            cctx.frame_dev = ctx.frame_dev;
+            const auto quad = maskQuadToFrame(frame, cands[(size_t)i], cctx);
+            found[(size_t)i] = verifyQuad(frame, quad, cctx);
+        }
+    };
+    if (opt.debug || n == 1) body(cv::Range(0, n));
+    else cv::parallel_for_(cv::Range(0, n), body);
+
+    for (int i = 0; i < n; ++i) {
+        const DetectionStats& cs = ws.candidates[(size_t)i].stats;
+        ctx.stats.warp_ms += cs.warp_ms;
+        ctx.stats.grid_ms += cs.grid_ms;
+        ctx.stats.refine_ms += cs.refine_ms;
+        ctx.stats.warped_relax = ctx.stats.warped_relax || cs.warped_relax;
+        ctx.stats.mask_warped = ctx.stats.mask_warped || cs.mask_warped;
+        ctx.stats.warped_resegmented = ctx.stats.warped_resegmented || cs.warped_resegmented;
+        ctx.stats.lattice = ctx.stats.lattice || cs.lattice;
+        if (found[(size_t)i]) out.markers.push_back(std::move(*found[(size_t)i]));
     }
 
-    // Package result
-    DetectionResult res;
-    res.polygon = final_poly;
-    res.coverage_percent = cov;
-    res.grid_ok = grid_ok;
+    // Union coverage: exact for one marker, rasterized (overlaps counted once) otherwise.
+    if (out.markers.size() == 1) {
+        out.union_coverage_percent = out.markers[0].coverage_percent;
+    }
+    else if (!out.markers.empty()) {
+        std::vector<std::vector<cv::Point2f>> polys;
+        polys.reserve(out.markers.size());
+        for (const auto& m : out.markers) polys.push_back(m.polygon);
+        out.union_coverage_percent = geom::unionCoveragePercent(polys, bgr.size(), kUnionRasterSide, ws.union_mask);
+    }
 
-    // Strict mode: fail if grid validation did not pass.
-    if (opt.strict_grid && !grid_ok) {
-        if (opt.debug) std::cerr << "[debug] strict_grid=true -> not found\n";
-        return std::nullopt;
+    if (opt.debug) {
+        std::cerr << "[debug] markers=" << out.markers.size()
+            << ", union coverage=" << out.union_coverage_percent << "%\n";
     }
-    return res;
+    ctx.stats.total_ms = ctx.total.ms();
+    ctx.stats.found = !out.markers.empty();
+    return out;
 }
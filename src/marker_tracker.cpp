@@ -0,0 +1,92 @@
+#include "marker_tracker.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace cv;
+
+namespace {
+    /// @brief Bounding box of a polygon expanded by a relative and absolute margin.
+    static Rect expandedRoi(const std::vector<Point2f>& poly, double margin, int min_px, const Size& sz) {
+        const Rect bb = boundingRect(poly);
+        const int mx = std::max(min_px, (int)std::lround(bb.width * margin));
+        const int my = std::max(min_px, (int)std::lround(bb.height * margin));
+        return Rect(bb.x - mx, bb.y - my, bb.width + 2 * mx, bb.height + 2 * my) & Rect(0, 0, sz.width, sz.height);
+    }
+
+    /// @brief True if a vertex lies on an ROI edge that is not also an image edge.
+    static bool touchesInnerBorder(const std::vector<Point2f>& poly, const Rect& roi, const Size& sz) {
+        const float tol = 2.f;
+        for (const auto& p : poly) {
+            if (roi.x > 0 && p.x <= (float)roi.x + tol) return true;
+            if (roi.y > 0 && p.y <= (float)roi.y + tol) return true;
+            if (roi.br().x < sz.width && p.x >= (float)roi.br().x - 1 - tol) return true;
+            if (roi.br().y < sz.height && p.y >= (float)roi.br().y - 1 - tol) return true;
+        }
+        return false;
+    }
+}
+
+MarkerTracker::MarkerTracker(const DetectOptions& opt, const TrackOptions& topt)
+    : opt_(opt), topt_(topt) {}
+
+void MarkerTracker::seed(const DetectionResult& prev, const Size& frame_size) {
+    prev_ = prev;
+    prev_size_ = frame_size;
+    since_full_ = 0;
+}
+
+void MarkerTracker::reset() {
+    prev_.reset();
+    since_full_ = 0;
+    last_tracked_ = false;
+}
+
+std::optional<DetectionResult> MarkerTracker::tryRoi(const Mat& bgr) {
+    const DetectionResult& prev = *prev_;
+    const Rect roi = expandedRoi(prev.polygon, topt_.roi_margin, topt_.min_margin_px, bgr.size());
+    if (roi.empty()) return std::nullopt;
+
+    auto res = detector_.detectInRoi(bgr, roi, opt_, ws_);
+    if (!res || !res->grid_ok) return std::nullopt;
+
+    // Marker may continue past the ROI: the quad would be clipped.
+    if (touchesInnerBorder(res->polygon, roi, bgr.size())) {
+        if (opt_.debug) std::cerr << "[debug] track: quad touches ROI border\n";
+        return std::nullopt;
+    }
+
+    const double jump = std::abs(res->coverage_percent - prev.coverage_percent)
+        / std::max(1e-6, prev.coverage_percent);
+    if (jump > topt_.max_coverage_jump) {
+        if (opt_.debug) std::cerr << "[debug] track: coverage jump " << jump << "\n";
+        return std::nullopt;
+    }
+    return res;
+}
+
+std::optional<DetectionResult> MarkerTracker::update(const Mat& bgr) {
+    last_tracked_ = false;
+    if (bgr.empty() || bgr.type() != CV_8UC3) {
+        reset();
+        return std::nullopt;
+    }
+
+    const bool due = topt_.redetect_interval > 0 && since_full_ >= topt_.redetect_interval;
+    if (prev_ && bgr.size() == prev_size_ && !due) {
+        if (auto res = tryRoi(bgr)) {
+            prev_ = res;
+            ++since_full_;
+            last_tracked_ = true;
+            return res;
+        }
+        if (opt_.debug) std::cerr << "[debug] track: falling back to full-frame detection\n";
+    }
+
+    auto res = detector_.detect(bgr, opt_, ws_);
+    prev_ = res;
+    prev_size_ = bgr.size();
+    since_full_ = 0;
+    return res;
+}
@@ -0,0 +1,219 @@
+#include "mce_c_api.h"
+#include "marker_detector.hpp"
+#include "scratch_mat.hpp"
+#include "timer.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace cv;
+
+namespace {
+    /// @brief Per-call state borrowed from a detector's pool.
+    struct Slot {
+        DetectorWorkspace ws;
+        ScratchMat converted;  ///< BGR copy for non-BGR inputs (CV_8UC3)
+    };
+
+    thread_local std::string t_last_error;
+
+    static mce_status fail(mce_status st, const char* what) {
+        t_last_error = what;
+        return st;
+    }
+
+    /// @brief True if @p field lies inside the caller's struct (older headers are shorter).
+#define MCE_HAS_FIELD(opt, field) \
+    ((opt)->struct_size >= offsetof(mce_options, field) + sizeof((opt)->field))
+
+    static DetectOptions toDetectOptions(const mce_options* o) {
+        DetectOptions opt;
+        if (!o) return opt;
+        if (MCE_HAS_FIELD(o, strict_grid))       opt.strict_grid = o->strict_grid != 0;
+        if (MCE_HAS_FIELD(o, min_cell_fraction)) opt.min_cell_fraction = o->min_cell_fraction;
+        if (MCE_HAS_FIELD(o, max_side))          opt.max_side = o->max_side;
+        if (MCE_HAS_FIELD(o, warp_size))         opt.warp_size = o->warp_size;
+        if (MCE_HAS_FIELD(o, grid_rows))         opt.grid_rows = o->grid_rows;
+        if (MCE_HAS_FIELD(o, grid_cols))         opt.grid_cols = o->grid_cols;
+        if (MCE_HAS_FIELD(o, quad_engine)) {
+            opt.quad_engine = o->quad_engine == 1 ? geom::QuadEngine::Components : geom::QuadEngine::Contours;
+        }
+        if (MCE_HAS_FIELD(o, precheck))          opt.precheck = o->precheck != 0;
+        if (MCE_HAS_FIELD(o, backend)) {
+            opt.backend = o->backend == 1 ? ComputeBackend::OpenCL : ComputeBackend::Cpu;
+        }
+        return opt;
+    }
+
+    /// @brief Wrap the caller's NV12 planes without copying; false on bad input.
+    static bool wrapNV12(const mce_image& img, Mat& y, Mat& uv, const char** why) {
+        *why = "invalid image";
+        if (!img.data || img.width <= 0 || img.height <= 0) return false;
+        if ((img.width % 2) || (img.height % 2)) { *why = "NV12 needs even width and height"; return false; }
+        if (img.stride < img.width) { *why = "stride < width"; return false; }
+        const int uv_stride = img.uv_stride > 0 ? img.uv_stride : img.stride;
+        if (uv_stride < img.width) { *why = "uv_stride < width"; return false; }
+        const uint8_t* uvp = img.uv ? img.uv : img.data + (size_t)img.stride * img.height;
+        y = Mat(img.height, img.width, CV_8UC1, const_cast<uint8_t*>(img.data), (size_t)img.stride);
+        uv = Mat(img.height / 2, img.width / 2, CV_8UC2, const_cast<uint8_t*>(uvp), (size_t)uv_stride);
+        return true;
+    }
+
+    /// @brief Wrap (BGR) or convert the caller's pixels into a BGR Mat; empty Mat on bad input.
+    static Mat toBgr(const mce_image& img, Slot& slot, const char** why) {
+        *why = "invalid image";
+        if (!img.data || img.width <= 0 || img.height <= 0) return Mat();
+        const Size sz(img.width, img.height);
+        void* data = const_cast<uint8_t*>(img.data); // only read
+
+        switch (img.format) {
+        case MCE_FORMAT_BGR:
+            if (img.stride < 3 * img.width) { *why = "stride < 3 * width"; return Mat(); }
+            return Mat(sz, CV_8UC3, data, (size_t)img.stride); // no copy
+        case MCE_FORMAT_RGB:
+        case MCE_FORMAT_BGRA: {
+            const bool rgb = img.format == MCE_FORMAT_RGB;
+            const int bpp = rgb ? 3 : 4;
+            if (img.stride < bpp * img.width) { *why = "stride < bytes per pixel * width"; return Mat(); }
+            const Mat src(sz, rgb ? CV_8UC3 : CV_8UC4, data, (size_t)img.stride);
+            Mat& bgr = slot.converted.view(sz, CV_8UC3);
+            cvtColor(src, bgr, rgb ? COLOR_RGB2BGR : COLOR_BGRA2BGR);
+            return bgr;
+        }
+        default:
+            *why = "unknown pixel format";
+            return Mat();
+        }
+    }
+}
+
+/// @brief Detector handle: immutable options plus a pool of per-call workspaces.
+struct mce_detector {
+    DetectOptions opt;
+    MarkerDetector detector;
+
+    std::mutex m;
+    std::vector<std::unique_ptr<Slot>> idle;
+
+    /// @brief Borrow a workspace (created on demand; at most one per concurrent call).
+    std::unique_ptr<Slot> acquire() {
+        {
+            std::lock_guard<std::mutex> lk(m);
+            if (!idle.empty()) {
+                std::unique_ptr<Slot> s = std::move(idle.back());
+                idle.pop_back();
+                return s;
+            }
+        }
+        return std::make_unique<Slot>();
+    }
+
+    void release(std::unique_ptr<Slot> s) {
+        std::lock_guard<std::mutex> lk(m);
+        idle.push_back(std::move(s));
+    }
+};
+
+extern "C" {
+
+uint32_t mce_abi_version(void) {
+    return MCE_ABI_VERSION;
+}
+
+void mce_options_init(mce_options* opt) {
+    if (!opt) return;
+    const DetectOptions d;
+    *opt = mce_options{};
+    opt->struct_size = (uint32_t)sizeof(mce_options);
+    opt->strict_grid = d.strict_grid ? 1 : 0;
+    opt->min_cell_fraction = d.min_cell_fraction;
+    opt->max_side = d.max_side;
+    opt->warp_size = d.warp_size;
+    opt->grid_rows = d.grid_rows;
+    opt->grid_cols = d.grid_cols;
+    opt->quad_engine = d.quad_engine == geom::QuadEngine::Components ? 1 : 0;
+    opt->precheck = d.precheck ? 1 : 0;
+    opt->backend = d.backend == ComputeBackend::OpenCL ? 1 : 0;
+}
+
+mce_detector* mce_detector_create(const mce_options* opt) {
+    t_last_error.clear();
+    try {
+        auto det = std::make_unique<mce_detector>();
+        det->opt = toDetectOptions(opt);
+        return det.release();
+    }
+    catch (const std::exception& e) {
+        t_last_error = e.what();
+        return nullptr;
+    }
+}
+
+void mce_detector_destroy(mce_detector* det) {
+    delete det;
+}
+
+mce_status mce_detect(mce_detector* det, const mce_image* img, mce_result* out) {
+    t_last_error.clear();
+    if (!det || !img || !out) return fail(MCE_ERR_INVALID_ARGUMENT, "null argument");
+
+    std::unique_ptr<Slot> slot;
+    try {
+        slot = det->acquire();
+        const char* why = "";
+        Mat bgr, y, uv;
+        const bool nv12 = img->format == MCE_FORMAT_NV12;
+        const bool ok = nv12 ? wrapNV12(*img, y, uv, &why) : !(bgr = toBgr(*img, *slot, &why)).empty();
+        if (!ok) {
+            det->release(std::move(slot));
+            return fail(MCE_ERR_INVALID_ARGUMENT, why);
+        }
+
+        // NV12 is segmented from its planes directly (no BGR conversion).
+        Timer t;
+        const auto res = nv12 ? det->detector.detectNV12(y, uv, det->opt, slot->ws)
+                              : det->detector.detect(bgr, det->opt, slot->ws);
+        const double ms = t.ms();
+        det->release(std::move(slot));
+        if (!res) return MCE_NOT_FOUND;
+
+        mce_result r{};
+        r.coverage_percent = res->coverage_percent;
+        for (size_t i = 0; i < 4 && i < res->polygon.size(); ++i) {
+            r.polygon[2 * i] = res->polygon[i].x;
+            r.polygon[2 * i + 1] = res->polygon[i].y;
+        }
+        r.grid_ok = res->grid_ok ? 1 : 0;
+        r.total_ms = ms;
+        *out = r;
+        return MCE_OK;
+    }
+    catch (const std::exception& e) {
+        // A workspace that saw an exception is dropped rather than returned to the pool.
+        t_last_error = e.what();
+        return MCE_ERR_INTERNAL;
+    }
+    catch (...) {
+        return fail(MCE_ERR_INTERNAL, "unknown error");
+    }
+}
+
+const char* mce_status_string(mce_status status) {
+    switch (status) {
+    case MCE_OK:                   return "ok";
+    case MCE_NOT_FOUND:            return "not found";
+    case MCE_ERR_INVALID_ARGUMENT: return "invalid argument";
+    case MCE_ERR_INTERNAL:         return "internal error";
+    }
+    return "unknown status";
+}
+
+const char* mce_last_error(void) {
+    return t_last_error.c_str();
+}
+
+} // extern "C"
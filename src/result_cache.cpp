@@ -0,0 +1,294 @@
+#include "result_cache.hpp"
+#include "color_profile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+
+namespace {
+    // --- XXH64 ---------------------------------------------------------------
+    constexpr std::uint64_t kP1 = 0x9E3779B185EBCA87ull;
+    constexpr std::uint64_t kP2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr std::uint64_t kP3 = 0x165667B19E3779F9ull;
+    constexpr std::uint64_t kP4 = 0x85EBCA77C2B2AE63ull;
+    constexpr std::uint64_t kP5 = 0x27D4EB2F165667C5ull;
+
+    static std::uint64_t rotl(std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static std::uint64_t getLE(const std::uint8_t* p, int bytes) {
+        std::uint64_t v = 0;
+        for (int i = bytes - 1; i >= 0; --i) v = (v << 8) | p[i];
+        return v;
+    }
+
+    static void putLE(std::uint8_t* p, std::uint64_t v, int bytes) {
+        for (int i = 0; i < bytes; ++i, v >>= 8) p[i] = (std::uint8_t)v;
+    }
+
+    static std::uint64_t xxRound(std::uint64_t acc, std::uint64_t input) {
+        return rotl(acc + input * kP2, 31) * kP1;
+    }
+
+    static std::uint64_t xxMerge(std::uint64_t acc, std::uint64_t v) {
+        return (acc ^ xxRound(0, v)) * kP1 + kP4;
+    }
+
+    // --- Cache file ----------------------------------------------------------
+    constexpr char kMagic[8] = { 'M', 'C', 'E', 'R', 'C', 'A', 'C', 'H' };
+    constexpr std::uint32_t kVersion = 1;
+    constexpr size_t kHeaderSize = 16;
+
+    // Record: content u64 | size u64 | options u64 | coverage f64 |
+    //         found u8 | grid_ok u8 | points u8 | 5 reserved |
+    //         kMaxPoints × (x f32, y f32) | checksum u32 (XXH64 of the above, low bits) | 4 reserved
+    constexpr size_t kPointsAt = 40;
+    constexpr size_t kChecksumAt = kPointsAt + (size_t)ResultCache::kMaxPoints * 8;
+    constexpr size_t kRecordSize = kChecksumAt + 8;
+
+    static std::uint32_t checksum(const std::uint8_t* rec) {
+        return (std::uint32_t)xxh64(rec, kChecksumAt);
+    }
+
+    static std::uint64_t bitsOf(double d) { std::uint64_t u; std::memcpy(&u, &d, 8); return u; }
+    static double doubleOf(std::uint64_t u) { double d; std::memcpy(&d, &u, 8); return d; }
+    static std::uint32_t bitsOf(float f) { std::uint32_t u; std::memcpy(&u, &f, 4); return u; }
+    static float floatOf(std::uint32_t u) { float f; std::memcpy(&f, &u, 4); return f; }
+
+    static ResultCache::Key recordKey(const std::uint8_t* rec) {
+        return ResultCache::Key{ getLE(rec, 8), getLE(rec + 8, 8), getLE(rec + 16, 8) };
+    }
+
+    static bool sameKey(const ResultCache::Key& a, const ResultCache::Key& b) {
+        return a.content == b.content && a.size == b.size && a.options == b.options;
+    }
+
+    static std::optional<DetectionResult> recordResult(const std::uint8_t* rec) {
+        if (rec[32] == 0) return std::nullopt;
+        DetectionResult r;
+        r.coverage_percent = doubleOf(getLE(rec + 24, 8));
+        r.grid_ok = rec[33] != 0;
+        const int n = std::min<int>(rec[34], ResultCache::kMaxPoints);
+        r.polygon.resize((size_t)n);
+        for (int i = 0; i < n; ++i) {
+            const std::uint8_t* p = rec + kPointsAt + (size_t)i * 8;
+            r.polygon[(size_t)i] = cv::Point2f(floatOf((std::uint32_t)getLE(p, 4)), floatOf((std::uint32_t)getLE(p + 4, 4)));
+        }
+        return r;
+    }
+
+    static void encodeRecord(std::uint8_t* rec, const ResultCache::Key& k, const std::optional<DetectionResult>& r) {
+        std::memset(rec, 0, kRecordSize);
+        putLE(rec, k.content, 8);
+        putLE(rec + 8, k.size, 8);
+        putLE(rec + 16, k.options, 8);
+        if (r) {
+            putLE(rec + 24, bitsOf(r->coverage_percent), 8);
+            rec[32] = 1;
+            rec[33] = r->grid_ok ? 1 : 0;
+            rec[34] = (std::uint8_t)r->polygon.size();
+            for (size_t i = 0; i < r->polygon.size(); ++i) {
+                putLE(rec + kPointsAt + i * 8, bitsOf(r->polygon[i].x), 4);
+                putLE(rec + kPointsAt + i * 8 + 4, bitsOf(r->polygon[i].y), 4);
+            }
+        }
+        putLE(rec + kChecksumAt, checksum(rec), 4);
+    }
+
+    // Appends fixed-width fields to the options hash input.
+    struct HashInput {
+        std::vector<std::uint8_t> bytes;
+        void add(std::uint64_t v) { std::uint8_t b[8]; putLE(b, v, 8); bytes.insert(bytes.end(), b, b + 8); }
+        void add(int v) { add((std::uint64_t)(std::int64_t)v); }
+        void add(bool v) { add((std::uint64_t)(v ? 1 : 0)); }
+        void add(double v) { add(bitsOf(v)); }
+    };
+}
+
+std::uint64_t xxh64(const void* data, size_t size, std::uint64_t seed) {
+    const std::uint8_t* p = static_cast<const std::uint8_t*>(data);
+    const std::uint8_t* const end = p + size;
+    std::uint64_t h;
+    if (size >= 32) {
+        std::uint64_t v1 = seed + kP1 + kP2, v2 = seed + kP2, v3 = seed, v4 = seed - kP1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = xxRound(v1, getLE(p, 8));
+            v2 = xxRound(v2, getLE(p + 8, 8));
+            v3 = xxRound(v3, getLE(p + 16, 8));
+            v4 = xxRound(v4, getLE(p + 24, 8));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = xxMerge(h, v1);
+        h = xxMerge(h, v2);
+        h = xxMerge(h, v3);
+        h = xxMerge(h, v4);
+    }
+    else {
+        h = seed + kP5;
+    }
+    h += (std::uint64_t)size;
+    for (; p + 8 <= end; p += 8) h = rotl(h ^ xxRound(0, getLE(p, 8)), 27) * kP1 + kP4;
+    if (p + 4 <= end) {
+        h = rotl(h ^ (getLE(p, 4) * kP1), 23) * kP2 + kP3;
+        p += 4;
+    }
+    for (; p < end; ++p) h = rotl(h ^ (*p * kP5), 11) * kP1;
+    h ^= h >> 33;
+    h *= kP2;
+    h ^= h >> 29;
+    h *= kP3;
+    h ^= h >> 32;
+    return h;
+}
+
+std::uint64_t optionsHash(const DetectOptions& opt, std::uint64_t salt) {
+    HashInput in;
+    in.add((std::uint64_t)kVersion);
+    in.add(salt);
+    in.add(opt.warp_size);
+    in.add(opt.strict_grid);
+    in.add(opt.min_cell_fraction);
+    in.add(opt.grid_rows);
+    in.add(opt.grid_cols);
+    in.add(opt.max_side);
+    in.add(opt.refine_corners);
+    in.add(opt.precheck);
+    in.add((int)opt.backend);
+    in.add((int)opt.quad_engine);
+    in.add((int)opt.warped_mask);
+    in.add(opt.warped_mask_fallback);
+    in.add(opt.pre_blur_ksize);
+    in.add(opt.morph_open_iter);
+    in.add(opt.morph_close_iter);
+    in.add(opt.seg_smin);
+    in.add(opt.seg_vmin);
+
+    // The palette, not the profile's name or identity.
+    const ColorProfile& profile = opt.color_profile ? *opt.color_profile : *ColorProfile::builtin();
+    in.add(profile.whiteSmax());
+    in.add(profile.whiteVmin());
+    for (const auto& c : profile.colors()) {
+        in.add((int)c.color);
+        in.add(c.range.hmin);
+        in.add(c.range.hmax);
+        in.add(c.range.smin);
+        in.add(c.range.smax);
+        in.add(c.range.vmin);
+    }
+    return xxh64(in.bytes.data(), in.bytes.size());
+}
+
+std::shared_ptr<ResultCache> ResultCache::open(const std::string& path, std::string* error) {
+    auto fail = [&](const std::string& why) -> std::shared_ptr<ResultCache> {
+        if (error) *error = path + ": " + why;
+        return nullptr;
+    };
+
+    std::shared_ptr<ResultCache> c(new ResultCache());
+    std::error_code ec;
+    const bool exists = std::filesystem::exists(path, ec);
+    if (exists) {
+        const std::uintmax_t bytes = std::filesystem::file_size(path, ec);
+        if (ec) return fail("cannot read cache file");
+        if (bytes > 0) {
+            if (!c->map_.open(path)) return fail("cannot map cache file");
+            const std::uint8_t* d = c->map_.data();
+            if (c->map_.size() < kHeaderSize || std::memcmp(d, kMagic, sizeof(kMagic)) != 0) {
+                return fail("not a result cache file");
+            }
+            if (getLE(d + 8, 4) != kVersion || getLE(d + 12, 4) != kRecordSize) {
+                return fail("unsupported cache version");
+            }
+            // Cut off a partial record so appends stay aligned. The mapping is
+            // dropped first: Windows cannot resize a mapped file.
+            const size_t valid = kHeaderSize + (c->map_.size() - kHeaderSize) / kRecordSize * kRecordSize;
+            if (valid != c->map_.size()) {
+                c->map_.close();
+                std::filesystem::resize_file(path, valid, ec);
+                if (ec) return fail("cannot truncate torn cache tail");
+                if (!c->map_.open(path)) return fail("cannot map cache file");
+            }
+            d = c->map_.data();
+            const size_t n = (c->map_.size() - kHeaderSize) / kRecordSize;
+            for (size_t i = 0; i < n; ++i) {
+                const std::uint8_t* rec = d + kHeaderSize + i * kRecordSize;
+                if (getLE(rec + kChecksumAt, 4) != checksum(rec)) continue; // corrupt record
+                c->mapped_[slot(recordKey(rec))] = rec;                      // later records win
+            }
+        }
+    }
+
+    c->file_ = std::fopen(path.c_str(), "ab");
+    if (!c->file_) return fail("cannot open cache file for writing");
+    if (!exists || !c->map_.isOpen()) {
+        std::uint8_t hdr[kHeaderSize] = {};
+        std::memcpy(hdr, kMagic, sizeof(kMagic));
+        putLE(hdr + 8, kVersion, 4);
+        putLE(hdr + 12, kRecordSize, 4);
+        if (std::fwrite(hdr, 1, kHeaderSize, c->file_) != kHeaderSize || std::fflush(c->file_) != 0) {
+            return fail("cannot write cache header");
+        }
+    }
+    return c;
+}
+
+ResultCache::~ResultCache() {
+    if (file_) std::fclose(file_);
+}
+
+std::uint64_t ResultCache::slot(const Key& k) {
+    return k.content ^ rotl(k.options, 29) ^ (k.size * kP3);
+}
+
+ResultCache::Key ResultCache::key(const std::uint8_t* data, size_t size, std::uint64_t options) {
+    return Key{ xxh64(data, size), (std::uint64_t)size, options };
+}
+
+bool ResultCache::find(const Key& k, std::optional<DetectionResult>& result) const {
+    std::lock_guard<std::mutex> lk(m_);
+    const std::uint64_t s = slot(k);
+    auto a = appended_.find(s);
+    if (a != appended_.end() && sameKey(a->second.key, k)) {
+        result = a->second.result;
+        ++hits_;
+        return true;
+    }
+    auto m = mapped_.find(s);
+    if (m != mapped_.end() && sameKey(recordKey(m->second), k)) {
+        result = recordResult(m->second);
+        ++hits_;
+        return true;
+    }
+    ++misses_;
+    return false;
+}
+
+bool ResultCache::insert(const Key& k, const std::optional<DetectionResult>& result) {
+    if (result && result->polygon.size() > (size_t)kMaxPoints) return false;
+    std::uint8_t rec[kRecordSize];
+    encodeRecord(rec, k, result);
+
+    std::lock_guard<std::mutex> lk(m_);
+    // One record per write call, flushed, so a killed run keeps what it finished.
+    if (std::fwrite(rec, 1, kRecordSize, file_) != kRecordSize || std::fflush(file_) != 0) return false;
+    appended_[slot(k)] = Entry{ k, result };
+    return true;
+}
+
+size_t ResultCache::size() const {
+    std::lock_guard<std::mutex> lk(m_);
+    size_t n = appended_.size();
+    for (const auto& m : mapped_) n += appended_.count(m.first) ? 0 : 1;
+    return n;
+}
+
+size_t ResultCache::hits() const {
+    std::lock_guard<std::mutex> lk(m_);
+    return hits_;
+}
+
+size_t ResultCache::misses() const {
+    std::lock_guard<std::mutex> lk(m_);
+    return misses_;
+}
@@ -0,0 +1,87 @@
+#include "row_source.hpp"
+
+#include <cctype>
+#include <cstdint>
+#include <limits>
+
+namespace {
+    // Cursor over the ASCII header of a Netpbm file.
+    struct HeaderReader {
+        const std::uint8_t* p;
+        const std::uint8_t* end;
+
+        // Skip whitespace and '#' comments (which run to the end of the line).
+        void skip() {
+            while (p < end) {
+                if (*p == '#') {
+                    while (p < end && *p != '\n' && *p != '\r') ++p;
+                }
+                else if (std::isspace(*p)) {
+                    ++p;
+                }
+                else {
+                    break;
+                }
+            }
+        }
+
+        bool number(int& v) {
+            skip();
+            if (p >= end || !std::isdigit(*p)) return false;
+            long long n = 0;
+            for (; p < end && std::isdigit(*p); ++p) {
+                n = n * 10 + (*p - '0');
+                if (n > std::numeric_limits<int>::max()) return false;
+            }
+            v = (int)n;
+            return true;
+        }
+    };
+}
+
+MatRowSource::MatRowSource(const cv::Mat& bgr) : bgr_(bgr) {
+    CV_Assert(bgr.type() == CV_8UC3);
+}
+
+void MatRowSource::read(const cv::Rect& r, cv::Mat& out) const {
+    CV_Assert((r & cv::Rect(0, 0, bgr_.cols, bgr_.rows)) == r && !r.empty());
+    bgr_(r).copyTo(out);
+}
+
+std::unique_ptr<NetpbmRowSource> NetpbmRowSource::open(const std::string& path, std::string* error) {
+    auto fail = [&](const std::string& why) -> std::unique_ptr<NetpbmRowSource> {
+        if (error) *error = path + ": " + why;
+        return nullptr;
+    };
+
+    std::unique_ptr<NetpbmRowSource> s(new NetpbmRowSource());
+    if (!s->file_.open(path)) return fail("cannot map file");
+    const std::uint8_t* d = s->file_.data();
+    const size_t n = s->file_.size();
+    if (n < 2 || d[0] != 'P' || (d[1] != '5' && d[1] != '6')) return fail("not a binary PGM/PPM file");
+    s->channels_ = d[1] == '5' ? 1 : 3;
+
+    HeaderReader h{ d + 2, d + n };
+    int w = 0, ht = 0, maxval = 0;
+    if (!h.number(w) || !h.number(ht) || !h.number(maxval)) return fail("malformed header");
+    if (w <= 0 || ht <= 0) return fail("empty image");
+    if (maxval != 255) return fail("only 8-bit samples (maxval 255) are supported");
+    // Exactly one whitespace byte separates the header from the samples.
+    if (h.p >= h.end || !std::isspace(*h.p)) return fail("malformed header");
+    s->pixels_ = h.p + 1;
+
+    const size_t need = (size_t)w * (size_t)ht * (size_t)s->channels_;
+    if ((size_t)(h.end - s->pixels_) < need) return fail("truncated pixel data");
+    s->size_ = cv::Size(w, ht);
+    return s;
+}
+
+void NetpbmRowSource::read(const cv::Rect& r, cv::Mat& out) const {
+    CV_Assert((r & cv::Rect(0, 0, size_.width, size_.height)) == r && !r.empty());
+    const size_t step = (size_t)size_.width * (size_t)channels_;
+    // A strided header over the mapped samples; cvtColor does the copy and the channel order.
+    const cv::Mat src(r.height, r.width, CV_8UC(channels_),
+        const_cast<std::uint8_t*>(pixels_ + (size_t)r.y * step + (size_t)r.x * (size_t)channels_), step);
+    out.create(r.size(), CV_8UC3);
+    cv::cvtColor(src, out, channels_ == 1 ? cv::COLOR_GRAY2BGR : cv::COLOR_RGB2BGR);
+}
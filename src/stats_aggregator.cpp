@@ -0,0 +1,133 @@
+#include "stats_aggregator.hpp"
+#include "frame_precheck.hpp"
+#include "report_format.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+
+namespace {
+    static const char* const kStageNames[] = {
+        "decode", "seg", "quad", "warp", "grid", "refine", "total"
+    };
+
+    /// @brief CSV field quoting (only when needed).
+    static void writeCsvField(std::ostream& os, const std::string& s) {
+        if (s.find_first_of(",\"\n") == std::string::npos) { os << s; return; }
+        os << '"';
+        for (char c : s) { if (c == '"') os << '"'; os << c; }
+        os << '"';
+    }
+}
+
+void StatsAggregator::add(const std::string& path, const DetectionStats& st, double decode_ms) {
+    const size_t idx = paths_.size();
+    paths_.push_back(path);
+
+    auto push = [&](Stage s, double ms) {
+        stages_[s].ms.push_back(ms);
+        stages_[s].who.push_back(idx);
+    };
+    push(kDecode, decode_ms);
+    if (st.precheck_reject == PrecheckReject::None) {
+        push(kSeg, st.seg_ms);
+        push(kQuad, st.quad_ms);
+    }
+    if (st.quad_found) {
+        push(kWarp, st.warp_ms);
+        push(kGrid, st.grid_ms);
+        push(kRefine, st.refine_ms);
+    }
+    push(kTotal, st.total_ms);
+
+    found_ += st.found ? 1 : 0;
+    quad_found_ += st.quad_found ? 1 : 0;
+    pyramid_ += st.pyramid ? 1 : 0;
+    rim_brake_ += st.rim_brake ? 1 : 0;
+    warped_relax_ += st.warped_relax ? 1 : 0;
+    mask_warped_ += st.mask_warped ? 1 : 0;
+    warped_resegmented_ += st.warped_resegmented ? 1 : 0;
+    lattice_ += st.lattice ? 1 : 0;
+    relaxed_ += st.relax_attempts > 0 ? 1 : 0;
+    relax_steps_ += st.relax_attempts;
+    precheck_reject_[(size_t)st.precheck_reject] += 1;
+}
+
+std::vector<StageSummary> StatsAggregator::summary() const {
+    std::vector<StageSummary> out;
+    out.reserve(kStageCount);
+    for (int s = 0; s < kStageCount; ++s) {
+        const Samples& smp = stages_[s];
+        StageSummary sum;
+        sum.name = kStageNames[s];
+        sum.n = smp.ms.size();
+        if (sum.n > 0) {
+            std::vector<double> sorted = smp.ms;
+            std::sort(sorted.begin(), sorted.end());
+            sum.mean_ms = std::accumulate(sorted.begin(), sorted.end(), 0.0) / (double)sum.n;
+            sum.p50_ms = report::percentile(sorted, 0.50);
+            sum.p95_ms = report::percentile(sorted, 0.95);
+            sum.p99_ms = report::percentile(sorted, 0.99);
+            const size_t k = (size_t)(std::max_element(smp.ms.begin(), smp.ms.end()) - smp.ms.begin());
+            sum.max_ms = smp.ms[k];
+            sum.max_path = paths_[smp.who[k]];
+        }
+        out.push_back(std::move(sum));
+    }
+    return out;
+}
+
+void StatsAggregator::writeJson(std::ostream& os) const {
+    const auto sums = summary();
+    const std::streamsize prec = os.precision();
+    os << std::fixed << std::setprecision(3);
+    os << "{\"images\":" << count()
+        << ",\"found\":" << found_
+        << ",\"quad_found\":" << quad_found_
+        << ",\"pyramid\":" << pyramid_
+        << ",\"rim_brake\":" << rim_brake_
+        << ",\"warped_relax\":" << warped_relax_
+        << ",\"mask_warped\":" << mask_warped_
+        << ",\"warped_resegmented\":" << warped_resegmented_
+        << ",\"lattice\":" << lattice_
+        << ",\"relaxed\":" << relaxed_
+        << ",\"relax_steps\":" << relax_steps_
+        << ",\"precheck_reject\":{";
+    for (int r = (int)PrecheckReject::FewColors; r <= (int)PrecheckReject::NoBlob; ++r) {
+        if (r != (int)PrecheckReject::FewColors) os << ',';
+        os << '"' << precheck::rejectName((PrecheckReject)r) << "\":" << precheck_reject_[r];
+    }
+    os << '}'
+        << ",\"stages\":{";
+    for (size_t i = 0; i < sums.size(); ++i) {
+        const StageSummary& s = sums[i];
+        if (i) os << ',';
+        os << '"' << s.name << "\":{\"n\":" << s.n
+            << ",\"mean_ms\":" << s.mean_ms
+            << ",\"p50_ms\":" << s.p50_ms
+            << ",\"p95_ms\":" << s.p95_ms
+            << ",\"p99_ms\":" << s.p99_ms
+            << ",\"max_ms\":" << s.max_ms
+            << ",\"max_path\":";
+        report::writeJsonString(os, s.max_path);
+        os << '}';
+    }
+    os << "}}\n";
+    os.unsetf(std::ios::floatfield);
+    os.precision(prec);
+}
+
+void StatsAggregator::writeCsv(std::ostream& os) const {
+    os << "stage,n,mean_ms,p50_ms,p95_ms,p99_ms,max_ms,max_path\n";
+    const std::streamsize prec = os.precision();
+    os << std::fixed << std::setprecision(3);
+    for (const StageSummary& s : summary()) {
+        os << s.name << ',' << s.n << ',' << s.mean_ms << ',' << s.p50_ms << ','
+            << s.p95_ms << ',' << s.p99_ms << ',' << s.max_ms << ',';
+        writeCsvField(os, s.max_path);
+        os << '\n';
+    }
+    os.unsetf(std::ios::floatfield);
+    os.precision(prec);
+}
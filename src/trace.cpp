@@ -0,0 +1,295 @@
+#include "trace.hpp"
+#include "report_format.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#if defined(MCE_TRACE_PERF) && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define MCE_TRACE_HAVE_PERF 1
+#endif
+
+#if defined(MCE_TRACE_ITT)
+#include <ittnotify.h>
+#endif
+
+namespace {
+    static std::int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct Registry {
+        std::mutex m;
+        std::vector<trace::Site*> sites;
+    };
+
+    static Registry& registry() {
+        static Registry r;
+        return r;
+    }
+
+#if defined(MCE_TRACE_CHROME)
+    struct Event {
+        const trace::Site* site;
+        std::int64_t ts_ns;
+        std::int64_t dur_ns;
+        trace::Counters delta;
+    };
+
+    /// @brief Events kept per thread; later ones are counted as dropped.
+    constexpr size_t kMaxEventsPerThread = (size_t)1 << 20;
+
+    struct ThreadEvents {
+        std::uint32_t tid = 0;
+        std::vector<Event> events;
+        std::uint64_t dropped = 0;
+    };
+
+    // Buffers outlive their threads, so events of finished workers are still written.
+    struct EventStore {
+        std::mutex m;
+        std::vector<std::shared_ptr<ThreadEvents>> threads;
+        std::uint32_t next_tid = 1;
+    };
+
+    /// @brief Trace time zero (load time of the library).
+    static const std::int64_t kEpochNs = nowNs();
+
+    static EventStore& store() {
+        static EventStore s;
+        return s;
+    }
+
+    static ThreadEvents& threadEvents() {
+        thread_local const std::shared_ptr<ThreadEvents> t = [] {
+            auto p = std::make_shared<ThreadEvents>();
+            EventStore& s = store();
+            std::lock_guard<std::mutex> lk(s.m);
+            p->tid = s.next_tid++;
+            s.threads.push_back(p);
+            return p;
+        }();
+        return *t;
+    }
+#endif
+
+#if defined(MCE_TRACE_HAVE_PERF)
+    // Per-thread counter group (user space only): cycles leads, instructions and
+    // cache misses follow, and one read() returns all three.
+    struct PerfGroup {
+        int fd[3] = { -1, -1, -1 };
+        bool ok = false;
+
+        PerfGroup() {
+            const std::uint64_t config[3] = {
+                PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES };
+            for (int i = 0; i < 3; ++i) {
+                perf_event_attr a{};
+                a.type = PERF_TYPE_HARDWARE;
+                a.size = sizeof(a);
+                a.config = config[i];
+                a.disabled = i == 0 ? 1 : 0;
+                a.exclude_kernel = 1;
+                a.exclude_hv = 1;
+                a.read_format = PERF_FORMAT_GROUP;
+                fd[i] = (int)syscall(SYS_perf_event_open, &a, 0, -1, i == 0 ? -1 : fd[0], 0);
+                if (fd[i] < 0) return; // no PMU access (perf_event_paranoid, VM): counters stay zero
+            }
+            ok = ioctl(fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == 0;
+        }
+
+        ~PerfGroup() {
+            for (int f : fd) if (f >= 0) close(f);
+        }
+
+        trace::Counters read() const {
+            trace::Counters c;
+            std::uint64_t buf[4] = {};
+            if (!ok || ::read(fd[0], buf, sizeof(buf)) != (ssize_t)sizeof(buf) || buf[0] != 3) return c;
+            c.cycles = buf[1];
+            c.instructions = buf[2];
+            c.cache_misses = buf[3];
+            return c;
+        }
+    };
+
+    static const PerfGroup& perfGroup() {
+        thread_local const PerfGroup g;
+        return g;
+    }
+
+    static trace::Counters readCounters() { return perfGroup().read(); }
+#else
+    static trace::Counters readCounters() { return trace::Counters{}; }
+#endif
+
+#if defined(MCE_TRACE_ITT)
+    static __itt_domain* ittDomain() {
+        static __itt_domain* const d = __itt_domain_create("mce");
+        return d;
+    }
+
+    static __itt_string_handle* ittHandle(trace::Site& site) {
+        void* h = site.handle.load(std::memory_order_acquire);
+        if (!h) {
+            h = __itt_string_handle_create(site.name()); // idempotent per name
+            site.handle.store(h, std::memory_order_release);
+        }
+        return static_cast<__itt_string_handle*>(h);
+    }
+#endif
+}
+
+namespace trace {
+    Site::Site(const char* name) : name_(name) {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lk(r.m);
+        r.sites.push_back(this);
+    }
+
+    Scope::Scope(Site& site) : site_(site), t0_ns_(0), c0_() {
+#if defined(MCE_TRACE_ITT)
+        __itt_task_begin(ittDomain(), __itt_null, __itt_null, ittHandle(site));
+#endif
+        c0_ = readCounters();
+        t0_ns_ = nowNs();
+    }
+
+    Scope::~Scope() {
+        const std::int64_t t1 = nowNs();
+        const Counters c1 = readCounters();
+        const Counters d{ c1.cycles - c0_.cycles, c1.instructions - c0_.instructions, c1.cache_misses - c0_.cache_misses };
+        site_.calls.fetch_add(1, std::memory_order_relaxed);
+        site_.ns.fetch_add((std::uint64_t)(t1 - t0_ns_), std::memory_order_relaxed);
+        site_.cycles.fetch_add(d.cycles, std::memory_order_relaxed);
+        site_.instructions.fetch_add(d.instructions, std::memory_order_relaxed);
+        site_.cache_misses.fetch_add(d.cache_misses, std::memory_order_relaxed);
+#if defined(MCE_TRACE_CHROME)
+        ThreadEvents& te = threadEvents();
+        if (te.events.size() < kMaxEventsPerThread) te.events.push_back(Event{ &site_, t0_ns_, t1 - t0_ns_, d });
+        else ++te.dropped;
+#endif
+#if defined(MCE_TRACE_ITT)
+        __itt_task_end(ittDomain());
+#endif
+    }
+
+    bool countersAvailable() {
+#if defined(MCE_TRACE_HAVE_PERF)
+        return perfGroup().ok;
+#else
+        return false;
+#endif
+    }
+
+    bool writeChromeTrace(const std::string& path) {
+#if defined(MCE_TRACE_CHROME)
+        std::ofstream os(path, std::ios::binary);
+        if (!os) return false;
+        const bool counters = countersAvailable();
+        EventStore& s = store();
+        std::lock_guard<std::mutex> lk(s.m);
+        std::uint64_t dropped = 0;
+        os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        os << std::fixed << std::setprecision(3);
+        for (const auto& t : s.threads) {
+            dropped += t->dropped;
+            for (const Event& e : t->events) {
+                os << (first ? "\n" : ",\n") << "{\"name\":";
+                report::writeJsonString(os, e.site->name());
+                os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << t->tid
+                    << ",\"ts\":" << (double)(e.ts_ns - kEpochNs) / 1000.0
+                    << ",\"dur\":" << (double)e.dur_ns / 1000.0;
+                if (counters) {
+                    os << ",\"args\":{\"cycles\":" << e.delta.cycles << ",\"instructions\":" << e.delta.instructions
+                        << ",\"cache_misses\":" << e.delta.cache_misses << "}";
+                }
+                os << "}";
+                first = false;
+            }
+        }
+        os << "\n],\"otherData\":{\"dropped_events\":" << dropped << "}}\n";
+        return (bool)os;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    void writeSummary(std::ostream& os) {
+        if (!enabled()) return;
+        // Sites sharing a name (e.g. one per template instantiation) form one row.
+        struct Row {
+            std::string name;
+            std::uint64_t calls = 0, ns = 0, cycles = 0, instructions = 0, cache_misses = 0;
+        };
+        std::vector<Row> rows;
+        {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lk(r.m);
+            for (const Site* s : r.sites) {
+                auto it = std::find_if(rows.begin(), rows.end(), [&](const Row& row) { return row.name == s->name(); });
+                if (it == rows.end()) it = rows.insert(rows.end(), Row{ s->name() });
+                it->calls += s->calls.load();
+                it->ns += s->ns.load();
+                it->cycles += s->cycles.load();
+                it->instructions += s->instructions.load();
+                it->cache_misses += s->cache_misses.load();
+            }
+        }
+        std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.ns > b.ns; });
+
+        const bool counters = countersAvailable();
+        const std::ios::fmtflags flags = os.flags();
+        os << std::left << std::setw(28) << "scope" << std::right << std::setw(10) << "calls"
+            << std::setw(12) << "total_ms" << std::setw(12) << "mean_us";
+        if (counters) os << std::setw(16) << "cycles" << std::setw(8) << "ipc" << std::setw(14) << "cache_misses";
+        os << "\n" << std::fixed;
+        for (const Row& r : rows) {
+            if (r.calls == 0) continue;
+            os << std::left << std::setw(28) << r.name << std::right << std::setw(10) << r.calls
+                << std::setprecision(3) << std::setw(12) << (double)r.ns / 1e6
+                << std::setprecision(2) << std::setw(12) << (double)r.ns / 1e3 / (double)r.calls;
+            if (counters) {
+                os << std::setw(16) << r.cycles
+                    << std::setprecision(2) << std::setw(8) << (r.cycles ? (double)r.instructions / (double)r.cycles : 0.0)
+                    << std::setw(14) << r.cache_misses;
+            }
+            os << "\n";
+        }
+        os.flags(flags);
+    }
+
+    void reset() {
+        {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lk(r.m);
+            for (Site* s : r.sites) {
+                s->calls = 0;
+                s->ns = 0;
+                s->cycles = 0;
+                s->instructions = 0;
+                s->cache_misses = 0;
+            }
+        }
+#if defined(MCE_TRACE_CHROME)
+        EventStore& s = store();
+        std::lock_guard<std::mutex> lk(s.m);
+        for (const auto& t : s.threads) {
+            t->events.clear();
+            t->dropped = 0;
+        }
+#endif
+    }
+}
@@ -0,0 +1,104 @@
+/**
+ * @file synthetic_board.hpp
+ * @brief Synthetic 3x3 marker boards and scenes shared by tests and benchmarks
+ */
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+
+namespace synth {
+
+    /**
+     * @brief Render the reference 3x3 board (blue/yellow/red, green/magenta/cyan, ...)
+     * @param cell Cell size in pixels (board is 3*cell square, black background)
+     */
+    inline cv::Mat makeBoard(int cell = 100) {
+        cv::Mat img(3 * cell, 3 * cell, CV_8UC3, cv::Scalar(0, 0, 0));
+        auto paint = [&](int r, int c, const cv::Scalar& bgr) {
+            cv::rectangle(img, cv::Rect(c * cell, r * cell, cell, cell), bgr, cv::FILLED);
+        };
+        // Row 0
+        paint(0, 0, { 255,   0,   0 });   // Blue
+        paint(0, 1, { 0, 255, 255 });     // Yellow
+        paint(0, 2, { 0,   0, 255 });     // Red
+        // Row 1
+        paint(1, 0, { 0, 255,   0 });     // Green
+        paint(1, 1, { 255,   0, 255 });   // Magenta
+        paint(1, 2, { 255, 255,   0 });   // Cyan
+        // Row 2
+        paint(2, 0, { 255,   0,   0 });   // Blue
+        paint(2, 1, { 0, 255, 255 });     // Yellow
+        paint(2, 2, { 0,   0, 255 });     // Red
+        return img;
+    }
+
+    /// @brief Rotate with border fill, growing the canvas so nothing is cropped
+    inline cv::Mat rotateKeepAll(const cv::Mat& src, double angle_deg) {
+        using namespace cv;
+        Point2f center(src.cols * 0.5f, src.rows * 0.5f);
+        Mat R = getRotationMatrix2D(center, angle_deg, 1.0);
+        Rect2f bb = RotatedRect(center, src.size(), (float)angle_deg).boundingRect2f();
+        R.at<double>(0, 2) += bb.width * 0.5 - center.x;
+        R.at<double>(1, 2) += bb.height * 0.5 - center.y;
+        Mat dst;
+        warpAffine(src, dst, R, Size((int)bb.width, (int)bb.height),
+            INTER_LINEAR, BORDER_CONSTANT, Scalar(0, 0, 0));
+        return dst;
+    }
+
+    /**
+     * @brief Parameters of a synthetic scene containing one board
+     */
+    struct SceneOptions {
+        /// @brief Board rotation in degrees
+        double angle_deg = 0.0;
+
+        /// @brief Gaussian blur sigma applied to the whole scene (0 = sharp)
+        double blur_sigma = 0.0;
+
+        /// @brief Number of random colored distractor shapes in the background
+        int clutter = 0;
+
+        /// @brief Board side as a fraction of min(width, height)
+        double board_frac = 0.4;
+
+        /// @brief RNG seed (scenes are deterministic)
+        unsigned seed = 42;
+    };
+
+    /**
+     * @brief Render a gray scene of size @p sz with a board in the center
+     */
+    inline cv::Mat makeScene(const cv::Size& sz, const SceneOptions& so = SceneOptions()) {
+        using namespace cv;
+        Mat scene(sz, CV_8UC3, Scalar(70, 70, 70));
+
+        // Distractors: small saturated shapes scattered over the background.
+        RNG rng(so.seed);
+        const int minSide = std::min(sz.width, sz.height);
+        for (int i = 0; i < so.clutter; ++i) {
+            const Point c(rng.uniform(0, sz.width), rng.uniform(0, sz.height));
+            const int r = std::max(2, rng.uniform(minSide / 80, minSide / 25 + 3));
+            const Scalar col(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+            if (i % 2) circle(scene, c, r, col, FILLED);
+            else rectangle(scene, Rect(c.x - r, c.y - r, 2 * r, r), col, FILLED);
+        }
+
+        // Board: rendered at final size, rotated, and pasted through its own mask.
+        const int cell = std::max(4, (int)(so.board_frac * minSide / 3.0));
+        Mat board = makeBoard(cell);
+        Mat alpha(board.size(), CV_8UC1, Scalar(255));
+        if (so.angle_deg != 0.0) {
+            board = rotateKeepAll(board, so.angle_deg);
+            alpha = rotateKeepAll(Mat(alpha.size(), CV_8UC3, Scalar::all(255)), so.angle_deg);
+            cvtColor(alpha, alpha, COLOR_BGR2GRAY);
+        }
+        const Rect dst((sz.width - board.cols) / 2, (sz.height - board.rows) / 2, board.cols, board.rows);
+        const Rect clip = dst & Rect(0, 0, sz.width, sz.height);
+        const Rect src(clip.x - dst.x, clip.y - dst.y, clip.width, clip.height);
+        board(src).copyTo(scene(clip), alpha(src));
+
+        if (so.blur_sigma > 0.0) GaussianBlur(scene, scene, Size(), so.blur_sigma);
+        return scene;
+    }
+}
@@ -1,47 +1,47 @@
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
 #include <opencv2/opencv.hpp>
 
+#include "batch_runner.hpp"
+#include "binary_morph.hpp"
+#include "bounded_queue.hpp"
 #include "color_segmenter.hpp"
+#include "debug_writer.hpp"
+#include "frame_server.hpp"
 #include "grid_detector.hpp"
 #include "geometry.hpp"
+#include "frame_precheck.hpp"
+#include "golden_eval.hpp"
+#include "image_source.hpp"
+#include "marker_detector.hpp"
+#include "marker_tracker.hpp"
+#include "mce_c_api.h"
+#include "result_cache.hpp"
+#include "row_source.hpp"
+#include "stats_aggregator.hpp"
+#include "synthetic_board.hpp"
+#include "trace.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 static inline bool approx(double a, double b, double eps = 1e-6) {
     return std::fabs(a - b) <= eps;
 }
 
-// helper: rotate with border fill
-static cv::Mat rotate_keep_all(const cv::Mat& src, double angle_deg) {
-    using namespace cv;
-    Point2f center(src.cols * 0.5f, src.rows * 0.5f);
-    Mat R = getRotationMatrix2D(center, angle_deg, 1.0);
-    Rect2f bb = RotatedRect(center, src.size(), angle_deg).boundingRect2f();
-    R.at<double>(0, 2) += bb.width * 0.5 - center.x;
-    R.at<double>(1, 2) += bb.height * 0.5 - center.y;
-    Mat dst;
-    warpAffine(src, dst, R, Size((int)bb.width, (int)bb.height),
-        INTER_LINEAR, BORDER_CONSTANT, Scalar(0, 0, 0));
-    return dst;
-}
-
 int main() {
     // === Synthetic 3x3 board (300x300) ===================================
-    cv::Mat img(300, 300, CV_8UC3, cv::Scalar(0, 0, 0));
-    auto paint = [&](int r, int c, const cv::Scalar& bgr) {
-        cv::rectangle(img, cv::Rect(c * 100, r * 100, 100, 100), bgr, cv::FILLED);
-    };
-    // Row 0
-    paint(0, 0, { 255,   0,   0 });   // Blue
-    paint(0, 1, { 0, 255, 255 });     // Yellow
-    paint(0, 2, { 0,   0, 255 });     // Red
-    // Row 1
-    paint(1, 0, { 0, 255,   0 });     // Green
-    paint(1, 1, { 255,   0, 255 });   // Magenta
-    paint(1, 2, { 255, 255,   0 });   // Cyan
-    // Row 2
-    paint(2, 0, { 255,   0,   0 });   // Blue
-    paint(2, 1, { 0, 255, 255 });     // Yellow
-    paint(2, 2, { 0,   0, 255 });     // Red
+    cv::Mat img = synth::makeBoard(100);
 
     // Mask of allowed colors
     cv::Mat mask = ColorSegmenter::allowedMaskHSV(img);
@@ -73,21 +73,1031 @@ int main() {
     double frac_g = (double)cv::countNonZero(mg) / (double)mg.total();
     assert(frac_g < 0.01);
 
+    // === Fused classifier matches the per-color inRange reference ===
+    {
+        cv::Mat hsv(64, 257, CV_8UC3);  // odd width exercises the scalar tail
+        cv::randu(hsv, cv::Scalar(0, 0, 0), cv::Scalar(180, 256, 256));
+        const int smin = 90, vmin = 80;
+        auto ref = [&](int h0, int h1, int s0, int v0) {
+            cv::Mat m;
+            cv::inRange(hsv, cv::Scalar(h0, std::max(s0, smin), std::max(v0, vmin)),
+                cv::Scalar(h1, 255, 255), m);
+            return m;
+        };
+        cv::Mat expect = ref(0, 10, 80, 50) | ref(170, 180, 80, 50) | ref(40, 85, 60, 50)
+            | ref(20, 35, 80, 70) | ref(90, 130, 60, 50) | ref(135, 165, 60, 50) | ref(85, 100, 60, 60);
+        cv::Mat white;
+        cv::inRange(hsv, cv::Scalar(0, 0, 210), cv::Scalar(180, 60, 255), white);
+        expect &= ~white;
+
+        cv::Mat fused, labels;
+        ColorSegmenter::classifyHSV(hsv, smin, vmin, fused, &labels);
+        assert(cv::countNonZero(fused != expect) == 0 && "fused kernel must match inRange");
+        assert(cv::countNonZero((labels != 0) != fused) == 0 && "labels only inside the mask");
+    }
+
+    // === Color profiles: built-in default, custom palettes, file round trip ===
+    {
+        cv::Mat hsv(180, 256, CV_8UC3);
+        for (int h = 0; h < hsv.rows; ++h)
+            for (int x = 0; x < hsv.cols; ++x)
+                hsv.at<cv::Vec3b>(h, x) = cv::Vec3b((unsigned char)h, (unsigned char)x, (unsigned char)(255 - x / 2));
+        cv::Mat def, builtin;
+        ColorSegmenter::classifyHSV(hsv, 90, 80, def);
+        ColorSegmenter::classifyHSV(hsv, 90, 80, builtin, nullptr, ColorProfile::builtin().get());
+        assert(cv::countNonZero(def != builtin) == 0);
+
+        // Blue only, wider than the built-in range: no other hue passes.
+        auto blue = ColorProfile::compile({ { { 80, 140, 40, 255, 30 }, MarkerColor::Blue } }, 60, 210, "blue");
+        cv::Mat m, labels;
+        ColorSegmenter::classifyHSV(hsv, 0, 0, m, &labels, blue.get());
+        assert(cv::countNonZero(m.rowRange(0, 80)) == 0 && cv::countNonZero(m.rowRange(141, 180)) == 0);
+        assert(cv::countNonZero(m.rowRange(80, 141)) > 0);
+        assert(cv::countNonZero((labels != 0) & (labels != (int)MarkerColor::Blue)) == 0);
+
+        const ColorProfile::Chain chain = blue->chain(90, 80);
+        assert(chain[0]->smin == 90 && chain[1]->smin == 80 && chain[2]->vmin == 60);
+        assert(chain[0] == &blue->table(90, 80) && "tables are compiled once and kept");
+
+        // Save/load keeps the palette; the segmenter accepts the loaded profile.
+        const std::string path = (std::filesystem::temp_directory_path() / "mce_profile_test.yaml").string();
+        const bool saved = ColorProfile::builtin()->save(path);
+        assert(saved);
+        std::string err;
+        auto loaded = ColorProfile::load(path, &err);
+        assert(loaded && err.empty());
+        assert(loaded->colors().size() == ColorProfile::builtin()->colors().size());
+        SegOptions sopt;
+        const cv::Mat scene = synth::makeScene(cv::Size(320, 240), synth::SceneOptions{});
+        const cv::Mat ref = ColorSegmenter::allowedMaskHSV(scene, sopt);
+        sopt.profile = loaded;
+        assert(cv::countNonZero(ColorSegmenter::allowedMaskHSV(scene, sopt) != ref) == 0);
+        sopt.profile = blue;
+        assert(cv::countNonZero(ColorSegmenter::allowedMaskHSV(scene, sopt)) < cv::countNonZero(ref));
+
+        {
+            std::ofstream bad(path);
+            bad << "%YAML:1.0\ncolors:\n  - { color: purple, h: [0, 10], s: [0, 255], v_min: 0 }\n";
+        }
+        assert(!ColorProfile::load(path, &err) && err.find("purple") != std::string::npos);
+        std::filesystem::remove(path);
+        assert(!ColorProfile::load(path, &err) && "missing file");
+    }
+
+    // === Sparse-mask relaxation from the slack map equals classifying at the relaxed floors ===
+    {
+        for (int sat : { 85, 75, 40 }) {   // passes after 1 step, after 2 steps, never
+            cv::Mat hsv(200, 200, CV_8UC3, cv::Scalar(0, 0, 128));
+            hsv(cv::Rect(40, 40, 24, 24)).setTo(cv::Scalar(100, sat, 150));
+            hsv(cv::Rect(120, 90, 30, 12)).setTo(cv::Scalar(60, sat + 3, 75));
+            SegOptions sopt;   // smin 90, vmin 80
+            ColorSegmenter seg;
+            seg.setPrepared(hsv);
+            cv::Mat m;
+            seg.mask(sopt, m);
+            const int steps = seg.stats().relax_attempts;
+            assert(steps == (sat == 85 ? 1 : 2));
+            cv::Mat ref;
+            ColorSegmenter::classifyHSV(hsv, sopt.smin - 10 * steps, sopt.vmin - 10 * steps, ref);
+            cv::morphologyEx(ref, ref, cv::MORPH_CLOSE, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3)),
+                cv::Point(-1, -1), sopt.close_iter);
+            assert(cv::countNonZero(m != ref) == 0 && "relaxed mask must equal the relaxed classification");
+            assert(!seg.stats().slack_reused);
+
+            // A uniformly relaxed retry on the same image reuses the slack map.
+            SegOptions relaxed = sopt;
+            relaxed.smin -= 20;
+            relaxed.vmin -= 20;
+            seg.mask(relaxed, m);
+            assert(seg.stats().slack_reused);
+            ColorSegmenter fresh;
+            fresh.setPrepared(hsv);
+            fresh.mask(relaxed, ref);
+            assert(cv::countNonZero(m != ref) == 0);
+            assert(fresh.stats().relax_attempts == seg.stats().relax_attempts);
+        }
+    }
+
     // === Rotation tests ===
     // Test 30° rotation
-    cv::Mat rot30 = rotate_keep_all(img, 30.0);
+    cv::Mat rot30 = synth::rotateKeepAll(img, 30.0);
     cv::Mat mask_rot30 = ColorSegmenter::allowedMaskHSV(rot30);
     assert(cv::countNonZero(mask_rot30) > 0 && "30° rotated grid should still be detected");
     
     // Test 45° rotation (requirement: robust to ±45°)
-    cv::Mat rot45 = rotate_keep_all(img, 45.0);
+    cv::Mat rot45 = synth::rotateKeepAll(img, 45.0);
     cv::Mat mask_rot45 = ColorSegmenter::allowedMaskHSV(rot45);
     assert(cv::countNonZero(mask_rot45) > 0 && "45° rotated grid should still be detected");
     
     // Test negative rotation
-    cv::Mat rot_neg30 = rotate_keep_all(img, -30.0);
+    cv::Mat rot_neg30 = synth::rotateKeepAll(img, -30.0);
     cv::Mat mask_rot_neg30 = ColorSegmenter::allowedMaskHSV(rot_neg30);
     assert(cv::countNonZero(mask_rot_neg30) > 0 && "-30° rotated grid should still be detected");
 
+    // === Pyramid (default max_side) agrees with full resolution, with and without refinement ===
+    {
+        synth::SceneOptions so;
+        so.angle_deg = 17.0;
+        const cv::Mat big = synth::makeScene(cv::Size(2400, 1800), so);
+        MarkerDetector det;
+        DetectorWorkspace ws;
+        DetectOptions full;
+        full.max_side = 0;
+        const auto ref = det.detect(big, full, ws);
+        assert(ref && ref->grid_ok && !ws.stats.pyramid);
+
+        const double scale = 2400.0 / DetectOptions{}.max_side;
+        for (bool refine : { true, false }) {
+            DetectOptions dopt;
+            dopt.refine_corners = refine;
+            const auto res = det.detect(big, dopt, ws);
+            assert(res && res->grid_ok && ws.stats.pyramid);
+            assert(approx(res->coverage_percent, ref->coverage_percent, 1.0) && "pyramid coverage within 1%");
+            assert(res->polygon.size() == ref->polygon.size());
+            // Each corner lands near a full-resolution corner: a few pixels once
+            // refined, a few coarse pixels otherwise.
+            const double tol = refine ? 4.0 : 4.0 * scale;
+            for (const cv::Point2f& p : res->polygon) {
+                double best = 1e9;
+                for (const cv::Point2f& q : ref->polygon) best = std::min(best, (double)cv::norm(p - q));
+                assert(best <= tol && "pyramid polygon matches full resolution");
+            }
+        }
+    }
+
+    // === Workspace reuse across frame sizes gives identical masks ===
+    {
+        SegOptions sopt;
+        SegWorkspace ws;
+        cv::Mat m;
+        for (const cv::Mat* frame : { &rot45, &img, &rot30 }) {
+            ColorSegmenter::allowedMaskHSV(*frame, sopt, ws, m);
+            cv::Mat ref = ColorSegmenter::allowedMaskHSV(*frame, sopt);
+            assert(m.size() == ref.size());
+            assert(cv::countNonZero(m != ref) == 0 && "workspace path must match");
+        }
+    }
+
+    // === Instance segmenter: one prepare(), several masks, same as static calls ===
+    {
+        SegOptions sopt, relaxed;
+        relaxed.smin = sopt.smin - 20;
+        relaxed.vmin = sopt.vmin - 20;
+        ColorSegmenter seg;
+        cv::Mat m;
+        seg.prepare(rot30, sopt.blur_ksize);
+        seg.mask(sopt, m);
+        assert(cv::countNonZero(m != ColorSegmenter::allowedMaskHSV(rot30, sopt)) == 0);
+        seg.mask(relaxed, m);
+        assert(cv::countNonZero(m != ColorSegmenter::allowedMaskHSV(rot30, relaxed)) == 0);
+        assert(seg.hsv().size() == rot30.size() && seg.rawV().type() == CV_8UC1);
+    }
+
+    // === Lazy ROI white-rim booster equals the full-frame booster ===
+    {
+        SegOptions sopt;
+        sopt.open_iter = 0;
+        sopt.close_iter = 0;
+        ColorSegmenter seg;
+        cv::Mat lazy;
+
+        cv::Mat rimmed = synth::makeScene(cv::Size(640, 480), synth::SceneOptions{});
+        cv::rectangle(rimmed, cv::Rect(218, 138, 204, 204), cv::Scalar(255, 255, 255), 12); // hugs the board
+        cv::GaussianBlur(rimmed, rimmed, cv::Size(), 2.0);
+        seg.segment(rimmed, sopt, lazy);
+        assert(!seg.stats().rim_skipped && seg.stats().relax_attempts == 0);
+
+        cv::Mat ref, rim, removed;
+        ColorSegmenter::classifyHSV(seg.hsv(), sopt.smin, sopt.vmin, ref);
+        SegWorkspace sws;
+        ColorSegmenter::whiteRimMask(seg.hsv(), sws, rim);
+        cv::bitwise_and(ref, rim, removed);
+        const int nz = cv::countNonZero(ref);
+        if (nz - cv::countNonZero(removed) >= 0.65 * nz) cv::subtract(ref, rim, ref);
+        cv::Mat diff;
+        cv::bitwise_xor(ref, lazy, diff);
+        assert(cv::countNonZero(diff) == 0 && "ROI booster must match the full-frame one");
+
+        seg.segment(synth::makeScene(cv::Size(640, 480), synth::SceneOptions{}), sopt, lazy);
+        assert(seg.stats().rim_skipped && "no white next to a sharp board");
+    }
+
+    // === Striped segmentation is bit-identical to the serial one ===
+    {
+        synth::SceneOptions so;
+        so.clutter = 150;
+        so.blur_sigma = 1.0;
+        cv::Mat big = synth::makeScene(cv::Size(1920, 1080), so);
+        cv::Mat rimmed = synth::makeScene(cv::Size(640, 480), synth::SceneOptions{});
+        cv::rectangle(rimmed, cv::Rect(218, 138, 204, 204), cv::Scalar(255, 255, 255), 12);
+        cv::GaussianBlur(rimmed, rimmed, cv::Size(), 2.0);
+
+        for (const cv::Mat* img : { &big, &rimmed }) {
+            SegOptions sopt;
+            sopt.blur_ksize = 5;
+            ColorSegmenter serial, striped;
+            cv::Mat ref, m;
+            serial.segment(*img, sopt, ref);
+            assert(serial.stats().stripes == 1);
+            for (int n : { 4, 7 }) {
+                sopt.stripes = n;
+                striped.segment(*img, sopt, m);
+                assert(striped.stats().stripes > 1);
+                assert(cv::countNonZero(m != ref) == 0 && "striped mask must equal the serial mask");
+                assert(cv::countNonZero(striped.hsv().reshape(1) != serial.hsv().reshape(1)) == 0);
+            }
+            assert(striped.stats().rim_skipped == serial.stats().rim_skipped);
+        }
+    }
+
+    // === Both quad engines agree on a cluttered scene ===
+    {
+        synth::SceneOptions so;
+        so.angle_deg = 20.0;
+        so.clutter = 150;
+        cv::Mat scene = synth::makeScene(cv::Size(640, 480), so);
+        cv::Mat m = ColorSegmenter::allowedMaskHSV(scene);
+        geom::QuadWorkspace ws;
+        auto qc = geom::findStrongQuad(m, ws, geom::QuadEngine::Contours);
+        auto qb = geom::findStrongQuad(m, ws, geom::QuadEngine::Components);
+        assert(qc && qb && "both engines must find the board");
+        for (int i = 0; i < 4; ++i) {
+            assert(cv::norm((*qc)[i] - (*qb)[i]) < 3.0 && "engines must pick the same blob");
+        }
+    }
+
+    // === Warped frame mask gives the same verdict as re-segmenting the warped view ===
+    {
+        synth::SceneOptions so;
+        so.angle_deg = 15.0;
+        const cv::Mat scene = synth::makeScene(cv::Size(800, 600), so);
+        MarkerDetector det;
+        DetectorWorkspace ws;
+        DetectOptions seg_opt, warp_opt;
+        warp_opt.warped_mask = WarpedMaskSource::FrameMask;
+        auto a = det.detect(scene, seg_opt, ws);
+        auto b = det.detect(scene, warp_opt, ws);
+        assert(a && b && "board must be found in both modes");
+        assert(ws.stats.mask_warped && !ws.stats.warped_relax);
+        assert(approx(a->coverage_percent, b->coverage_percent, 1e-9) && "same quad, same coverage");
+    }
+
+    // === Lattice grid check: same verdicts as the warped square, without warping ===
+    {
+        // Identity map: sampled fractions track the integral-based cells.
+        cv::Mat mask(300, 300, CV_8UC1, cv::Scalar(255));
+        mask(cv::Rect(100, 0, 4, 300)).setTo(0);    // seam near 1/3
+        mask(cv::Rect(0, 200, 300, 6)).setTo(0);    // seam near 2/3
+        mask(cv::Rect(200, 100, 100, 100)).setTo(0); // empty middle-right cell
+        const cv::Mat eye = cv::Mat::eye(3, 3, CV_64F);
+        const grid::LatticeMask lm = grid::latticeMaskChecks(mask, eye, 300, 3, 3, 0.15);
+        const grid::CellsReport ref = grid::checkGridCells(mask, 0.15);
+        for (size_t i = 0; i < ref.frac.size(); ++i) assert(std::fabs(lm.cells.frac[i] - ref.frac[i]) < 0.1);
+        assert(!lm.cells.ok && lm.cells.at(1, 2) == 0.0);
+        assert(lm.seams.ok && std::abs(lm.seams.cx[0] - 101) <= 8 && std::abs(lm.seams.cy[1] - 202) <= 8);
+
+        synth::SceneOptions so;
+        so.angle_deg = 15.0;
+        const cv::Mat scene = synth::makeScene(cv::Size(800, 600), so);
+        MarkerDetector det;
+        DetectorWorkspace ws;
+        DetectOptions seg_opt, lat_opt;
+        lat_opt.warped_mask = WarpedMaskSource::Lattice;
+        auto a = det.detect(scene, seg_opt, ws);
+        auto b = det.detect(scene, lat_opt, ws);
+        assert(a && b && "board must be found in both modes");
+        assert(ws.stats.lattice && !ws.stats.mask_warped && !ws.stats.warped_resegmented);
+        assert(approx(a->coverage_percent, b->coverage_percent, 1e-9) && "same quad, same coverage");
+
+        // The colorful fallback from lattice samples agrees on the board.
+        lat_opt.min_cell_fraction = 1.1;   // cells can never pass: only colorful can
+        lat_opt.strict_grid = false;
+        auto c = det.detect(scene, lat_opt, ws);
+        auto d = det.detect(scene, [&] { DetectOptions o = lat_opt; o.warped_mask = WarpedMaskSource::Segment; return o; }(), ws);
+        assert(c.has_value() == d.has_value());
+    }
+
+    // === NxM grids from one integral: 4x4 seams and cells, 3x3 matches the ROI scan ===
+    {
+        cv::Mat m4(400, 400, CV_8UC1, cv::Scalar(255));
+        for (int k = 1; k < 4; ++k) {
+            m4.colRange(k * 100 - 4, k * 100 + 4).setTo(0);
+            m4.rowRange(k * 100 - 4, k * 100 + 4).setTo(0);
+        }
+        grid::GridWorkspace gws;
+        grid::integrateMask(m4, gws);
+        const grid::Seams s4 = grid::checkGridSeams(gws, 4, 4);
+        assert(s4.ok && s4.cx.size() == 3 && s4.cy.size() == 3);
+        assert(std::abs(s4.cx[1] - 196) <= 1 && std::abs(s4.cy[2] - 296) <= 1);
+        const grid::CellsReport c4 = grid::checkGridCells(gws, 4, 4, 0.5);
+        assert(c4.ok && c4.frac.size() == 16);
+        assert(approx(c4.at(1, 1), (92.0 * 92.0) / (100.0 * 100.0), 1e-9));
+
+        const grid::CellsReport c3 = grid::checkGridCells(mask, 0.2);
+        for (int r = 0; r < 3; ++r)
+            for (int c = 0; c < 3; ++c) {
+                const cv::Rect roi = grid::cellRect(mask.size(), 3, 3, r, c);
+                assert(approx(c3.at(r, c), (double)cv::countNonZero(mask(roi)) / roi.area(), 1e-9));
+            }
+    }
+
+    // === OpenCL backend: same verdict as the CPU path (CPU fallback without a device) ===
+    {
+        const cv::Mat scene = synth::makeScene(cv::Size(800, 600), synth::SceneOptions{});
+        MarkerDetector det;
+        DetectOptions cpu, ocl;
+        ocl.backend = ComputeBackend::OpenCL;
+        DetectorWorkspace ws;
+        const auto a = det.detect(scene, cpu, ws);
+        const auto b = det.detect(scene, ocl, ws);
+        assert(a && b && "both backends must find the board");
+        assert(ws.stats.opencl == ColorSegmenter::openclAvailable());
+        assert(approx(a->coverage_percent, b->coverage_percent, 0.5));
+
+        if (ColorSegmenter::openclAvailable()) {
+            cv::UMat dev;
+            scene.copyTo(dev);
+            OclSegWorkspace ows;
+            cv::Mat m_ocl;
+            ColorSegmenter::allowedMaskOCL(dev, SegOptions{}, ows, m_ocl);
+            cv::Mat diff;
+            cv::bitwise_xor(m_ocl, ColorSegmenter::allowedMaskHSV(scene), diff);
+            assert(cv::countNonZero(diff) < 0.01 * (double)diff.total());
+        }
+    }
+
+    // === Early-exit cascade: reject reasons, and boards still pass ===
+    {
+        precheck::PrecheckWorkspace pws;
+        const precheck::PrecheckOptions popt;
+        const cv::Mat black(480, 640, CV_8UC3, cv::Scalar(0, 0, 0));
+        assert(precheck::run(black, popt, pws) == PrecheckReject::FewColors);
+        cv::Mat red = black.clone();
+        cv::rectangle(red, cv::Rect(200, 150, 200, 150), cv::Scalar(0, 0, 255), cv::FILLED);
+        assert(precheck::run(red, popt, pws) == PrecheckReject::FewHues);
+        cv::Mat dots = black.clone();
+        for (int y = 8; y < dots.rows; y += 40)
+            for (int x = 8; x < dots.cols; x += 40)
+                cv::circle(dots, { x, y }, 3, ((x / 40) % 2) ? cv::Scalar(0, 0, 255) : cv::Scalar(255, 0, 0), cv::FILLED);
+        assert(precheck::run(dots, popt, pws) == PrecheckReject::NoBlob);
+
+        // A single-color palette needs a single hue.
+        DetectOptions one;
+        one.color_profile = ColorProfile::compile({ { { 80, 140, 40, 255, 30 }, MarkerColor::Blue } }, 60, 210, "blue");
+        const precheck::PrecheckOptions popt1 = precheck::optionsFor(one);
+        assert(popt1.min_hues == 1);
+        cv::Mat blue = black.clone();
+        cv::rectangle(blue, cv::Rect(200, 150, 200, 150), cv::Scalar(255, 0, 0), cv::FILLED);
+        assert(precheck::run(blue, popt1, pws) == PrecheckReject::None);
+
+        DetectOptions opt;
+        opt.precheck = true;
+        MarkerDetector det;
+        DetectorWorkspace ws;
+        assert(!det.detect(black, opt, ws) && ws.stats.precheck_reject == PrecheckReject::FewColors);
+        assert(ws.stats.seg_ms == 0.0 && "rejected frames skip segmentation");
+        const cv::Mat board = synth::makeScene(cv::Size(640, 480), synth::SceneOptions{});
+        assert(det.detect(board, opt, ws) && ws.stats.precheck_reject == PrecheckReject::None);
+    }
+
+    // === detectAll: two boards side by side, union = sum of disjoint coverages ===
+    {
+        synth::SceneOptions left, right;
+        right.angle_deg = 25.0;
+        cv::Mat two;
+        cv::hconcat(synth::makeScene(cv::Size(480, 480), left),
+            synth::makeScene(cv::Size(480, 480), right), two);
+        MarkerDetector det;
+        DetectorWorkspace ws;
+        const MultiDetectionResult all = det.detectAll(two, DetectOptions{}, ws, 4);
+        assert(all.markers.size() == 2 && "both boards must be found");
+        const double sum = all.markers[0].coverage_percent + all.markers[1].coverage_percent;
+        assert(approx(all.union_coverage_percent, sum, 0.5));
+
+        // Overlapping markers: the shared area counts once, not as a hole.
+        ScratchMat raster;
+        const std::vector<std::vector<cv::Point2f>> overlap{
+            { { 0.f, 0.f }, { 100.f, 0.f }, { 100.f, 100.f }, { 0.f, 100.f } },
+            { { 50.f, 50.f }, { 150.f, 50.f }, { 150.f, 150.f }, { 50.f, 150.f } } };
+        const double u = geom::unionCoveragePercent(overlap, cv::Size(200, 200), 2048, raster);
+        assert(approx(u, 100.0 * 17500.0 / 40000.0, 1.0)); // 2 × 100² − 50²
+    }
+
+    // === BoundedQueue: FIFO order across threads, close() drains then stops ===
+    {
+        BoundedQueue<int> q(2);
+        std::thread producer([&] {
+            for (int i = 0; i < 100; ++i) q.push(i);
+            q.close();
+        });
+        int expected = 0;
+        while (auto v = q.pop()) assert(*v == expected++);
+        producer.join();
+        assert(expected == 100);
+        const bool pushed = q.push(1);
+        assert(!pushed && !q.pop() && "closed queue rejects pushes");
+    }
+
+    // === BatchRunner: ordered and unordered delivery, load failures reported per file ===
+    {
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "mce_batch_runner_test";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        std::vector<std::string> paths;
+        std::vector<cv::Mat> images; // empty = not loadable
+        for (int i = 0; i < 6; ++i) {
+            synth::SceneOptions so;
+            so.board_frac = 0.25 + 0.05 * i;
+            so.angle_deg = 7.0 * i;
+            images.push_back(synth::makeScene(cv::Size(480, 360), so));
+        }
+        images.insert(images.begin() + 2, cv::Mat());  // undecodable bytes
+        images.insert(images.begin() + 5, cv::Mat());  // missing file
+        for (size_t i = 0; i < images.size(); ++i) {
+            const std::string p = (dir / ("img" + std::to_string(i) + ".png")).string();
+            paths.push_back(p);
+            if (i == 2) std::ofstream(p, std::ios::binary) << "not an image";
+            else if (!images[i].empty()) {
+                const bool wrote = cv::imwrite(p, images[i]);
+                assert(wrote);
+            }
+        }
+
+        const DetectOptions dopt;
+        MarkerDetector det;
+        DetectorWorkspace dws;
+        std::vector<std::optional<DetectionResult>> expect;
+        for (const cv::Mat& img : images) expect.push_back(img.empty() ? std::nullopt : det.detect(img, dopt, dws));
+
+        for (const bool ordered : { true, false }) {
+            BatchOptions bopt;
+            bopt.jobs = 3;
+            bopt.ordered = ordered;
+            const BatchRunner runner(dopt, bopt);
+            const std::thread::id caller = std::this_thread::get_id();
+            std::vector<size_t> order;
+            runner.run(paths, [&](const BatchItem& it) {
+                assert(std::this_thread::get_id() == caller && "sink runs on the caller's thread");
+                assert(it.index < paths.size() && it.path == paths[it.index]);
+                assert(it.loaded == !images[it.index].empty());
+                assert(it.result.has_value() == expect[it.index].has_value());
+                if (it.result) assert(approx(it.result->coverage_percent, expect[it.index]->coverage_percent, 1e-9));
+                order.push_back(it.index);
+            });
+            assert(order.size() == paths.size() && "every path is reported, failures included");
+            if (ordered) {
+                for (size_t i = 0; i < order.size(); ++i) assert(order[i] == i);
+            }
+            else {
+                std::sort(order.begin(), order.end());
+                assert(std::adjacent_find(order.begin(), order.end()) == order.end() && order.back() == paths.size() - 1);
+            }
+        }
+
+        // A throwing sink stops the run: threads are joined and the exception reaches the caller.
+        {
+            BatchOptions bopt;
+            bopt.jobs = 3;
+            bopt.queue_depth = 1;
+            const BatchRunner runner(dopt, bopt);
+            size_t delivered = 0;
+            bool thrown = false;
+            try {
+                runner.run(paths, [&](const BatchItem&) {
+                    if (++delivered == 2) throw std::runtime_error("sink failed");
+                });
+            }
+            catch (const std::runtime_error&) {
+                thrown = true;
+            }
+            assert(thrown && delivered == 2);
+        }
+        std::filesystem::remove_all(dir);
+    }
+
+    // === Tracker: ROI path while the marker moves, full-frame fallback on jump / border / loss ===
+    {
+        const cv::Size fs(640, 480);
+        // Scene moved right/down by (dx, dy); uncovered pixels get the background gray.
+        const auto shifted = [&](const cv::Mat& scene, int dx, int dy) {
+            cv::Mat out(fs, CV_8UC3, cv::Scalar(70, 70, 70));
+            scene(cv::Rect(0, 0, fs.width - dx, fs.height - dy)).copyTo(out(cv::Rect(dx, dy, fs.width - dx, fs.height - dy)));
+            return out;
+        };
+        synth::SceneOptions small, grown;
+        small.board_frac = 0.3;
+        grown.board_frac = 0.36; // 1.44× the area: beyond max_coverage_jump, still inside the ROI
+        const cv::Mat base = synth::makeScene(fs, small);
+        const cv::Mat big = synth::makeScene(fs, grown);
+        const cv::Mat empty(fs, CV_8UC3, cv::Scalar(70, 70, 70));
+
+        const DetectOptions dopt;
+        MarkerDetector det;
+        DetectorWorkspace dws;
+        const auto full = [&](const cv::Mat& f) { return det.detect(f, dopt, dws); };
+
+        MarkerTracker tr(dopt);
+        assert(!tr.tracking());
+        const auto r0 = tr.update(base);
+        const auto f0 = full(base);
+        assert(r0 && f0 && !tr.lastWasTracked() && tr.tracking() && "first frame is a full detection");
+        assert(approx(r0->coverage_percent, f0->coverage_percent, 1e-9));
+
+        // Small motion: answered from the ROI, same coverage.
+        for (int step = 1; step <= 2; ++step) {
+            const auto r = tr.update(shifted(base, 8 * step, 4 * step));
+            assert(r && tr.lastWasTracked());
+            assert(approx(r->coverage_percent, r0->coverage_percent, 0.5));
+            assert(std::fabs(r->polygon[0].x - r0->polygon[0].x - 8.0f * step) < 3.0f);
+        }
+
+        // Coverage jump: the ROI result is rejected and the full-frame one reported.
+        const cv::Mat jumped = shifted(big, 16, 8);
+        const auto rj = tr.update(jumped);
+        const auto fj = full(jumped);
+        assert(rj && fj && !tr.lastWasTracked() && "coverage jump forces a full detection");
+        assert(approx(rj->coverage_percent, fj->coverage_percent, 1e-9) && rj->coverage_percent > 1.3 * r0->coverage_percent);
+        assert(tr.update(jumped) && tr.lastWasTracked() && "tracking resumes from the new result");
+
+        // Large motion: the marker leaves the ROI (clipped quad or ROI miss), full detection finds it.
+        const cv::Mat moved = shifted(big, 120, 60);
+        const auto rm = tr.update(moved);
+        assert(rm && !tr.lastWasTracked());
+        assert(std::fabs(rm->polygon[0].x - fj->polygon[0].x - 104.0f) < 3.0f);
+
+        // Disappearance: nothing found, the track is dropped; the return is a full detection.
+        assert(!tr.update(empty) && !tr.lastWasTracked() && !tr.tracking());
+        assert(tr.update(base) && !tr.lastWasTracked() && tr.tracking());
+
+        // Frame size change: full detection.
+        const cv::Mat larger = synth::makeScene(cv::Size(800, 600), small);
+        assert(tr.update(larger) && !tr.lastWasTracked());
+
+        // Redetection interval: every third update after a full one is full again.
+        TrackOptions topt;
+        topt.redetect_interval = 2;
+        MarkerTracker periodic(dopt, topt);
+        const bool expect_tracked[] = { false, true, true, false, true, true, false };
+        for (int i = 0; i < 7; ++i) {
+            const auto r = periodic.update(shifted(base, 2 * i, i));
+            assert(r && periodic.lastWasTracked() == expect_tracked[i]);
+        }
+    }
+
+    // === NV12 input: HSV from Y/UV matches the BGR path, detectNV12 finds the board ===
+    {
+        const cv::Mat bgr = synth::makeScene(cv::Size(640, 480), synth::SceneOptions{});
+        cv::Mat i420;
+        cv::cvtColor(bgr, i420, cv::COLOR_BGR2YUV_I420);
+        const int w = bgr.cols, hh = bgr.rows;
+        const cv::Mat y(hh, w, CV_8UC1, i420.data);
+        cv::Mat u(hh / 2, w / 2, CV_8UC1, i420.data + w * hh);
+        cv::Mat v(hh / 2, w / 2, CV_8UC1, i420.data + w * hh + (w / 2) * (hh / 2));
+        cv::Mat uv;
+        cv::merge(std::vector<cv::Mat>{ u, v }, uv);
+        cv::Mat back;
+        cv::cvtColorTwoPlane(y, uv, back, cv::COLOR_YUV2BGR_NV12);
+
+        SegOptions sopt;
+        ColorSegmenter a, b;
+        cv::Mat ma, mb;
+        a.prepareNV12(y, uv, sopt.blur_ksize);
+        a.mask(sopt, ma);
+        b.prepare(back, sopt.blur_ksize);
+        b.mask(sopt, mb);
+        cv::Mat diff;
+        cv::bitwise_xor(ma, mb, diff);
+        assert(cv::countNonZero(diff) < (int)(0.02 * (double)diff.total()) && "NV12 mask close to BGR mask");
+
+        MarkerDetector det;
+        DetectorWorkspace ws;
+        DetectOptions dopt;
+        const auto rb = det.detect(bgr, dopt, ws);
+        const auto rn = det.detectNV12(y, uv, dopt, ws);
+        assert(rb && rn && rn->grid_ok);
+        assert(approx(rb->coverage_percent, rn->coverage_percent, 1.0));
+
+        dopt.max_side = 317;  // odd budget: NV12 pyramid rounds to even sizes
+        const auto rp = det.detectNV12(y, uv, dopt, ws);
+        assert(rp && ws.stats.pyramid && approx(rb->coverage_percent, rp->coverage_percent, 1.0));
+
+        assert(!det.detectNV12(y, u, dopt, ws) && "chroma must be CV_8UC2");
+        assert(!det.detectNV12(y(cv::Rect(0, 0, w - 1, hh)), uv, dopt, ws));
+    }
+
+    // === C API: BGR without copy, RGB and NV12 conversions, one handle from many threads ===
+    {
+        assert(mce_abi_version() == MCE_ABI_VERSION);
+        mce_options copt;
+        mce_options_init(&copt);
+        mce_detector* h = mce_detector_create(&copt);
+        assert(h);
+
+        const cv::Mat bgr = synth::makeScene(cv::Size(640, 480), synth::SceneOptions{});
+        mce_image img{};
+        img.data = bgr.data;
+        img.width = bgr.cols;
+        img.height = bgr.rows;
+        img.stride = (int32_t)bgr.step;
+        img.format = MCE_FORMAT_BGR;
+        mce_result r0{};
+        const mce_status rc0 = mce_detect(h, &img, &r0);
+        assert(rc0 == MCE_OK && r0.grid_ok);
+
+        cv::Mat rgb;
+        cv::cvtColor(bgr, rgb, cv::COLOR_BGR2RGB);
+        img.data = rgb.data;
+        img.format = MCE_FORMAT_RGB;
+        mce_result r1{};
+        const mce_status rc1 = mce_detect(h, &img, &r1);
+        assert(rc1 == MCE_OK && approx(r0.coverage_percent, r1.coverage_percent, 1e-9));
+
+        // NV12 = Y plane + interleaved U/V (built from I420)
+        cv::Mat i420;
+        cv::cvtColor(bgr, i420, cv::COLOR_BGR2YUV_I420);
+        const int w = bgr.cols, hh = bgr.rows;
+        cv::Mat u(hh / 2, w / 2, CV_8UC1, i420.data + w * hh);
+        cv::Mat v(hh / 2, w / 2, CV_8UC1, i420.data + w * hh + (w / 2) * (hh / 2));
+        cv::Mat uv;
+        cv::merge(std::vector<cv::Mat>{ u, v }, uv);
+        img.data = i420.data;
+        img.stride = w;
+        img.uv = uv.data;
+        img.uv_stride = (int32_t)uv.step;
+        img.format = MCE_FORMAT_NV12;
+        mce_result r2{};
+        const mce_status rc2 = mce_detect(h, &img, &r2);
+        assert(rc2 == MCE_OK && approx(r0.coverage_percent, r2.coverage_percent, 1.0));
+
+        img.format = 42;
+        const mce_status rc_format = mce_detect(h, &img, &r2);
+        assert(rc_format == MCE_ERR_INVALID_ARGUMENT && *mce_last_error() != '\0');
+        const mce_status rc_null = mce_detect(h, nullptr, &r2);
+        assert(rc_null == MCE_ERR_INVALID_ARGUMENT);
+
+        std::vector<std::thread> pool;
+        std::vector<double> cov(4, 0.0);
+        for (int t = 0; t < 4; ++t) {
+            pool.emplace_back([&, t] {
+                mce_image bi{};
+                bi.data = bgr.data;
+                bi.width = bgr.cols;
+                bi.height = bgr.rows;
+                bi.stride = (int32_t)bgr.step;
+                bi.format = MCE_FORMAT_BGR;
+                for (int k = 0; k < 3; ++k) {
+                    mce_result rr{};
+                    if (mce_detect(h, &bi, &rr) == MCE_OK) cov[(size_t)t] = rr.coverage_percent;
+                }
+            });
+        }
+        for (auto& th : pool) th.join();
+        for (double c : cov) assert(approx(c, r0.coverage_percent, 1e-9));
+        mce_detector_destroy(h);
+    }
+
+    // === Golden manifest parsing and accuracy scoring ===
+    {
+        std::istringstream in("path,coverage\n# comment\n\na.png, 12.5\nsub/b.jpg,none\n/abs/c.png,-\n");
+        std::string err;
+        const auto m = loadGoldenManifest(in, "data", &err);
+        assert(m && m->size() == 3);
+        assert((*m)[0].path == (std::filesystem::path("data") / "a.png").string());
+        assert((*m)[0].expected_coverage && approx(*(*m)[0].expected_coverage, 12.5));
+        assert(!(*m)[1].expected_coverage && !(*m)[2].expected_coverage && (*m)[2].path == "/abs/c.png");
+
+        std::istringstream bad("a.png,12\nb.png,lots\n");
+        assert(!loadGoldenManifest(bad, "", &err) && err.rfind("line 2", 0) == 0);
+
+        DetectionResult hit;
+        hit.coverage_percent = 13.0;
+        AccuracyScorer acc(1.0);
+        acc.add("tp", 12.5, hit);            // |err| 0.5
+        hit.coverage_percent = 20.0;
+        acc.add("tp_far", 17.0, hit);        // |err| 3.0 > tol
+        acc.add("fn", 10.0, std::nullopt);
+        acc.add("fp", std::nullopt, hit);
+        acc.add("tn", std::nullopt, std::nullopt);
+        const AccuracyReport rep = acc.report();
+        assert(rep.images == 5 && rep.true_pos == 2 && rep.false_pos == 1 && rep.false_neg == 1 && rep.true_neg == 1);
+        assert(rep.over_tol == 1 && approx(rep.mean_abs_err, 1.75) && approx(rep.max_abs_err, 3.0));
+        assert(rep.worst_path == "tp_far" && acc.misses().size() == 2);
+    }
+
+    // === Stats aggregator: nearest-rank percentiles per stage ===
+    {
+        StatsAggregator agg;
+        for (int i = 1; i <= 100; ++i) {
+            DetectionStats st;
+            st.total_ms = (double)i;
+            st.quad_found = (i % 2) == 0;
+            agg.add("img" + std::to_string(i), st);
+        }
+        const auto sums = agg.summary();
+        const StageSummary& total = sums.back();
+        assert(total.name == "total" && total.n == 100);
+        assert(approx(total.p50_ms, 50.0) && approx(total.p95_ms, 95.0) && approx(total.p99_ms, 99.0));
+        assert(approx(total.max_ms, 100.0) && total.max_path == "img100");
+        assert(sums[3].name == "warp" && sums[3].n == 50 && "warp only counts images with a quad");
+    }
+
+    // === Header probing and reduced-decode choice ===
+    {
+        cv::Mat frame(600, 1000, CV_8UC3, cv::Scalar(40, 120, 200));
+        std::vector<unsigned char> jpg, png;
+        cv::imencode(".jpg", frame, jpg);
+        cv::imencode(".png", frame, png);
+
+        auto hj = probeImageHeader(jpg.data(), jpg.size());
+        assert(hj && hj->format == ImageHeader::Format::Jpeg);
+        assert(hj->width == 1000 && hj->height == 600);
+        assert(chooseDecodeReduction(*hj, 256) == 2);   // 1/4 would give 250 < 256
+        assert(chooseDecodeReduction(*hj, 100) == 8);
+        assert(chooseDecodeReduction(*hj, 0) == 1);
+
+        auto hp = probeImageHeader(png.data(), png.size());
+        assert(hp && hp->format == ImageHeader::Format::Png && hp->width == 1000 && hp->height == 600);
+        assert(chooseDecodeReduction(*hp, 100) == 1 && "PNG has no DCT scaling");
+        assert(!probeImageHeader(jpg.data(), 3));
+
+        // Near-square JPEG rotated by EXIF (orientation 6): 1000x993 at 1/8 is
+        // 125x125, so only the tag can tell that the full size is 993x1000.
+        std::vector<unsigned char> sq;
+        cv::imencode(".jpg", cv::Mat(993, 1000, CV_8UC3, cv::Scalar(40, 120, 200)), sq);
+        const unsigned char app1[] = { 0xFF, 0xE1, 0x00, 0x22, 'E', 'x', 'i', 'f', 0, 0,
+            'I', 'I', 0x2A, 0x00, 0x08, 0x00, 0x00, 0x00, 0x01, 0x00,
+            0x12, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00 };
+        sq.insert(sq.begin() + 2, std::begin(app1), std::end(app1));
+        auto hs = probeImageHeader(sq.data(), sq.size());
+        assert(hs && hs->width == 1000 && hs->height == 993 && hs->orientation == 6);
+        DecodedImage dec;
+        const bool decoded = decodeImageBuffer(sq.data(), sq.size(), 125, dec);
+        assert(decoded && dec.reduction == 8 && dec.bgr.size() == cv::Size(125, 125));
+        assert(dec.full_size == cv::Size(993, 1000));
+    }
+
+    // === Serve protocol: header round trip and one raw frame through a pipe ===
+    {
+        const cv::Mat frame = synth::makeScene(cv::Size(640, 480));
+        FrameHeader h;
+        h.id = 7;
+        h.kind = FrameHeader::RawBgr;
+        h.width = (std::uint32_t)frame.cols;
+        h.height = (std::uint32_t)frame.rows;
+        h.length = (std::uint32_t)frame.total() * 3u;
+        std::uint8_t raw[kFrameHeaderSize];
+        writeFrameHeader(h, raw);
+        FrameHeader back;
+        assert(parseFrameHeader(raw, back) && back.id == 7 && back.width == h.width);
+        raw[20] ^= 1; // payload length no longer matches width × height × 3
+        assert(!parseFrameHeader(raw, back));
+        raw[20] ^= 1;
+
+#ifndef _WIN32
+        int in[2], out[2];
+        const bool piped = pipe(in) == 0 && pipe(out) == 0;
+        assert(piped);
+        std::thread client([&] {
+            ssize_t n = write(in[1], raw, kFrameHeaderSize);
+            n += write(in[1], frame.data, h.length);
+            (void)n;
+            close(in[1]);
+        });
+        BatchOptions bopt;
+        bopt.jobs = 2;
+        FrameServer server(DetectOptions{}, bopt);
+        const size_t served = server.serveStream(in[0], out[1]);
+        assert(served == 1);
+        client.join();
+        close(out[1]);
+        char buf[512] = {};
+        const ssize_t got = read(out[0], buf, sizeof(buf) - 1);
+        assert(got > 0);
+        const std::string line(buf);
+        assert(line.find("\"id\":7") != std::string::npos);
+        assert(line.find("\"status\":\"ok\"") != std::string::npos && "synthetic board must be found");
+        close(in[0]);
+        close(out[0]);
+#endif
+    }
+
+    // === Debug writer: QOI round trip, sampling, dedup, queue budget ===
+    {
+        const cv::Mat scene = synth::makeScene(cv::Size(97, 61), synth::SceneOptions{});
+        cv::Mat bgra;
+        cv::cvtColor(scene, bgra, cv::COLOR_BGR2BGRA);
+        bgra.col(5).setTo(cv::Scalar(10, 20, 30, 128));
+        assert(cv::countNonZero(decodeQoi(encodeQoi(scene)).reshape(1) != scene.reshape(1)) == 0);
+        assert(cv::countNonZero(decodeQoi(encodeQoi(bgra)).reshape(1) != bgra.reshape(1)) == 0);
+        cv::Mat gray, gray3;
+        cv::cvtColor(scene, gray, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(gray, gray3, cv::COLOR_GRAY2BGR);
+        const std::vector<std::uint8_t> qoi = encodeQoi(gray);
+        assert(cv::countNonZero(decodeQoi(qoi).reshape(1) != gray3.reshape(1)) == 0);
+        assert(decodeQoi(std::vector<std::uint8_t>(qoi.begin(), qoi.begin() + 20)).empty() && "truncated");
+
+        DebugWriterOptions wopt;
+        wopt.sample_rate = 0.25;
+        int sampled = 0;
+        {
+            DebugWriter w(wopt);
+            for (int i = 0; i < 100; ++i) sampled += w.sample() ? 1 : 0;
+            assert(w.stats().images_skipped == 75);
+        }
+        assert(sampled == 25);
+
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "mce_debug_writer_test";
+        std::filesystem::remove_all(dir);
+        wopt = DebugWriterOptions{};
+        wopt.format = DebugFormat::Qoi;
+        {
+            DebugWriter w(wopt);
+            const bool queued_a = w.submit(scene, (dir / "a").string());
+            assert(queued_a);
+            w.flush();
+            const bool queued_b = w.submit(scene, (dir / "b").string());
+            assert(queued_b);
+            w.flush();
+            const DebugWriterStats ws = w.stats();
+            assert(ws.written == 1 && ws.deduplicated == 1);
+        }
+        std::ifstream f(dir / "b.qoi", std::ios::binary);
+        const std::vector<std::uint8_t> bytes((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        assert(cv::countNonZero(decodeQoi(bytes).reshape(1) != scene.reshape(1)) == 0 && "linked copy is the artifact");
+
+        // Rewriting a linked artifact must leave the file it was linked to alone.
+        wopt.dedup = false;
+        {
+            DebugWriter w(wopt);
+            const bool queued = w.submit(gray3, (dir / "b").string());
+            assert(queued);
+            w.flush();
+        }
+        std::ifstream fa(dir / "a.qoi", std::ios::binary);
+        const std::vector<std::uint8_t> bytes_a((std::istreambuf_iterator<char>(fa)), std::istreambuf_iterator<char>());
+        assert(cv::countNonZero(decodeQoi(bytes_a).reshape(1) != scene.reshape(1)) == 0 && "link target unchanged");
+
+        // A one-image budget: every artifact is either written or dropped, never lost silently.
+        wopt.max_queued_bytes = scene.total() * scene.elemSize();
+        int accepted = 0;
+        {
+            DebugWriter w(wopt);
+            for (int i = 0; i < 20; ++i) accepted += w.submit(scene, (dir / ("c" + std::to_string(i))).string()) ? 1 : 0;
+            w.flush();
+            const DebugWriterStats ws = w.stats();
+            assert(accepted >= 1 && ws.written == (std::uint64_t)accepted && ws.dropped == (std::uint64_t)(20 - accepted));
+        }
+        std::filesystem::remove_all(dir);
+    }
+
+    // === Fixed-size square warp: same pixels as the baseline forward warp, one inversion ===
+    {
+        const cv::Mat scene = synth::makeScene(cv::Size(640, 480), synth::SceneOptions{});
+        const std::vector<cv::Point2f> quad{ { 180.3f, 95.7f }, { 470.1f, 120.2f }, { 455.6f, 400.9f }, { 150.4f, 370.0f } };
+        assert(geom::hasFixedWarp(320) && geom::hasFixedWarp(160) && !geom::hasFixedWarp(321));
+        const geom::WarpResult wr = geom::warpToSquareWithH(scene, quad, 320);
+        cv::Mat eye = wr.H * wr.Hinv;
+        assert(cv::norm(eye / eye.at<double>(2, 2), cv::Mat::eye(3, 3, CV_64F), cv::NORM_INF) < 1e-9);
+
+        // Baseline: warpPerspective inverts H itself. Sample positions agree to
+        // 1/32 px (OpenCV versions differ in that rounding), so only edge pixels move.
+        cv::Mat ref, diff;
+        cv::warpPerspective(scene, ref, wr.H, cv::Size(320, 320), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+        cv::absdiff(ref, wr.image, diff);
+        diff = diff.reshape(1);
+        assert(cv::countNonZero(diff > 8) <= (int)(diff.total() / 100));
+        assert(cv::mean(diff)[0] < 0.5);
+
+        // Sizes without a fixed path are warpPerspective itself.
+        cv::Mat general;
+        geom::warpSquare(scene, wr.Hinv, 321, general);
+        cv::warpPerspective(scene, ref, wr.Hinv, cv::Size(321, 321),
+            cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_REPLICATE);
+        assert(cv::countNonZero(general.reshape(1) != ref.reshape(1)) == 0 && "unspecialized sizes use warpPerspective");
+    }
+
+    // === Result cache: XXH64 vectors, options sensitivity, persistence across opens ===
+    {
+        assert(xxh64("", 0) == 0xEF46DB3751D8E999ull);
+        assert(xxh64("abc", 3) == 0x44BC2CF5AD770999ull);
+
+        DetectOptions a, b;
+        b.min_cell_fraction = 0.2;
+        assert(optionsHash(a) == optionsHash(DetectOptions{}));
+        assert(optionsHash(a) != optionsHash(b));
+        assert(optionsHash(a) != optionsHash(a, 1) && "reduced decode is part of the key");
+        b = a;
+        b.seg_stripes = 4;
+        b.debug = true;
+        assert(optionsHash(a) == optionsHash(b) && "parallelism and logging never change results");
+
+        const std::filesystem::path file = std::filesystem::temp_directory_path() / "mce_result_cache_test.bin";
+        std::filesystem::remove(file);
+        const std::uint8_t bytes[] = { 1, 2, 3, 4, 5 };
+        const ResultCache::Key k1 = ResultCache::key(bytes, sizeof(bytes), optionsHash(a));
+        const ResultCache::Key k2 = ResultCache::key(bytes, 4, optionsHash(a));
+        DetectionResult r;
+        r.polygon = { { 1.5f, 2.0f }, { 10.f, 2.f }, { 10.f, 12.25f }, { 1.f, 12.f } };
+        r.coverage_percent = 42.5;
+        r.grid_ok = true;
+        {
+            auto c = ResultCache::open(file.string());
+            assert(c);
+            std::optional<DetectionResult> got;
+            assert(!c->find(k1, got));
+            const bool in1 = c->insert(k1, r);
+            const bool in2 = c->insert(k2, std::nullopt);
+            assert(in1 && in2);
+            assert(c->find(k1, got) && got && got->coverage_percent == 42.5);
+        }
+        {
+            std::ofstream(file, std::ios::binary | std::ios::app) << "torn"; // partial record of a killed run
+            auto c = ResultCache::open(file.string());
+            assert(c && c->size() == 2);
+            std::optional<DetectionResult> got;
+            assert(c->find(k1, got) && got && got->grid_ok && got->polygon.size() == 4);
+            assert(got->polygon[2] == cv::Point2f(10.f, 12.25f) && got->coverage_percent == 42.5);
+            assert(c->find(k2, got) && !got && "no marker is cached too");
+            assert(!c->find(ResultCache::key(bytes, sizeof(bytes), optionsHash(b, 1)), got));
+            assert(c->hits() == 2 && c->misses() == 1);
+        }
+        assert(std::filesystem::file_size(file) == 16 + 2 * 112);
+        std::filesystem::remove(file);
+        std::ofstream(file, std::ios::binary) << "not a cache file";
+        std::string err;
+        assert(!ResultCache::open(file.string(), &err) && !err.empty());
+        std::filesystem::remove(file);
+    }
+
+    // === Streaming: strip-reduced detection agrees with detect(); PPM strips read in place ===
+    {
+        synth::SceneOptions so;
+        so.angle_deg = 12.0;
+        so.clutter = 6;
+        const cv::Mat scene = synth::makeScene(cv::Size(2000, 1500), so);
+        DetectOptions sopt;
+        sopt.max_side = 500;       // 1/4: strips of 256 rows straddle the 4-row blocks
+        MarkerDetector det;
+        DetectorWorkspace ws;
+        const auto ref = det.detect(scene, sopt, ws);
+        const auto streamed = det.detectStreaming(MatRowSource(scene), sopt, ws);
+        assert(ref && streamed && ws.stats.pyramid);
+        assert(std::fabs(ref->coverage_percent - streamed->coverage_percent) < 0.5);
+        for (size_t i = 0; i < 4; ++i) assert(cv::norm(ref->polygon[i] - streamed->polygon[i]) < 3.0);
+
+        const std::filesystem::path ppm = std::filesystem::temp_directory_path() / "mce_row_source_test.ppm";
+        const bool wrote = cv::imwrite(ppm.string(), scene);
+        assert(wrote);
+        std::string err;
+        auto rows = NetpbmRowSource::open(ppm.string(), &err);
+        assert(rows && rows->size() == scene.size());
+        cv::Mat part;
+        const cv::Rect r(123, 456, 789, 300);
+        rows->read(r, part);
+        assert(cv::countNonZero(part.reshape(1) != scene(r).clone().reshape(1)) == 0);
+        const auto from_file = det.detectStreaming(*rows, sopt, ws);
+        assert(from_file && from_file->coverage_percent == streamed->coverage_percent);
+        rows.reset();
+        std::filesystem::remove(ppm);
+        assert(!NetpbmRowSource::open(ppm.string(), &err) && !err.empty());
+    }
+
+    // === Tracing: scopes are free when compiled out, counted when compiled in ===
+    {
+        trace::reset();
+        for (int i = 0; i < 3; ++i) {
+            MCE_TRACE_SCOPE("test.scope");
+        }
+        std::ostringstream summary;
+        trace::writeSummary(summary);
+        if (trace::enabled()) assert(summary.str().find("test.scope") != std::string::npos);
+        else assert(summary.str().empty() && !trace::writeChromeTrace("unused.json"));
+    }
+
+    // === Packed morphology: equal to OpenCV's 3x3 erode/dilate chains, borders included ===
+    {
+        const cv::Mat k3 = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+        binmorph::Workspace mws;
+        for (const cv::Size sz : { cv::Size(1, 1), cv::Size(63, 5), cv::Size(64, 64), cv::Size(130, 97), cv::Size(641, 3) }) {
+            cv::Mat noise(sz, CV_8UC1), m;
+            cv::randu(noise, cv::Scalar(0), cv::Scalar(256));
+            cv::threshold(noise, m, 110, 255, cv::THRESH_BINARY);
+            for (int o = 0; o <= 2; ++o) {
+                for (int c = 0; c <= 2; ++c) {
+                    cv::Mat ref = m.clone(), got = m.clone();
+                    if (o > 0) cv::morphologyEx(ref, ref, cv::MORPH_OPEN, k3, cv::Point(-1, -1), o);
+                    if (c > 0) cv::morphologyEx(ref, ref, cv::MORPH_CLOSE, k3, cv::Point(-1, -1), c);
+                    binmorph::openClose(got, got, o, c, mws); // in place
+                    assert(cv::countNonZero(ref != got) == 0);
+                }
+            }
+            cv::Mat ref, got;
+            cv::dilate(m, ref, k3, cv::Point(-1, -1), 2);
+            binmorph::dilate(m, got, 2, mws);
+            assert(cv::countNonZero(ref != got) == 0);
+        }
+    }
+
     return 0;
 }